@@ -0,0 +1,297 @@
+#pragma once
+
+#include "Debug.hpp"
+#include "Geometry.hpp"
+#include "Math.hpp"
+#include "Memory.hpp"
+#include "Type.hpp"
+
+// NOTE: Agents are kept in a uniform grid of linked lists, so finding the agents around
+//       the player only touches the cells in range. Agents that are not engaged and not
+//       in range are dormant: they are in no list that is walked per frame.
+
+enum AITierId
+{
+	DormantAITierId,
+	NearbyAITierId,
+	EngagedAITierId,
+	AITierN
+};
+
+struct AIAgent
+{
+	V2 position;
+	AITierId tier;
+	B32 engaged;
+	R32 think_wait;
+
+	I32 cell_index;
+	I32 previous_in_cell;
+	I32 next_in_cell;
+
+	I32 active_slot;
+};
+
+struct AIScheduler
+{
+	AIAgent *agents;
+	I32 agent_n;
+
+	R32 cell_side;
+	I32 cell_row_n;
+	I32 cell_col_n;
+	I32 *cell_first_agents;
+
+	I32 *active_agents;
+	I32 active_agent_n;
+
+	I32 *think_agents;
+	I32 think_agent_n;
+	I32 think_cursor;
+
+	R32 nearby_distance;
+	R32 think_intervals[AITierN];
+	I32 max_think_n_per_frame;
+};
+
+static AIScheduler
+func CreateAIScheduler(MemArena *arena, I32 agent_n, R32 world_width, R32 world_height, R32 cell_side)
+{
+	Assert(agent_n > 0);
+	Assert(cell_side > 0.0f);
+
+	AIScheduler scheduler = {};
+	scheduler.agent_n = agent_n;
+	scheduler.agents = ArenaAllocArray(arena, AIAgent, agent_n);
+	scheduler.active_agents = ArenaAllocArray(arena, I32, agent_n);
+	scheduler.think_agents = ArenaAllocArray(arena, I32, agent_n);
+
+	scheduler.cell_side = cell_side;
+	scheduler.cell_col_n = IntMax2(1, (I32)(world_width / cell_side) + 1);
+	scheduler.cell_row_n = IntMax2(1, (I32)(world_height / cell_side) + 1);
+	I32 cell_n = scheduler.cell_row_n * scheduler.cell_col_n;
+	scheduler.cell_first_agents = ArenaAllocArray(arena, I32, cell_n);
+	for(I32 i = 0; i < cell_n; i++)
+	{
+		scheduler.cell_first_agents[i] = -1;
+	}
+
+	for(I32 i = 0; i < agent_n; i++)
+	{
+		AIAgent *agent = &scheduler.agents[i];
+		*agent = {};
+		agent->tier = DormantAITierId;
+		agent->cell_index = -1;
+		agent->previous_in_cell = -1;
+		agent->next_in_cell = -1;
+		agent->active_slot = -1;
+	}
+
+	scheduler.nearby_distance = 60.0f;
+	scheduler.think_intervals[DormantAITierId] = 0.0f;
+	scheduler.think_intervals[NearbyAITierId] = 0.5f;
+	scheduler.think_intervals[EngagedAITierId] = 0.0f;
+	scheduler.max_think_n_per_frame = 64;
+	return scheduler;
+}
+
+static I32
+func GetAICellIndex(AIScheduler *scheduler, V2 position)
+{
+	I32 col = ClipInt((I32)(position.x / scheduler->cell_side), 0, scheduler->cell_col_n);
+	I32 row = ClipInt((I32)(position.y / scheduler->cell_side), 0, scheduler->cell_row_n);
+	col = IntMin2(col, scheduler->cell_col_n - 1);
+	row = IntMin2(row, scheduler->cell_row_n - 1);
+	I32 cell_index = row * scheduler->cell_col_n + col;
+	return cell_index;
+}
+
+static void
+func RemoveAIAgentFromCell(AIScheduler *scheduler, I32 agent_index)
+{
+	AIAgent *agent = &scheduler->agents[agent_index];
+	if(agent->cell_index >= 0)
+	{
+		if(agent->previous_in_cell >= 0)
+		{
+			scheduler->agents[agent->previous_in_cell].next_in_cell = agent->next_in_cell;
+		}
+		else
+		{
+			scheduler->cell_first_agents[agent->cell_index] = agent->next_in_cell;
+		}
+
+		if(agent->next_in_cell >= 0)
+		{
+			scheduler->agents[agent->next_in_cell].previous_in_cell = agent->previous_in_cell;
+		}
+
+		agent->cell_index = -1;
+		agent->previous_in_cell = -1;
+		agent->next_in_cell = -1;
+	}
+}
+
+// NOTE: Call this whenever an agent moves, it only relinks when the cell changes.
+static void
+func MoveAIAgent(AIScheduler *scheduler, I32 agent_index, V2 position)
+{
+	Assert(IsIntBetween(agent_index, 0, scheduler->agent_n - 1));
+	AIAgent *agent = &scheduler->agents[agent_index];
+	agent->position = position;
+
+	I32 cell_index = GetAICellIndex(scheduler, position);
+	if(cell_index != agent->cell_index)
+	{
+		RemoveAIAgentFromCell(scheduler, agent_index);
+
+		I32 first_agent = scheduler->cell_first_agents[cell_index];
+		agent->cell_index = cell_index;
+		agent->previous_in_cell = -1;
+		agent->next_in_cell = first_agent;
+		if(first_agent >= 0)
+		{
+			scheduler->agents[first_agent].previous_in_cell = agent_index;
+		}
+		scheduler->cell_first_agents[cell_index] = agent_index;
+	}
+}
+
+static void
+func ActivateAIAgent(AIScheduler *scheduler, I32 agent_index, AITierId tier)
+{
+	Assert(tier != DormantAITierId);
+	AIAgent *agent = &scheduler->agents[agent_index];
+	if(agent->active_slot < 0)
+	{
+		Assert(scheduler->active_agent_n < scheduler->agent_n);
+		agent->active_slot = scheduler->active_agent_n;
+		scheduler->active_agents[scheduler->active_agent_n] = agent_index;
+		scheduler->active_agent_n++;
+		agent->think_wait = 0.0f;
+	}
+	agent->tier = tier;
+}
+
+static void
+func DeactivateAIAgent(AIScheduler *scheduler, I32 agent_index)
+{
+	AIAgent *agent = &scheduler->agents[agent_index];
+	if(agent->active_slot >= 0)
+	{
+		I32 last_agent = scheduler->active_agents[scheduler->active_agent_n - 1];
+		scheduler->active_agents[agent->active_slot] = last_agent;
+		scheduler->agents[last_agent].active_slot = agent->active_slot;
+		scheduler->active_agent_n--;
+		agent->active_slot = -1;
+	}
+	agent->tier = DormantAITierId;
+}
+
+static void
+func SetAIAgentEngaged(AIScheduler *scheduler, I32 agent_index, B32 engaged)
+{
+	AIAgent *agent = &scheduler->agents[agent_index];
+	agent->engaged = engaged;
+	if(engaged)
+	{
+		ActivateAIAgent(scheduler, agent_index, EngagedAITierId);
+	}
+	else if(agent->tier == EngagedAITierId)
+	{
+		agent->tier = NearbyAITierId;
+	}
+}
+
+// NOTE: Dead or removed agents should leave the grid so they are never woken up again.
+static void
+func RemoveAIAgent(AIScheduler *scheduler, I32 agent_index)
+{
+	DeactivateAIAgent(scheduler, agent_index);
+	RemoveAIAgentFromCell(scheduler, agent_index);
+	scheduler->agents[agent_index].engaged = false;
+}
+
+static void
+func AddAIThinkAgentsOfTier(AIScheduler *scheduler, AITierId tier)
+{
+	I32 active_agent_n = scheduler->active_agent_n;
+	for(I32 i = 0; i < active_agent_n; i++)
+	{
+		if(scheduler->think_agent_n >= scheduler->max_think_n_per_frame)
+		{
+			break;
+		}
+
+		I32 agent_index = scheduler->active_agents[(scheduler->think_cursor + i) % active_agent_n];
+		AIAgent *agent = &scheduler->agents[agent_index];
+		if(agent->tier == tier && agent->think_wait <= 0.0f)
+		{
+			scheduler->think_agents[scheduler->think_agent_n] = agent_index;
+			scheduler->think_agent_n++;
+			agent->think_wait += scheduler->think_intervals[tier];
+			if(agent->think_wait < 0.0f)
+			{
+				agent->think_wait = 0.0f;
+			}
+		}
+	}
+}
+
+// NOTE: After this, think_agents holds the agents that should run their AI this frame.
+//       Engaged agents go first; whoever does not fit into the budget stays due and
+//       the cursor makes sure it is among the first ones next frame.
+static void
+func UpdateAIScheduler(AIScheduler *scheduler, V2 focus_position, R32 seconds)
+{
+	R32 nearby_distance = scheduler->nearby_distance;
+
+	for(I32 i = 0; i < scheduler->active_agent_n; i++)
+	{
+		I32 agent_index = scheduler->active_agents[i];
+		AIAgent *agent = &scheduler->agents[agent_index];
+		if(!agent->engaged && MaxDistance(agent->position, focus_position) > nearby_distance)
+		{
+			DeactivateAIAgent(scheduler, agent_index);
+			i--;
+		}
+		else
+		{
+			agent->think_wait -= seconds;
+		}
+	}
+
+	V2 min_position = MakePoint(focus_position.x - nearby_distance, focus_position.y - nearby_distance);
+	V2 max_position = MakePoint(focus_position.x + nearby_distance, focus_position.y + nearby_distance);
+	I32 min_cell_index = GetAICellIndex(scheduler, min_position);
+	I32 max_cell_index = GetAICellIndex(scheduler, max_position);
+	I32 min_row = min_cell_index / scheduler->cell_col_n;
+	I32 min_col = min_cell_index % scheduler->cell_col_n;
+	I32 max_row = max_cell_index / scheduler->cell_col_n;
+	I32 max_col = max_cell_index % scheduler->cell_col_n;
+	for(I32 row = min_row; row <= max_row; row++)
+	{
+		for(I32 col = min_col; col <= max_col; col++)
+		{
+			I32 agent_index = scheduler->cell_first_agents[row * scheduler->cell_col_n + col];
+			while(agent_index >= 0)
+			{
+				AIAgent *agent = &scheduler->agents[agent_index];
+				if(agent->tier == DormantAITierId && MaxDistance(agent->position, focus_position) <= nearby_distance)
+				{
+					ActivateAIAgent(scheduler, agent_index, NearbyAITierId);
+				}
+				agent_index = agent->next_in_cell;
+			}
+		}
+	}
+
+	scheduler->think_agent_n = 0;
+	if(scheduler->active_agent_n > 0)
+	{
+		scheduler->think_cursor %= scheduler->active_agent_n;
+		AddAIThinkAgentsOfTier(scheduler, EngagedAITierId);
+		AddAIThinkAgentsOfTier(scheduler, NearbyAITierId);
+		scheduler->think_cursor += scheduler->think_agent_n;
+	}
+}
@@ -6,6 +6,7 @@
 #include "Geometry.hpp"
 #include "Math.hpp"
 #include "Memory.hpp"
+#include "Profiler.hpp"
 #include "String.hpp"
 #include "Text.hpp"
 #include "Type.hpp"
@@ -38,7 +39,7 @@ func ResizeBitmap(Bitmap *bitmap, I32 width, I32 height)
 {
 	if(bitmap->memory)
 	{
-		delete bitmap->memory;
+		delete[] bitmap->memory;
 	}
     
 	bitmap->width = width;
@@ -161,6 +162,20 @@ func MixColorCodes(U32 base_color_code, U32 color_code_to_add)
 	return result_color_code;
 }
 
+// NOTE: Moves every channel of the base color towards the color by coverage / 256,
+//       red and blue, then alpha and green, are mixed in 16-bit halves of a word.
+static U32
+func BlendColorCodes(U32 base_color_code, U32 color_code, U32 coverage)
+{
+	Assert(coverage <= 256);
+	U32 mask = 0x00FF00FF;
+	U32 base_coverage = 256 - coverage;
+	U32 red_blue = (((base_color_code & mask) * base_coverage + (color_code & mask) * coverage) >> 8) & mask;
+	U32 alpha_green = ((((base_color_code >> 8) & mask) * base_coverage + ((color_code >> 8) & mask) * coverage) >> 8) & mask;
+	U32 result = red_blue | (alpha_green << 8);
+	return result;
+}
+
 static V4
 func InterpolateColors(V4 color1, R32 ratio, V4 color2)
 {
@@ -466,6 +481,7 @@ static void
 func DrawBitmapTextLine(Bitmap *bitmap, I8 *text, GlyphData *glyph_data, 
 						I32 left, I32 base_line_y, V4 color)
 {
+	ProfileFunction();
 	Assert(glyph_data);
 	R32 textX = (R32)left;
 	R32 textY = (R32)base_line_y;
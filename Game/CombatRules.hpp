@@ -0,0 +1,206 @@
+#pragma once
+
+#include "Ability.hpp"
+#include "Debug.hpp"
+#include "Effect.hpp"
+#include "Math.hpp"
+#include "Type.hpp"
+
+// NOTE: The combat numbers shared by CombatLab and CombatSim, so a balance change lands in both.
+//       Only values go in here, how an entity stores its effects and attributes is up to the caller.
+
+#define MaxLevel 5
+static I32 MaxHealthAtLevel[] =
+{
+	0,
+	100,
+	150,
+	200,
+	250,
+	300
+};
+
+#define EarthShieldAbsorbDamage 50
+#define BlessingOfTheSunBonusDamage 2
+#define BlessingOfTheSunBonusHealing 2
+#define BlessingOfTheSunShieldHealing 10
+#define SnakeStrikePoisonChance 0.3f
+
+static I32
+func GetMaxHealth(I32 level, I32 constitution)
+{
+	Assert(IsIntBetween(level, 1, MaxLevel));
+	I32 max_health = MaxHealthAtLevel[level] + constitution * 10;
+	return max_health;
+}
+
+// NOTE: The steps are done in integers and in this order, CombatLab and CombatSim have to give the same numbers.
+static I32
+func ReduceDamageDone(I32 damage, B32 has_reduced_damage_done)
+{
+	I32 final_damage = damage;
+	if(has_reduced_damage_done)
+	{
+		final_damage -= final_damage / 5;
+	}
+	return final_damage;
+}
+
+static I32
+func ReduceDamageTaken(I32 damage, B32 has_reduced_damage_taken, B32 has_shield_raised, B32 has_earth_shield)
+{
+	I32 final_damage = damage;
+	if(has_reduced_damage_taken)
+	{
+		final_damage -= final_damage / 5;
+	}
+	if(has_shield_raised)
+	{
+		final_damage -= final_damage / 2;
+	}
+	if(has_earth_shield)
+	{
+		final_damage -= final_damage / 10;
+	}
+	return final_damage;
+}
+
+static I32
+func GetAbilityBaseDamage(AbilityId ability_id, I32 strength, I32 intellect)
+{
+	I32 damage = 0;
+	switch(ability_id)
+	{
+		case LightningAbilityId:
+		{
+			damage = 20 + intellect;
+			break;
+		}
+		case SmallPunchAbilityId:
+		case SwordSwingAbilityId:
+		case SnakeStrikeAbilityId:
+		{
+			damage = 10 + strength;
+			break;
+		}
+		case BigPunchAbilityId:
+		case CrocodileLashAbilityId:
+		{
+			damage = 30 + strength;
+			break;
+		}
+		case SpinningKickAbilityId:
+		{
+			damage = 5 + strength;
+			break;
+		}
+		case SwordStabAbilityId:
+		case CrocodileBiteAbilityId:
+		{
+			damage = 15 + strength;
+			break;
+		}
+		case TigerBiteAbilityId:
+		{
+			damage = 25 + strength;
+			break;
+		}
+	}
+	return damage;
+}
+
+static I32
+func GetAbilityHealing(AbilityId ability_id)
+{
+	I32 healing = 0;
+	switch(ability_id)
+	{
+		case HealAbilityId:
+		case MercyOfTheSunAbilityId:
+		{
+			healing = 30;
+			break;
+		}
+		case LightOfTheSunAbilityId:
+		{
+			healing = 20;
+			break;
+		}
+	}
+	return healing;
+}
+
+// NOTE: Effects with a tick do their damage or healing every time the remaining time crosses a whole tick.
+static R32
+func GetEffectTickSeconds(EffectId effect_id)
+{
+	R32 tick_seconds = 0.0f;
+	switch(effect_id)
+	{
+		case BurningEffectId:
+		case RegenerateEffectId:
+		{
+			tick_seconds = 1.0f;
+			break;
+		}
+		case PoisonedEffectId:
+		case HealOverTimeEffectId:
+		case BleedingEffectId:
+		{
+			tick_seconds = 3.0f;
+			break;
+		}
+	}
+	return tick_seconds;
+}
+
+static B32
+func EffectTicked(EffectId effect_id, R32 time_remaining, R32 seconds)
+{
+	B32 ticked = false;
+	R32 tick_seconds = GetEffectTickSeconds(effect_id);
+	if(tick_seconds > 0.0f)
+	{
+		R32 ticks_per_second = 1.0f / tick_seconds;
+		R32 previous_time_remaining = time_remaining + seconds;
+		ticked = (Floor(time_remaining * ticks_per_second) != Floor(previous_time_remaining * ticks_per_second));
+	}
+	return ticked;
+}
+
+static I32
+func GetEffectTickDamage(EffectId effect_id)
+{
+	I32 damage = 0;
+	switch(effect_id)
+	{
+		case BurningEffectId:
+		case PoisonedEffectId:
+		{
+			damage = 2;
+			break;
+		}
+		case BleedingEffectId:
+		{
+			damage = 10;
+			break;
+		}
+	}
+	return damage;
+}
+
+static I32
+func GetEffectTickHealing(EffectId effect_id)
+{
+	I32 healing = 0;
+	switch(effect_id)
+	{
+		case RegenerateEffectId:
+		case HealOverTimeEffectId:
+		{
+			healing = 5;
+			break;
+		}
+	}
+	return healing;
+}
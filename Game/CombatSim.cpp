@@ -0,0 +1,473 @@
+// NOTE: Headless combat balance simulator, not part of the game build.
+//       Linux:   g++ -O2 -pthread CombatSim.cpp -o CombatSim
+//       Windows: cl /O2 CombatSim.cpp
+//       Usage:   CombatSim [encounters per scenario] [thread n, 0 for all cores] [seed] [output prefix] [options]
+//       Options: -levels 1-5        player levels to sweep
+//                -enemy-levels 1-5  enemy levels to sweep
+//                -gear 0,5,10       gear levels to sweep, added to every attribute of the player
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CombatSim.hpp"
+#include "Debug.hpp"
+#include "Math.hpp"
+#include "Thread.hpp"
+#include "Type.hpp"
+
+#define SimBatchSize 1024
+#define SimMaxThreadN 64
+#define SimMaxGearLevelN 16
+
+static ClassId SimPlayerClasses[] = {DruidClassId, MonkClassId, PaladinClassId};
+static ClassId SimEnemyClasses[] = {SnakeClassId, CrocodileClassId, TigerClassId};
+
+#define SimPlayerClassN (I32)(sizeof(SimPlayerClasses) / sizeof(SimPlayerClasses[0]))
+#define SimEnemyClassN (I32)(sizeof(SimEnemyClasses) / sizeof(SimEnemyClasses[0]))
+
+struct SimSweep
+{
+	I32 min_player_level;
+	I32 max_player_level;
+	I32 min_enemy_level;
+	I32 max_enemy_level;
+	I32 gear_levels[SimMaxGearLevelN];
+	I32 gear_level_n;
+};
+
+struct SimWork
+{
+	SimScenario *scenarios;
+	I32 scenario_n;
+	I32 encounter_n;
+	I32 batch_per_scenario;
+	U64 seed;
+
+	volatile I32 next_batch;
+};
+
+struct SimWorker
+{
+	SimWork *work;
+	SimStats *stats;
+};
+
+static I8 *
+func GetSimClassName(ClassId class_id)
+{
+	I8 *name = 0;
+	switch(class_id)
+	{
+		case DruidClassId:
+		{
+			name = "Druid";
+			break;
+		}
+		case MonkClassId:
+		{
+			name = "Monk";
+			break;
+		}
+		case PaladinClassId:
+		{
+			name = "Paladin";
+			break;
+		}
+		case SnakeClassId:
+		{
+			name = "Snake";
+			break;
+		}
+		case CrocodileClassId:
+		{
+			name = "Crocodile";
+			break;
+		}
+		case TigerClassId:
+		{
+			name = "Tiger";
+			break;
+		}
+		default:
+		{
+			DebugBreak();
+		}
+	}
+	return name;
+}
+
+static SimSweep
+func GetDefaultSimSweep()
+{
+	SimSweep sweep = {};
+	sweep.min_player_level = 1;
+	sweep.max_player_level = MaxLevel;
+	sweep.min_enemy_level = 1;
+	sweep.max_enemy_level = MaxLevel;
+	sweep.gear_levels[0] = 0;
+	sweep.gear_levels[1] = 5;
+	sweep.gear_levels[2] = 10;
+	sweep.gear_level_n = 3;
+	return sweep;
+}
+
+static I32
+func GetSimScenarioN(SimSweep *sweep)
+{
+	I32 player_level_n = sweep->max_player_level - sweep->min_player_level + 1;
+	I32 enemy_level_n = sweep->max_enemy_level - sweep->min_enemy_level + 1;
+	I32 scenario_n = SimPlayerClassN * player_level_n * sweep->gear_level_n * SimEnemyClassN * enemy_level_n;
+	return scenario_n;
+}
+
+// NOTE: Parses "min-max" or a single level, returns false if it is not a range inside 1..MaxLevel.
+static B32
+func ParseSimLevelRange(I8 *text, I32 *min_level, I32 *max_level)
+{
+	I8 *end = 0;
+	I32 min = (I32)strtol(text, &end, 10);
+	I32 max = min;
+	if(end != text && *end == '-')
+	{
+		I8 *max_text = end + 1;
+		max = (I32)strtol(max_text, &end, 10);
+		if(end == max_text)
+		{
+			end = text;
+		}
+	}
+	B32 is_valid = (end != text && *end == 0 && 1 <= min && min <= max && max <= MaxLevel);
+	if(is_valid)
+	{
+		*min_level = min;
+		*max_level = max;
+	}
+	return is_valid;
+}
+
+// NOTE: Parses a comma separated list of gear levels, returns false if it is empty, too long or not numbers.
+static B32
+func ParseSimGearLevels(I8 *text, SimSweep *sweep)
+{
+	I32 gear_level_n = 0;
+	I32 gear_levels[SimMaxGearLevelN] = {};
+	B32 is_valid = true;
+	I8 *at = text;
+	while(is_valid)
+	{
+		I8 *end = 0;
+		I32 gear = (I32)strtol(at, &end, 10);
+		is_valid = (end != at && gear >= 0 && gear_level_n < SimMaxGearLevelN);
+		if(is_valid)
+		{
+			gear_levels[gear_level_n] = gear;
+			gear_level_n++;
+			if(*end == 0)
+			{
+				break;
+			}
+			is_valid = (*end == ',');
+			at = end + 1;
+		}
+	}
+
+	if(is_valid)
+	{
+		for(I32 i = 0; i < gear_level_n; i++)
+		{
+			sweep->gear_levels[i] = gear_levels[i];
+		}
+		sweep->gear_level_n = gear_level_n;
+	}
+	return is_valid;
+}
+
+static I32
+func FillSimScenarios(SimSweep *sweep, SimScenario *scenarios)
+{
+	I32 scenario_n = 0;
+	for(I32 player_class = 0; player_class < SimPlayerClassN; player_class++)
+	{
+		for(I32 player_level = sweep->min_player_level; player_level <= sweep->max_player_level; player_level++)
+		{
+			for(I32 gear_level = 0; gear_level < sweep->gear_level_n; gear_level++)
+			{
+				for(I32 enemy_class = 0; enemy_class < SimEnemyClassN; enemy_class++)
+				{
+					for(I32 enemy_level = sweep->min_enemy_level; enemy_level <= sweep->max_enemy_level; enemy_level++)
+					{
+						SimScenario *scenario = &scenarios[scenario_n];
+						scenario_n++;
+
+						I32 gear = sweep->gear_levels[gear_level];
+						*scenario = {};
+						scenario->player_class_id = SimPlayerClasses[player_class];
+						scenario->player_level = player_level;
+						scenario->player_gear.strength = gear;
+						scenario->player_gear.intellect = gear;
+						scenario->player_gear.constitution = gear;
+						scenario->player_gear.dexterity = gear;
+						scenario->player_reaction_time = 0.3f;
+						scenario->enemy_class_id = SimEnemyClasses[enemy_class];
+						scenario->enemy_level = enemy_level;
+						scenario->enemy_reaction_time = 0.1f;
+					}
+				}
+			}
+		}
+	}
+	Assert(scenario_n == GetSimScenarioN(sweep));
+	return scenario_n;
+}
+
+// NOTE: Batches are claimed in order, but every batch has its own random stream,
+//       so the results do not depend on which thread ran which batch.
+static void
+func SimWorkerProc(void *parameter)
+{
+	SimWorker *worker = (SimWorker *)parameter;
+	SimWork *work = worker->work;
+	I32 batch_n = work->scenario_n * work->batch_per_scenario;
+	while(1)
+	{
+		I32 batch = AtomicIncrement(&work->next_batch) - 1;
+		if(batch >= batch_n)
+		{
+			break;
+		}
+
+		I32 scenario_index = batch / work->batch_per_scenario;
+		I32 first_encounter = (batch % work->batch_per_scenario) * SimBatchSize;
+		I32 encounter_n = IntMin2(SimBatchSize, work->encounter_n - first_encounter);
+
+		SimScenario *scenario = &work->scenarios[scenario_index];
+		SimStats *stats = &worker->stats[scenario_index];
+		RandomSeries random = CreateRandomSeries(work->seed, (U64)batch);
+		for(I32 i = 0; i < encounter_n; i++)
+		{
+			SimResult result = RunSimEncounter(scenario, &random);
+			AddSimResult(stats, &result);
+		}
+	}
+}
+
+static void
+func WriteSimHistogram(FILE *file, I8 *scenario_line, I8 *stat_name, SimHistogram *histogram)
+{
+	for(I32 i = 0; i < SimHistogramBucketN; i++)
+	{
+		if(histogram->counts[i] > 0)
+		{
+			R32 bucket_min = (R32)i * histogram->bucket_width;
+			fprintf(file, "%s,%s,%g,%u\n", scenario_line, stat_name, bucket_min, histogram->counts[i]);
+		}
+	}
+}
+
+// NOTE: Returns false if an output file could not be opened, after printing which one.
+static B32
+func WriteSimResults(const char *prefix, SimScenario *scenarios, SimStats *stats, I32 scenario_n)
+{
+	I8 summary_path[256] = {};
+	snprintf(summary_path, sizeof(summary_path), "%s_summary.csv", prefix);
+	I8 histogram_path[256] = {};
+	snprintf(histogram_path, sizeof(histogram_path), "%s_histograms.csv", prefix);
+
+	FILE *summary_file = fopen(summary_path, "w");
+	FILE *histogram_file = fopen(histogram_path, "w");
+	if(summary_file == 0 || histogram_file == 0)
+	{
+		fprintf(stderr, "Can not open %s for writing.\n", (summary_file == 0) ? summary_path : histogram_path);
+		if(summary_file)
+		{
+			fclose(summary_file);
+		}
+		if(histogram_file)
+		{
+			fclose(histogram_file);
+		}
+		return false;
+	}
+
+	I8 *scenario_header = "class,level,gear,enemy,enemy_level";
+	fprintf(summary_file, "%s,encounters,win_rate,timeout_rate,mean_dps,mean_time_to_kill\n", scenario_header);
+	fprintf(histogram_file, "%s,stat,bucket_min,count\n", scenario_header);
+
+	for(I32 i = 0; i < scenario_n; i++)
+	{
+		SimScenario *scenario = &scenarios[i];
+		SimStats *scenario_stats = &stats[i];
+
+		I8 scenario_line[128] = {};
+		snprintf(scenario_line, sizeof(scenario_line), "%s,%d,%d,%s,%d",
+				 GetSimClassName(scenario->player_class_id), scenario->player_level,
+				 scenario->player_gear.strength,
+				 GetSimClassName(scenario->enemy_class_id), scenario->enemy_level);
+
+		R32 encounter_n = (R32)scenario_stats->encounter_n;
+		R32 win_rate = (R32)scenario_stats->win_n / encounter_n;
+		R32 timeout_rate = (R32)scenario_stats->timeout_n / encounter_n;
+		R32 mean_dps = (R32)scenario_stats->total_damage * 1000.0f / (R32)scenario_stats->total_milliseconds;
+		R32 mean_time_to_kill = 0.0f;
+		if(scenario_stats->win_n > 0)
+		{
+			mean_time_to_kill = (R32)scenario_stats->total_win_milliseconds / (1000.0f * (R32)scenario_stats->win_n);
+		}
+		fprintf(summary_file, "%s,%lld,%.4f,%.4f,%.3f,%.3f\n", scenario_line, scenario_stats->encounter_n,
+				win_rate, timeout_rate, mean_dps, mean_time_to_kill);
+
+		WriteSimHistogram(histogram_file, scenario_line, "dps", &scenario_stats->dps);
+		WriteSimHistogram(histogram_file, scenario_line, "time_to_kill", &scenario_stats->time_to_kill);
+		WriteSimHistogram(histogram_file, scenario_line, "health_left", &scenario_stats->health_left);
+	}
+
+	fclose(summary_file);
+	fclose(histogram_file);
+	return true;
+}
+
+static void
+func PrintSimUsage()
+{
+	fprintf(stderr, "Usage: CombatSim [encounters per scenario] [thread n, 0 for all cores] [seed] [output prefix]\n");
+	fprintf(stderr, "                 [-levels min-max] [-enemy-levels min-max] [-gear a,b,...]\n");
+	fprintf(stderr, "Levels are between 1 and %d, at most %d gear levels.\n", MaxLevel, SimMaxGearLevelN);
+}
+
+I32
+func main(I32 argument_n, I8 **arguments)
+{
+	I32 encounter_n = 10000;
+	I32 thread_n = 0;
+	U64 seed = 1;
+	const char *prefix = "CombatSim";
+	SimSweep sweep = GetDefaultSimSweep();
+
+	B32 are_arguments_valid = true;
+	I32 position = 0;
+	for(I32 i = 1; are_arguments_valid && i < argument_n; i++)
+	{
+		I8 *argument = arguments[i];
+		I8 *value = (i + 1 < argument_n) ? arguments[i + 1] : 0;
+		if(strcmp(argument, "-levels") == 0)
+		{
+			are_arguments_valid = (value && ParseSimLevelRange(value, &sweep.min_player_level, &sweep.max_player_level));
+			i++;
+		}
+		else if(strcmp(argument, "-enemy-levels") == 0)
+		{
+			are_arguments_valid = (value && ParseSimLevelRange(value, &sweep.min_enemy_level, &sweep.max_enemy_level));
+			i++;
+		}
+		else if(strcmp(argument, "-gear") == 0)
+		{
+			are_arguments_valid = (value && ParseSimGearLevels(value, &sweep));
+			i++;
+		}
+		else
+		{
+			switch(position)
+			{
+				case 0:
+				{
+					encounter_n = atoi(argument);
+					break;
+				}
+				case 1:
+				{
+					thread_n = atoi(argument);
+					break;
+				}
+				case 2:
+				{
+					seed = (U64)strtoull(argument, 0, 10);
+					break;
+				}
+				case 3:
+				{
+					prefix = argument;
+					break;
+				}
+				default:
+				{
+					are_arguments_valid = false;
+				}
+			}
+			position++;
+		}
+	}
+	if(!are_arguments_valid || encounter_n <= 0)
+	{
+		PrintSimUsage();
+		return 1;
+	}
+
+	if(thread_n <= 0)
+	{
+		thread_n = GetProcessorCount();
+	}
+	thread_n = IntMin2(thread_n, SimMaxThreadN);
+
+	I32 scenario_n = GetSimScenarioN(&sweep);
+	SimScenario *scenarios = (SimScenario *)calloc(scenario_n, sizeof(SimScenario));
+	if(scenarios == 0)
+	{
+		fprintf(stderr, "Can not allocate %d scenarios.\n", scenario_n);
+		return 1;
+	}
+	FillSimScenarios(&sweep, scenarios);
+
+	SimWork work = {};
+	work.scenarios = scenarios;
+	work.scenario_n = scenario_n;
+	work.encounter_n = encounter_n;
+	work.batch_per_scenario = (encounter_n + SimBatchSize - 1) / SimBatchSize;
+	work.seed = seed;
+	work.next_batch = 0;
+
+	// NOTE: Every thread gets its own stats so the hot loop never shares a cache line.
+	SimStats *stats = (SimStats *)calloc(thread_n * scenario_n, sizeof(SimStats));
+	if(stats == 0)
+	{
+		fprintf(stderr, "Can not allocate the stats of %d threads.\n", thread_n);
+		free(scenarios);
+		return 1;
+	}
+	for(I32 i = 0; i < thread_n * scenario_n; i++)
+	{
+		InitSimStats(&stats[i]);
+	}
+
+	static Thread threads[SimMaxThreadN];
+	static SimWorker workers[SimMaxThreadN];
+	for(I32 i = 0; i < thread_n; i++)
+	{
+		workers[i].work = &work;
+		workers[i].stats = &stats[i * scenario_n];
+		StartThread(&threads[i], SimWorkerProc, &workers[i]);
+	}
+	for(I32 i = 0; i < thread_n; i++)
+	{
+		WaitForThread(&threads[i]);
+	}
+
+	for(I32 i = 1; i < thread_n; i++)
+	{
+		for(I32 j = 0; j < scenario_n; j++)
+		{
+			MergeSimStats(&stats[j], &stats[i * scenario_n + j]);
+		}
+	}
+
+	B32 is_written = WriteSimResults(prefix, scenarios, stats, scenario_n);
+	if(is_written)
+	{
+		printf("%d scenarios x %d encounters on %d threads, written to %s_*.csv\n",
+			   scenario_n, encounter_n, thread_n, prefix);
+	}
+
+	free(stats);
+	free(scenarios);
+	return (is_written) ? 0 : 1;
+}
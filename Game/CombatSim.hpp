@@ -0,0 +1,769 @@
+#pragma once
+
+#include "Ability.hpp"
+#include "CombatRules.hpp"
+#include "Debug.hpp"
+#include "Effect.hpp"
+#include "Math.hpp"
+#include "Type.hpp"
+
+// NOTE: The CombatLab rules for one player against one enemy, the numbers come from CombatRules.hpp.
+//       Everything lives in SimEncounter so that a step never allocates.
+//       Movement, items and the hate table are left out, both sides are always in range.
+
+#define SimMaxEffectN 16
+#define SimStepSeconds 0.05f
+#define SimMaxSeconds 300.0f
+
+struct SimEffect
+{
+	EffectId effect_id;
+	R32 time_remaining;
+};
+
+struct SimEntity
+{
+	ClassId class_id;
+	I32 level;
+
+	I32 health;
+	I32 absorb_damage;
+
+	I32 strength;
+	I32 intellect;
+	I32 constitution;
+	I32 dexterity;
+
+	R32 recharge;
+	R32 reaction_time;
+	R32 reaction_remaining;
+
+	AbilityId casted_ability;
+	R32 cast_time_remaining;
+
+	R32 cooldowns[AbilityN];
+
+	I32 effect_n;
+	SimEffect effects[SimMaxEffectN];
+
+	I32 damage_done;
+};
+
+struct SimGear
+{
+	I32 strength;
+	I32 intellect;
+	I32 constitution;
+	I32 dexterity;
+};
+
+struct SimScenario
+{
+	ClassId player_class_id;
+	I32 player_level;
+	SimGear player_gear;
+	R32 player_reaction_time;
+
+	ClassId enemy_class_id;
+	I32 enemy_level;
+	R32 enemy_reaction_time;
+};
+
+struct SimEncounter
+{
+	SimEntity player;
+	SimEntity enemy;
+	R32 time;
+	RandomSeries *random;
+};
+
+struct SimResult
+{
+	B32 player_won;
+	B32 timed_out;
+	R32 seconds;
+	I32 player_damage_done;
+	I32 player_health_left;
+	I32 player_max_health;
+};
+
+static I32
+func GetSimEntityMaxHealth(SimEntity *entity)
+{
+	I32 max_health = GetMaxHealth(entity->level, entity->constitution);
+	return max_health;
+}
+
+static B32
+func SimIsDead(SimEntity *entity)
+{
+	B32 is_dead = (entity->health == 0);
+	return is_dead;
+}
+
+static B32
+func SimHasEffect(SimEntity *entity, EffectId effect_id)
+{
+	B32 has_effect = false;
+	for(I32 i = 0; i < entity->effect_n; i++)
+	{
+		if(entity->effects[i].effect_id == effect_id)
+		{
+			has_effect = true;
+			break;
+		}
+	}
+	return has_effect;
+}
+
+static void
+func SimRemoveEffect(SimEntity *entity, EffectId effect_id)
+{
+	I32 remaining_effect_n = 0;
+	for(I32 i = 0; i < entity->effect_n; i++)
+	{
+		SimEffect *effect = &entity->effects[i];
+		if(effect->effect_id != effect_id)
+		{
+			entity->effects[remaining_effect_n] = *effect;
+			remaining_effect_n++;
+		}
+	}
+	entity->effect_n = remaining_effect_n;
+}
+
+static void
+func SimResetOrAddEffect(SimEntity *entity, EffectId effect_id)
+{
+	SimEffect *effect = 0;
+	for(I32 i = 0; i < entity->effect_n; i++)
+	{
+		if(entity->effects[i].effect_id == effect_id)
+		{
+			effect = &entity->effects[i];
+			break;
+		}
+	}
+
+	if(!effect)
+	{
+		Assert(entity->effect_n < SimMaxEffectN);
+		effect = &entity->effects[entity->effect_n];
+		entity->effect_n++;
+		effect->effect_id = effect_id;
+	}
+
+	if(EffectHasDuration(effect_id))
+	{
+		effect->time_remaining = GetEffectDuration(effect_id);
+	}
+}
+
+static B32
+func SimCanTakeDamage(SimEntity *entity)
+{
+	B32 can_take_damage = (!SimIsDead(entity) && !SimHasEffect(entity, InvulnerableEffectId));
+	return can_take_damage;
+}
+
+static I32
+func GetSimFinalDamage(SimEntity *source, SimEntity *target, I32 damage)
+{
+	I32 final_damage = damage;
+	if(source)
+	{
+		final_damage = ReduceDamageDone(final_damage, SimHasEffect(source, ReducedDamageDoneAndTakenEffectId));
+	}
+	final_damage = ReduceDamageTaken(final_damage, SimHasEffect(target, ReducedDamageDoneAndTakenEffectId),
+									 SimHasEffect(target, ShieldRaisedEffectId), SimHasEffect(target, EarthShieldEffectId));
+	return final_damage;
+}
+
+static void
+func SimDealFinalDamage(SimEntity *source, SimEntity *target, I32 damage)
+{
+	if(damage > 0)
+	{
+		I32 health_before = target->health;
+		if(target->absorb_damage >= damage)
+		{
+			target->absorb_damage -= damage;
+		}
+		else
+		{
+			damage -= target->absorb_damage;
+			target->absorb_damage = 0;
+			target->health = IntMax2(target->health - damage, 0);
+		}
+		source->damage_done += (health_before - target->health);
+	}
+}
+
+static void
+func SimDealDamage(SimEntity *source, SimEntity *target, I32 damage)
+{
+	if(SimCanTakeDamage(target))
+	{
+		I32 final_damage = GetSimFinalDamage(source, target, damage);
+		SimDealFinalDamage(source, target, final_damage);
+	}
+}
+
+// NOTE: Damage over time has no source entity for the reductions, but counts towards the opponent's damage.
+static void
+func SimDealDamageFromEffect(SimEntity *opponent, SimEntity *target, I32 damage)
+{
+	if(SimCanTakeDamage(target))
+	{
+		I32 final_damage = GetSimFinalDamage(0, target, damage);
+		SimDealFinalDamage(opponent, target, final_damage);
+	}
+}
+
+static void
+func SimHeal(SimEntity *entity, I32 healing)
+{
+	if(!SimIsDead(entity))
+	{
+		I32 max_health = GetSimEntityMaxHealth(entity);
+		entity->health = IntMin2(entity->health + healing, max_health);
+	}
+}
+
+static B32
+func SimAbilityIsEnabled(SimEntity *entity, SimEntity *enemy, AbilityId ability_id)
+{
+	B32 enabled = false;
+	switch(ability_id)
+	{
+		case RollAbilityId:
+		{
+			// NOTE: Roll only moves the entity, there is nowhere to move to here.
+			enabled = false;
+			break;
+		}
+		case HealAbilityId:
+		case EarthShieldAbilityId:
+		case SpinningKickAbilityId:
+		case AvoidanceAbilityId:
+		case SwordSwingAbilityId:
+		case RaiseShieldAbilityId:
+		case LightOfTheSunAbilityId:
+		case BlessingOfTheSunAbilityId:
+		case MercyOfTheSunAbilityId:
+		{
+			enabled = true;
+			break;
+		}
+		default:
+		{
+			enabled = !SimIsDead(enemy);
+		}
+	}
+
+	if(entity->class_id == PaladinClassId && SimHasEffect(entity, ShieldRaisedEffectId))
+	{
+		if(ability_id == SwordStabAbilityId || ability_id == SwordSwingAbilityId)
+		{
+			enabled = false;
+		}
+	}
+	else if(SimHasEffect(entity, BlindEffectId))
+	{
+		enabled = false;
+	}
+	return enabled;
+}
+
+static B32
+func SimCanUseAbility(SimEntity *entity, SimEntity *enemy, AbilityId ability_id)
+{
+	B32 can_use = true;
+	if(SimIsDead(entity) || entity->level < GetAbilityMinLevel(ability_id))
+	{
+		can_use = false;
+	}
+	else if(entity->recharge > 0.0f || entity->reaction_remaining > 0.0f)
+	{
+		can_use = false;
+	}
+	else if(entity->cooldowns[ability_id] > 0.0f || entity->casted_ability != NoAbilityId)
+	{
+		can_use = false;
+	}
+	else
+	{
+		can_use = SimAbilityIsEnabled(entity, enemy, ability_id);
+	}
+	return can_use;
+}
+
+static void
+func SimApplyAbility(SimEncounter *encounter, SimEntity *entity, SimEntity *enemy, AbilityId ability_id)
+{
+	I32 damage = GetAbilityBaseDamage(ability_id, entity->strength, entity->intellect);
+	switch(ability_id)
+	{
+		case LightningAbilityId:
+		case SmallPunchAbilityId:
+		case BigPunchAbilityId:
+		case SpinningKickAbilityId:
+		case CrocodileLashAbilityId:
+		{
+			SimDealDamage(entity, enemy, damage);
+			break;
+		}
+		case EarthShakeAbilityId:
+		{
+			SimResetOrAddEffect(enemy, EarthShakeEffectId);
+			break;
+		}
+		case HealAbilityId:
+		{
+			SimHeal(entity, GetAbilityHealing(ability_id));
+			break;
+		}
+		case EarthShieldAbilityId:
+		{
+			SimResetOrAddEffect(entity, EarthShieldEffectId);
+			entity->absorb_damage += EarthShieldAbsorbDamage;
+			break;
+		}
+		case KickAbilityId:
+		{
+			SimResetOrAddEffect(enemy, KickedEffectId);
+			break;
+		}
+		case AvoidanceAbilityId:
+		{
+			SimResetOrAddEffect(entity, InvulnerableEffectId);
+			break;
+		}
+		case SwordStabAbilityId:
+		case SwordSwingAbilityId:
+		{
+			if(SimHasEffect(entity, BlessingOfTheSunEffectId))
+			{
+				damage += BlessingOfTheSunBonusDamage;
+				SimHeal(entity, BlessingOfTheSunBonusHealing);
+			}
+			SimDealDamage(entity, enemy, damage);
+			break;
+		}
+		case RaiseShieldAbilityId:
+		{
+			SimResetOrAddEffect(entity, ShieldRaisedEffectId);
+			if(SimHasEffect(entity, BlessingOfTheSunEffectId))
+			{
+				SimHeal(entity, BlessingOfTheSunShieldHealing);
+			}
+			break;
+		}
+		case BurnAbilityId:
+		{
+			SimResetOrAddEffect(enemy, BurningEffectId);
+			break;
+		}
+		case LightOfTheSunAbilityId:
+		{
+			SimHeal(entity, GetAbilityHealing(ability_id));
+			break;
+		}
+		case BlessingOfTheSunAbilityId:
+		{
+			SimRemoveEffect(entity, BlessingOfTheSunEffectId);
+			SimResetOrAddEffect(entity, BlessingOfTheSunEffectId);
+			break;
+		}
+		case MercyOfTheSunAbilityId:
+		{
+			SimHeal(entity, GetAbilityHealing(ability_id));
+			if(!SimIsDead(enemy))
+			{
+				SimResetOrAddEffect(enemy, BlindEffectId);
+			}
+			break;
+		}
+		case SnakeStrikeAbilityId:
+		{
+			SimDealDamage(entity, enemy, damage);
+			if(RandomUnit(encounter->random) < SnakeStrikePoisonChance && !SimHasEffect(enemy, ImmuneToPoisonEffectId))
+			{
+				SimResetOrAddEffect(enemy, PoisonedEffectId);
+			}
+			break;
+		}
+		case CrocodileBiteAbilityId:
+		{
+			SimDealDamage(entity, enemy, damage);
+			SimResetOrAddEffect(enemy, BittenEffectId);
+			break;
+		}
+		case TigerBiteAbilityId:
+		{
+			SimDealDamage(entity, enemy, damage);
+			SimResetOrAddEffect(enemy, BleedingEffectId);
+			break;
+		}
+		default:
+		{
+			DebugBreak();
+		}
+	}
+
+	entity->cooldowns[ability_id] = GetAbilityCooldownDuration(ability_id);
+}
+
+static void
+func SimAttemptToUseAbility(SimEncounter *encounter, SimEntity *entity, SimEntity *enemy, AbilityId ability_id)
+{
+	if(SimCanUseAbility(entity, enemy, ability_id))
+	{
+		if(AbilityIsCasted(ability_id))
+		{
+			entity->casted_ability = ability_id;
+			entity->cast_time_remaining = GetAbilityCastDuration(ability_id);
+		}
+		else
+		{
+			SimApplyAbility(encounter, entity, enemy, ability_id);
+		}
+
+		entity->recharge = GetAbilityRechargeDuration(ability_id);
+		entity->reaction_remaining = entity->reaction_time * RandomUnit(encounter->random);
+	}
+}
+
+static R32
+func GetSimHealthRatio(SimEntity *entity)
+{
+	R32 ratio = (R32)entity->health / (R32)GetSimEntityMaxHealth(entity);
+	return ratio;
+}
+
+// NOTE: Scripted rotations, one priority list per class. Abilities without recharge
+//       do not block the rest of the list, the same as pressing several keys in one frame.
+static void
+func SimPlayerThink(SimEncounter *encounter)
+{
+	SimEntity *player = &encounter->player;
+	SimEntity *enemy = &encounter->enemy;
+	R32 health_ratio = GetSimHealthRatio(player);
+	switch(player->class_id)
+	{
+		case DruidClassId:
+		{
+			if(!SimHasEffect(player, EarthShieldEffectId))
+			{
+				SimAttemptToUseAbility(encounter, player, enemy, EarthShieldAbilityId);
+			}
+			if(health_ratio < 0.5f)
+			{
+				SimAttemptToUseAbility(encounter, player, enemy, HealAbilityId);
+			}
+			SimAttemptToUseAbility(encounter, player, enemy, EarthShakeAbilityId);
+			SimAttemptToUseAbility(encounter, player, enemy, LightningAbilityId);
+			break;
+		}
+		case MonkClassId:
+		{
+			if(health_ratio < 0.3f)
+			{
+				SimAttemptToUseAbility(encounter, player, enemy, AvoidanceAbilityId);
+			}
+			SimAttemptToUseAbility(encounter, player, enemy, BigPunchAbilityId);
+			SimAttemptToUseAbility(encounter, player, enemy, KickAbilityId);
+			SimAttemptToUseAbility(encounter, player, enemy, SpinningKickAbilityId);
+			SimAttemptToUseAbility(encounter, player, enemy, SmallPunchAbilityId);
+			break;
+		}
+		case PaladinClassId:
+		{
+			if(!SimHasEffect(player, BlessingOfTheSunEffectId))
+			{
+				SimAttemptToUseAbility(encounter, player, enemy, BlessingOfTheSunAbilityId);
+			}
+			if(health_ratio < 0.4f)
+			{
+				SimAttemptToUseAbility(encounter, player, enemy, MercyOfTheSunAbilityId);
+			}
+			if(!SimHasEffect(enemy, BurningEffectId))
+			{
+				SimAttemptToUseAbility(encounter, player, enemy, BurnAbilityId);
+			}
+			if(health_ratio < 0.6f)
+			{
+				SimAttemptToUseAbility(encounter, player, enemy, LightOfTheSunAbilityId);
+			}
+			SimAttemptToUseAbility(encounter, player, enemy, RaiseShieldAbilityId);
+			SimAttemptToUseAbility(encounter, player, enemy, SwordStabAbilityId);
+			break;
+		}
+		default:
+		{
+			DebugBreak();
+		}
+	}
+}
+
+static void
+func SimEnemyThink(SimEncounter *encounter)
+{
+	SimEntity *enemy = &encounter->enemy;
+	SimEntity *player = &encounter->player;
+	switch(enemy->class_id)
+	{
+		case SnakeClassId:
+		{
+			SimAttemptToUseAbility(encounter, enemy, player, SnakeStrikeAbilityId);
+			break;
+		}
+		case CrocodileClassId:
+		{
+			SimAttemptToUseAbility(encounter, enemy, player, CrocodileBiteAbilityId);
+			SimAttemptToUseAbility(encounter, enemy, player, CrocodileLashAbilityId);
+			break;
+		}
+		case TigerClassId:
+		{
+			SimAttemptToUseAbility(encounter, enemy, player, TigerBiteAbilityId);
+			break;
+		}
+		default:
+		{
+			DebugBreak();
+		}
+	}
+}
+
+static void
+func SimUpdateEffects(SimEntity *entity, SimEntity *opponent, R32 seconds)
+{
+	I32 remaining_effect_n = 0;
+	for(I32 i = 0; i < entity->effect_n; i++)
+	{
+		SimEffect *effect = &entity->effects[i];
+		effect->time_remaining -= seconds;
+		if(!EffectHasDuration(effect->effect_id) || effect->time_remaining > 0.0f)
+		{
+			entity->effects[remaining_effect_n] = *effect;
+			remaining_effect_n++;
+		}
+		else if(effect->effect_id == EarthShieldEffectId)
+		{
+			entity->absorb_damage = 0;
+		}
+	}
+	entity->effect_n = remaining_effect_n;
+
+	for(I32 i = 0; i < entity->effect_n; i++)
+	{
+		SimEffect *effect = &entity->effects[i];
+		if(EffectTicked(effect->effect_id, effect->time_remaining, seconds))
+		{
+			I32 damage = GetEffectTickDamage(effect->effect_id);
+			if(damage > 0)
+			{
+				SimDealDamageFromEffect(opponent, entity, damage);
+			}
+			I32 healing = GetEffectTickHealing(effect->effect_id);
+			if(healing > 0)
+			{
+				SimHeal(entity, healing);
+			}
+		}
+	}
+}
+
+static void
+func SimUpdateTimers(SimEntity *entity, R32 seconds)
+{
+	entity->recharge = Max2(entity->recharge - seconds, 0.0f);
+	entity->reaction_remaining = Max2(entity->reaction_remaining - seconds, 0.0f);
+	for(I32 i = 0; i < AbilityN; i++)
+	{
+		entity->cooldowns[i] = Max2(entity->cooldowns[i] - seconds, 0.0f);
+	}
+}
+
+static void
+func SimUpdateCasting(SimEncounter *encounter, SimEntity *entity, SimEntity *enemy, R32 seconds)
+{
+	if(entity->casted_ability != NoAbilityId)
+	{
+		if(SimIsDead(entity))
+		{
+			entity->casted_ability = NoAbilityId;
+		}
+		else
+		{
+			entity->cast_time_remaining -= seconds;
+			if(entity->cast_time_remaining <= 0.0f)
+			{
+				AbilityId ability_id = entity->casted_ability;
+				entity->casted_ability = NoAbilityId;
+				entity->cast_time_remaining = 0.0f;
+				if(ability_id != LightningAbilityId || !SimIsDead(enemy))
+				{
+					SimApplyAbility(encounter, entity, enemy, ability_id);
+				}
+			}
+		}
+	}
+}
+
+static SimEntity
+func CreateSimEntity(ClassId class_id, I32 level, SimGear gear, R32 reaction_time)
+{
+	Assert(IsIntBetween(level, 1, MaxLevel));
+	SimEntity entity = {};
+	entity.class_id = class_id;
+	entity.level = level;
+	entity.strength     = level + gear.strength;
+	entity.intellect    = level + gear.intellect;
+	entity.constitution = level + gear.constitution;
+	entity.dexterity    = level + gear.dexterity;
+	entity.reaction_time = reaction_time;
+	entity.casted_ability = NoAbilityId;
+	entity.health = GetSimEntityMaxHealth(&entity);
+	return entity;
+}
+
+static void
+func SimStep(SimEncounter *encounter, R32 seconds)
+{
+	SimEntity *player = &encounter->player;
+	SimEntity *enemy = &encounter->enemy;
+
+	SimUpdateEffects(player, enemy, seconds);
+	SimUpdateEffects(enemy, player, seconds);
+	SimUpdateTimers(player, seconds);
+	SimUpdateTimers(enemy, seconds);
+
+	SimPlayerThink(encounter);
+	SimEnemyThink(encounter);
+
+	SimUpdateCasting(encounter, player, enemy, seconds);
+	SimUpdateCasting(encounter, enemy, player, seconds);
+
+	encounter->time += seconds;
+}
+
+static SimResult
+func RunSimEncounter(SimScenario *scenario, RandomSeries *random)
+{
+	SimGear no_gear = {};
+	SimEncounter encounter = {};
+	encounter.random = random;
+	encounter.player = CreateSimEntity(scenario->player_class_id, scenario->player_level,
+									   scenario->player_gear, scenario->player_reaction_time);
+	encounter.enemy = CreateSimEntity(scenario->enemy_class_id, scenario->enemy_level,
+									  no_gear, scenario->enemy_reaction_time);
+
+	// NOTE: Who gets the first move depends on how fast both sides react to the pull.
+	encounter.player.reaction_remaining = scenario->player_reaction_time * RandomUnit(random);
+	encounter.enemy.reaction_remaining = scenario->enemy_reaction_time * RandomUnit(random);
+
+	while(!SimIsDead(&encounter.player) && !SimIsDead(&encounter.enemy) && encounter.time < SimMaxSeconds)
+	{
+		SimStep(&encounter, SimStepSeconds);
+	}
+
+	SimResult result = {};
+	result.player_won = SimIsDead(&encounter.enemy) && !SimIsDead(&encounter.player);
+	result.timed_out = (!SimIsDead(&encounter.enemy) && !SimIsDead(&encounter.player));
+	result.seconds = encounter.time;
+	result.player_damage_done = encounter.player.damage_done;
+	result.player_health_left = encounter.player.health;
+	result.player_max_health = GetSimEntityMaxHealth(&encounter.player);
+	return result;
+}
+
+#define SimHistogramBucketN 128
+
+struct SimHistogram
+{
+	R32 bucket_width;
+	U32 counts[SimHistogramBucketN];
+};
+
+static void
+func AddToSimHistogram(SimHistogram *histogram, R32 value)
+{
+	Assert(histogram->bucket_width > 0.0f);
+	I32 bucket = Floor(value / histogram->bucket_width);
+	bucket = IntMin2(IntMax2(bucket, 0), SimHistogramBucketN - 1);
+	histogram->counts[bucket]++;
+}
+
+static void
+func MergeSimHistogram(SimHistogram *to, SimHistogram *from)
+{
+	Assert(to->bucket_width == from->bucket_width);
+	for(I32 i = 0; i < SimHistogramBucketN; i++)
+	{
+		to->counts[i] += from->counts[i];
+	}
+}
+
+struct SimStats
+{
+	I64 encounter_n;
+	I64 win_n;
+	I64 timeout_n;
+	I64 total_damage;
+	I64 total_milliseconds;
+	I64 total_win_milliseconds;
+
+	SimHistogram dps;
+	SimHistogram time_to_kill;
+	SimHistogram health_left;
+};
+
+static void
+func InitSimStats(SimStats *stats)
+{
+	*stats = {};
+	stats->dps.bucket_width = 0.5f;
+	stats->time_to_kill.bucket_width = 1.0f;
+	stats->health_left.bucket_width = 0.01f;
+}
+
+static void
+func AddSimResult(SimStats *stats, SimResult *result)
+{
+	stats->encounter_n++;
+	stats->total_damage += result->player_damage_done;
+	I64 milliseconds = (I64)(result->seconds * 1000.0f);
+	stats->total_milliseconds += milliseconds;
+
+	R32 dps = (R32)result->player_damage_done / result->seconds;
+	AddToSimHistogram(&stats->dps, dps);
+	if(result->player_won)
+	{
+		stats->win_n++;
+		stats->total_win_milliseconds += milliseconds;
+		AddToSimHistogram(&stats->time_to_kill, result->seconds);
+
+		R32 health_ratio = (R32)result->player_health_left / (R32)result->player_max_health;
+		AddToSimHistogram(&stats->health_left, health_ratio);
+	}
+	if(result->timed_out)
+	{
+		stats->timeout_n++;
+	}
+}
+
+static void
+func MergeSimStats(SimStats *to, SimStats *from)
+{
+	to->encounter_n += from->encounter_n;
+	to->win_n += from->win_n;
+	to->timeout_n += from->timeout_n;
+	to->total_damage += from->total_damage;
+	to->total_milliseconds += from->total_milliseconds;
+	to->total_win_milliseconds += from->total_win_milliseconds;
+	MergeSimHistogram(&to->dps, &from->dps);
+	MergeSimHistogram(&to->time_to_kill, &from->time_to_kill);
+	MergeSimHistogram(&to->health_left, &from->health_left);
+}
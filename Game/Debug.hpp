@@ -2,7 +2,13 @@
 
 #define DEBUG_MODE
 
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <signal.h>
+#define DebugBreak() raise(SIGTRAP)
+#endif
+
 #include <stdio.h>
 
 #include "Type.hpp"
@@ -5,6 +5,7 @@
 #include "Geometry.hpp"
 #include "Math.hpp"
 #include "Memory.hpp"
+#include "Profiler.hpp"
 #include "Text.hpp"
 #include "Texture.hpp"
 #include "Type.hpp"
@@ -342,26 +343,160 @@ func BresenhamAdvance(BresenhamContext* context)
 	}
 }
 
-static void
-func Bresenham(Canvas* canvas, V2 point1, V2 point2, V4 color)
+// NOTE: Liang-Barsky, cuts the segment to the part that is inside the rect. Returns false if no part of it is inside.
+static B32
+func ClipLineToRect(V2 *point1, V2 *point2, Rect rect)
 {
-	Bitmap bitmap = canvas->bitmap;
-	U32 color_code = GetColorCode(color);
+	R32 dx = point2->x - point1->x;
+	R32 dy = point2->y - point1->y;
+	R32 directions[4] = {-dx, dx, -dy, dy};
+	R32 distances[4] = {point1->x - rect.left, rect.right - point1->x, point1->y - rect.top, rect.bottom - point1->y};
+
+	R32 enter_ratio = 0.0f;
+	R32 exit_ratio = 1.0f;
+	B32 is_inside = true;
+	for(I32 i = 0; i < 4 && is_inside; i++)
+	{
+		if(directions[i] == 0.0f)
+		{
+			is_inside = (distances[i] >= 0.0f);
+		}
+		else
+		{
+			R32 ratio = distances[i] / directions[i];
+			if(directions[i] < 0.0f)
+			{
+				enter_ratio = Max2(enter_ratio, ratio);
+			}
+			else
+			{
+				exit_ratio = Min2(exit_ratio, ratio);
+			}
+			is_inside = (enter_ratio <= exit_ratio);
+		}
+	}
+
+	if(is_inside)
+	{
+		V2 start = *point1;
+		if(enter_ratio > 0.0f)
+		{
+			point1->x = start.x + enter_ratio * dx;
+			point1->y = start.y + enter_ratio * dy;
+		}
+		if(exit_ratio < 1.0f)
+		{
+			point2->x = start.x + exit_ratio * dx;
+			point2->y = start.y + exit_ratio * dy;
+		}
+	}
+	return is_inside;
+}
 
-	BresenhamContext context = BresenhamInitUnit(canvas, point1, point2);
-	while(1) 
+// NOTE: Floor of numerator / denominator for a positive denominator.
+static I64
+func FloorDivide(I64 numerator, I64 denominator)
+{
+	Assert(denominator > 0);
+	I64 quotient = numerator / denominator;
+	if(numerator % denominator != 0 && numerator < 0)
 	{
-		SetPixelCheck(bitmap, context.y1, context.x1, color_code);
+		quotient--;
+	}
+	return quotient;
+}
+
+#define MaxLinePixelDistance (1 << 20)
 
-		if(context.x1 == context.x2 && context.y1 == context.y2)
+// NOTE: Draws the same pixels as stepping a BresenhamContext from one truncated point to the other,
+//       but only steps through the part that is on the bitmap.
+//       The line takes major_n steps on its major axis and minor_n on the other. With error starting at major_n / 2,
+//       after k steps it has taken ceil((k * minor_n - start_error) / major_n) minor steps, so the first and
+//       last step on the bitmap come from a division instead of walking there.
+//       Points very far away are first brought closer with ClipLineToRect so the pixel math stays in range.
+static void
+func DrawPixelLine(Bitmap bitmap, V2 pixel_point1, V2 pixel_point2, U32 color_code)
+{
+	Rect guard_rect = {};
+	guard_rect.left = -(R32)MaxLinePixelDistance;
+	guard_rect.right = (R32)(bitmap.width + MaxLinePixelDistance);
+	guard_rect.top = -(R32)MaxLinePixelDistance;
+	guard_rect.bottom = (R32)(bitmap.height + MaxLinePixelDistance);
+	if(ClipLineToRect(&pixel_point1, &pixel_point2, guard_rect))
+	{
+		BresenhamContext context = BresenhamInitPixel(pixel_point1, pixel_point2);
+		B32 is_x_major = (context.abs_x > context.abs_y);
+		I32 major1 = is_x_major ? context.x1 : context.y1;
+		I32 minor1 = is_x_major ? context.y1 : context.x1;
+		I32 major_add = is_x_major ? context.add_x : context.add_y;
+		I32 minor_add = is_x_major ? context.add_y : context.add_x;
+		I64 major_n = is_x_major ? context.abs_x : context.abs_y;
+		I64 minor_n = is_x_major ? context.abs_y : context.abs_x;
+		I32 major_size = is_x_major ? bitmap.width : bitmap.height;
+		I32 minor_size = is_x_major ? bitmap.height : bitmap.width;
+		I64 start_error = major_n / 2;
+
+		I64 first_step = 0;
+		I64 last_step = major_n;
+		I64 first_major_step = (major_add > 0) ? -major1 : major1 - (major_size - 1);
+		I64 last_major_step = (major_add > 0) ? (major_size - 1) - major1 : major1;
+		first_step = (first_major_step > first_step) ? first_major_step : first_step;
+		last_step = (last_major_step < last_step) ? last_major_step : last_step;
+
+		I64 min_minor_step_n = (minor_add > 0) ? -minor1 : minor1 - (minor_size - 1);
+		I64 max_minor_step_n = (minor_add > 0) ? (minor_size - 1) - minor1 : minor1;
+		if(minor_n == 0)
+		{
+			if(min_minor_step_n > 0 || max_minor_step_n < 0)
+			{
+				last_step = first_step - 1;
+			}
+		}
+		else
 		{
-			break;
+			I64 first_minor_step = FloorDivide((min_minor_step_n - 1) * major_n + start_error, minor_n) + 1;
+			I64 last_minor_step = FloorDivide(max_minor_step_n * major_n + start_error, minor_n);
+			first_step = (first_minor_step > first_step) ? first_minor_step : first_step;
+			last_step = (last_minor_step < last_step) ? last_minor_step : last_step;
 		}
 
-		BresenhamAdvance(&context);
+		if(first_step <= last_step)
+		{
+			I64 minor_step_n = (major_n > 0) ? FloorDivide(first_step * minor_n - start_error + major_n - 1, major_n) : 0;
+			I64 error = start_error - first_step * minor_n + minor_step_n * major_n;
+			I32 major = major1 + (I32)first_step * major_add;
+			I32 minor = minor1 + (I32)minor_step_n * minor_add;
+			for(I64 step = first_step; step <= last_step; step++)
+			{
+				I32 row = is_x_major ? minor : major;
+				I32 col = is_x_major ? major : minor;
+				Assert(row >= 0 && row < bitmap.height && col >= 0 && col < bitmap.width);
+				SetPixel(bitmap, row, col, color_code);
+
+				if(error < minor_n)
+				{
+					minor += minor_add;
+					error += major_n - minor_n;
+				}
+				else
+				{
+					error -= minor_n;
+				}
+				major += major_add;
+			}
+		}
 	}
 }
 
+static void
+func Bresenham(Canvas* canvas, V2 point1, V2 point2, V4 color)
+{
+	Camera* camera = canvas->camera;
+	V2 pixel_point1 = UnitToPixel(camera, point1);
+	V2 pixel_point2 = UnitToPixel(camera, point2);
+	DrawPixelLine(canvas->bitmap, pixel_point1, pixel_point2, GetColorCode(color));
+}
+
 static V2
 func LineAtX(V2 line_point1, V2 line_point2, R32 x)
 {
@@ -591,69 +726,231 @@ func DrawVerticalTrapezoid(Canvas* canvas, V2 top_left, V2 top_right, V2 bottom_
 	}
 }
 
+// NOTE: Fills the pixels first_col..last_col of a row of the bitmap, the row has to be inside the bitmap.
+static void
+func FillPixelSpan(Bitmap bitmap, I32 row, I32 first_col, I32 last_col, U32 color_code)
+{
+	Assert(row >= 0 && row < bitmap.height);
+	first_col = IntMax2(first_col, 0);
+	last_col = IntMin2(last_col, bitmap.width - 1);
+	U32 *pixel = bitmap.memory + row * bitmap.width + first_col;
+	for(I32 col = first_col; col <= last_col; col++)
+	{
+		*pixel = color_code;
+		pixel++;
+	}
+}
+
+// NOTE: Circles are filled one row at a time, pixel (row, col) is inside if its squared distance from the center pixel
+//       is at most radius * radius. The half width of the rows is found by walking outwards from the center row,
+//       like in the midpoint circle algorithm, so the whole circle takes only integer adds and compares.
+//       Only the rows that are on the bitmap are walked.
+#define CircleHalfWidthCacheN 256
+
+static void
+func FillPixelCircleRows(Bitmap bitmap, I32 center_row, I32 center_col, I32 radius, I32 *half_widths, U32 color_code)
+{
+	if(center_row + radius >= 0 && center_row - radius < bitmap.height &&
+	   center_col + radius >= 0 && center_col - radius < bitmap.width)
+	{
+		I32 first_dy = 0;
+		if(center_row < 0)
+		{
+			first_dy = -center_row;
+		}
+		else if(center_row >= bitmap.height)
+		{
+			first_dy = center_row - (bitmap.height - 1);
+		}
+		I32 last_dy = IntMin2(radius, IntMax2(center_row, bitmap.height - 1 - center_row));
+
+		I64 radius_square = (I64)radius * radius;
+		I32 half_width = 0;
+		if(half_widths == 0)
+		{
+			half_width = (I32)sqrtf((R32)(radius_square - (I64)first_dy * first_dy)) + 1;
+		}
+
+		for(I32 dy = first_dy; dy <= last_dy; dy++)
+		{
+			if(half_widths != 0)
+			{
+				half_width = half_widths[dy];
+			}
+			else
+			{
+				I64 dy_square = (I64)dy * dy;
+				while((I64)half_width * half_width + dy_square > radius_square)
+				{
+					half_width--;
+				}
+			}
+
+			I32 first_col = center_col - half_width;
+			I32 last_col = center_col + half_width;
+			I32 top_row = center_row - dy;
+			I32 bottom_row = center_row + dy;
+			if(top_row >= 0 && top_row < bitmap.height)
+			{
+				FillPixelSpan(bitmap, top_row, first_col, last_col, color_code);
+			}
+			if(dy > 0 && bottom_row >= 0 && bottom_row < bitmap.height)
+			{
+				FillPixelSpan(bitmap, bottom_row, first_col, last_col, color_code);
+			}
+		}
+	}
+}
+
 static void
 func DrawCircle(Canvas *canvas, V2 center, R32 radius, V4 color)
 {
 	U32 color_code = GetColorCode(color);
 
 	Camera *camera = canvas->camera;
-
 	I32 center_x_pixel = UnitXtoPixel(camera, center.x);
 	I32 center_y_pixel = UnitYtoPixel(camera, center.y);
+	I32 pixel_radius = (I32)(radius * camera->unit_in_pixels);
 
-	I32 left_pixel   = UnitXtoPixel(camera, center.x - radius);
-	I32 right_pixel  = UnitXtoPixel(camera, center.x + radius);
-	I32 top_pixel    = UnitYtoPixel(camera, center.y - radius);
-	I32 bottom_pixel = UnitYtoPixel(camera, center.y + radius);
+	FillPixelCircleRows(canvas->bitmap, center_y_pixel, center_x_pixel, pixel_radius, 0, color_code);
+}
 
-	if(top_pixel > bottom_pixel)
+// NOTE: Draws circles of the same radius and color. The half widths of the rows are only found once
+//       if the radius is small enough for them to fit in CircleHalfWidthCacheN.
+static void
+func DrawCircles(Canvas *canvas, V2 *centers, I32 center_n, R32 radius, V4 color)
+{
+	ProfileFunction();
+	U32 color_code = GetColorCode(color);
+
+	Camera *camera = canvas->camera;
+	I32 pixel_radius = (I32)(radius * camera->unit_in_pixels);
+
+	I32 half_width_cache[CircleHalfWidthCacheN] = {};
+	I32 *half_widths = 0;
+	if(pixel_radius < CircleHalfWidthCacheN)
 	{
-		IntSwap(&top_pixel, &bottom_pixel);
+		half_widths = half_width_cache;
+		I32 half_width = pixel_radius;
+		for(I32 dy = 0; dy <= pixel_radius; dy++)
+		{
+			while(half_width * half_width + dy * dy > pixel_radius * pixel_radius)
+			{
+				half_width--;
+			}
+			half_widths[dy] = half_width;
+		}
 	}
 
-	if(left_pixel > right_pixel)
+	for(I32 i = 0; i < center_n; i++)
 	{
-		IntSwap(&left_pixel, &right_pixel);
+		I32 center_x_pixel = UnitXtoPixel(camera, centers[i].x);
+		I32 center_y_pixel = UnitYtoPixel(camera, centers[i].y);
+		FillPixelCircleRows(canvas->bitmap, center_y_pixel, center_x_pixel, pixel_radius, half_widths, color_code);
 	}
+}
 
-	I32 pixel_radius = (I32)(radius * camera->unit_in_pixels);
-	I32 pixel_radius_square = pixel_radius * pixel_radius;
+// NOTE: Anti-aliased circle. Pixels whose center is closer than radius - 0.5 pixels to the center are filled,
+//       pixels closer than radius + 0.5 get the color mixed in by how far they are inside the edge.
+static void
+func DrawSmoothCircle(Canvas *canvas, V2 center, R32 radius, V4 color)
+{
+	U32 color_code = GetColorCode(color);
 
+	Camera *camera = canvas->camera;
 	Bitmap bitmap = canvas->bitmap;
-	top_pixel    = IntMax2(top_pixel, 0);
-	bottom_pixel = IntMin2(bottom_pixel, bitmap.height - 1);
-	left_pixel   = IntMax2(left_pixel, 0);
-	right_pixel  = IntMin2(right_pixel, bitmap.width - 1);
-
-	for(I32 row = top_pixel; row < bottom_pixel; row++)
+	R32 center_x = camera->screen_pixel_size.x * 0.5f + (center.x - camera->center.x) * camera->unit_in_pixels;
+	R32 center_y = camera->screen_pixel_size.y * 0.5f + (center.y - camera->center.y) * camera->unit_in_pixels;
+	R32 pixel_radius = radius * camera->unit_in_pixels;
+	R32 outer_radius = pixel_radius + 0.5f;
+	R32 inner_radius = pixel_radius - 0.5f;
+
+	I32 first_row = IntMax2(Floor(center_y - outer_radius), 0);
+	I32 last_row = IntMin2(Floor(center_y + outer_radius), bitmap.height - 1);
+	for(I32 row = first_row; row <= last_row; row++)
 	{
-		for(I32 col = left_pixel; col < right_pixel; col++)
+		R32 dy = (R32)row + 0.5f - center_y;
+		R32 outer_square = outer_radius * outer_radius - dy * dy;
+		if(outer_square > 0.0f)
 		{
-			U32 *pixel = bitmap.memory + row * bitmap.width + col;
-			I32 pixel_distance_square = IntSquare(row - center_y_pixel) + IntSquare(col - center_x_pixel);
-			if(pixel_distance_square <= pixel_radius_square)
+			R32 outer_half_width = sqrtf(outer_square);
+			I32 outer_first_col = IntMax2(Floor(center_x - outer_half_width - 0.5f) + 1, 0);
+			I32 outer_last_col = IntMin2(Floor(center_x + outer_half_width - 0.5f), bitmap.width - 1);
+
+			I32 inner_first_col = outer_last_col + 1;
+			I32 inner_last_col = outer_last_col;
+			R32 inner_square = inner_radius * inner_radius - dy * dy;
+			if(inner_radius > 0.0f && inner_square > 0.0f)
 			{
-				*pixel = color_code;
+				R32 inner_half_width = sqrtf(inner_square);
+				inner_first_col = IntMax2(Floor(center_x - inner_half_width - 0.5f) + 1, outer_first_col);
+				inner_last_col = IntMin2(Floor(center_x + inner_half_width - 0.5f), outer_last_col);
+				FillPixelSpan(bitmap, row, inner_first_col, inner_last_col, color_code);
+			}
+
+			U32 *pixel_row = bitmap.memory + row * bitmap.width;
+			for(I32 col = outer_first_col; col <= outer_last_col; col++)
+			{
+				if(col >= inner_first_col && col <= inner_last_col)
+				{
+					col = inner_last_col;
+					continue;
+				}
+				R32 dx = (R32)col + 0.5f - center_x;
+				R32 coverage = Clip(outer_radius - sqrtf(dx * dx + dy * dy), 0.0f, 1.0f);
+				pixel_row[col] = BlendColorCodes(pixel_row[col], color_code, (U32)(coverage * 256.0f));
 			}
 		}
 	}
 }
 
+// NOTE: Midpoint circle. Walks the octant from (radius, 0) to the diagonal and mirrors every pixel to the other seven.
+//       col stays the largest one for which (col, row) is inside by the test of DrawCircle,
+//       so the outline is the edge of the filled circle. error is radius^2 - col^2 - row^2.
 static void
 func DrawCircleOutline(Canvas *canvas, V2 center, R32 radius, V4 color)
 {
-	I32 line_n = 20;
-	R32 angle_advance = (2.0f * PI) / R32(line_n);
-	R32 angle = 0.0f;
-	for(I32 i = 0; i < line_n; i++)
+	U32 color_code = GetColorCode(color);
+
+	Camera *camera = canvas->camera;
+	Bitmap bitmap = canvas->bitmap;
+	I32 center_col = UnitXtoPixel(camera, center.x);
+	I32 center_row = UnitYtoPixel(camera, center.y);
+	I32 pixel_radius = (I32)(radius * camera->unit_in_pixels);
+
+	B32 is_on_bitmap = (center_row + pixel_radius >= 0 && center_row - pixel_radius < bitmap.height &&
+						center_col + pixel_radius >= 0 && center_col - pixel_radius < bitmap.width);
+	B32 is_inside_bitmap = (center_row - pixel_radius >= 0 && center_row + pixel_radius < bitmap.height &&
+							center_col - pixel_radius >= 0 && center_col + pixel_radius < bitmap.width);
+	if(is_on_bitmap)
 	{
-		R32 angle1 = angle;
-		R32 angle2 = angle + angle_advance;
-		V2 point1 = center + radius * RotationVector(angle1);
-		V2 point2 = center + radius * RotationVector(angle2);
-		Bresenham(canvas, point1, point2, color);
+		I32 col = pixel_radius;
+		I32 row = 0;
+		I64 error = 0;
+		while(col >= row)
+		{
+			I32 cols[8] = {col, -col, col, -col, row, -row, row, -row};
+			I32 rows[8] = {row, row, -row, -row, col, col, -col, -col};
+			for(I32 i = 0; i < 8; i++)
+			{
+				if(is_inside_bitmap)
+				{
+					SetPixel(bitmap, center_row + rows[i], center_col + cols[i], color_code);
+				}
+				else
+				{
+					SetPixelCheck(bitmap, center_row + rows[i], center_col + cols[i], color_code);
+				}
+			}
 
-		angle += angle_advance;
+			row++;
+			error -= 2 * row - 1;
+			while(error < 0 && col >= row)
+			{
+				error += 2 * col - 1;
+				col--;
+			}
+		}
 	}
 }
 
@@ -686,11 +983,7 @@ func DrawRectLRTB(Canvas* canvas, R32 left, R32 right, R32 top, R32 bottom, V4 c
 
 	for(I32 row = top_pixel; row < bottom_pixel; row++) 
 	{
-		for(I32 col = left_pixel; col < right_pixel; col++) 
-		{
-			U32 *pixel = bitmap.memory + row * bitmap.width + col;
-			*pixel = color_code;
-		}
+		FillPixelSpan(bitmap, row, left_pixel, right_pixel - 1, color_code);
 	}
 }
 
@@ -817,56 +1110,88 @@ func DrawLine(Canvas* canvas, V2 point1, V2 point2, V4 color, R32 line_width)
 
 #define WorldTextureScale 20.0f
 
-static void
-func FillScreenWithWorldTexture(Canvas* canvas, Texture texture)
+// NOTE: Maps the pixels of the canvas to texels of the mip level that fits the zoom of the camera.
+//       Texel coordinates are shifted by half a texel so the bilinear samples are centered on the texels.
+struct WorldTextureSampler
 {
-	Bitmap bitmap = canvas->bitmap;
-	Camera* camera = canvas->camera;
+	Texture mip;
+	R32 start_x;
+	R32 start_y;
+	R32 texel_per_pixel;
+	U32 fixed_texel_per_pixel;
+};
 
+static WorldTextureSampler
+func GetWorldTextureSampler(Camera *camera, Texture texture, R32 texel_per_unit)
+{
 	R32 pixel_in_units = Invert(camera->unit_in_pixels);
+	I32 mip_level = GetTextureMipLevel(texture, pixel_in_units * texel_per_unit);
+	R32 mip_texel_per_unit = texel_per_unit / (R32)(1 << mip_level);
+
+	WorldTextureSampler sampler = {};
+	sampler.mip = GetTextureMip(texture, mip_level);
+	sampler.start_x = (camera->center.x - (camera->screen_pixel_size.x * 0.5f * pixel_in_units)) * mip_texel_per_unit - 0.5f;
+	sampler.start_y = (camera->center.y - (camera->screen_pixel_size.y * 0.5f * pixel_in_units)) * mip_texel_per_unit - 0.5f;
+	sampler.texel_per_pixel = pixel_in_units * mip_texel_per_unit;
+	sampler.fixed_texel_per_pixel = (U32)(sampler.texel_per_pixel * 65536.0f);
+	return sampler;
+}
 
-	R32 start_x = camera->center.x - (camera->screen_pixel_size.x * 0.5f * pixel_in_units);
-	R32 start_y = camera->center.y - (camera->screen_pixel_size.y * 0.5f * pixel_in_units);
-	start_x *= WorldTextureScale;
-	start_y *= WorldTextureScale;
-
-	R32 add_x = pixel_in_units;
-	R32 add_y = pixel_in_units;
-	add_x *= WorldTextureScale;
-	add_y *= WorldTextureScale;
-	I32 and_val = (texture.side - 1);
-
-	U32 *pixel = bitmap.memory;
-
-	I32 start_int_x = ((I32)start_x) & and_val;
-	I32 start_int_y = ((I32)start_y) & and_val;
-
-	U32 *texture_row = texture.memory + (start_int_y << texture.log_side) + (start_int_x);
-
-	R32 y = start_y;
-	I32 prev_int_y = ((I32)y) & and_val;
-
-	for(I32 row = 0; row < bitmap.height; row++) 
+// NOTE: Samples the pixels first_col..last_col of a row of the bitmap.
+static void
+func SampleWorldTextureSpan(WorldTextureSampler *sampler, Bitmap bitmap, I32 row, I32 first_col, I32 last_col)
+{
+	if(first_col <= last_col)
 	{
-		R32 x = start_x;
-		I32 prev_int_x = (((I32)x) & and_val);
-		U32 *texture_pixel = texture_row;
+		Texture mip = sampler->mip;
+		U32 x = GetTextureFixedCoord(mip, sampler->start_x + (R32)first_col * sampler->texel_per_pixel);
+		U32 y = GetTextureFixedCoord(mip, sampler->start_y + (R32)row * sampler->texel_per_pixel);
+		U32 *pixels = bitmap.memory + row * bitmap.width + first_col;
+		SampleTextureRow(mip, pixels, last_col - first_col + 1, x, y, sampler->fixed_texel_per_pixel);
+	}
+}
 
-		for(I32 col = 0; col < bitmap.width; col++) 
+// NOTE: Narrows first_col..last_col to the pixels of the row that are inside a convex polygon,
+//       that is the ones for which TurnsRight holds for every edge. Points are in pixels.
+static void
+func ClipRowSpanToConvexPoly(V2 *points, I32 point_n, R32 row, I32 *first_col, I32 *last_col)
+{
+	I32 prev = point_n - 1;
+	for(I32 i = 0; i < point_n && *first_col <= *last_col; i++)
+	{
+		V2 point1 = points[prev];
+		V2 point2 = points[i];
+		R32 dx = point2.x - point1.x;
+		R32 dy = point2.y - point1.y;
+		// NOTE: TurnsRight(point1, point2, (col, row)) is (limit - dy * col > 0).
+		R32 limit = dx * (row - point2.y) + dy * point2.x;
+		if(dy > 0.0f)
 		{
-			*pixel = *texture_pixel;
-			pixel++;
-
-			x += add_x;
-			I32 int_x = ((I32)x) & and_val;
-			texture_pixel += (int_x - prev_int_x);
-			prev_int_x = int_x;
+			R32 max_col = Clip(limit / dy, (R32)*first_col - 1.0f, (R32)*last_col + 1.0f);
+			*last_col = IntMin2(*last_col, -Floor(-max_col) - 1);
+		}
+		else if(dy < 0.0f)
+		{
+			R32 min_col = Clip(limit / dy, (R32)*first_col - 1.0f, (R32)*last_col + 1.0f);
+			*first_col = IntMax2(*first_col, Floor(min_col) + 1);
 		}
+		else if(limit <= 0.0f)
+		{
+			*last_col = *first_col - 1;
+		}
+		prev = i;
+	}
+}
 
-		y += add_y;
-		I32 int_y = ((I32)y) & and_val;
-		texture_row += (int_y - prev_int_y) << texture.log_side;
-		prev_int_y = int_y;
+static void
+func FillScreenWithWorldTexture(Canvas* canvas, Texture texture)
+{
+	ProfileFunction();
+	Bitmap bitmap = canvas->bitmap;
+	WorldTextureSampler sampler = GetWorldTextureSampler(canvas->camera, texture, WorldTextureScale);
+	for(I32 row = 0; row < bitmap.height; row++) 
+	{
+		SampleWorldTextureSpan(&sampler, bitmap, row, 0, bitmap.width - 1);
 	}
 }
 
@@ -902,83 +1227,14 @@ func DrawWorldTextureQuad(Canvas *canvas, Quad quad, Texture texture)
 	max_x = IntMin2(max_x, bitmap.width - 1);
 	min_y = IntMax2(min_y, 0);
 	max_y = IntMin2(max_y, bitmap.height - 1);
-    
-	R32 pixel_in_units = Invert(camera->unit_in_pixels);
-
-	R32 start_x = camera->center.x - (camera->screen_pixel_size.x * 0.5f * pixel_in_units);
-	R32 start_y = camera->center.y - (camera->screen_pixel_size.y * 0.5f * pixel_in_units);
-	start_x *= WorldTextureScale;
-	start_y *= WorldTextureScale;
-
-	R32 add_x = pixel_in_units;
-	R32 add_y = pixel_in_units;
-	add_x *= WorldTextureScale;
-	add_y *= WorldTextureScale;
-    
-    start_x += (min_x * add_x);
-    start_y += (min_y * add_y);
-    
-    I32 and_val = (texture.side - 1);
-
-	I32 start_int_x = ((I32)start_x) & and_val;
-	I32 start_int_y = ((I32)start_y) & and_val;
-
-	U32 *texture_row = texture.memory + (start_int_y << texture.log_side) + (start_int_x);
-	U32 *pixel_row = bitmap.memory + (bitmap.width * min_y) + (min_x);
-
-	R32 y = start_y;
-	I32 prev_int_y = ((I32)y) & and_val;
 
+	WorldTextureSampler sampler = GetWorldTextureSampler(camera, texture, WorldTextureScale);
 	for(I32 row = min_y; row < max_y; row++) 
 	{
-        R32 x = start_x;
-		I32 prev_int_x = ((I32)x & and_val);
-		U32 *texture_pixel = texture_row;
-		U32 *pixel = pixel_row;
-    
-		for(I32 col = min_x; col < max_x; col++) 
-		{
-			V2 test_point = {};
-            test_point.x = (R32)col;
-            test_point.y = (R32)row;
-
-			B32 draw_point = true;
-
-			if(!TurnsRight(points[0], points[1], test_point))
-			{
-				draw_point = false;
-			}
-			else if(!TurnsRight(points[1], points[2], test_point))
-			{
-				draw_point = false;
-			}
-			else if(!TurnsRight(points[2], points[3], test_point))
-			{
-				draw_point = false;
-			}
-			else if(!TurnsRight(points[3], points[0], test_point))
-			{
-				draw_point = false;
-			}
-
-			if(draw_point)
-			{
-                *pixel = *texture_pixel;
-			}
-            
-            pixel++;
-            
-            x += add_x;
-			I32 int_x = ((I32)x) & and_val;
-			texture_pixel += (int_x - prev_int_x);
-			prev_int_x = int_x;
-		}
-        
-        y += add_y;
-		I32 int_y = ((I32)y) & and_val;
-		texture_row += (int_y - prev_int_y) << texture.log_side;
-		pixel_row += (bitmap.width);
-		prev_int_y = int_y;
+		I32 first_col = min_x;
+		I32 last_col = max_x - 1;
+		ClipRowSpanToConvexPoly(points, 4, (R32)row, &first_col, &last_col);
+		SampleWorldTextureSpan(&sampler, bitmap, row, first_col, last_col);
 	}
 }
 
@@ -1045,64 +1301,10 @@ func WorldTextureRect(Canvas *canvas, R32 left, R32 right, R32 top, R32 bottom,
 	right_pixel  = IntMin2(right_pixel, bitmap.width - 1);
 
 	R32 texture_zoom = 16.0f;
-
-	V2 top_left_pixel = MakePoint((R32)left_pixel, (R32)top_pixel);
-	V2 top_left_unit = PixelToUnit(camera, top_left_pixel);
-	// NOTE: optimization stuff
-	top_left_unit.x *= texture_zoom;
-	top_left_unit.y *= texture_zoom;
-
-	R32 unit_per_pixel = Invert(camera->unit_in_pixels);
-	// NOTE: optimization stuff
-	unit_per_pixel *= texture_zoom;
-
-	I32 sub_unit_per_pixel = (I32)(unit_per_pixel * 255.0f);
-
-	U32 *top_left = bitmap.memory + top_pixel * bitmap.width + left_pixel;
-
-	// TODO: try to optimize this code
-	V2 world_unit = top_left_unit;
-	I32 leftx  = ((I32)world_unit.x) & (texture.side - 1);
-	I32 topy   = ((I32)world_unit.y) & (texture.side - 1);
-
-	I32 leftsubx = (I32)((world_unit.x - Floor(world_unit.x)) * 255.0f);
-	I32 topsuby = (I32)((world_unit.y - Floor(world_unit.y)) * 255.0f);
-
-	I32 x = leftx;
-	I32 y = topy;
-
-	I32 subx = leftsubx;
-	I32 suby = topsuby;
-
+	WorldTextureSampler sampler = GetWorldTextureSampler(camera, texture, texture_zoom);
 	for(I32 row = top_pixel; row < bottom_pixel; row++) 
 	{
-		x = leftx;
-		subx = leftsubx;
-
-		U32 *pixel = top_left;
-
-		for(I32 col = left_pixel; col < right_pixel; col++) 
-		{
-			*pixel = TextureColorCodeInt(texture, y, x);
-			//*pixel = TextureColorCode(texture, x, subx, y, suby);
-			pixel++;
-
-			subx += sub_unit_per_pixel;
-			if(subx > 0xFF) 
-			{
-				x = ((x + (subx >> 8)) & (texture.side - 1));
-				subx = (subx & 0xFF);
-			}
-		}
-
-		suby += sub_unit_per_pixel;
-		if(suby > 0xFF) 
-		{
-			y = ((y + (suby >> 8)) & (texture.side - 1));
-			suby = (suby & 0xFF);
-		}
-
-		top_left += bitmap.width;
+		SampleWorldTextureSpan(&sampler, bitmap, row, left_pixel, right_pixel - 1);
 	}
 }
 
@@ -1215,6 +1417,11 @@ func DrawWorldTexturePoly(Canvas *canvas, V2 *points, I32 point_n, Texture textu
 	Bitmap bitmap = canvas->bitmap;
 	Camera *camera = canvas->camera;
 
+	for(I32 i = 0; i < point_n; i++)
+	{
+		points[i] = UnitToPixel(camera, points[i]);
+	}
+
 	I32 min_x = bitmap.width;
 	I32 min_y = bitmap.height;
 	I32 max_x = 0;
@@ -1222,9 +1429,8 @@ func DrawWorldTexturePoly(Canvas *canvas, V2 *points, I32 point_n, Texture textu
 
 	for(I32 i = 0; i < point_n; i++) 
 	{
-		V2 point_in_pixels = UnitToPixel(camera, points[i]);
-		I32 point_x = I32(point_in_pixels.x);
-		I32 point_y = I32(point_in_pixels.y);
+		I32 point_x = I32(points[i].x);
+		I32 point_y = I32(points[i].y);
 		min_x = IntMin2(min_x, point_x);
 		max_x = IntMax2(max_x, point_x);
 		min_y = IntMin2(min_y, point_y);
@@ -1236,78 +1442,13 @@ func DrawWorldTexturePoly(Canvas *canvas, V2 *points, I32 point_n, Texture textu
 	min_y = IntMax2(min_y, 0);
 	max_y = IntMin2(max_y, bitmap.height - 1);
 
-	R32 pixel_in_units = Invert(camera->unit_in_pixels);
-    
-    R32 start_x = camera->center.x - (camera->screen_pixel_size.x * 0.5f * pixel_in_units);
-	R32 start_y = camera->center.y - (camera->screen_pixel_size.y * 0.5f * pixel_in_units);
-	start_x *= WorldTextureScale;
-	start_y *= WorldTextureScale;
-
-	R32 add_x = pixel_in_units;
-	R32 add_y = pixel_in_units;
-	add_x *= WorldTextureScale;
-	add_y *= WorldTextureScale;
-    
-    start_x += (min_x * add_x);
-    start_y += (min_y * add_y);
-    
-    I32 and_val = (texture.side - 1);
-
-	I32 start_int_x = ((I32)start_x) & and_val;
-	I32 start_int_y = ((I32)start_y) & and_val;
-
-	U32 *texture_row = texture.memory + (start_int_y << texture.log_side) + (start_int_x);
-	U32 *pixel_row = bitmap.memory + (bitmap.width * min_y) + (min_x);
-
-	R32 y = start_y;
-	I32 prev_int_y = (I32(y)) & and_val;
-
-	U32 *pixel = 0;
+	WorldTextureSampler sampler = GetWorldTextureSampler(camera, texture, WorldTextureScale);
 	for(I32 row = min_y; row <= max_y; row++) 
 	{
-        R32 x = start_x;
-		I32 prev_int_x = (I32(x) & and_val);
-		U32 *texture_pixel = texture_row;
-		U32 *pixel = pixel_row;
-    
-		for(I32 col = min_x; col <= max_x; col++) 
-		{
-            V2 test_point = {};
-            test_point.x = R32(col);
-            test_point.y = R32(row);
-
-			B32 draw_point = true;
-
-			I32 prev = point_n - 1;
-			for(I32 i = 0; i < point_n; i++) 
-			{
-				V2 prev_point = UnitToPixel(camera, points[prev]);
-				V2 this_point = UnitToPixel(camera, points[i]);
-				if(!TurnsRight(prev_point, this_point, test_point)) 
-				{
-					draw_point = false;
-					break;
-				}
-				prev = i;
-			}
-
-			if(draw_point)
-			{
-                *pixel = *texture_pixel;
-			}
-                
-            pixel++;
-            x += add_x;
-            I32 int_x = ((I32)x) & and_val;
-            texture_pixel += (int_x - prev_int_x);
-            prev_int_x = int_x;
-		}
-        
-        y += add_y;
-        I32 int_y = ((I32)y) & and_val;
-        texture_row += (int_y - prev_int_y) << texture.log_side;
-        pixel_row += (bitmap.width);
-        prev_int_y = int_y;
+		I32 first_col = min_x;
+		I32 last_col = max_x;
+		ClipRowSpanToConvexPoly(points, point_n, (R32)row, &first_col, &last_col);
+		SampleWorldTextureSpan(&sampler, bitmap, row, first_col, last_col);
 	}
 
 	for(I32 i = 0; i < point_n; i++)
@@ -1326,6 +1467,7 @@ func DrawQuadPoints(Canvas *canvas, V2 point1, V2 point2, V2 point3, V2 point4,
 static void
 func DrawBitmap(Canvas *canvas, Bitmap *bitmap, R32 left, R32 top)
 {
+	ProfileFunction();
 	Camera *camera = canvas->camera;
 	I32 pixel_left = UnitXtoPixel(camera, left);
 	I32 pixel_top  = UnitYtoPixel(camera, top);
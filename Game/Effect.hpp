@@ -25,7 +25,9 @@ enum EffectId
 	ImmuneToPoisonEffectId,
 	FeelingQuickEffectId,
 	IncreasedDamageDoneAndTakenEffectId,
-	BleedingEffectId
+	BleedingEffectId,
+
+	EffectN
 };
 
 static I8 *
@@ -151,7 +153,7 @@ static R32
 func EffectHasDuration(EffectId effect_id)
 {
 	B32 has_duration = true;
-	switch(effectId)
+	switch(effect_id)
 	{
 		case RegenerateEffectId:
 		{
@@ -0,0 +1,210 @@
+#pragma once
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Debug.hpp"
+#include "Memory.hpp"
+#include "Type.hpp"
+
+#define MaxFilePathSize 260
+
+// NOTE: Writes next to the file first and renames the written file over it in EndFileWriter,
+//       so a crash leaves either the old or the new file and never half of one.
+//       Failures do not assert, they make EndFileWriter return false and the caller decides whether it matters.
+struct FileWriter
+{
+	I8 file_path[MaxFilePathSize];
+	I8 temp_path[MaxFilePathSize + 8];
+#ifdef _WIN32
+	HANDLE file;
+#else
+	I32 file;
+#endif
+	U32 size;
+	B32 failed;
+};
+
+static B32
+func BeginFileWriter(FileWriter *writer, I8 *file_path)
+{
+	*writer = {};
+	I32 path_length = 0;
+	while(file_path[path_length] != 0)
+	{
+		Assert(path_length + 1 < MaxFilePathSize);
+		writer->file_path[path_length] = file_path[path_length];
+		writer->temp_path[path_length] = file_path[path_length];
+		path_length++;
+	}
+	I8 *temp_extension = ".tmp";
+	for(I32 i = 0; temp_extension[i] != 0; i++)
+	{
+		writer->temp_path[path_length + i] = temp_extension[i];
+	}
+
+#ifdef _WIN32
+	writer->file = CreateFileA(writer->temp_path, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	writer->failed = (writer->file == INVALID_HANDLE_VALUE);
+#else
+	writer->file = open(writer->temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	writer->failed = (writer->file < 0);
+#endif
+	return !writer->failed;
+}
+
+// NOTE: Writes size bytes at offset, which is at most the current size of the file.
+static void
+func WriteToFileAt(FileWriter *writer, U32 offset, void *data, U32 size)
+{
+	if(!writer->failed)
+	{
+		Assert(offset <= writer->size);
+#ifdef _WIN32
+		DWORD position = SetFilePointer(writer->file, (LONG)offset, 0, FILE_BEGIN);
+		DWORD written_size = 0;
+		BOOL written = WriteFile(writer->file, (LPCVOID)data, (DWORD)size, &written_size, 0);
+		writer->failed = (position != offset || !written || written_size != size);
+#else
+		U8 *bytes = (U8 *)data;
+		U32 written_size = 0;
+		while(!writer->failed && written_size < size)
+		{
+			ssize_t result = pwrite(writer->file, bytes + written_size, size - written_size, offset + written_size);
+			writer->failed = (result <= 0);
+			if(!writer->failed)
+			{
+				written_size += (U32)result;
+			}
+		}
+#endif
+		if(!writer->failed && offset + size > writer->size)
+		{
+			writer->size = offset + size;
+		}
+	}
+}
+
+static void
+func WriteToFile(FileWriter *writer, void *data, U32 size)
+{
+	WriteToFileAt(writer, writer->size, data, size);
+}
+
+static B32
+func EndFileWriter(FileWriter *writer)
+{
+	B32 succeeded = false;
+#ifdef _WIN32
+	if(writer->file != INVALID_HANDLE_VALUE)
+	{
+		BOOL flushed = FlushFileBuffers(writer->file);
+		CloseHandle(writer->file);
+		if(!writer->failed && flushed)
+		{
+			succeeded = MoveFileExA(writer->temp_path, writer->file_path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+		}
+	}
+#else
+	if(writer->file >= 0)
+	{
+		B32 flushed = (fsync(writer->file) == 0);
+		close(writer->file);
+		if(!writer->failed && flushed)
+		{
+			succeeded = (rename(writer->temp_path, writer->file_path) == 0);
+		}
+	}
+#endif
+	return succeeded;
+}
+
+static B32
+func WriteFileAtomically(I8 *file_path, void *data, U32 size)
+{
+	FileWriter writer = {};
+	BeginFileWriter(&writer, file_path);
+	WriteToFile(&writer, data, size);
+	B32 succeeded = EndFileWriter(&writer);
+	return succeeded;
+}
+
+// NOTE: Reads the whole file to the top of the arena and returns 0 if it cannot be read, the arena is then left as it was.
+static U8 *
+func ReadWholeFile(I8 *file_path, MemArena *arena, U32 *size)
+{
+	U8 *data = 0;
+	*size = 0;
+	TempMemory temp_memory = BeginTempMemory(arena);
+#ifdef _WIN32
+	HANDLE file = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if(file != INVALID_HANDLE_VALUE)
+	{
+		DWORD file_size = GetFileSize(file, 0);
+		if(file_size != INVALID_FILE_SIZE)
+		{
+			U8 *buffer = ArenaAllocArray(arena, U8, file_size);
+			DWORD read_size = 0;
+			BOOL read = ReadFile(file, (LPVOID)buffer, file_size, &read_size, 0);
+			if(read && read_size == file_size)
+			{
+				data = buffer;
+				*size = (U32)file_size;
+			}
+		}
+		CloseHandle(file);
+	}
+#else
+	I32 file = open(file_path, O_RDONLY);
+	if(file >= 0)
+	{
+		struct stat file_stat = {};
+		if(fstat(file, &file_stat) == 0)
+		{
+			U32 file_size = (U32)file_stat.st_size;
+			U8 *buffer = ArenaAllocArray(arena, U8, file_size);
+			U32 read_size = 0;
+			B32 failed = false;
+			while(!failed && read_size < file_size)
+			{
+				ssize_t result = read(file, buffer + read_size, file_size - read_size);
+				failed = (result <= 0);
+				if(!failed)
+				{
+					read_size += (U32)result;
+				}
+			}
+			if(!failed)
+			{
+				data = buffer;
+				*size = file_size;
+			}
+		}
+		close(file);
+	}
+#endif
+	if(data == 0)
+	{
+		EndTempMemory(temp_memory);
+	}
+	return data;
+}
+
+// NOTE: Succeeds if the directory already exists.
+static B32
+func CreateDirectoryIfMissing(I8 *directory_path)
+{
+#ifdef _WIN32
+	B32 succeeded = (CreateDirectoryA(directory_path, 0) || GetLastError() == ERROR_ALREADY_EXISTS);
+#else
+	B32 succeeded = (mkdir(directory_path, 0755) == 0 || errno == EEXIST);
+#endif
+	return succeeded;
+}
@@ -2,9 +2,25 @@
 
 #include "Item.hpp"
 #include "Map.hpp"
+#include "MapFile.hpp"
+#include "MapGen.hpp"
+#include "MapMigrate.hpp"
+#include "MapStream.hpp"
+#include "MemoryStats.hpp"
+#include "Pool.hpp"
+#include "Profiler.hpp"
+#include "ProfilerOverlay.hpp"
+#include "RenderScale.hpp"
 #include "UserInput.hpp"
 
-#define GameArenaSize (1 * MegaByte)
+// NOTE: Only reserved, pages are committed as the game allocates them.
+#define GameArenaSize (128 * MegaByte)
+// NOTE: A stream slot holds a chunk with its passability and region labels, about 21 KB, so 64 slots take about 1.3 MB.
+#define GameMapChunkSlotN 64
+#define GameMapStreamRadius (0.5f * MapChunkSide * MapTileSide)
+#define EntityMapStreamRadius (2.0f * MapTileSide)
+#define GameGeneratedMapSide 256
+#define GameGeneratedMapSeed 1
 
 struct SubTile
 {
@@ -145,22 +161,27 @@ func GetContainingSubTile(Map *map, V2 point)
 	return sub_tile;
 }
 
-#define MaxEntityN 1024
+// NOTE: Room for entities on top of the player and the npcs of the map.
+#define GameSpareEntityN 64
 
 struct Game
 {
-	I8 arena_memory[GameArenaSize];
 	MemArena arena;
 	Map map;
+	MapStream map_stream;
+	B32 is_map_streamed;
 
 	Inventory inventory;
 	B32 show_inventory;
+	B32 show_memory_stats;
+	B32 show_profiler;
+
+	RenderScale render_scale;
 
 	Inventory trade_inventory;
 	B32 show_trade_window;
 
-	Entity entities[MaxEntityN];
-	I32 entity_n;
+	Pool<Entity> entities;
 
 	Entity *player;
 
@@ -174,9 +195,9 @@ func SubTileIsOccupied(Game *game, SubTile sub_tile)
 	Assert(IsValidSubTile(map, sub_tile));
 
 	B32 is_occupied = false;
-	for(I32 i = 0; i < game->entity_n; i++)
+	for(I32 i = 0; i < game->entities.item_n; i++)
 	{
-		Entity *entity = &game->entities[i];
+		Entity *entity = GetPoolItemAt(&game->entities, i);
 		SubTile entity_sub_tile = GetContainingSubTile(map, entity->position);
 		if(SubTilesAreEqual(entity_sub_tile, sub_tile))
 		{
@@ -191,9 +212,7 @@ func SubTileIsOccupied(Game *game, SubTile sub_tile)
 static Entity *
 func AddEntity(Game *game, Entity entity)
 {
-	Assert(game->entity_n < MaxEntityN);
-	Entity *result = &game->entities[game->entity_n];
-	game->entity_n++;
+	Entity *result = AddPoolItem(&game->entities);
 	*result = entity;
 	return result;
 }
@@ -258,25 +277,71 @@ func GetRandomGroupId()
 	return id;
 }
 
+// NOTE: Used when the map file is missing or broken. The file is left alone, so nothing is lost if it can be fixed.
+static void
+func LoadGeneratedMap(Map *map, MemArena *arena)
+{
+	MemArena *scratch_arena = GetScratchArena();
+	TempMemory temp_memory = BeginTempMemory(scratch_arena);
+	MapGenParams params = GetDefaultMapGenParams(GameGeneratedMapSide, GameGeneratedMapSide, GameGeneratedMapSeed);
+	MapFileHeader *header = PushCaveMapFile(&params, scratch_arena);
+
+	MapFileView view = {};
+	view.base = (U8 *)header;
+	view.size = header->file_size;
+	Verify(LoadMapFromFileView(&view, arena, map));
+	EndTempMemory(temp_memory);
+}
+
 static void
 func GameInit(Game *game, Canvas *canvas)
 {
-	game->arena = CreateMemArena(game->arena_memory, GameArenaSize);
+	game->arena = CreateReservedMemArena(GameArenaSize);
+	TrackMemArena(&game->arena, "Game", GeneralMemoryTagId);
 
 	Camera *camera = canvas->camera;
 	camera->unit_in_pixels = 30;
 	camera->center = MakePoint(0.0, 0.0);
 
+	InitRenderScale(&game->render_scale, DefaultTargetFramesPerSecond);
+
 	Entity player = {};
 	player.position = MakePoint(0.5f * MapTileSide, 0.5f * MapTileSide);
 	player.velocity = MakeVector(0.0f, 0.0f);
 	player.max_health_points = 20;
 	player.health_points = player.max_health_points;
 	player.group_id = OrangeGroupId;
-	AddPlayer(game, player);
 
 	I8 *map_file = "Data/Map.data";
-	game->map = ReadMapFromFile(map_file, &game->arena); 
+	B32 is_map_file_valid = UpgradeMapFile(map_file, GetScratchArena());
+	if(is_map_file_valid && IsStreamableMapFile(map_file))
+	{
+		game->map = OpenMapStream(&game->map_stream, &game->map, map_file, &game->arena, GameMapChunkSlotN);
+		game->is_map_streamed = true;
+
+		BeginMapStreamFrame(&game->map_stream);
+		RequestMapChunksAround(&game->map_stream, player.position, GameMapStreamRadius);
+		EndMapStreamFrame(&game->map_stream);
+		FinishMapStreamLoading(&game->map_stream);
+	}
+	else
+	{
+		if(!is_map_file_valid || !LoadMapFromFile(map_file, &game->arena, &game->map))
+		{
+			LoadGeneratedMap(&game->map, &game->arena);
+		}
+		game->is_map_streamed = false;
+
+		Map *map = &game->map;
+		if(map->nav)
+		{
+			SetMapRegionLabels(map, map->nav->region_labels, map->nav->region_n, GetMaxMapRegionN(map), &game->arena);
+		}
+		else
+		{
+			InitMapRegions(map, &game->arena);
+		}
+	}
 	game->item_spawn_cooldowns = ArenaAllocArray(&game->arena, R32, game->map.item_n);
 
 	for(I32 i = 0; i < game->map.item_n; i++)
@@ -293,6 +358,8 @@ func GameInit(Game *game, Canvas *canvas)
 	game->show_trade_window = false;
 
 	Map *map = &game->map;
+	game->entities = CreatePool<Entity>(&game->arena, 1 + map->entity_n + GameSpareEntityN);
+	AddPlayer(game, player);
 	for(I32 i = 0; i < map->entity_n; i++)
 	{
 		MapEntity *map_entity = &map->entities[i];
@@ -379,13 +446,21 @@ func GetUpdatedEntityPosition(Game *game, Entity *entity, R32 seconds)
 		IV2 right_tile = GetContainingTile(map, GetEntityRight(entity));
 		right_tile.col++;
 
-		for(I32 row = top_tile.row; row <= bottom_tile.row; row++)
+		I32 first_col = IntMax2(left_tile.col, 0);
+		I32 last_col = IntMin2(right_tile.col, map->tile_col_n - 1);
+		I32 col_n = last_col - first_col + 1;
+		Assert(col_n <= 64);
+
+		if(col_n > 0 && AnySolidTileInRect(map, top_tile.row, first_col, bottom_tile.row, last_col))
 		{
-			for(I32 col = left_tile.col; col <= right_tile.col; col++)
+			for(I32 row = IntMax2(top_tile.row, 0); row <= IntMin2(bottom_tile.row, map->tile_row_n - 1); row++)
 			{
-				IV2 tile = MakeTile(row, col);
-				if(IsValidTile(map, tile) && IsTileType(map, tile, NoTileId))
+				U64 solid_mask = ~GetPassableRowMask(map, row, first_col, col_n) & GetLowBitMask(col_n);
+				while(solid_mask)
 				{
+					IV2 tile = MakeTile(row, first_col + GetLowestSetBitIndex(solid_mask));
+					solid_mask &= (solid_mask - 1);
+
 					Poly16 collision_poly = {};
 					Rect tile_rect = GetTileRect(map, tile);
 					Rect collision_rect = GetExtendedRect(tile_rect, EntityRadius);
@@ -606,6 +681,7 @@ func GetInventoryRect(Inventory *inventory)
 static void
 func DrawInventory(Canvas *canvas, Inventory *inventory)
 {
+	ProfileFunction();
 	Bitmap *bitmap = &canvas->bitmap;
 	GlyphData *glyph_data = canvas->glyph_data;
 	Assert(glyph_data != 0);
@@ -766,17 +842,25 @@ func UpdateNpcTarget(Game *game, Entity *npc)
 		target = 0;
 	}
 
+	Map *map = &game->map;
+	IV2 npc_tile = GetContainingTile(map, npc->position);
+	if(target && !SameRegion(map, npc_tile, GetContainingTile(map, target->position)))
+	{
+		target = 0;
+	}
+
 	R32 closest_distance = MaxAttackDistance;
 	if(!target)
 	{
-		for(I32 i = 0; i < game->entity_n; i++)
+		for(I32 i = 0; i < game->entities.item_n; i++)
 		{
-			Entity *entity = &game->entities[i];
+			Entity *entity = GetPoolItemAt(&game->entities, i);
 			if(entity != npc)
 			{
 				B32 is_alive = (entity->health_points > 0);
 				B32 is_enemy = IsEnemyOf(npc, entity);
-				if(is_alive && is_enemy)
+				B32 is_reachable = SameRegion(map, npc_tile, GetContainingTile(map, entity->position));
+				if(is_alive && is_enemy && is_reachable)
 				{
 					R32 distance = Distance(npc->position, entity->position);
 					if(distance <= closest_distance)
@@ -797,15 +881,20 @@ func GetNpcMoveDirection(Game *game, Entity *npc)
 {
 	V2 direction = {};
 	
+	Map *map = &game->map;
 	Entity *target = npc->target;
-	if(target)
+	if(target && SameRegion(map, GetContainingTile(map, npc->position), GetContainingTile(map, target->position)))
 	{
-		Map *map = &game->map;
-
 		SubTile base_sub_tile = GetContainingSubTile(map, npc->position);
 
 		SubTile top_left_sub_tile = OffsetSubTile(base_sub_tile, MakeIntPoint(-2, -2));
 
+		// NOTE: The 5x5 sub tile window touches at most 2x2 tiles.
+		IV2 top_left_tile = top_left_sub_tile.tile_index;
+		U64 passable_rows[2] = {};
+		passable_rows[0] = GetPassableRowMask(map, top_left_tile.row, top_left_tile.col, 2);
+		passable_rows[1] = GetPassableRowMask(map, top_left_tile.row + 1, top_left_tile.col, 2);
+
 		IV2 visited_offsets[5 * 5] = {};
 		I32 visited_n = 0;
 		B32 is_visited[5][5] = {};
@@ -842,8 +931,9 @@ func GetNpcMoveDirection(Game *game, Entity *npc)
 				}
 
 				SubTile sub_tile = OffsetSubTile(top_left_sub_tile, offset);
-				TileId tile_id = GetTileType(map, sub_tile.tile_index);
-				if(tile_id == NoTileId)
+				IV2 window_tile = sub_tile.tile_index - top_left_tile;
+				Assert(IsIntBetween(window_tile.row, 0, 1) && IsIntBetween(window_tile.col, 0, 1));
+				if(!((passable_rows[window_tile.row] >> window_tile.col) & 1))
 				{
 					continue;
 				}
@@ -903,6 +993,7 @@ func GetNpcMoveDirection(Game *game, Entity *npc)
 static void
 func UpdateNpc(Game *game, Entity *npc, R32 seconds)
 {
+	ProfileFunction();
 	if(npc->health_points > 0)
 	{
 		npc->recharge_time = ClipUpToZero(npc->recharge_time - seconds);
@@ -966,12 +1057,43 @@ func UpdateNpc(Game *game, Entity *npc, R32 seconds)
 	UpdateEntityMovementWithSubTileCollision(game, npc, seconds);
 }
 
+#define MemoryStatsOverlayWidth 480
+
+static void
+func DrawMemoryStatsOverlay(Canvas *canvas)
+{
+	ProfileFunction();
+	Bitmap *bitmap = &canvas->bitmap;
+	MemoryTagStats tag_stats[MemoryTagN] = {};
+	GetMemoryTagStats(tag_stats);
+
+	IntRect rect = {};
+	rect.left = UIBoxPadding;
+	rect.top = UIBoxPadding;
+	rect.right = rect.left + MemoryStatsOverlayWidth;
+	rect.bottom = rect.top + 2 * TooltipTopPadding + MemoryTagN * TextHeightInPixels;
+	DrawBitmapRect(bitmap, rect, MakeColor(0.0f, 0.0f, 0.0f));
+	DrawBitmapRectOutline(bitmap, rect, MakeColor(1.0f, 1.0f, 1.0f));
+
+	V4 text_color = MakeColor(1.0f, 1.0f, 1.0f);
+	I32 text_left = rect.left + TooltipPadding;
+	I32 text_top = rect.top + TooltipTopPadding;
+	I8 line[MemoryStatsLineSize];
+	for(I32 tag_id = 0; tag_id < MemoryTagN; tag_id++)
+	{
+		String string = StartString(line, MemoryStatsLineSize);
+		AddMemoryTagStatsLine(&string, (MemoryTagId)tag_id, &tag_stats[tag_id]);
+		DrawBitmapTextLineTopLeft(bitmap, line, canvas->glyph_data, text_left, text_top, text_color);
+		text_top += TextHeightInPixels;
+	}
+}
+
 static void
 func GameUpdate(Game *game, Canvas *canvas, R32 seconds, UserInput *user_input)
 {
+	ProfileFunction();
 	Bitmap *bitmap = &canvas->bitmap;
-	V4 background_color = MakeColor(0.0f, 0.0f, 0.0f);
-	FillBitmapWithColor(bitmap, background_color);
+	UpdateRenderScale(&game->render_scale, seconds);
 
 	Entity *player = game->player;
 	Assert(player != 0);
@@ -997,6 +1119,23 @@ func GameUpdate(Game *game, Canvas *canvas, R32 seconds, UserInput *user_input)
 		player->velocity.y += player_move_speed;
 	}
 
+	if(WasKeyReleased(user_input, VK_F3))
+	{
+		game->show_memory_stats = !game->show_memory_stats;
+	}
+	if(WasKeyReleased(user_input, VK_F4))
+	{
+		DumpMemoryStats("Data/MemoryStats.txt");
+	}
+	if(WasKeyReleased(user_input, VK_F5))
+	{
+		ToggleDynamicRenderScale(&game->render_scale);
+	}
+	if(WasKeyReleased(user_input, VK_F6))
+	{
+		game->show_profiler = !game->show_profiler;
+	}
+
 	if(WasKeyReleased(user_input, 'I'))
 	{
 		if(game->show_inventory)
@@ -1014,20 +1153,48 @@ func GameUpdate(Game *game, Canvas *canvas, R32 seconds, UserInput *user_input)
 	}
 
 	Map *map = &game->map;
+	UpdateMapRegions(map, GetScratchArena());
 	UpdateEntityMovementWithoutSubTileCollision(game, player, seconds);
 	canvas->camera->center = player->position;
 
-	DrawMapWithoutItems(canvas, map);
+	if(game->is_map_streamed)
+	{
+		MapStream *map_stream = &game->map_stream;
+		BeginMapStreamFrame(map_stream);
+		RequestMapChunksAround(map_stream, canvas->camera->center, GameMapStreamRadius);
+		for(I32 i = 0; i < game->entities.item_n; i++)
+		{
+			Entity *entity = GetPoolItemAt(&game->entities, i);
+			if(IsAlive(entity))
+			{
+				RequestMapChunksAround(map_stream, entity->position, EntityMapStreamRadius);
+			}
+		}
+		EndMapStreamFrame(map_stream);
+	}
+
+	Canvas *world_canvas = BeginWorldRender(&game->render_scale, canvas);
+	V4 background_color = MakeColor(0.0f, 0.0f, 0.0f);
+	FillBitmapWithColor(&world_canvas->bitmap, background_color);
+
+	DrawMapWithoutItems(world_canvas, map);
+	MemArena *scratch_arena = GetScratchArena();
+	TempMemory temp_memory = BeginTempMemory(scratch_arena);
+	V2 *item_positions = ArenaAllocArray(scratch_arena, V2, map->item_n);
+	I32 item_position_n = 0;
 	for(I32 i = 0; i < map->item_n; i++)
 	{
 		game->item_spawn_cooldowns[i] -= seconds;
 		if(game->item_spawn_cooldowns[i] <= 0.0f)
 		{		
-			DrawMapItem(canvas, &map->items[i]);
+			item_positions[item_position_n] = map->items[i].position;
+			item_position_n++;
 
 			game->item_spawn_cooldowns[i] = 0.0f;
 		}
 	}
+	DrawMapItemsAt(world_canvas, item_positions, item_position_n);
+	EndTempMemory(temp_memory);
 
 	I32 hover_item_index = 0;
 	MapItem *hover_item = 0;
@@ -1049,7 +1216,7 @@ func GameUpdate(Game *game, Canvas *canvas, R32 seconds, UserInput *user_input)
 	if(hover_item)
 	{
 		V4 hover_item_color = MakeColor(1.0f, 0.2f, 1.0f);
-		DrawCircle(canvas, hover_item->position, MapItemRadius, hover_item_color);
+		DrawCircle(world_canvas, hover_item->position, MapItemRadius, hover_item_color);
 
 		if(WasKeyReleased(user_input, 'E'))
 		{
@@ -1065,9 +1232,9 @@ func GameUpdate(Game *game, Canvas *canvas, R32 seconds, UserInput *user_input)
 
 		Entity *new_target = player->target;
 		R32 new_target_distance = max_target_distance;
-		for(I32 i = 0; i < game->entity_n; i++)
+		for(I32 i = 0; i < game->entities.item_n; i++)
 		{
-			Entity *entity = &game->entities[i];
+			Entity *entity = GetPoolItemAt(&game->entities, i);
 			if(entity != player && entity != player->target)
 			{
 				if(IsAlive(entity) && IsEnemyOf(player, entity))
@@ -1106,16 +1273,16 @@ func GameUpdate(Game *game, Canvas *canvas, R32 seconds, UserInput *user_input)
 		}
 	}
 
-	for(I32 i = 0; i < game->entity_n; i++)
+	for(I32 i = 0; i < game->entities.item_n; i++)
 	{
-		Entity *entity = &game->entities[i];
+		Entity *entity = GetPoolItemAt(&game->entities, i);
 		V4 color = GetEntityGroupColor(entity->group_id);
-		DrawEntity(canvas, entity, color);
+		DrawEntity(world_canvas, entity, color);
 
 		if(entity == player->target)
 		{
 			V4 highlight_color = MakeColor(1.0f, 1.0f, 0.0f);
-			HighlightEntity(canvas, entity, highlight_color);
+			HighlightEntity(world_canvas, entity, highlight_color);
 		}
 
 		if(entity != game->player)
@@ -1123,6 +1290,7 @@ func GameUpdate(Game *game, Canvas *canvas, R32 seconds, UserInput *user_input)
 			UpdateNpc(game, entity, seconds);
 		}
 	}
+	EndWorldRender(&game->render_scale, canvas, world_canvas);
 
 	if(player->recharge_time > 0.0f)
 	{
@@ -1198,4 +1366,16 @@ func GameUpdate(Game *game, Canvas *canvas, R32 seconds, UserInput *user_input)
 			}
 		}
 	}
+
+	if(game->show_memory_stats)
+	{
+		DrawMemoryStatsOverlay(canvas);
+	}
+
+#ifdef PROFILER_MODE
+	if(game->show_profiler)
+	{
+		DrawProfilerOverlay(canvas);
+	}
+#endif
 }
\ No newline at end of file
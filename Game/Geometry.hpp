@@ -61,6 +61,17 @@ struct IntRect
 	I32 bottom;
 };
 
+static IntRect
+func MakeIntRectLRTB(I32 left, I32 right, I32 top, I32 bottom)
+{
+	IntRect rect = {};
+	rect.left   = left;
+	rect.right  = right;
+	rect.top    = top;
+	rect.bottom = bottom;
+	return rect;
+}
+
 static IntRect
 func GetIntRectIntersection(IntRect rect1, IntRect rect2)
 {
@@ -0,0 +1,225 @@
+#pragma once
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HASH_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "Debug.hpp"
+#include "Type.hpp"
+
+// NOTE: Fast non-cryptographic 64-bit hash for checksums, in the style of XXH3.
+//       Data is consumed in 64 byte stripes by 8 accumulators. Every accumulator adds the product of
+//       the two halves of (data ^ secret) and the data of its neighbor lane. After every block of
+//       HashBlockStripeN stripes the accumulators are scrambled. The SSE2 and the scalar version
+//       compute exactly the same value, so files hashed on one machine check out on any other.
+//       Data can be added in pieces, the result only depends on the bytes and not on how they were split.
+
+#define HashStripeSize 64
+#define HashBlockStripeN 16
+#define HashPrime32 0x9E3779B1U
+#define HashPrime64a 0x9E3779B185EBCA87ULL
+#define HashPrime64b 0xC2B2AE3D27D4EB4FULL
+#define HashPrime64c 0x165667B19E3779F9ULL
+
+static U64 global_hash_secret[16] =
+{
+	0x529ED28196C194BFULL, 0xB92F5E7CF6C8D93BULL, 0x1ECB363FF3FE8045ULL, 0x7856CB89364210A0ULL,
+	0x4AE957C18A0E5FE0ULL, 0xB76EBD72444DB03CULL, 0x5946F6D10716A048ULL, 0x016B16252345C1F3ULL,
+	0x8B99D640B9CEA9D6ULL, 0x70B153AA4B48845FULL, 0xF4086205A48E2E61ULL, 0x8E7EE4384576FDCFULL,
+	0x13C0B72350D92072ULL, 0x628C83F7142DD61DULL, 0x40E3B449A4988A35ULL, 0x739F5D2F3ACED0E1ULL
+};
+
+struct HashState
+{
+	U64 accumulators[8];
+	U8 buffer[HashStripeSize];
+	U32 buffer_size;
+	U32 block_stripe_n;
+	U64 total_size;
+};
+
+static U64
+func ReadHashWord(U8 *data)
+{
+	U64 word = 0;
+	for(I32 i = 0; i < 8; i++)
+	{
+		word |= ((U64)data[i] << (8 * i));
+	}
+	return word;
+}
+
+static HashState
+func BeginHash()
+{
+	HashState state = {};
+	state.accumulators[0] = HashPrime32;
+	state.accumulators[1] = HashPrime64a;
+	state.accumulators[2] = HashPrime64b;
+	state.accumulators[3] = HashPrime64c;
+	state.accumulators[4] = HashPrime64a ^ HashPrime64b;
+	state.accumulators[5] = HashPrime64b ^ HashPrime64c;
+	state.accumulators[6] = HashPrime64c ^ HashPrime64a;
+	state.accumulators[7] = HashPrime32 ^ HashPrime64a;
+	return state;
+}
+
+#ifdef HASH_SSE2
+static void
+func AccumulateHashStripes(HashState *state, U8 *data, U32 stripe_n)
+{
+	__m128i accumulators[4] = {};
+	__m128i secrets[4] = {};
+	__m128i scramble_secrets[4] = {};
+	for(I32 i = 0; i < 4; i++)
+	{
+		accumulators[i] = _mm_loadu_si128((__m128i *)(state->accumulators + 2 * i));
+		secrets[i] = _mm_loadu_si128((__m128i *)(global_hash_secret + 2 * i));
+		scramble_secrets[i] = _mm_loadu_si128((__m128i *)(global_hash_secret + 8 + 2 * i));
+	}
+	__m128i prime = _mm_set1_epi32((I32)HashPrime32);
+
+	for(U32 stripe = 0; stripe < stripe_n; stripe++)
+	{
+		U8 *stripe_data = data + stripe * HashStripeSize;
+		for(I32 i = 0; i < 4; i++)
+		{
+			__m128i words = _mm_loadu_si128((__m128i *)(stripe_data + 16 * i));
+			__m128i keyed = _mm_xor_si128(words, secrets[i]);
+			__m128i products = _mm_mul_epu32(keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+			__m128i swapped = _mm_shuffle_epi32(words, _MM_SHUFFLE(1, 0, 3, 2));
+			accumulators[i] = _mm_add_epi64(accumulators[i], _mm_add_epi64(products, swapped));
+		}
+
+		state->block_stripe_n++;
+		if(state->block_stripe_n == HashBlockStripeN)
+		{
+			for(I32 i = 0; i < 4; i++)
+			{
+				__m128i value = _mm_xor_si128(accumulators[i], _mm_srli_epi64(accumulators[i], 47));
+				value = _mm_xor_si128(value, scramble_secrets[i]);
+				__m128i low = _mm_mul_epu32(value, prime);
+				__m128i high = _mm_mul_epu32(_mm_srli_epi64(value, 32), prime);
+				accumulators[i] = _mm_add_epi64(low, _mm_slli_epi64(high, 32));
+			}
+			state->block_stripe_n = 0;
+		}
+	}
+
+	for(I32 i = 0; i < 4; i++)
+	{
+		_mm_storeu_si128((__m128i *)(state->accumulators + 2 * i), accumulators[i]);
+	}
+}
+#else
+static void
+func AccumulateHashStripes(HashState *state, U8 *data, U32 stripe_n)
+{
+	U64 *accumulators = state->accumulators;
+	for(U32 stripe = 0; stripe < stripe_n; stripe++)
+	{
+		U8 *stripe_data = data + stripe * HashStripeSize;
+		for(I32 i = 0; i < 8; i++)
+		{
+			U64 word = ReadHashWord(stripe_data + 8 * i);
+			U64 keyed = word ^ global_hash_secret[i];
+			accumulators[i ^ 1] += word;
+			accumulators[i] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+		}
+
+		state->block_stripe_n++;
+		if(state->block_stripe_n == HashBlockStripeN)
+		{
+			for(I32 i = 0; i < 8; i++)
+			{
+				U64 value = accumulators[i] ^ (accumulators[i] >> 47);
+				value ^= global_hash_secret[8 + i];
+				accumulators[i] = value * HashPrime32;
+			}
+			state->block_stripe_n = 0;
+		}
+	}
+}
+#endif
+
+static void
+func UpdateHash(HashState *state, void *data, U32 size)
+{
+	U8 *bytes = (U8 *)data;
+	state->total_size += size;
+
+	if(state->buffer_size > 0)
+	{
+		while(size > 0 && state->buffer_size < HashStripeSize)
+		{
+			state->buffer[state->buffer_size] = *bytes;
+			state->buffer_size++;
+			bytes++;
+			size--;
+		}
+		if(state->buffer_size == HashStripeSize)
+		{
+			AccumulateHashStripes(state, state->buffer, 1);
+			state->buffer_size = 0;
+		}
+	}
+
+	U32 stripe_n = size / HashStripeSize;
+	AccumulateHashStripes(state, bytes, stripe_n);
+	bytes += stripe_n * HashStripeSize;
+	size -= stripe_n * HashStripeSize;
+
+	for(U32 i = 0; i < size; i++)
+	{
+		state->buffer[state->buffer_size] = bytes[i];
+		state->buffer_size++;
+	}
+}
+
+static U64
+func MixHashWords(U64 word1, U64 word2)
+{
+	U64 mixed = (word1 ^ ((word2 << 29) | (word2 >> 35))) * HashPrime64a;
+	mixed ^= (mixed >> 31);
+	return mixed;
+}
+
+// NOTE: The last partial stripe is padded with zeros, total_size tells it apart from real zeros.
+static U64
+func EndHash(HashState *state)
+{
+	if(state->buffer_size > 0)
+	{
+		for(U32 i = state->buffer_size; i < HashStripeSize; i++)
+		{
+			state->buffer[i] = 0;
+		}
+		AccumulateHashStripes(state, state->buffer, 1);
+		state->buffer_size = 0;
+	}
+
+	U64 hash = state->total_size * HashPrime64a;
+	for(I32 i = 0; i < 4; i++)
+	{
+		U64 word1 = state->accumulators[2 * i] ^ global_hash_secret[2 * i + 1];
+		U64 word2 = state->accumulators[2 * i + 1] ^ global_hash_secret[8 + 2 * i];
+		hash += MixHashWords(word1, word2);
+	}
+
+	hash ^= (hash >> 33);
+	hash *= HashPrime64b;
+	hash ^= (hash >> 29);
+	hash *= HashPrime64c;
+	hash ^= (hash >> 32);
+	return hash;
+}
+
+static U64
+func HashBytes(void *data, U32 size)
+{
+	HashState state = BeginHash();
+	UpdateHash(&state, data, size);
+	U64 hash = EndHash(&state);
+	return hash;
+}
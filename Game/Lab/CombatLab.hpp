@@ -1,24 +1,19 @@
 #pragma once
 
+#include "../AIScheduler.hpp"
 #include "../Ability.hpp"
+#include "../CombatRules.hpp"
 #include "../Effect.hpp"
 #include "../Item.hpp"
 #include "../Map.hpp"
+#include "../Pool.hpp"
+#include "../Profiler.hpp"
+#include "../ProfilerOverlay.hpp"
+#include "../Raycast.hpp"
 #include "../UserInput.hpp"
 
 #define EntityRadius 1.0f
 
-#define MaxLevel 5
-I32 MaxHealthAtLevel[] =
-{
-	0,
-	100,
-	150,
-	200,
-	250,
-	300
-};
-
 enum GroupId
 {
 	PlayerGroupId,
@@ -53,6 +48,17 @@ struct Entity
 	I32 constitution;
 	I32 dexterity;
 
+	ItemAttributes attribute_modifiers;
+	I32 effect_counts[EffectN];
+
+	B32 derived_stats_dirty;
+	I32 max_health;
+	R32 move_speed;
+	B32 has_reduced_damage_done;
+	B32 has_reduced_damage_taken;
+	B32 has_shield_raised;
+	B32 has_earth_shield;
+
 	I32 herbalism;
 
 	V2 input_direction;
@@ -94,11 +100,9 @@ struct HateTableEntry
 	I32 value;
 };
 
-#define MaxHateTableEntryN 64
 struct HateTable
 {
-	HateTableEntry entries[MaxHateTableEntryN];
-	I32 entry_n;
+	Pool<HateTableEntry> entries;
 };
 
 #define DroppedItemTotalDuration 10.0f
@@ -117,36 +121,24 @@ struct Flower
 };
 
 #define EntityN 256
-#define MaxAbilityCooldownN 64
-#define MaxItemCooldownN 64
-#define MaxEffectN 64
-#define MaxDamageDisplayN 64
 #define MaxCombatLogLineN 32
 #define MaxCombatLogLineLength 64
-#define MaxDroppedItemN 32
 #define MaxFlowerN 256
-#define CombatLabArenaSize (2 * MegaByte)
+#define CombatLabArenaSize (64 * MegaByte)
 
 struct CombatLabState
 {
-	I8 arena_memory[CombatLabArenaSize];
 	MemArena arena;
 
 	Map map;
 
-	AbilityCooldown ability_cooldowns[MaxAbilityCooldownN];
-	I32 ability_cooldown_n;
-
-	ItemCooldown item_cooldowns[MaxItemCooldownN];
-	I32 item_cooldown_n;
-
-	Effect effects[MaxEffectN];
-	I32 effect_n;
+	Pool<AbilityCooldown> ability_cooldowns;
+	Pool<ItemCooldown> item_cooldowns;
+	Pool<Effect> effects;
 
 	Entity entities[EntityN];
 
-	DroppedItem dropped_items[MaxDroppedItemN];
-	I32 dropped_item_n;
+	Pool<DroppedItem> dropped_items;
 
 	Flower flowers[MaxFlowerN];
 	I32 flower_n;
@@ -154,8 +146,7 @@ struct CombatLabState
 
 	DroppedItem *hover_dropped_item;
 
-	DamageDisplay damage_displays[MaxDamageDisplayN];
-	I32 damage_display_n;
+	Pool<DamageDisplay> damage_displays;
 
 	I8 combat_log_lines[MaxCombatLogLineN][MaxCombatLogLineLength + 1];
 	I32 combat_log_last_line_index;
@@ -163,22 +154,50 @@ struct CombatLabState
 
 	HateTable hate_table;
 
+	AIScheduler ai_scheduler;
+	LineOfSightCache line_of_sight_cache;
+
 	AbilityId hover_ability_id;
 
 	B32 show_character_info;
 	Inventory equip_inventory;
 
 	B32 show_inventory;
+	B32 show_profiler;
 	Inventory inventory;
 
 	InventoryItem hover_item;
 	InventoryItem drag_item;
 };
 
+struct CombatLabCapacities
+{
+	I32 ability_cooldown_n;
+	I32 item_cooldown_n;
+	I32 effect_n;
+	I32 dropped_item_n;
+	I32 damage_display_n;
+	I32 hate_table_entry_n;
+};
+
+static CombatLabCapacities
+func GetDefaultCombatLabCapacities()
+{
+	CombatLabCapacities capacities = {};
+	capacities.ability_cooldown_n = 64;
+	capacities.item_cooldown_n = 64;
+	capacities.effect_n = 64;
+	capacities.dropped_item_n = 32;
+	capacities.damage_display_n = 64;
+	capacities.hate_table_entry_n = 64;
+	return capacities;
+}
+
 #define EntityMoveSpeed 11.0f
 #define AnimalMoveSpeed 10.0f
 
 #define EnemyAttackRadius 10.0f
+#define EnemyPullDistance 30.0f
 
 #define MaxMeleeAttackDistance (4.0f * EntityRadius)
 #define MaxRangedAttackDistance (30.0f)
@@ -230,18 +249,143 @@ func FindEntityStartPosition(Map *map)
 	return start_position;
 }
 
+// NOTE: Attributes are the level plus the sum of the modifiers of every equipped item and active effect.
+//       Modifiers are added and removed one by one, so the attribute fields are always up to date,
+//       values derived from them are recalculated lazily.
+static void
+func UpdateEntityAttributes(Entity *entity)
+{
+	ItemAttributes *modifiers = &entity->attribute_modifiers;
+	entity->constitution = IntMax2(entity->level + modifiers->constitution, 0);
+	entity->strength     = IntMax2(entity->level + modifiers->strength, 0);
+	entity->intellect    = IntMax2(entity->level + modifiers->intellect, 0);
+	entity->dexterity    = IntMax2(entity->level + modifiers->dexterity, 0);
+	entity->derived_stats_dirty = true;
+}
+
+static void
+func AddAttributeModifier(Entity *entity, ItemAttributes attributes, I32 sign)
+{
+	Assert(sign == 1 || sign == -1);
+	ItemAttributes *modifiers = &entity->attribute_modifiers;
+	modifiers->constitution += sign * attributes.constitution;
+	modifiers->strength     += sign * attributes.strength;
+	modifiers->intellect    += sign * attributes.intellect;
+	modifiers->dexterity    += sign * attributes.dexterity;
+	UpdateEntityAttributes(entity);
+}
+
+static ItemAttributes
+func GetEffectAttributes(EffectId effect_id)
+{
+	ItemAttributes attributes = {};
+	switch(effect_id)
+	{
+		case IntellectPotionEffectId:
+		{
+			attributes.intellect = 10;
+			break;
+		}
+		case FeelingSmartEffectId:
+		{
+			attributes.intellect = 10;
+			attributes.strength = -10;
+			break;
+		}
+		case FeelingStrongEffectId:
+		{
+			attributes.strength = 10;
+			attributes.intellect = -10;
+			break;
+		}
+		case FeelingQuickEffectId:
+		{
+			attributes.constitution = 10;
+			attributes.dexterity = 10;
+			break;
+		}
+	}
+	return attributes;
+}
+
+static void
+func UpdateEntityDerivedStats(Entity *entity)
+{
+	entity->max_health = GetMaxHealth(entity->level, entity->constitution);
+
+	switch(entity->class_id)
+	{
+		case SnakeClassId:
+		case CrocodileClassId:
+		{
+			entity->move_speed = AnimalMoveSpeed;
+			break;
+		}
+		default:
+		{
+			entity->move_speed = EntityMoveSpeed;
+		}
+	}
+	if(entity->effect_counts[BittenEffectId] > 0)
+	{
+		entity->move_speed *= 0.5f;
+	}
+
+	// NOTE: The damage reductions are cached as the steps ReduceDamageDone and ReduceDamageTaken apply,
+	//       a single multiplier would round differently from CombatSim.
+	entity->has_reduced_damage_done  = (entity->effect_counts[ReducedDamageDoneAndTakenEffectId] > 0);
+	entity->has_reduced_damage_taken = (entity->effect_counts[ReducedDamageDoneAndTakenEffectId] > 0);
+	entity->has_shield_raised        = (entity->effect_counts[ShieldRaisedEffectId] > 0);
+	entity->has_earth_shield         = (entity->effect_counts[EarthShieldEffectId] > 0);
+
+	entity->derived_stats_dirty = false;
+}
+
+static void
+func UpdateEntityDerivedStatsIfDirty(Entity *entity)
+{
+	if(entity->derived_stats_dirty)
+	{
+		UpdateEntityDerivedStats(entity);
+	}
+}
+
+static void
+func AddEntityEffectStats(Entity *entity, EffectId effect_id)
+{
+	entity->effect_counts[effect_id]++;
+	AddAttributeModifier(entity, GetEffectAttributes(effect_id), +1);
+}
+
+static void
+func RemoveEntityEffectStats(Entity *entity, EffectId effect_id)
+{
+	Assert(entity->effect_counts[effect_id] > 0);
+	entity->effect_counts[effect_id]--;
+	AddAttributeModifier(entity, GetEffectAttributes(effect_id), -1);
+}
+
 static I32
 func GetEntityMaxHealth(Entity *entity)
 {
-	Assert(IsIntBetween(entity->level, 1, 5));
-	I32 max_health = MaxHealthAtLevel[entity->level] + entity->constitution * 10;
+	UpdateEntityDerivedStatsIfDirty(entity);
+	I32 max_health = entity->max_health;
 	return max_health;
 }
 
 static void
 func CombatLabInit(CombatLabState *lab_state, Canvas *canvas)
 {
-	lab_state->arena = CreateMemArena(lab_state->arena_memory, CombatLabArenaSize);
+	lab_state->arena = CreateReservedMemArena(CombatLabArenaSize);
+
+	MemArena *arena = &lab_state->arena;
+	CombatLabCapacities capacities = GetDefaultCombatLabCapacities();
+	lab_state->ability_cooldowns = CreatePool<AbilityCooldown>(arena, capacities.ability_cooldown_n);
+	lab_state->item_cooldowns = CreatePool<ItemCooldown>(arena, capacities.item_cooldown_n);
+	lab_state->effects = CreatePool<Effect>(arena, capacities.effect_n);
+	lab_state->dropped_items = CreatePool<DroppedItem>(arena, capacities.dropped_item_n);
+	lab_state->damage_displays = CreatePool<DamageDisplay>(arena, capacities.damage_display_n);
+	lab_state->hate_table.entries = CreatePool<HateTableEntry>(arena, capacities.hate_table_entry_n);
 
 	Map *map = &lab_state->map;
 
@@ -263,10 +407,7 @@ func CombatLabInit(CombatLabState *lab_state, Canvas *canvas)
 	player->class_id = DruidClassId;
 	player->group_id = PlayerGroupId;
 
-	player->strength = 1;
-	player->constitution = 1;
-	player->dexterity = 1;
-	player->intellect = 1;
+	UpdateEntityAttributes(player);
 
 	player->herbalism = 1;
 
@@ -279,10 +420,20 @@ func CombatLabInit(CombatLabState *lab_state, Canvas *canvas)
 		enemy->position = GetTileCenter(map, tile);
 
 		enemy->group_id = EnemyGroupId;
+		enemy->level = 1;
+		UpdateEntityAttributes(enemy);
 		enemy->health = GetEntityMaxHealth(enemy);
 	}
 
-	MemArena *arena = &lab_state->arena;
+	AIScheduler *ai_scheduler = &lab_state->ai_scheduler;
+	*ai_scheduler = CreateAIScheduler(arena, EntityN, map_width, map_height, EnemyPullDistance);
+	ai_scheduler->nearby_distance = 2.0f * EnemyPullDistance;
+
+	lab_state->line_of_sight_cache = CreateLineOfSightCache(arena, 10);
+	for(I32 i = 1; i < EntityN; i++)
+	{
+		MoveAIAgent(ai_scheduler, i, lab_state->entities[i].position);
+	}
 
 	Inventory *inventory = &lab_state->inventory;
 	InitInventory(inventory, arena, 3, 4);
@@ -293,12 +444,12 @@ func CombatLabInit(CombatLabState *lab_state, Canvas *canvas)
 
 	Inventory *equip_inventory = &lab_state->equip_inventory;
 	InitInventory(equip_inventory, arena, 1, 6);
-	SetInventorySlotId(equip_inventory, 0, 0, HeadSlotId);
-	SetInventorySlotId(equip_inventory, 0, 1, ChestSlotId);
-	SetInventorySlotId(equip_inventory, 0, 2, HandsSlotId);
-	SetInventorySlotId(equip_inventory, 0, 3, WaistSlotId);
-	SetInventorySlotId(equip_inventory, 0, 4, LegsSlotId);
-	SetInventorySlotId(equip_inventory, 0, 5, FeetSlotId);
+	SetInventorySlotId(equip_inventory, MakeIntPoint(0, 0), HeadSlotId);
+	SetInventorySlotId(equip_inventory, MakeIntPoint(0, 1), ChestSlotId);
+	SetInventorySlotId(equip_inventory, MakeIntPoint(0, 2), HandsSlotId);
+	SetInventorySlotId(equip_inventory, MakeIntPoint(0, 3), WaistSlotId);
+	SetInventorySlotId(equip_inventory, MakeIntPoint(0, 4), LegsSlotId);
+	SetInventorySlotId(equip_inventory, MakeIntPoint(0, 5), FeetSlotId);
 
 	lab_state->flower_n = MaxFlowerN;
 	for(I32 i = 0; i < lab_state->flower_n; i++)
@@ -312,12 +463,12 @@ func CombatLabInit(CombatLabState *lab_state, Canvas *canvas)
 #define TileGridColor MakeColor(0.2f, 0.2f, 0.2f)
 
 static B32
-func AbilityIsOnCooldown(CombatLabState *labState, Entity *entity, AbilityId ability_id)
+func AbilityIsOnCooldown(CombatLabState *lab_state, Entity *entity, AbilityId ability_id)
 {
 	B32 is_on_cooldown = false;
-	for(I32 i = 0; i < labState->ability_cooldown_n; i++)
+	for(I32 i = 0; i < lab_state->ability_cooldowns.item_n; i++)
 	{
-		AbilityCooldown *cooldown = &labState->ability_cooldowns[i];
+		AbilityCooldown *cooldown = GetPoolItemAt(&lab_state->ability_cooldowns, i);
 		if(cooldown->entity == entity && cooldown->ability_id == ability_id)
 		{
 			is_on_cooldown = true;
@@ -337,16 +488,7 @@ func IsDead(Entity *entity)
 static B32
 func HasEffect(CombatLabState *lab_state, Entity *entity, EffectId effect_id)
 {
-	B32 has_effect = false;
-	for(I32 i = 0; i < lab_state->effect_n; i++)
-	{
-		Effect *effect = &lab_state->effects[i];
-		if(effect->entity == entity && effect->effect_id == effect_id)
-		{
-			has_effect = true;
-			break;
-		}
-	}
+	B32 has_effect = (entity->effect_counts[effect_id] > 0);
 	return has_effect;
 }
 
@@ -385,7 +527,7 @@ func AbilityIsEnabled(CombatLabState *lab_state, Entity *entity, AbilityId abili
 	}
 	else
 	{
-		switch(abilityId)
+		switch(ability_id)
 		{
 			case SmallPunchAbilityId:
 			case BigPunchAbilityId:
@@ -408,12 +550,13 @@ func AbilityIsEnabled(CombatLabState *lab_state, Entity *entity, AbilityId abili
 			case EarthShakeAbilityId:
 			case BurnAbilityId:
 			{
-				enabled = has_living_enemy_target && (distance_from_target <= MaxRangedAttackDistance);
+				enabled = has_living_enemy_target && (distance_from_target <= MaxRangedAttackDistance) &&
+						  HasLineOfSight(&lab_state->map, entity->position, target->position);
 				break;
 			}
 			case HealAbilityId:
 			{
-				Map* map = &labState->map;
+				Map* map = &lab_state->map;
 				IV2 entity_tile = GetContainingTile(map, entity->position);
 				enabled = (has_living_friendly_target);
 				break;
@@ -511,9 +654,7 @@ func CanTakeDamage(CombatLabState *lab_state, Entity* entity)
 static void
 func AddDamageDisplay(CombatLabState *lab_state, V2 position, I32 damage)
 {
-	Assert(lab_state->damageDisplayN < MaxDamageDisplayN);
-	DamageDisplay *display = &lab_state->damageDisplays[labState->damage_display_n];
-	lab_state->damage_display_n++;
+	DamageDisplay *display = AddPoolItem(&lab_state->damage_displays);
 	display->position = position;
 	display->damage = damage;
 	display->time_remaining = DamageDisplayDuration;
@@ -523,9 +664,9 @@ static HateTableEntry *
 func GetHateTableEntry(HateTable *hate_table, Entity* source, Entity* target)
 {
 	HateTableEntry *result = 0;
-	for(I32 i = 0; i < hate_table->entry_n; i++)
+	for(I32 i = 0; i < hate_table->entries.item_n; i++)
 	{
-		HateTableEntry *entry = &hate_table->entries[i];
+		HateTableEntry *entry = GetPoolItemAt(&hate_table->entries, i);
 		if(entry->source == source && entry->target == target)
 		{
 			result = entry;
@@ -536,12 +677,10 @@ func GetHateTableEntry(HateTable *hate_table, Entity* source, Entity* target)
 }
 
 static HateTableEntry *
-func AddEmptyHateTableEntry(HateTable *hate-table, Entity *source, Entity *target)
+func AddEmptyHateTableEntry(HateTable *hate_table, Entity *source, Entity *target)
 {
 	Assert(GetHateTableEntry(hate_table, source, target) == 0);
-	Assert(hate_table->entry_n < MaxHateTableEntryN);
-	HateTableEntry *entry = &hate_table->entries[hateTable->entry_n];
-	hateTable->entry_n++;
+	HateTableEntry *entry = AddPoolItem(&hate_table->entries);
 
 	entry->source = source;
 	entry->target = target;
@@ -577,7 +716,7 @@ func GetVisibleItemId(CombatLabState *lab_state, ItemId item_id)
 		case BlueFlowerOfHealingItemId:
 		case BlueFlowerOfDampeningItemId:
 		{
-			visible_item_id = (herbalism >= 5) ? item_Id : BlueFlowerItemId;
+			visible_item_id = (herbalism >= 5) ? item_id : BlueFlowerItemId;
 			break;
 		}
 		case RedFlowerOfStrengthItemId:
@@ -605,7 +744,7 @@ func GetVisibleItemId(CombatLabState *lab_state, ItemId item_id)
 }
 
 static I8 *
-func GetVisibleItemName(CombatLabState *lab_state, ItemId itemId)
+func GetVisibleItemName(CombatLabState *lab_state, ItemId item_id)
 {
 	ItemId visible_item_id = GetVisibleItemId(lab_state, item_id);
 	I8 *name = GetItemName(visible_item_id);
@@ -618,13 +757,11 @@ func DropItem(CombatLabState *lab_state, Entity* entity, ItemId item_id)
 	Assert(item_id != NoItemId);
 
 	DroppedItem item = {};
-	item.item_id = itemId;
+	item.item_id = item_id;
 	item.position = entity->position;
 	item.time_left = DroppedItemTotalDuration;
 
-	Assert(lab_state->dropped_item_n + 1 < MaxDroppedItemN);
-	lab_state->dropped_items[lab_state->dropped_item_n] = item;
-	lab_state->dropped_item_n++;
+	*AddPoolItem(&lab_state->dropped_items) = item;
 
 	I8 *item_name = GetVisibleItemName(lab_state, item_id);
 	CombatLog(lab_state, entity->name + " drops " + item_name + ".");
@@ -661,10 +798,7 @@ func LevelUp(Entity *entity)
 {
 	Assert(IsIntBetween(entity->level, 1, MaxLevel - 1));
 	entity->level++;
-	entity->intellect++;
-	entity->strength++;
-	entity->dexterity++;
-	entity->constitution++;
+	UpdateEntityAttributes(entity);
 }
 
 static I32
@@ -675,24 +809,12 @@ func GetFinalDamage(CombatLabState *lab_state, Entity *source, Entity *target, I
 
 	if(source)
 	{
-		if(HasEffect(lab_state, source, ReducedDamageDoneAndTakenEffectId))
-		{
-			final_damage -= final_damage / 5;
-		}
-	}
-
-	if(HasEffect(lab_state, target, ReducedDamageDoneAndTakenEffectId))
-	{
-		final_damage -= final_damage / 5;
-	}
-	if(HasEffect(lab_state, target, ShieldRaisedEffectId))
-	{
-		final_damage -= final_damage / 2;
-	}
-	if(HasEffect(lab_state, target, EarthShieldEffectId))
-	{
-		final_damage -= final_damage / 10;
+		UpdateEntityDerivedStatsIfDirty(source);
+		final_damage = ReduceDamageDone(final_damage, source->has_reduced_damage_done);
 	}
+	UpdateEntityDerivedStatsIfDirty(target);
+	final_damage = ReduceDamageTaken(final_damage, target->has_reduced_damage_taken,
+									 target->has_shield_raised, target->has_earth_shield);
 	return final_damage;
 }
 
@@ -768,7 +890,7 @@ func Heal(CombatLabState *lab_state, Entity *source, Entity *target, I32 healing
 {
 	Assert(CanBeHealed(target));
 	Assert(!IsDead(source));
-	Assert(source->groupId == target->group_id);
+	Assert(source->group_id == target->group_id);
 	I32 max_health = GetEntityMaxHealth(target);
 	target->health = IntMin2(target->health + healing, max_health);
 	AddDamageDisplay(lab_state, target->position, -healing);
@@ -799,9 +921,7 @@ func AddAbilityCooldown(CombatLabState *lab_state, Entity *entity, AbilityId abi
 	R32 duration = GetAbilityCooldownDuration(ability_id);
 
 	Assert(duration > 0.0f);
-	Assert(lab_state->ability_cooldown_n < MaxAbilityCooldownN);
-	AbilityCooldown* cooldown = &lab_state->ability_cooldowns[lab_state->ability_cooldown_n];
-	lab_state->ability_cooldown_n++;
+	AbilityCooldown* cooldown = AddPoolItem(&lab_state->ability_cooldowns);
 
 	cooldown->entity = entity;
 	cooldown->ability_id = ability_id;
@@ -812,9 +932,9 @@ static AbilityCooldown *
 func GetAbilityCooldown(CombatLabState *lab_state, Entity *entity, AbilityId ability_id)
 {
 	AbilityCooldown *result = 0;
-	for(I32 i = 0; i < labState->ability_cooldown_n; i++)
+	for(I32 i = 0; i < lab_state->ability_cooldowns.item_n; i++)
 	{
-		AbilityCooldown *cooldown = &lab_state->ability_cooldowns[i];
+		AbilityCooldown *cooldown = GetPoolItemAt(&lab_state->ability_cooldowns, i);
 		if(cooldown->entity == entity && cooldown->ability_id == ability_id)
 		{
 			result = cooldown;
@@ -882,90 +1002,22 @@ func GetClosestMoveDirection(V2 distance)
 	return direction;
 }
 
-static void
-func RecalculatePlayerAttributes(CombatLabState *lab_state)
-{
-	Entity *player = &lab_state->entities[0];
-	Assert(IsIntBetween(player->level, 1, MaxLevel));
-
-	player->constitution = player->level;
-	player->strength     = player->level;
-	player->intellect    = player->level;
-	player->dexterity    = player->level;
-
-	Inventory *equip_inventory = &labState->equip_inventory;
-	for(I32 row = 0; row < equip_inventory->rowN; row++)
-	{
-		for(I32 col = 0; col < equip_inventory->colN; col++)
-		{
-			ItemId item_id = GetInventoryItemId(equip_inventory, row, col);
-			if(item_id != NoItemId)
-			{
-				ItemAttributes attributes = GetItemAttributes(itemId);
-				player->constitution += attributes.constitution;
-				player->strength     += attributes.strength;
-				player->intellect    += attributes.intellect;
-				player->dexterity    += attributes.dexterity;
-			}
-		}
-	}
-
-	for(I32 i = 0; i < lab_state->effect_n; i++)
-	{
-		Effect *effect = &lab_state->effects[i];
-		if(effect->entity == player)
-		{
-			switch(effect->effect_id)
-			{
-				case IntellectPotionEffectId:
-				{
-					player->intellect += 10;
-					break;
-				}
-				case FeelingSmartEffectId:
-				{
-					player->intellect += 10;
-					player->strength -= 10;
-					player->strength = IntMax2(player->strength, 0);
-					break;
-				}
-				case FeelingStrongEffectId:
-				{
-					player->strength += 10;
-					player->intellect -= 10;
-					player->intellect = IntMax2(player->intellect, 0);
-					break;
-				}
-				case FeelingQuickEffectId:
-				{
-					player->constitution += 10;
-					player->dexterity += 10;
-					break;
-				}
-			}
-		}
-	}
-}
-
 static void
 func RemoveEffect(CombatLabState *lab_state, Entity *entity, EffectId effect_id)
 {
-	I32 remaining_effect_n = 0;
-	for(I32 i = 0; i < lab_state->effect_n; i++)
+	Pool<Effect> *effects = &lab_state->effects;
+	for(I32 i = 0; i < effects->item_n;)
 	{
-		Effect *effect = &lab_state->effects[i];
+		Effect *effect = GetPoolItemAt(effects, i);
 		if(effect->entity != entity || effect->effect_id != effect_id)
 		{
-			lab_state->effects[remaining_effect_n] = *effect;
-			remaining_effect_n++;
+			i++;
+		}
+		else
+		{
+			RemoveEntityEffectStats(entity, effect_id);
+			RemovePoolItemAt(effects, i);
 		}
-	}
-	lab_state->effectN = remaining_effect_n;
-
-	Entity *player = &lab_state->entities[0];
-	if(entity == player)
-	{
-		RecalculatePlayerAttributes(lab_state);
 	}
 }
 
@@ -993,9 +1045,7 @@ static void
 func AddEffect(CombatLabState *lab_state, Entity *entity, EffectId effect_id)
 {
 	Assert(CanAddEffect(lab_state, entity, effect_id));
-	Assert(lab_state->effect_n < MaxEffectN);
-	Effect *effect = &lab_state->effects[lab_state->effect_n];
-	lab_state->effect_n++;
+	Effect *effect = AddPoolItem(&lab_state->effects);
 
 	effect->entity = entity;
 	effect->effect_id = effect_id;
@@ -1007,11 +1057,7 @@ func AddEffect(CombatLabState *lab_state, Entity *entity, EffectId effect_id)
 		effect->time_remaining = duration;
 	}
 
-	Entity *player = &lab_state->entities[0];
-	if(entity == player)
-	{
-		RecalculatePlayerAttributes(lab_state);
-	}
+	AddEntityEffectStats(entity, effect_id);
 
 	I8 *effect_name = GetEffectName(effect_id);
 	CombatLog(lab_state, entity->name + " gets " + effect_name + ".");
@@ -1021,9 +1067,9 @@ static void
 func ResetOrAddEffect(CombatLabState *lab_state, Entity *entity, EffectId effect_id)
 {
 	B32 found_effect = false;
-	for(I32 i = 0; i < lab_state->effect_n; i++)
+	for(I32 i = 0; i < lab_state->effects.item_n; i++)
 	{
-		Effect *effect = &lab_state->effects[i];
+		Effect *effect = GetPoolItemAt(&lab_state->effects, i);
 		if(effect->entity == entity && effect->effect_id == effect_id)
 		{
 
@@ -1050,60 +1096,7 @@ func ResetOrAddEffect(CombatLabState *lab_state, Entity *entity, EffectId effect
 static I32
 func GetAbilityDamage(Entity *entity, AbilityId ability_id)
 {
-	I32 damage = 0;
-	switch(ability_Id)
-	{
-		case LightningAbilityId:
-		{
-			damage = 20 + entity->intellect;
-			break;
-		}
-		case SmallPunchAbilityId:
-		{
-			damage = 10 + entity->strength;
-			break;
-		}
-		case BigPunchAbilityId:
-		{
-			damage = 30 + entity->strength;
-			break;
-		}
-		case SpinningKickAbilityId:
-		{
-			damage = 5 + entity->strength;
-			break;
-		}
-		case SwordStabAbilityId:
-		{
-			damage = 15 + entity->strength;
-			break;
-		}
-		case SwordSwingAbilityId:
-		{
-			damage = 10 + entity->strength;
-			break;
-		}
-		case SnakeStrikeAbilityId:
-		{
-			damage = 10 + entity->strength;
-			break;
-		}
-		case CrocodileBiteAbilityId:
-		{
-			damage = 15 + entity->strength;
-			break;
-		}
-		case CrocodileLashAbilityId:
-		{
-			damage = 30 + entity->strength;
-			break;
-		}
-		case TigerBiteAbilityId:
-		{
-			damage = 25 + entity->strength;
-			break;
-		}
-	}
+	I32 damage = GetAbilityBaseDamage(ability_id, entity->strength, entity->intellect);
 	return damage;
 }
 
@@ -1138,7 +1131,7 @@ func UseInstantAbility(CombatLabState *lab_state, Entity *entity, AbilityId abil
 		{
 			Assert(has_friendly_target && !IsDead(target));
 			ResetOrAddEffect(lab_state, target, EarthShieldEffectId);
-			target->absorb_damage += 50;
+			target->absorb_damage += EarthShieldAbsorbDamage;
 			break;
 		}
 		case BigPunchAbilityId:
@@ -1174,7 +1167,7 @@ func UseInstantAbility(CombatLabState *lab_state, Entity *entity, AbilityId abil
 		case RollAbilityId:
 		{
 			R32 move_speed = 20.0f;
-			entity->velocity = moveSpeed * GetClosestMoveDirection(entity->input_direction);
+			entity->velocity = move_speed * GetClosestMoveDirection(entity->input_direction);
 			AddEffect(lab_state, entity, RollingEffectId);
 			break;
 		}
@@ -1187,8 +1180,8 @@ func UseInstantAbility(CombatLabState *lab_state, Entity *entity, AbilityId abil
 		{
 			if(HasEffect(lab_state, entity, BlessingOfTheSunEffectId))
 			{
-				damage += 2;
-				Heal(lab_state, entity, entity, 2);
+				damage += BlessingOfTheSunBonusDamage;
+				Heal(lab_state, entity, entity, BlessingOfTheSunBonusHealing);
 			}
 
 			Assert(has_enemy_target);
@@ -1199,8 +1192,8 @@ func UseInstantAbility(CombatLabState *lab_state, Entity *entity, AbilityId abil
 		{
 			if(HasEffect(lab_state, entity, BlessingOfTheSunEffectId))
 			{
-				damage += 2;
-				Heal(lab_state, entity, entity, 2);
+				damage += BlessingOfTheSunBonusDamage;
+				Heal(lab_state, entity, entity, BlessingOfTheSunBonusHealing);
 			}
 
 			for(I32 i = 0; i < EntityN; i++)
@@ -1222,13 +1215,13 @@ func UseInstantAbility(CombatLabState *lab_state, Entity *entity, AbilityId abil
 			AddEffect(lab_state, entity, ShieldRaisedEffectId);
 			if(HasEffect(lab_state, entity, BlessingOfTheSunEffectId))
 			{
-				Heal(lab_state, entity, entity, 10);
+				Heal(lab_state, entity, entity, BlessingOfTheSunShieldHealing);
 			}
 			break;
 		}
 		case BurnAbilityId:
 		{
-			Assert(hasEnemyTarget);
+			Assert(has_enemy_target);
 			AddEffect(lab_state, target, BurningEffectId);
 			break;
 		}
@@ -1240,7 +1233,7 @@ func UseInstantAbility(CombatLabState *lab_state, Entity *entity, AbilityId abil
 		}
 		case MercyOfTheSunAbilityId:
 		{
-			Heal(lab_state, entity, entity, 30);
+			Heal(lab_state, entity, entity, GetAbilityHealing(ability_id));
 			for(I32 i = 0; i < EntityN; i++)
 			{
 				Entity* target = &lab_state->entities[i];
@@ -1249,7 +1242,7 @@ func UseInstantAbility(CombatLabState *lab_state, Entity *entity, AbilityId abil
 					R32 distance = Distance(entity->position, target->position);
 					if(distance <= MaxMeleeAttackDistance)
 					{
-						AddEffect(labState, target, BlindEffectId);
+						AddEffect(lab_state, target, BlindEffectId);
 					}
 				}
 			}
@@ -1259,7 +1252,7 @@ func UseInstantAbility(CombatLabState *lab_state, Entity *entity, AbilityId abil
 		{
 			Assert(has_enemy_target);
 			DealDamageFromEntity(lab_state, entity, target, damage);
-			if(RandomBetween(0.0f, 1.0f) < 0.3f)
+			if(RandomBetween(0.0f, 1.0f) < SnakeStrikePoisonChance)
 			{
 				ResetOrAddEffect(lab_state, target, PoisonedEffectId);
 			}
@@ -1293,7 +1286,7 @@ func UseInstantAbility(CombatLabState *lab_state, Entity *entity, AbilityId abil
 
 	if(AbilityHasCooldown(ability_id))
 	{
-		AddAbilityCooldown(lab_state, entity, abilityId);
+		AddAbilityCooldown(lab_state, entity, ability_id);
 	}
 }
 
@@ -1318,12 +1311,12 @@ func FinishCasting(CombatLabState *lab_state, Entity *entity)
 		case HealAbilityId:
 		{
 			Assert(has_friendly_target);
-			AttemptToHeal(lab_state, entity, target, 30);
+			AttemptToHeal(lab_state, entity, target, GetAbilityHealing(ability_id));
 			break;
 		}
 		case LightOfTheSunAbilityId:
 		{
-			AttemptToHeal(lab_state, entity, entity, 20);
+			AttemptToHeal(lab_state, entity, entity, GetAbilityHealing(ability_id));
 			break;
 		}
 		default:
@@ -1350,7 +1343,7 @@ func UseAbility(CombatLabState *lab_state, Entity *entity, AbilityId ability_id)
 	{
 		Assert(CanUseAbility(lab_state, entity, ability_id));
 		R32 cast_duration = GetAbilityCastDuration(ability_id);
-		Assert(cast_durection > 0.0f);
+		Assert(cast_duration > 0.0f);
 		entity->casted_ability = ability_id;
 		entity->cast_time_total = cast_duration;
 		entity->cast_time_remaining = cast_duration;
@@ -1481,7 +1474,7 @@ func DrawEntityBars(Canvas *canvas, Entity *entity)
 		Assert(IsBetween(cast_ratio, 0.0f, 1.0f));
 
 		Rect cast_bar_filled_rect = cast_bar_background_rect;
-		cast_bar_filled_rect.right = Lerp(cast_bar_background_rect.left, castRatio, cast_bar_background_rect.right);
+		cast_bar_filled_rect.right = Lerp(cast_bar_background_rect.left, cast_ratio, cast_bar_background_rect.right);
 		DrawRect(canvas, cast_bar_filled_rect, cast_bar_filled_color);
 
 		DrawRectOutline(canvas, cast_bar_background_rect, cast_bar_outline_color);
@@ -1735,10 +1728,10 @@ func UpdateAndDrawFlowers(Canvas *canvas, CombatLabState *lab_state, V2 mouse_po
 	R32 radius = 0.5f;
 
 	V4 text_color = MakeColor(1.0f, 1.0f, 1.0f);
-	V4 text_backgroud_color = MakeColor(0.5f, 0.5f, 0.5f);
+	V4 text_background_color = MakeColor(0.5f, 0.5f, 0.5f);
 	V4 text_hover_background_color = MakeColor(0.7f, 0.5f, 0.5f);
 
-	labState->hover_flower = 0;
+	lab_state->hover_flower = 0;
 
 	for(I32 i = 0; i < lab_state->flower_n; i++)
 	{
@@ -1779,13 +1772,13 @@ func DrawUIBox(Bitmap *bitmap, I32 left, I32 right, I32 top, I32 bottom, R32 rec
 	V4 outline_color = MakeColor(1.0f, 1.0f, 1.0f);
 	V4 recharge_color = MakeColor(0.5f, 0.5f, 0.5f);
 
-	DrawBitmapRect(bitmap, left, right, top, bottom, color);
+	DrawBitmapRect(bitmap, MakeIntRectLRTB(left, right, top, bottom), color);
 
 	Assert(IsBetween(recharge_ratio, 0.0f, 1.0f));
 	I32 recharge_right = (I32)Lerp((R32)left, recharge_ratio, (R32)right);
-	DrawBitmapRect(bitmap, left, recharge_right, top, bottom, recharge_color);
+	DrawBitmapRect(bitmap, MakeIntRectLRTB(left, recharge_right, top, bottom), recharge_color);
 
-	DrawBitmapRectOutline(bitmap, left, right, top, bottom, outline_color);
+	DrawBitmapRectOutline(bitmap, MakeIntRectLRTB(left, right, top, bottom), outline_color);
 }
 
 static void
@@ -1794,8 +1787,8 @@ func DrawUIBoxWithText(Bitmap *bitmap, I32 left, I32 right, I32 top, I32 bottom,
 {
 	DrawUIBox(bitmap, left, right, top, bottom, recharge_ratio, color);
 	V4 text_color = MakeColor(1.0f, 1.0f, 1.0f);
-	Assert(text != 0 && glyphData != 0);
-	DrawBitmapTextLineCentered(bitmap, text, glyph_data, left, right, top, bottom, text_color);
+	Assert(text != 0 && glyph_data != 0);
+	DrawBitmapTextLineCentered(bitmap, text, glyph_data, MakeIntRectLRTB(left, right, top, bottom), text_color);
 }
 
 static void
@@ -1838,9 +1831,9 @@ func DrawPlayerEffectBar(Canvas *canvas, CombatLabState *lab_state)
 	I32 left = UIBoxPadding;
 	I32 top = UIBoxPadding;
 
-	for(I32 i = 0; i < lab_state->effect_n; i++)
+	for(I32 i = 0; i < lab_state->effects.item_n; i++)
 	{
-		Effect *effect = &lab_state->effects[i];
+		Effect *effect = GetPoolItemAt(&lab_state->effects, i);
 		if(effect->entity == player)
 		{
 			DrawEffectUIBox(bitmap, effect, top, left);
@@ -1868,9 +1861,9 @@ func DrawTargetEffectBar(Canvas *canvas, CombatLabState *lab_state)
 		I32 left = (bitmap->width - 1) - UIBoxPadding - UIBoxSide;
 		I32 top = UIBoxPadding;
 
-		for(I32 i = 0; i < lab_state->effect_n; i++)
+		for(I32 i = 0; i < lab_state->effects.item_n; i++)
 		{
-			Effect *effect = &lab_state->effects[i];
+			Effect *effect = GetPoolItemAt(&lab_state->effects, i);
 			if(effect->entity == target)
 			{
 				DrawEffectUIBox(bitmap, effect, top, left);
@@ -1935,7 +1928,7 @@ func DrawAbilityBar(Canvas *canvas, CombatLabState *lab_state, IV2 mouse_positio
 		AbilityId ability_id = (AbilityId)id;
 		ClassId ability_class_id = GetAbilityClass(ability_id);
 		I32 ability_min_level = GetAbilityMinLevel(ability_id);
-		if(entity->level >= ability_min_level && entity->classId == ability_class_id)
+		if(entity->level >= ability_min_level && entity->class_id == ability_class_id)
 		{
 			ability_n++;
 		}
@@ -1968,7 +1961,7 @@ func DrawAbilityBar(Canvas *canvas, CombatLabState *lab_state, IV2 mouse_positio
 			V4 box_background_color = MakeColor(0.0f, 0.0f, 0.0f);
 			V4 box_cannot_use_color = MakeColor(0.2f, 0.0f, 0.0f);
 
-			V4 color = boxBackgroundColor;
+			V4 color = box_background_color;
 
 			R32 recharge = 0.0f;
 			R32 recharge_from = 0.0f;
@@ -1976,7 +1969,7 @@ func DrawAbilityBar(Canvas *canvas, CombatLabState *lab_state, IV2 mouse_positio
 			if(cooldown)
 			{
 				recharge = cooldown->time_remaining;
-				recharge_from = GetAbilityCooldownDuration(abilityId);
+				recharge_from = GetAbilityCooldownDuration(ability_id);
 			}
 			else if(entity->recharge > 0.0f)
 			{
@@ -1996,7 +1989,7 @@ func DrawAbilityBar(Canvas *canvas, CombatLabState *lab_state, IV2 mouse_positio
 
 			DrawUIBoxWithText(bitmap, box_left, box_right, box_top, box_bottom, recharge_ratio, name, glyph_data, color);
 
-			if(IsIntBetween(mouse_position.col, box_left, box_right) && IsIntBetween(mousePosition.row, box_top, box_bottom))
+			if(IsIntBetween(mouse_position.col, box_left, box_right) && IsIntBetween(mouse_position.row, box_top, box_bottom))
 			{
 				I32 tooltip_left = (box_left + box_right) / 2 - TooltipWidth / 2;
 				I32 tooltip_bottom = box_top - 5;
@@ -2023,37 +2016,39 @@ func UpdateEntityRecharge(Entity *entity, R32 seconds)
 static void
 func UpdateAbilityCooldowns(CombatLabState *lab_state, R32 seconds)
 {
-	I32 remaining_n = 0;
-	for(I32 i = 0; i < lab_state->ability_cooldown_n; i++)
+	Pool<AbilityCooldown> *cooldowns = &lab_state->ability_cooldowns;
+	for(I32 i = 0; i < cooldowns->item_n;)
 	{
-		AbilityCooldown *cooldown = &lab_state->ability_cooldowns[i];
+		AbilityCooldown *cooldown = GetPoolItemAt(cooldowns, i);
 		cooldown->time_remaining -= seconds;
 		if(cooldown->time_remaining > 0.0f)
 		{
-			lab_state->ability_cooldowns[remaining_n] = *cooldown;
-			remaining_n++;
+			i++;
+		}
+		else
+		{
+			RemovePoolItemAt(cooldowns, i);
 		}
 	}
-
-	lab_state->ability_cooldown_n = remaining_n;
 }
 
 static void
 func UpdateItemCooldowns(CombatLabState *lab_state, R32 seconds)
 {
-	I32 remaining_n = 0;
-	for(I32 i = 0; i < lab_state->item_cooldown_n; i++)
+	Pool<ItemCooldown> *cooldowns = &lab_state->item_cooldowns;
+	for(I32 i = 0; i < cooldowns->item_n;)
 	{
-		ItemCooldown *cooldown = &lab_state->item_cooldowns[i];
+		ItemCooldown *cooldown = GetPoolItemAt(cooldowns, i);
 		cooldown->time_remaining -= seconds;
 		if(cooldown->time_remaining > 0.0f)
 		{
-			lab_state->item_cooldowns[remaining_n] = *cooldown;
-			remaining_n++;
+			i++;
+		}
+		else
+		{
+			RemovePoolItemAt(cooldowns, i);
 		}
 	}
-
-	lab_state->item_cooldown_n = remaining_n;
 }
 
 static void
@@ -2072,8 +2067,8 @@ func DrawCombatLog(Canvas *canvas, CombatLabState *lab_state)
 	V4 outline_color = MakeColor(0.5f, 0.5f, 0.5f);
 	V4 text_color = MakeColor(1.0f, 1.0f, 1.0f);
 
-	DrawBitmapRect(bitmap, left, right, top, bottom, backgrond_color);
-	DrawBitmapRectOutline(bitmap, left, right, top, bottom, outline_color);
+	DrawBitmapRect(bitmap, MakeIntRectLRTB(left, right, top, bottom), background_color);
+	DrawBitmapRectOutline(bitmap, MakeIntRectLRTB(left, right, top, bottom), outline_color);
 
 	I32 text_left   = left + UIBoxPadding;
 	I32 text_right  = right - UIBoxPadding;
@@ -2115,13 +2110,13 @@ func DrawCombatLog(Canvas *canvas, CombatLabState *lab_state)
 }
 
 static I32
-GetHateTableEntityEntryN(HateTable *htae_table, Entity* source)
+GetHateTableEntityEntryN(HateTable *hate_table, Entity* source)
 {
 	Assert(source != 0);
 	I32 entry_n = 0;
-	for(I32 i = 0; i < hate_table->entry_n; i++)
+	for(I32 i = 0; i < hate_table->entries.item_n; i++)
 	{
-		HateTableEntry *entry = &hate_table->entries[i];
+		HateTableEntry *entry = GetPoolItemAt(&hate_table->entries, i);
 		if(entry->source == source)
 		{
 			entry_n++;
@@ -2134,43 +2129,44 @@ GetHateTableEntityEntryN(HateTable *htae_table, Entity* source)
 static void
 func RemoveDeadEntitiesFromHateTable(HateTable *hate_table)
 {
-	I32 remaining_entry_n = 0;
-	for(I32 i = 0; i < hate_table->entry_n; i++)
+	Pool<HateTableEntry> *entries = &hate_table->entries;
+	for(I32 i = 0; i < entries->item_n;)
 	{
-		HateTableEntry *entry = &hate_table->entries[i];
+		HateTableEntry *entry = GetPoolItemAt(entries, i);
 		if(!IsDead(entry->source) && !IsDead(entry->target))
 		{
-			hate_table->entries[remaining_entry_n] = *entry;
-			remaining_entry_n++;
+			i++;
+		}
+		else
+		{
+			RemovePoolItemAt(entries, i);
 		}
 	}
-
-	hate_table->entry_n = remaining_entry_n;
 }
 
 static void
 func SortHateTable(HateTable *hate_table)
 {
-	for(I32 index = 0; index < hate_table->entry_n; index++)
+	Pool<HateTableEntry> *entries = &hate_table->entries;
+	for(I32 index = 0; index < entries->item_n; index++)
 	{
-		HateTableEntry entry = hate_table->entries[index];
 		for(I32 previous_index = index - 1; previous_index >= 0; previous_index--)
 		{
-			HateTableEntry previous_entry = hate_table->entries[previous_index];
+			HateTableEntry *entry = GetPoolItemAt(entries, previous_index + 1);
+			HateTableEntry *previous_entry = GetPoolItemAt(entries, previous_index);
 			B32 need_swap = false;
-			if(previous_entry.source > entry.source)
+			if(previous_entry->source > entry->source)
 			{
 				need_swap = true;
 			}
-			else if(previous_entry.source == entry.source && previous_entry.value < entry.value)
+			else if(previous_entry->source == entry->source && previous_entry->value < entry->value)
 			{
 				need_swap = true;
 			}
 
 			if(need_swap)
 			{
-				hate_table->entries[previous_index] = entry;
-				hate_table->entries[previous_index + 1] = previous_entry;
+				SwapPoolItemsAt(entries, previous_index, previous_index + 1);
 			}
 			else
 			{
@@ -2180,14 +2176,35 @@ func SortHateTable(HateTable *hate_table)
 	}
 }
 
+static I32
+func GetEntityIndex(CombatLabState *lab_state, Entity *entity)
+{
+	I32 index = (I32)(entity - lab_state->entities);
+	Assert(IsIntBetween(index, 0, EntityN - 1));
+	return index;
+}
+
+// NOTE: An enemy is engaged for the AI scheduler exactly as long as it has a target.
+static void
+func SetEnemyTarget(CombatLabState *lab_state, Entity *enemy, Entity *target)
+{
+	Assert(enemy->group_id == EnemyGroupId);
+	if(enemy->target != target)
+	{
+		enemy->target = target;
+		B32 engaged = (target != 0 && !IsDead(enemy));
+		SetAIAgentEngaged(&lab_state->ai_scheduler, GetEntityIndex(lab_state, enemy), engaged);
+	}
+}
+
 static void
 func UpdateEnemyTargets(CombatLabState *lab_state)
 {
 	HateTable *hate_table = &lab_state->hate_table;
 	HateTableEntry *previous_entry = 0;
-	for(I32 i = 0; i < hate_table->entry_n; i++)
+	for(I32 i = 0; i < hate_table->entries.item_n; i++)
 	{
-		HateTableEntry *entry = &hate_table->entries[i];
+		HateTableEntry *entry = GetPoolItemAt(&hate_table->entries, i);
 		if(entry->source->group_id == EnemyGroupId)
 		{
 			if(previous_entry != 0)
@@ -2195,7 +2212,7 @@ func UpdateEnemyTargets(CombatLabState *lab_state)
 				Assert(previous_entry->source <= entry->source);
 				if(previous_entry->source != entry->source)
 				{
-					entry->source->target = entry->target;
+					SetEnemyTarget(lab_state, entry->source, entry->target);
 				}
 				else
 				{
@@ -2204,7 +2221,7 @@ func UpdateEnemyTargets(CombatLabState *lab_state)
 			}
 			else
 			{
-				entry->source->target = entry->target;
+				SetEnemyTarget(lab_state, entry->source, entry->target);
 			}
 		}
 
@@ -2219,9 +2236,9 @@ func GetItemCooldown(CombatLabState *lab_state, Entity *entity, ItemId item_id)
 	Assert(ItemHasOwnCooldown(item_id));
 
 	ItemCooldown *result = 0;
-	for(I32 i = 0; i < lab_state->item_cooldown_n; i++)
+	for(I32 i = 0; i < lab_state->item_cooldowns.item_n; i++)
 	{
-		ItemCooldown *cooldown = &lab_state->item_cooldowns[i];
+		ItemCooldown *cooldown = GetPoolItemAt(&lab_state->item_cooldowns, i);
 		if(cooldown->entity == entity && cooldown->item_id == item_id)
 		{
 			result = cooldown;
@@ -2248,15 +2265,34 @@ func SwapItems(InventoryItem *item1, InventoryItem *item2)
 {
 	Assert(CanSwapItems(item1, item2));
 
-	SetSlotItemId(item1->inventory, item1->slot, item2->item_id);
-	SetSlotItemId(item2->inventory, item2->slot, item1->item_id);
+	SetInventoryItemId(item1->inventory, item1->slot, item2->item_id);
+	SetInventoryItemId(item2->inventory, item2->slot, item1->item_id);
 }
 
 static void
-func AttemptToSwapItems(InventoryItem *item1, InventoryItem *item2)
+func UpdateEquipAttributes(CombatLabState *lab_state, Inventory *inventory, ItemId removed_item_id, ItemId added_item_id)
+{
+	if(inventory == &lab_state->equip_inventory)
+	{
+		Entity *player = &lab_state->entities[0];
+		if(removed_item_id != NoItemId)
+		{
+			AddAttributeModifier(player, GetItemAttributes(removed_item_id), -1);
+		}
+		if(added_item_id != NoItemId)
+		{
+			AddAttributeModifier(player, GetItemAttributes(added_item_id), +1);
+		}
+	}
+}
+
+static void
+func AttemptToSwapItems(CombatLabState *lab_state, InventoryItem *item1, InventoryItem *item2)
 {
 	if(CanSwapItems(item1, item2))
 	{
+		UpdateEquipAttributes(lab_state, item1->inventory, item1->item_id, item2->item_id);
+		UpdateEquipAttributes(lab_state, item2->inventory, item2->item_id, item1->item_id);
 		SwapItems(item1, item2);
 	}
 }
@@ -2264,7 +2300,7 @@ func AttemptToSwapItems(InventoryItem *item1, InventoryItem *item2)
 #define InventorySlotSide 50
 
 static void
-func DrawInventorySlot(Canvas *canvas, CombatLabState *lab_state, SlotId slotId, ItemId item_id, I32 top, I32 left)
+func DrawInventorySlot(Canvas *canvas, CombatLabState *lab_state, SlotId slot_id, ItemId item_id, I32 top, I32 left)
 {
 	I32 bottom = top + InventorySlotSide;
 	I32 right  = left + InventorySlotSide;
@@ -2280,23 +2316,23 @@ func DrawInventorySlot(Canvas *canvas, CombatLabState *lab_state, SlotId slotId,
 
 	if(item_id == NoItemId)
 	{
-		DrawBitmapRect(bitmap, left, right, top, bottom, slot_background_color);
+		DrawBitmapRect(bitmap, MakeIntRectLRTB(left, right, top, bottom), slot_background_color);
 		if(slot_id != AnySlotId)
 		{
 			I8 *slot_name = GetSlotName(slot_id);
 			Assert(slot_name != 0);
-			DrawBitmapTextLineCentered(bitmap, slot_name, glyph_data, left, right, top, bottom, slot_name_color);
+			DrawBitmapTextLineCentered(bitmap, slot_name, glyph_data, MakeIntRectLRTB(left, right, top, bottom), slot_name_color);
 		}
 	}
 	else
 	{
-		DrawBitmapRect(bitmap, left, right, top, bottom, item_background_color);
+		DrawBitmapRect(bitmap, MakeIntRectLRTB(left, right, top, bottom), item_background_color);
 
 		R32 total_cooldown = GetItemCooldownDuration(item_id);
 		if(total_cooldown > 0.0f)
 		{
 			Entity *player = &lab_state->entities[0];
-			ItemCooldown* cooldown = GetItemCooldown(lab_state, player, itemId);
+			ItemCooldown* cooldown = GetItemCooldown(lab_state, player, item_id);
 			if(cooldown)
 			{
 				R32 remaining_cooldown = cooldown->time_remaining;
@@ -2304,12 +2340,12 @@ func DrawInventorySlot(Canvas *canvas, CombatLabState *lab_state, SlotId slotId,
 				Assert(IsBetween(cooldown_ratio, 0.0f, 1.0f));
 
 				I32 cooldown_right = (I32)Lerp((R32)left, cooldown_ratio, (R32)right);
-				DrawBitmapRect(bitmap, left, cooldown_right, top, bottom, cooldown_color);
+				DrawBitmapRect(bitmap, MakeIntRectLRTB(left, cooldown_right, top, bottom), cooldown_color);
 			}
 		}
 
 		I8 *name = GetItemSlotName(item_id);
-		DrawBitmapTextLineCentered(bitmap, name, glyph_data, left, right, top, bottom, item_name_color);
+		DrawBitmapTextLineCentered(bitmap, name, glyph_data, MakeIntRectLRTB(left, right, top, bottom), item_name_color);
 	}
 }
 
@@ -2319,7 +2355,7 @@ func DrawInventorySlotOutline(Canvas *canvas, I32 top, I32 left, V4 color)
 	Bitmap *bitmap = &canvas->bitmap;
 	I32 bottom = top + InventorySlotSide;
 	I32 right = left + InventorySlotSide;
-	DrawBitmapRectOutline(bitmap, left, right, top, bottom, color);
+	DrawBitmapRectOutline(bitmap, MakeIntRectLRTB(left, right, top, bottom), color);
 }
 
 #define InventorySlotPadding 2
@@ -2327,14 +2363,14 @@ func DrawInventorySlotOutline(Canvas *canvas, I32 top, I32 left, V4 color)
 static I32
 func GetInventoryWidth(Inventory *inventory)
 {
-	I32 width = InventorySlotPadding + inventory->colN * (InventorySlotSide + InventorySlotPadding);
+	I32 width = InventorySlotPadding + inventory->col_n * (InventorySlotSide + InventorySlotPadding);
 	return width;
 }
 
 static I32
 func GetInventoryHeight(Inventory *inventory)
 {
-	I32 height = InventorySlotPadding + inventory->rowN * (InventorySlotSide + InventorySlotPadding);
+	I32 height = InventorySlotPadding + inventory->row_n * (InventorySlotSide + InventorySlotPadding);
 	return height;
 }
 
@@ -2358,7 +2394,7 @@ func UpdateAndDrawInventory(Canvas *canvas, CombatLabState *lab_state, Inventory
 	V4 background_color = MakeColor(0.5f, 0.5f, 0.5f);
 	V4 hover_outline_color = MakeColor(1.0f, 1.0f, 0.0f);
 	V4 invalid_outline_color = MakeColor(1.0f, 0.0f, 0.0f);
-	DrawBitmapRect(bitmap, left, right, top, bottom, background_color);
+	DrawBitmapRect(bitmap, MakeIntRectLRTB(left, right, top, bottom), background_color);
 
 	InventoryItem *drag_item = &lab_state->drag_item;
 	InventoryItem *hover_item = &lab_state->hover_item;
@@ -2369,8 +2405,8 @@ func UpdateAndDrawInventory(Canvas *canvas, CombatLabState *lab_state, Inventory
 		I32 slot_left = left + slot_padding;
 		for(I32 col = 0; col < inventory->col_n; col++)
 		{
-			SlotId slot_id = GetInventorySlotId(inventory, row, col);
-			ItemId item_id = GetInventoryItemId(inventory, row, col);
+			SlotId slot_id = GetInventorySlotId(inventory, MakeIntPoint(row, col));
+			ItemId item_id = GetInventoryItemId(inventory, MakeIntPoint(row, col));
 			
 			ItemId visible_item_id = (item_id == NoItemId) ? NoItemId : GetVisibleItemId(lab_state, item_id);
 
@@ -2396,7 +2432,7 @@ func UpdateAndDrawInventory(Canvas *canvas, CombatLabState *lab_state, Inventory
 					I32 tooltip_right = IntMin2((slot_left + InventorySlotSide / 2) + TooltipWidth / 2,
 												  (bitmap->width - 1) - UIBoxPadding);
 
-					tooltip_right = IntMax2(tooltipRight, UIBoxPadding + TooltipWidth);
+					tooltip_right = IntMax2(tooltip_right, UIBoxPadding + TooltipWidth);
 
 					I8 tooltip_buffer[128];
 					String tooltip = GetItemTooltipText(visible_item_id, tooltip_buffer, 128);
@@ -2410,11 +2446,11 @@ func UpdateAndDrawInventory(Canvas *canvas, CombatLabState *lab_state, Inventory
 				}
 
 				DrawInventorySlotOutline(canvas, slot_top, slot_left, outline_color);
-				hoverItem->inventory = inventory;
-				hoverItem->slot_id = slot_id;
-				hoverItem->item_id = item_id;
-				hoverItem->slot.row = row;
-				hoverItem->slot.col = col;
+				hover_item->inventory = inventory;
+				hover_item->slot_id = slot_id;
+				hover_item->item_id = item_id;
+				hover_item->slot.row = row;
+				hover_item->slot.col = col;
 			}
 
 			slot_left += (InventorySlotSide + slot_padding);
@@ -2443,9 +2479,9 @@ func DrawCharacterInfo(Canvas *canvas, Entity *entity, CombatLabState *lab_state
 
 	inventory->left = right - GetInventoryWidth(inventory);
 	inventory->top = top - GetInventoryHeight(inventory);
-	UpdateAndDrawInventory(canvas, labState, inventory, mouse_position);
+	UpdateAndDrawInventory(canvas, lab_state, inventory, mouse_position);
 
-	DrawBitmapRect(bitmap, left, right, top, bottom, background_color);
+	DrawBitmapRect(bitmap, MakeIntRectLRTB(left, right, top, bottom), background_color);
 
 	GlyphData *glyph_data = canvas->glyph_data;
 	Assert(glyph_data != 0);
@@ -2509,7 +2545,7 @@ func DrawCharacterInfo(Canvas *canvas, Entity *entity, CombatLabState *lab_state
 	DrawBitmapTextLineTopLeft(bitmap, line_buffer, glyph_data, text_left, text_top, text_color);
 	text_top += TextHeightInPixels;
 
-	DrawBitmapRectOutline(bitmap, left, right, top, bottom, outline_color);
+	DrawBitmapRectOutline(bitmap, MakeIntRectLRTB(left, right, top, bottom), outline_color);
 }
 
 static void
@@ -2539,8 +2575,8 @@ func DrawHateTable(Canvas *canvas, CombatLabState *lab_state)
 			I32 bottom = (bitmap->height - 1) - UIBoxPadding;
 			I32 top    = bottom - height;
 
-			DrawBitmapRect(bitmap, left, right, top, bottom, background_color);
-			DrawBitmapRectOutline(bitmap, left, right, top, bottom, outline_color);
+			DrawBitmapRect(bitmap, MakeIntRectLRTB(left, right, top, bottom), background_color);
+			DrawBitmapRectOutline(bitmap, MakeIntRectLRTB(left, right, top, bottom), outline_color);
 
 			I32 text_left = left + UIBoxPadding;
 			I32 text_right = right - UIBoxPadding;
@@ -2549,9 +2585,9 @@ func DrawHateTable(Canvas *canvas, CombatLabState *lab_state)
 			DrawBitmapTextLineTopLeft(bitmap, "Hate", canvas->glyph_data, text_left, text_top, title_color);
 			text_top += TextHeightInPixels;
 
-			for(I32 i = 0; i < hate_table->entryN; i++)
+			for(I32 i = 0; i < hate_table->entries.item_n; i++)
 			{
-				HateTableEntry* entry = &hate_table->entries[i];
+				HateTableEntry* entry = GetPoolItemAt(&hate_table->entries, i);
 				if(entry->source == target)
 				{
 					I8 *name = entry->target->name;
@@ -2569,69 +2605,40 @@ func DrawHateTable(Canvas *canvas, CombatLabState *lab_state)
 static void
 func UpdateEffects(CombatLabState *lab_state, R32 seconds)
 {
-	I32 remaining_effect_n = 0;
-	for(I32 i = 0; i < lab_state->effect_n; i++)
+	Pool<Effect> *effects = &lab_state->effects;
+	for(I32 i = 0; i < effects->item_n;)
 	{
-		Effect *effect = &lab_state->effects[i];
+		Effect *effect = GetPoolItemAt(effects, i);
 		effect->time_remaining -= seconds;
 		if(!EffectHasDuration(effect->effect_id) || effect->time_remaining > 0.0f)
 		{
-			lab_state->effects[remaining_effect_n] = *effect;
-			remaining_effect_n++;
+			i++;
 		}
-		else if(effect->effect_id == EarthShieldEffectId)
+		else
 		{
-			effect->entity->absorb_damage = 0;
+			RemoveEntityEffectStats(effect->entity, effect->effect_id);
+			if(effect->effect_id == EarthShieldEffectId)
+			{
+				effect->entity->absorb_damage = 0;
+			}
+			RemovePoolItemAt(effects, i);
 		}
 	}
-	labState->effect_n = remaining_effect_n;
 
-	for(I32 i = 0; i < lab_state->effect_n; i++)
+	for(I32 i = 0; i < lab_state->effects.item_n; i++)
 	{
-		Effect *effect = &lab_state->effects[i];
-		R32 time = effect->time_remaining;
-		R32 previous_time = time + seconds;
-		EffectId effect_id = effect->effect_id;
-		switch(effect_id)
+		Effect *effect = GetPoolItemAt(&lab_state->effects, i);
+		if(EffectTicked(effect->effect_id, effect->time_remaining, seconds))
 		{
-			case BurningEffectId:
-			{
-				if(Floor(time) != Floor(previous_time))
-				{
-					DealDamageFromEffect(lab_state, effect->effect_id, effect->entity, 2);
-				}
-				break;
-			}
-			case PoisonedEffectId:
-			{
-				if(Floor(time * (1.0f / 3.0f)) != Floor(previous_time * (1.0f / 3.0f)))
-				{
-					DealDamageFromEffect(lab_state, effect->effect_id, effect->entity, 2);
-				}
-				break;
-			}
-			case RegenerateEffectId:
-			{
-				if(Floor(time) != Floor(previous_time))
-				{
-					AttemptToHeal(lab_state, effect->entity, effect->entity, 5);
-				}
-				break;
-			}
-			case HealOverTimeEffectId:
+			I32 damage = GetEffectTickDamage(effect->effect_id);
+			if(damage > 0)
 			{
-				if(Floor(time * (1.0f / 3.0f)) != Floor(previous_time * (1.0f / 3.0f)))
-				{
-					AttemptToHeal(lab_state, effect->entity, effect->entity, 5);
-				}
-				break;
+				DealDamageFromEffect(lab_state, effect->effect_id, effect->entity, damage);
 			}
-			case BleedingEffectId:
+			I32 healing = GetEffectTickHealing(effect->effect_id);
+			if(healing > 0)
 			{
-				if(Floor(time * (1.0f / 3.0f)) != Floor(previous_time * (1.0f / 3.0f)))
-				{
-					DealDamageFromEffect(lab_state, effect->effect_id, effect->entity, 10);
-				}
+				AttemptToHeal(lab_state, effect->entity, effect->entity, healing);
 			}
 		}
 	}
@@ -2642,25 +2649,26 @@ func UpdateDamageDisplays(CombatLabState *lab_state, R32 seconds)
 {
 	R32 scroll_up_speed = 1.0f;
 
-	I32 remaining_display_n = 0;
-	for(I32 i = 0; i < lab_state->damage_display_n; i++)
+	Pool<DamageDisplay> *displays = &lab_state->damage_displays;
+	for(I32 i = 0; i < displays->item_n;)
 	{
-		DamageDisplay *display = &lab_state->damage_displays[i];
-		display->position.y -= scoll_up_speed * seconds;
+		DamageDisplay *display = GetPoolItemAt(displays, i);
+		display->position.y -= scroll_up_speed * seconds;
 
 		display->time_remaining -= seconds;
 		if(display->time_remaining > 0.0f)
 		{
-			lab_state->damage_displays[remaining_display_n] = *display;
-			remaining_display_n++;
+			i++;
+		}
+		else
+		{
+			RemovePoolItemAt(displays, i);
 		}
 	}
-
-	lab_state->damage_display_n = remaining_display_n;
 }
 
 static B32
-func CanMove(CombatLabState *lab_State, Entity *entity)
+func CanMove(CombatLabState *lab_state, Entity *entity)
 {
 	B32 can_move = false;
 	if(IsDead(entity))
@@ -2688,34 +2696,21 @@ func CanPickUpItem(CombatLabState *lab_state, Entity *entity, DroppedItem *item)
 }
 
 static void
-func PickUpItem(CombatLabState *lab_State, Entity *entity, DroppedItem *item)
+func PickUpItem(CombatLabState *lab_state, Entity *entity, DroppedItem *item)
 {
 	Assert(item != 0);
 	Assert(CanPickUpItem(lab_state, entity, item));
 
-	I32 item_index = 0;
-	B32 item_found = false;
-	for(I32 i = 0; i < lab_state->dropped_item_n; i++)
-	{
-		if(item == &lab_state->dropped_items[i])
-		{
-			item_found = true;
-			item_index = i;
-			break;
-		}
-	}
-
-	Assert(item_found);
-	lab_state->dropped_item_n--;
-	for(I32 i = item_index; i < lab_state->dropped_item_n; i++)
-	{
-		lab_state->dropped_items[i] = lab_state->dropped_items[i + 1];
-	}
-
 	AddItemToInventory(&lab_state->inventory, item->item_id);
 
 	I8 *item_name = GetVisibleItemName(lab_state, item->item_id);
 	CombatLog(lab_state, entity->name + " picks up " + item_name + ".");
+
+	if(lab_state->hover_dropped_item == item)
+	{
+		lab_state->hover_dropped_item = 0;
+	}
+	RemovePoolItem(&lab_state->dropped_items, item);
 }
 
 static void
@@ -2756,22 +2751,24 @@ func UpdateAndDrawDroppedItems(Canvas *canvas, CombatLabState *lab_state, V2 mou
 {
 	lab_state->hover_dropped_item = 0;
 
-	I32 remaining_n = 0;
-	for(I32 i = 0; i < lab_state->dropped_item_n; i++)
+	Pool<DroppedItem> *dropped_items = &lab_state->dropped_items;
+	for(I32 i = 0; i < dropped_items->item_n;)
 	{
-		DroppedItem *item = &lab_state->dropped_items[i];
+		DroppedItem *item = GetPoolItemAt(dropped_items, i);
 		item->time_left -= seconds;
 		if(item->time_left > 0.0f)
 		{
-			lab_state->dropped_items[remaining_n] = *item;
-			remaining_n++;
+			i++;
+		}
+		else
+		{
+			RemovePoolItemAt(dropped_items, i);
 		}
 	}
-	lab_state->dropped_item_n = remaining_n;
 
-	for(I32 i = 0; i < lab_state->dropped_item_n; i++)
+	for(I32 i = 0; i < dropped_items->item_n; i++)
 	{
-		DroppedItem *item = &lab_state->dropped_items[i];
+		DroppedItem *item = GetPoolItemAt(dropped_items, i);
 		I8 *item_name = GetVisibleItemName(lab_state, item->item_id);
 
 		V4 normal_background_color = MakeColor(0.5f, 0.5f, 0.5f);
@@ -2802,9 +2799,9 @@ func DrawDamageDisplays(Canvas *canvas, CombatLabState *lab_state)
 {
 	V4 damage_color = MakeColor(1.0f, 1.0f, 0.0f);
 	V4 heal_color = MakeColor(0.0f, 0.5f, 0.0f);
-	for(I32 i = 0; i < lab_state->damage_display_n; i++)
+	for(I32 i = 0; i < lab_state->damage_displays.item_n; i++)
 	{
-		DamageDisplay *display = &lab_state->damage_displays[i];
+		DamageDisplay *display = GetPoolItemAt(&lab_state->damage_displays, i);
 		I8 text[16] = {};
 		V4 text_color = {};
 		if(display->damage > 0)
@@ -2901,26 +2898,20 @@ func UpdateEntityMovement(Entity *entity, Map *map, R32 seconds)
 static void
 func RemoveEffectsOfDeadEntities(CombatLabState *lab_state)
 {
-	I32 remaining_effect_n = 0;
-	for(I32 i = 0; i < lab_state->effect_n; i++)
+	Pool<Effect> *effects = &lab_state->effects;
+	for(I32 i = 0; i < effects->item_n;)
 	{
-		Effect *effect = &lab_state->effects[i];
+		Effect *effect = GetPoolItemAt(effects, i);
 		if(!IsDead(effect->entity))
 		{
-			lab_state->effects[remaining_effect_n] = *effect;
-			remaining_effect_n++;
+			i++;
 		}
 		else
 		{
-			Entity *player = &lab_state->entities[0];
-			if(effect->entity == player)
-			{
-				RecalculatePlayerAttributes(lab_state);
-			}
+			RemoveEntityEffectStats(effect->entity, effect->effect_id);
+			RemovePoolItemAt(effects, i);
 		}
 	}
-
-	lab_state->effect_n = remaining_effect_n;
 }
 
 static void
@@ -2929,7 +2920,7 @@ func DeleteInventoryItem(InventoryItem item)
 	Inventory* inventory = item.inventory;
 	Assert(inventory != 0);
 
-	SetSlotItemId(item.inventory, item.slot, NoItemId);
+	SetInventoryItemId(item.inventory, item.slot, NoItemId);
 }
 
 static B32
@@ -2940,9 +2931,9 @@ func ItemIsOnCooldown(CombatLabState *lab_state, Entity *entity, ItemId item_id)
 	ItemId cooldown_item_id = GetItemIdForCooldown(item_id);
 	Assert(ItemHasOwnCooldown(cooldown_item_id));
 
-	for(I32 i = 0; i < lab_state->item_cooldown_n; i++)
+	for(I32 i = 0; i < lab_state->item_cooldowns.item_n; i++)
 	{
-		ItemCooldown *cooldown = &lab_state->item_cooldowns[i];
+		ItemCooldown *cooldown = GetPoolItemAt(&lab_state->item_cooldowns, i);
 		Assert(ItemHasOwnCooldown(cooldown->item_id));
 		if(cooldown->entity == entity && cooldown->item_id == cooldown_item_id)
 		{
@@ -2969,9 +2960,7 @@ func AddItemCooldown(CombatLabState *lab_state, Entity *entity, ItemId item_id)
 	cooldown.item_id = item_id;
 	cooldown.time_remaining = duration;
 
-	Assert(lab_state->item_cooldown_n < MaxItemCooldownN);
-	lab_staet->item_cooldowns[lab_state->item_cooldown_n] = cooldown;
-	lab_state->item_cooldown_n++;
+	*AddPoolItem(&lab_state->item_cooldowns) = cooldown;
 }
 
 static B32
@@ -3130,40 +3119,12 @@ func UseItem(CombatLabState *lab_state, Entity *entity, InventoryItem item)
 static R32
 func GetEntityMoveSpeed(CombatLabState *lab_state, Entity *entity)
 {
-	R32 move_speed = EntityMoveSpeed;
-	if(IsDead(entity))
+	R32 move_speed = 0.0f;
+	if(!IsDead(entity))
 	{
-		moveSpeed = 0.0f;
+		UpdateEntityDerivedStatsIfDirty(entity);
+		move_speed = entity->move_speed;
 	}
-	else
-	{
-		switch(entity->class_id)
-		{
-			case SnakeClassId:
-			case CrocodileClassId:
-			{
-				move_speed = AnimalMoveSpeed;
-				break;
-			}
-			default:
-			{
-				move_speed = EntityMoveSpeed;
-			}
-		}
-
-		if(HasEffect(lab_state, entity, BittenEffectId))
-		{
-			move_speed *= 0.5f;
-		}
-
-		if(HasEffect(lab_state, entity, EarthShakeEffectId))
-		{
-			Map* map = &lab_state->map;
-			IV2 tile = GetContainingTile(map, entity->position);
-			TileId tile_type = GetTileType(map, tile);
-		}
-	}
-
 	return move_speed;
 }
 
@@ -3187,10 +3148,11 @@ func IsNeutral(Entity *entity)
 static void
 func CombatLabUpdate(CombatLabState *lab_state, Canvas *canvas, R32 seconds, UserInput *user_input)
 {
+	ProfileFunction();
 	V4 background_color = MakeColor(0.0f, 0.0f, 0.0f);
 	ClearScreen(canvas, background_color);
 
-	DrawMap(canvas, &labState->map);
+	DrawMapWithoutItems(canvas, &lab_state->map);
 
 	V2 mouse_position = PixelToUnit(canvas->camera, user_input->mouse_pixel_position);
 	UpdateAndDrawFlowers(canvas, lab_state, mouse_position);
@@ -3201,116 +3163,144 @@ func CombatLabUpdate(CombatLabState *lab_state, Canvas *canvas, R32 seconds, Use
 	Entity *player = &lab_state->entities[0];
 	Assert(player->group_id == PlayerGroupId);
 
-	UpdateAbilityCooldowns(lab_state, seconds);
-	UpdateItemCooldowns(lab_state, seconds);
-	UpdateEffects(lab_state, seconds);
-	UpdateDamageDisplays(lab_state, seconds);
-
-	player->input_direction = MakeVector(0.0f, 0.0f);
-
 	Map *map = &lab_state->map;
 
-	B32 input_move_left  = IsKeyDown(user_input, 'A') || IsKeyDown(user_input, VK_LEFT);
-	B32 input_move_right = IsKeyDown(user_input, 'D') || IsKeyDown(user_input, VK_RIGHT);
-	B32 input_move_up    = IsKeyDown(user_input, 'W') || IsKeyDown(user_input, VK_UP);
-	B32 input_move_down  = IsKeyDown(user_input, 'S') || IsKeyDown(user_input, VK_DOWN);	
-
-	IV2 player_tile = GetContainingTile(map, player->position);
-	if(input_move_left && input_move_right)
+	if(WasKeyReleased(user_input, VK_F6))
 	{
-		player->input_diretion.x = 0.0f;
-	}
-	else if(input_move_left)
-	{
-		player->input_direction.x = -1.0f;
-	}
-	else if(input_move_right)
-	{
-		player->input_direction.x = +1.0f;
+		lab_state->show_profiler = !lab_state->show_profiler;
 	}
 
-	if(input_move_up && input_move_down)
-	{
-		player->input_direction.y = 0.0f;
-	}
-	else if(input_move_up)
-	{
-		player->input_direction.y = -1.0f;
-	}
-	else if(input_move_down)
 	{
-		player->input_direction.y = +1.0f;
+		ProfileZone("UpdateTimers");
+		UpdateAbilityCooldowns(lab_state, seconds);
+		UpdateItemCooldowns(lab_state, seconds);
+		UpdateEffects(lab_state, seconds);
+		UpdateDamageDisplays(lab_state, seconds);
 	}
 
-	if(IsDead(player))
 	{
-		player->velocity = MakeVector(0.0f, 0.0f);
-	}
-	if(CanMove(labState, player))
-	{
-		R32 move_speed = GetEntityMoveSpeed(lab_state, player);
-		player->velocity = move_speed * player->input_direction;
-	}
-
-	UpdateEntityMovement(player, map, seconds);
+		ProfileZone("UpdatePlayer");
+		player->input_direction = MakeVector(0.0f, 0.0f);
 
-	canvas->camera->center = player->position;
+		B32 input_move_left  = IsKeyDown(user_input, 'A') || IsKeyDown(user_input, VK_LEFT);
+		B32 input_move_right = IsKeyDown(user_input, 'D') || IsKeyDown(user_input, VK_RIGHT);
+		B32 input_move_up    = IsKeyDown(user_input, 'W') || IsKeyDown(user_input, VK_UP);
+		B32 input_move_down  = IsKeyDown(user_input, 'S') || IsKeyDown(user_input, VK_DOWN);	
 
-	if(player->input_direction.x != 0.0f || player->input_direction.y != 0.0f)
-	{
-		if(player->casted_ability != NoAbilityId)
+		if(input_move_left && input_move_right)
 		{
-			player->casted_ability = NoAbilityId;
+			player->input_direction.x = 0.0f;
 		}
-	}
-
-	R32 enemy_pull_distance = 30.0f;
-	for(I32 i = 0; i < EntityN; i++)
-	{
-		Entity *enemy = &lab_state->entities[i];
-		if (enemy->group_id != EnemyGroupId)
+		else if(input_move_left)
+		{
+			player->input_direction.x = -1.0f;
+		}
+		else if(input_move_right)
 		{
-			continue;
+			player->input_direction.x = +1.0f;
 		}
 
-		if(enemy->target == 0)
+		if(input_move_up && input_move_down)
 		{
-			R32 distance_from_player = MaxDistance(player->position, enemy->position);
-			B32 is_neutral = IsNeutral(enemy);
-			if(!is_neutral && distance_from_player <= enemy_pull_distance)
-			{
-				enemy->target = player;
-				AddEmptyHateTableEntry(&lab_state->hate_table, enemy, player);
-			}
+			player->input_direction.y = 0.0f;
+		}
+		else if(input_move_up)
+		{
+			player->input_direction.y = -1.0f;
+		}
+		else if(input_move_down)
+		{
+			player->input_direction.y = +1.0f;
 		}
 
-		Entity *target = enemy->target;
-		if(IsDead(enemy))
+		if(IsDead(player))
+		{
+			player->velocity = MakeVector(0.0f, 0.0f);
+		}
+		if(CanMove(lab_state, player))
 		{
-			enemy->velocity = MakeVector(0.0f, 0.0f);
+			R32 move_speed = GetEntityMoveSpeed(lab_state, player);
+			player->velocity = move_speed * player->input_direction;
 		}
-		if(target == 0)
+
+		UpdateEntityMovement(player, map, seconds);
+
+		canvas->camera->center = player->position;
+
+		if(player->input_direction.x != 0.0f || player->input_direction.y != 0.0f)
 		{
-			if(CanMove(labState, enemy))
+			if(player->casted_ability != NoAbilityId)
 			{
-				enemy->velocity = MakeVector(0.0f, 0.0f);
+				player->casted_ability = NoAbilityId;
 			}
 		}
-		else if(CanMove(labState, enemy))
+	}
+
+	AIScheduler *ai_scheduler = &lab_state->ai_scheduler;
+	UpdateAIScheduler(ai_scheduler, player->position, seconds);
+
+	LineOfSightCache *line_of_sight_cache = &lab_state->line_of_sight_cache;
+	StartLineOfSightCacheFrame(line_of_sight_cache);
+	IV2 player_tile = GetContainingTile(map, player->position);
+
+	{
+		ProfileZone("UpdateEnemies");
+		for(I32 i = 0; i < ai_scheduler->think_agent_n; i++)
 		{
-			IV2 enemy_tile = GetContainingTile(map, enemy->position);
-			Assert(enemy->group_id != enemy->target->group_id);
-			IV2 target_tile = GetContainingTile(map, enemy->target->position);
-			if(enemy_tile == target_tile)
+			I32 enemy_index = ai_scheduler->think_agents[i];
+			Entity *enemy = &lab_state->entities[enemy_index];
+			Assert(enemy->group_id == EnemyGroupId);
+
+			if(IsDead(enemy))
+			{
+				RemoveAIAgent(ai_scheduler, enemy_index);
+			}
+			else if(enemy->target == 0)
+			{
+				R32 distance_from_player = MaxDistance(player->position, enemy->position);
+				B32 is_neutral = IsNeutral(enemy);
+				if(!is_neutral && distance_from_player <= EnemyPullDistance &&
+				   HasCachedTileLineOfSight(line_of_sight_cache, map, GetContainingTile(map, enemy->position), player_tile))
+				{
+					AddEmptyHateTableEntry(&lab_state->hate_table, enemy, player);
+					SetEnemyTarget(lab_state, enemy, player);
+				}
+			}
+
+			Entity *target = enemy->target;
+			if(IsDead(enemy))
 			{
 				enemy->velocity = MakeVector(0.0f, 0.0f);
 			}
-			else
+			if(target == 0)
 			{
+				if(CanMove(lab_state, enemy))
+				{
+					enemy->velocity = MakeVector(0.0f, 0.0f);
+				}
+			}
+			else if(CanMove(lab_state, enemy))
+			{
+				IV2 enemy_tile = GetContainingTile(map, enemy->position);
+				Assert(enemy->group_id != enemy->target->group_id);
+				IV2 target_tile = GetContainingTile(map, enemy->target->position);
+				if(enemy_tile == target_tile)
+				{
+					enemy->velocity = MakeVector(0.0f, 0.0f);
+				}
+				else
+				{
+				}
 			}
 		}
 
-		UpdateEntityMovement(enemy, map, seconds);
+		for(I32 i = 0; i < ai_scheduler->active_agent_n; i++)
+		{
+			I32 enemy_index = ai_scheduler->active_agents[i];
+			Entity *enemy = &lab_state->entities[enemy_index];
+			UpdateEntityMovement(enemy, map, seconds);
+			MoveAIAgent(ai_scheduler, enemy_index, enemy->position);
+		}
 	}
 
 	if(WasKeyPressed(user_input, VK_TAB))
@@ -3366,58 +3356,61 @@ func CombatLabUpdate(CombatLabState *lab_state, Canvas *canvas, R32 seconds, Use
 		}
 	}
 
-	for(I32 i = 0; i < EntityN; i++)
-	{
-		Entity *entity = &lab_state->entities[i];
-		UpdateEntityRecharge(entity, seconds);
-	}
-
-	for(I32 i = '1'; i <= '7'; i++)
 	{
-		if(WasKeyPressed(user_input, i))
+		ProfileZone("UpdateAbilities");
+		for(I32 i = 0; i < EntityN; i++)
 		{
-			AttemptToUseAbilityAtIndex(lab_state, player, i - '1');
+			Entity *entity = &lab_state->entities[i];
+			UpdateEntityRecharge(entity, seconds);
 		}
-	}
 
-	for(I32 i = 1; i < EntityN; i++)
-	{
-		Entity *entity = &lab_state->entities[i];
-		if(entity->class_id == SnakeClassId)
-		{
-			AttemptToUseAbility(lab_state, entity, SnakeStrikeAbilityId);
-		}
-		else if(entity->class_id == CrocodileClassId)
-		{
-			AttemptToUseAbility(lab_state, entity, CrocodileBiteAbilityId);
-			AttemptToUseAbility(lab_state, entity, CrocodileLashAbilityId);
-		}
-		else if(entity->class_id == TigerClassId)
-		{
-			AttemptToUseAbility(lab_state, entity, TigerBiteAbilityId);
-		}
-		else
+		for(I32 i = '1'; i <= '7'; i++)
 		{
-			DebugBreak();
+			if(WasKeyPressed(user_input, i))
+			{
+				AttemptToUseAbilityAtIndex(lab_state, player, i - '1');
+			}
 		}
-	}
 
-	for(I32 i = 0; i < EntityN; i++)
-	{
-		Entity *entity = &lab_state->entities[i];
-		if(entity->casted_ability != NoAbilityId)
+		for(I32 i = 0; i < ai_scheduler->think_agent_n; i++)
 		{
-			if(IsDead(entity))
+			Entity *entity = &lab_state->entities[ai_scheduler->think_agents[i]];
+			if(entity->class_id == SnakeClassId)
+			{
+				AttemptToUseAbility(lab_state, entity, SnakeStrikeAbilityId);
+			}
+			else if(entity->class_id == CrocodileClassId)
+			{
+				AttemptToUseAbility(lab_state, entity, CrocodileBiteAbilityId);
+				AttemptToUseAbility(lab_state, entity, CrocodileLashAbilityId);
+			}
+			else if(entity->class_id == TigerClassId)
 			{
-				entity->casted_ability = NoAbilityId;
+				AttemptToUseAbility(lab_state, entity, TigerBiteAbilityId);
 			}
 			else
 			{
-				Assert(entity->cast_time_total > 0.0f);
-				entity->cast_time_remaining -= seconds;
-				if(entity->cast_time_remaining <= 0.0f)
+				DebugBreak();
+			}
+		}
+
+		for(I32 i = 0; i < EntityN; i++)
+		{
+			Entity *entity = &lab_state->entities[i];
+			if(entity->casted_ability != NoAbilityId)
+			{
+				if(IsDead(entity))
 				{
-					FinishCasting(lab_state, entity);
+					entity->casted_ability = NoAbilityId;
+				}
+				else
+				{
+					Assert(entity->cast_time_total > 0.0f);
+					entity->cast_time_remaining -= seconds;
+					if(entity->cast_time_remaining <= 0.0f)
+					{
+						FinishCasting(lab_state, entity);
+					}
 				}
 			}
 		}
@@ -3425,7 +3418,7 @@ func CombatLabUpdate(CombatLabState *lab_state, Canvas *canvas, R32 seconds, Use
 
 	if(WasKeyReleased(user_input, VK_RBUTTON))
 	{
-		if(lab_state->hoverItem.item_id != NoItemId)
+		if(lab_state->hover_item.item_id != NoItemId)
 		{
 			if(CanUseItem(lab_state, player, lab_state->hover_item.item_id))
 			{
@@ -3434,175 +3427,192 @@ func CombatLabUpdate(CombatLabState *lab_state, Canvas *canvas, R32 seconds, Use
 		}
 	}
 
-	RemoveDeadEntitiesFromHateTable(&lab_state->hate_table);
-	SortHateTable(&lab_state->hate_table);
-	UpdateEnemyTargets(lab_state);
-	RemoveEffectsOfDeadEntities(lab_state);
-
-	V4 player_color = MakeColor(0.0f, 1.0f, 1.0f);
-	if(player == player->target)
 	{
-		DrawSelectedEntity(canvas, player, player_color);
-	}
-	else
-	{
-		DrawEntity(canvas, player, player_color);
+		ProfileZone("UpdateHateTable");
+		RemoveDeadEntitiesFromHateTable(&lab_state->hate_table);
+		SortHateTable(&lab_state->hate_table);
+		UpdateEnemyTargets(lab_state);
+		RemoveEffectsOfDeadEntities(lab_state);
 	}
 
-	V4 neutral_enemy_color = MakeColor(1.0f, 1.0f, 0.0f);
-	V4 hostile_enemy_color = MakeColor(1.0f, 0.0f, 0.0f);
-	for(I32 i = 0; i < EntityN; i++)
 	{
-		Entity* enemy = &lab_state->entities[i];
-		if(enemy->group_id != EnemyGroupId)
+		ProfileZone("DrawEntities");
+		V4 player_color = MakeColor(0.0f, 1.0f, 1.0f);
+		if(player == player->target)
 		{
-			continue;
-		}
-
-		B32 is_neutral = IsNeutral(enemy);
-		V4 enemy_color = (is_neutral) ? neutral_enemy_color : hostile_enemy_color;
-
-		if(enemy == player->target)
-		{
-			DrawSelectedEntity(canvas, enemy, enemy_color);
+			DrawSelectedEntity(canvas, player, player_color);
 		}
 		else
 		{
-			DrawEntity(canvas, enemy, enemy_color);
+			DrawEntity(canvas, player, player_color);
 		}
-	}
 
-	for(I32 i = 0; i < EntityN; i++)
-	{
-		Entity *entity = &lab_state->entities[i];
-		DrawEntityBars(canvas, entity);
-	}
+		V4 neutral_enemy_color = MakeColor(1.0f, 1.0f, 0.0f);
+		V4 hostile_enemy_color = MakeColor(1.0f, 0.0f, 0.0f);
+		for(I32 i = 0; i < EntityN; i++)
+		{
+			Entity* enemy = &lab_state->entities[i];
+			if(enemy->group_id != EnemyGroupId)
+			{
+				continue;
+			}
 
-	V4 entity_name_color = MakeColor(1.0f, 1.0f, 1.0f);
-	V4 cast_ability_name_color = MakeColor(0.0f, 1.0f, 1.0f);
-	for(I32 i = 0; i < EntityN; i++)
-	{
-		Entity *entity = &lab_state->entities[i];
-		R32 text_center_x = entity->position.x;
-		R32 text_bottom = entity->position.y - 2.0f * EntityRadius;
+			B32 is_neutral = IsNeutral(enemy);
+			V4 enemy_color = (is_neutral) ? neutral_enemy_color : hostile_enemy_color;
 
-		if(entity->casted_ability == NoAbilityId)
-		{
-			DrawTextLineBottomXCentered(canvas, entity->name, text_bottom, text_center_x, entity_name_color);
+			if(enemy == player->target)
+			{
+				DrawSelectedEntity(canvas, enemy, enemy_color);
+			}
+			else
+			{
+				DrawEntity(canvas, enemy, enemy_color);
+			}
 		}
-		else
+
+		for(I32 i = 0; i < EntityN; i++)
 		{
-			I8 *ability_name = GetAbilityName(entity->casted_ability);
-			DrawTextLineBottomXCentered(canvas, ability_name, text_bottom, text_center_x, cast_ability_name_color);
+			Entity *entity = &lab_state->entities[i];
+			DrawEntityBars(canvas, entity);
 		}
-	}
 
-	if(WasKeyReleased(user_input, 'V'))
-	{
-		lab_state->show_inventory = !lab_state->show_inventory;
-	}
+		V4 entity_name_color = MakeColor(1.0f, 1.0f, 1.0f);
+		V4 cast_ability_name_color = MakeColor(0.0f, 1.0f, 1.0f);
+		for(I32 i = 0; i < EntityN; i++)
+		{
+			Entity *entity = &lab_state->entities[i];
+			R32 text_center_x = entity->position.x;
+			R32 text_bottom = entity->position.y - 2.0f * EntityRadius;
 
-	if(WasKeyReleased(user_input, 'C'))
-	{
-		lab_state->show_character_info = !lab_state->show_character_info;
+			if(entity->casted_ability == NoAbilityId)
+			{
+				DrawTextLineBottomXCentered(canvas, entity->name, text_bottom, text_center_x, entity_name_color);
+			}
+			else
+			{
+				I8 *ability_name = GetAbilityName(entity->casted_ability);
+				DrawTextLineBottomXCentered(canvas, ability_name, text_bottom, text_center_x, cast_ability_name_color);
+			}
+		}
 	}
 
-	if(WasKeyPressed(user_input, VK_LBUTTON))
 	{
-		if(lab_state->hover_item.inventory != 0 && lab_state->hover_item.item_id != NoItemId)
+		ProfileZone("UpdateAndDrawUI");
+		if(WasKeyReleased(user_input, 'V'))
 		{
-			lab_state->drag_item = lab_state->hover_item;
+			lab_state->show_inventory = !lab_state->show_inventory;
 		}
-	}
 
-	if(WasKeyReleased(user_input, VK_LBUTTON))
-	{
-		InventoryItem *drag_item = &lab_state->drag_item;
-		InventoryItem *hover_item = &lab_state->hover_item;
-		if(drag_item->inventory != 0)
+		if(WasKeyReleased(user_input, 'C'))
 		{
-			Assert(drag_item->item_id != NoItemId);
-			if(hover_item->inventory != 0)
-			{
-				AttemptToSwapItems(drag_item, hover_item);
-			}
-			else
+			lab_state->show_character_info = !lab_state->show_character_info;
+		}
+
+		if(WasKeyPressed(user_input, VK_LBUTTON))
+		{
+			if(lab_state->hover_item.inventory != 0 && lab_state->hover_item.item_id != NoItemId)
 			{
-				DropItem(lab_state, player, drag_item->item_id);
-				SetSlotItemId(drag_item->inventory, drag_item->slot, NoItemId);
+				lab_state->drag_item = lab_state->hover_item;
 			}
 		}
 
-		lab_state->drag_item.inventory = 0;
-	}
-
-	if(WasKeyPressed(user_input, ' '))
-	{
-		DroppedItem *item = lab_state->hover_dropped_item;
-		if(item != 0)
+		if(WasKeyReleased(user_input, VK_LBUTTON))
 		{
-			if(CanPickUpItem(lab_state, player, item))
+			InventoryItem *drag_item = &lab_state->drag_item;
+			InventoryItem *hover_item = &lab_state->hover_item;
+			if(drag_item->inventory != 0)
 			{
-				PickUpItem(lab_state, player, item);
+				Assert(drag_item->item_id != NoItemId);
+				if(hover_item->inventory != 0)
+				{
+					AttemptToSwapItems(lab_state, drag_item, hover_item);
+				}
+				else
+				{
+					UpdateEquipAttributes(lab_state, drag_item->inventory, drag_item->item_id, NoItemId);
+					DropItem(lab_state, player, drag_item->item_id);
+					SetInventoryItemId(drag_item->inventory, drag_item->slot, NoItemId);
+				}
 			}
+
+			lab_state->drag_item.inventory = 0;
 		}
 
-		Flower *flower = lab_state->hover_flower;
-		if(flower)
+		if(WasKeyPressed(user_input, ' '))
 		{
-			if(HasEmptySlot(&lab_state->inventory))
+			DroppedItem *item = lab_state->hover_dropped_item;
+			if(item != 0)
 			{
-				PickUpFlower(lab_state, flower);
-				player->herbalism++;
+				if(CanPickUpItem(lab_state, player, item))
+				{
+					PickUpItem(lab_state, player, item);
+				}
+			}
+
+			Flower *flower = lab_state->hover_flower;
+			if(flower)
+			{
+				if(HasEmptySlot(&lab_state->inventory))
+				{
+					PickUpFlower(lab_state, flower);
+					player->herbalism++;
+				}
 			}
 		}
-	}
 
-	lab_state->hover_item.inventory = 0;
-	if(lab_state->show_inventory)
-	{
-		Inventory *inventory = &lab_state->inventory;
-		I32 right = (canvas->bitmap.width - 1) - UIBoxPadding - UIBoxSide - UIBoxPadding;
-		I32 bottom = (canvas->bitmap.height - 1) - UIBoxPadding;
-		inventory->left = right - GetInventoryWidth(inventory);
-		inventory->top = bottom - GetInventoryHeight(inventory);
-		UpdateAndDrawInventory(canvas, lab_state, inventory, user_input->mouse_pixel_position);
-	}
-	else
-	{
-		DrawHateTable(canvas, lab_state);
-	}
+		lab_state->hover_item.inventory = 0;
+		if(lab_state->show_inventory)
+		{
+			Inventory *inventory = &lab_state->inventory;
+			I32 right = (canvas->bitmap.width - 1) - UIBoxPadding - UIBoxSide - UIBoxPadding;
+			I32 bottom = (canvas->bitmap.height - 1) - UIBoxPadding;
+			inventory->left = right - GetInventoryWidth(inventory);
+			inventory->top = bottom - GetInventoryHeight(inventory);
+			UpdateAndDrawInventory(canvas, lab_state, inventory, user_input->mouse_pixel_position);
+		}
+		else
+		{
+			DrawHateTable(canvas, lab_state);
+		}
 
-	DrawAbilityBar(canvas, lab_state, user_input->mouse_pixel_position);
-	DrawHelpBar(canvas, lab_state, user_input->mouse_pixel_position);
-	DrawPlayerEffectBar(canvas, lab_state);
-	DrawTargetEffectBar(canvas, lab_state);
-	DrawDamageDisplays(canvas, lab_state);
+		DrawAbilityBar(canvas, lab_state, user_input->mouse_pixel_position);
+		DrawHelpBar(canvas, lab_state, user_input->mouse_pixel_position);
+		DrawPlayerEffectBar(canvas, lab_state);
+		DrawTargetEffectBar(canvas, lab_state);
+		DrawDamageDisplays(canvas, lab_state);
 
-	if(lab_state->show_character_info)
-	{
-		DrawCharacterInfo(canvas, player, lab_state, user_input->mouse_pixel_position);
-	}
-	else
-	{
-		DrawCombatLog(canvas, lab_state);
-	}
+		if(lab_state->show_character_info)
+		{
+			DrawCharacterInfo(canvas, player, lab_state, user_input->mouse_pixel_position);
+		}
+		else
+		{
+			DrawCombatLog(canvas, lab_state);
+		}
 
-	InventoryItem *drag_item = &lab_state->drag_item;
-	if(drag_item->inventory != 0)
-	{
-		Assert(drag_item->item_id != 0);
+		InventoryItem *drag_item = &lab_state->drag_item;
+		if(drag_item->inventory != 0)
+		{
+			Assert(drag_item->item_id != 0);
 		
-		I32 slot_top  = user_input->mouse_pixel_position.row - InventorySlotSide / 2;
-		I32 slot_left = user_input->mouse_pixel_position.col - InventorySlotSide / 2;
+			I32 slot_top  = user_input->mouse_pixel_position.row - InventorySlotSide / 2;
+			I32 slot_left = user_input->mouse_pixel_position.col - InventorySlotSide / 2;
 
-		V4 drag_outline_color = MakeColor(1.0f, 0.5f, 0.0f);
+			V4 drag_outline_color = MakeColor(1.0f, 0.5f, 0.0f);
 
-		DrawInventorySlot(canvas, lab_state, drag_item->slot_id, drag_item->item_id, slot_top, slot_left);
-		DrawInventorySlotOutline(canvas, slot_top, slot_left, drag_outline_color);
+			DrawInventorySlot(canvas, lab_state, drag_item->slot_id, drag_item->item_id, slot_top, slot_left);
+			DrawInventorySlotOutline(canvas, slot_top, slot_left, drag_outline_color);
+		}
+
+		UpdateAndDrawDroppedItems(canvas, lab_state, mouse_position, seconds);
 	}
 
-	UpdateAndDrawDroppedItems(canvas, lab_state, mouse_position, seconds);
+#ifdef PROFILER_MODE
+	if(lab_state->show_profiler)
+	{
+		DrawProfilerOverlay(canvas);
+	}
+#endif
 }
 
 // TODO: Stop spamming combat log when dying next to a tree!
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <Windows.h>
+
+#include "../Debug.hpp"
+#include "../Draw.hpp"
+#include "../Map.hpp"
+#include "../Raycast.hpp"
+#include "../String.hpp"
+#include "../UserInput.hpp"
+
+#define RaycastLabArenaSize (8 * MegaByte)
+#define RaycastLabTileRowN 512
+#define RaycastLabTileColN 512
+#define RaycastLabRayN (64 * 1024)
+#define RaycastLabMaxRayTileN 12
+#define RaycastLabVisibilityRadius 3
+
+enum RaycastBenchmarkMode
+{
+	RayBenchmarkMode,
+	CachedRayBenchmarkMode,
+	PrecomputedBenchmarkMode
+};
+
+struct RaycastLabState
+{
+	I8 arena_memory[RaycastLabArenaSize];
+	MemArena arena;
+
+	Map map;
+	LineOfSightCache cache;
+	VisibilityTable visibility_table;
+	RandomSeries random;
+
+	RaycastBenchmarkMode benchmark_mode;
+	R32 rays_per_second;
+	I32 visible_ray_n;
+};
+
+static void
+func RaycastLabInit(RaycastLabState *lab_state, Canvas *canvas)
+{
+	lab_state->arena = CreateMemArena(lab_state->arena_memory, RaycastLabArenaSize);
+	MemArena *arena = &lab_state->arena;
+
+	canvas->glyph_data = GetGlobalGlyphData();
+	lab_state->random = CreateRandomSeries(1, 1);
+
+	Map *map = &lab_state->map;
+	*map = {};
+	map->tile_row_n = RaycastLabTileRowN;
+	map->tile_col_n = RaycastLabTileColN;
+	AllocMapTiles(map, arena);
+	for(I32 i = 0; i < map->tile_row_n * map->tile_col_n; i++)
+	{
+		B32 is_wall = (RandomUnit(&lab_state->random) < 0.2f);
+		map->tile_types[i] = (is_wall) ? NoTileId : CaveTileId;
+	}
+	UpdateMapPassability(map);
+
+	lab_state->cache = CreateLineOfSightCache(arena, 16);
+	lab_state->visibility_table = CreateVisibilityTable(arena, map, RaycastLabVisibilityRadius);
+	lab_state->benchmark_mode = RayBenchmarkMode;
+
+	Camera *camera = canvas->camera;
+	camera->unit_in_pixels = 5.0f;
+	camera->center = MakePoint(0.5f * GetMapWidth(map), 0.5f * GetMapHeight(map));
+}
+
+// NOTE: Random short rays all over the map, the way enemies check their targets.
+static void
+func RunRaycastBenchmark(RaycastLabState *lab_state)
+{
+	Map *map = &lab_state->map;
+	RandomSeries *random = &lab_state->random;
+	RaycastBenchmarkMode mode = lab_state->benchmark_mode;
+	LineOfSightCache *cache = &lab_state->cache;
+	StartLineOfSightCacheFrame(cache);
+
+	LARGE_INTEGER counter_frequency;
+	LARGE_INTEGER start_counter;
+	LARGE_INTEGER end_counter;
+	QueryPerformanceFrequency(&counter_frequency);
+	QueryPerformanceCounter(&start_counter);
+
+	I32 radius = RaycastLabVisibilityRadius;
+	I32 visible_ray_n = 0;
+	for(I32 i = 0; i < RaycastLabRayN; i++)
+	{
+		IV2 from_tile = MakeTile(RandomIntBetween(random, 0, map->tile_row_n - 1),
+								 RandomIntBetween(random, 0, map->tile_col_n - 1));
+		I32 max_offset = (mode == RayBenchmarkMode) ? RaycastLabMaxRayTileN : radius;
+		IV2 to_tile = MakeTile(from_tile.row + RandomIntBetween(random, -max_offset, max_offset),
+							   from_tile.col + RandomIntBetween(random, -max_offset, max_offset));
+		to_tile.row = IntMin2(IntMax2(to_tile.row, 0), map->tile_row_n - 1);
+		to_tile.col = IntMin2(IntMax2(to_tile.col, 0), map->tile_col_n - 1);
+
+		B32 is_visible = false;
+		switch(mode)
+		{
+			case RayBenchmarkMode:
+			{
+				is_visible = HasTileLineOfSight(map, from_tile, to_tile);
+				break;
+			}
+			case CachedRayBenchmarkMode:
+			{
+				is_visible = HasCachedTileLineOfSight(cache, map, from_tile, to_tile);
+				break;
+			}
+			case PrecomputedBenchmarkMode:
+			{
+				is_visible = HasPrecomputedTileLineOfSight(&lab_state->visibility_table, map, from_tile, to_tile);
+				break;
+			}
+			default:
+			{
+				DebugBreak();
+			}
+		}
+
+		if(is_visible)
+		{
+			visible_ray_n++;
+		}
+	}
+
+	QueryPerformanceCounter(&end_counter);
+	R32 seconds = (R32)(end_counter.QuadPart - start_counter.QuadPart) / (R32)counter_frequency.QuadPart;
+	if(seconds > 0.0f)
+	{
+		lab_state->rays_per_second = (R32)RaycastLabRayN / seconds;
+	}
+	lab_state->visible_ray_n = visible_ray_n;
+}
+
+static I8 *
+func GetRaycastBenchmarkModeName(RaycastBenchmarkMode mode)
+{
+	I8 *name = 0;
+	switch(mode)
+	{
+		case RayBenchmarkMode:
+		{
+			name = "[1] DDA ray";
+			break;
+		}
+		case CachedRayBenchmarkMode:
+		{
+			name = "[2] Cached tile pair";
+			break;
+		}
+		case PrecomputedBenchmarkMode:
+		{
+			name = "[3] Precomputed table";
+			break;
+		}
+		default:
+		{
+			DebugBreak();
+		}
+	}
+	return name;
+}
+
+static void
+func RaycastLabUpdate(RaycastLabState *lab_state, Canvas *canvas, R32 seconds, UserInput *user_input)
+{
+	V4 background_color = MakeColor(0.0f, 0.0f, 0.0f);
+	ClearScreen(canvas, background_color);
+
+	if(WasKeyPressed(user_input, '1'))
+	{
+		lab_state->benchmark_mode = RayBenchmarkMode;
+	}
+	else if(WasKeyPressed(user_input, '2'))
+	{
+		lab_state->benchmark_mode = CachedRayBenchmarkMode;
+	}
+	else if(WasKeyPressed(user_input, '3'))
+	{
+		lab_state->benchmark_mode = PrecomputedBenchmarkMode;
+	}
+
+	RunRaycastBenchmark(lab_state);
+
+	Map *map = &lab_state->map;
+	DrawMapWithoutItems(canvas, map);
+
+	Camera *camera = canvas->camera;
+	V2 mouse_position = PixelToUnit(camera, user_input->mouse_pixel_position);
+	IV2 blocking_tile = {};
+	B32 is_visible = CastTileRay(map, camera->center, mouse_position, &blocking_tile);
+	if(is_visible)
+	{
+		DrawLine(canvas, camera->center, mouse_position, MakeColor(0.0f, 1.0f, 0.0f), 0.5f);
+	}
+	else
+	{
+		DrawLine(canvas, camera->center, mouse_position, MakeColor(1.0f, 0.0f, 0.0f), 0.5f);
+		HighlightTile(canvas, map, blocking_tile, MakeColor(1.0f, 0.0f, 0.0f));
+	}
+
+	I8 text_buffer[128] = {};
+	String text = StartString(text_buffer, 128);
+	text = text + GetRaycastBenchmarkModeName(lab_state->benchmark_mode) + ": " +
+		   (I32)(lab_state->rays_per_second / 1000.0f) + "k rays/sec, " +
+		   lab_state->visible_ray_n + "/" + RaycastLabRayN + " visible";
+
+	V4 text_color = MakeColor(1.0f, 1.0f, 1.0f);
+	DrawBitmapTextLineTopLeft(&canvas->bitmap, text_buffer, canvas->glyph_data, 10, 10, text_color);
+}
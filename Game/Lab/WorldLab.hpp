@@ -7,28 +7,52 @@
 #include "../Draw.hpp"
 #include "../Geometry.hpp"
 #include "../Map.hpp"
+#include "../MapEdit.hpp"
+#include "../MapFile.hpp"
+#include "../MapGen.hpp"
+#include "../MapMigrate.hpp"
+#include "../MapSave.hpp"
+#include "../MemoryStats.hpp"
+#include "../SparseMap.hpp"
 #include "../UserInput.hpp"
 
-#define WorldLabArenaSize (1 * MegaByte)
+#define WorldLabMapArenaSize (128 * MegaByte)
+#define WorldLabJournalArenaSize (4 * MegaByte)
+#define WorldLabMaxMapEditN (16 * 1024)
+#define WorldLabMaxMapEditRunN (192 * 1024)
+#define WorldLabAutosaveSeconds 5.0f
+#define WorldLabCaveMapSide 4096
+#define WorldLabLoadArenaSize (1 * GigaByte)
 
 enum WorldEditMode
 {
 	PlaceTileMode,
 	PlaceItemMode,
 	RemoveItemMode,
-	PlaceEntityMode
+	PlaceEntityMode,
+	FillRectMode,
+	FloodFillMode,
+	BrushMode
 };
 
 struct WorldLabState
 {
-	I8 arena_memory1[WorldLabArenaSize];
-	I8 arena_memory2[WorldLabArenaSize];
-	MemArena arena1;
-	MemArena arena2;
-	MemArena *arena;
-	MemArena *tmp_arena;
+	I8 journal_arena_memory[WorldLabJournalArenaSize];
+	MemArena map_arena;
+	MemArena journal_arena;
 
-	Map map;
+	SparseMap map;
+	MapEditJournal journal;
+
+	MapSaver saver;
+	B32 is_save_requested;
+	R32 autosave_seconds;
+
+	U64 cave_seed;
+
+	IV2 fill_rect_start;
+	B32 is_filling_rect;
+	R32 brush_radius;
 
 	WorldEditMode edit_mode;
 
@@ -36,18 +60,22 @@ struct WorldLabState
 };
 
 static void
-func DrawMapItems(Canvas *canvas, Map *map)
+func DrawMapItems(Canvas *canvas, SparseMap *map)
 {
+	MemArena *scratch_arena = GetScratchArena();
+	TempMemory temp_memory = BeginTempMemory(scratch_arena);
+	V2 *item_positions = ArenaAllocArray(scratch_arena, V2, map->item_n);
 	for(I32 i = 0; i < map->item_n; i++)
 	{
-		DrawMapItem(canvas, &map->items[i]);
+		item_positions[i] = map->items[i].position;
 	}
+	DrawMapItemsAt(canvas, item_positions, map->item_n);
+	EndTempMemory(temp_memory);
 }
 
 static void
-func DrawMapEntities(Canvas *canvas, Map *map)
+func DrawMapEntities(Canvas *canvas, SparseMap *map)
 {
-	V4 color = MakeColor(1.0f, 0.5f, 0.0f);
 	R32 radius = 0.5f;
 	for(I32 i = 0; i < map->entity_n; i++)
 	{
@@ -58,33 +86,30 @@ func DrawMapEntities(Canvas *canvas, Map *map)
 }
 
 static void
-func DrawMapWithItems(Canvas *canvas, Map *map)
+func DrawMapWithItems(Canvas *canvas, SparseMap *map)
 {
-	DrawMapWithoutItems(canvas, map);
+	DrawSparseMap(canvas, map);
 	DrawMapItems(canvas, map);
 	DrawMapEntities(canvas, map);
 }
 
-static void
-func WorldLabSwapArenas(WorldLabState *lab_state)
-{
-	MemArena *arena = lab_state->arena;
-	lab_state->arena = lab_state->tmp_arena;
-	lab_state->tmp_arena = arena;
-
-	Assert((lab_state->arena == &lab_state->arena1) && (lab_state->tmp_arena == &lab_state->arena2) ||
-		   (lab_state->arena == &lab_state->arena2) && (lab_state->tmp_arena == &lab_state->arena1));
-}
-
 static void
 func WorldLabInit(WorldLabState *lab_state, Canvas* canvas)
 {
-	lab_state->arena1 = CreateMemArena(lab_state->arena_memory1, WorldLabArenaSize);
-	lab_state->arena2 = CreateMemArena(lab_state->arena_memory2, WorldLabArenaSize);
-	lab_state->arena = &lab_state->arena1;
-	lab_state->tmp_arena = &lab_state->arena2;
+	lab_state->map_arena = CreateReservedMemArena(WorldLabMapArenaSize);
+	lab_state->journal_arena = CreateMemArena(lab_state->journal_arena_memory, WorldLabJournalArenaSize);
+	lab_state->map = CreateSparseMap(&lab_state->map_arena);
+	lab_state->journal = CreateMapEditJournal(&lab_state->journal_arena, WorldLabMaxMapEditN, WorldLabMaxMapEditRunN);
+	lab_state->brush_radius = 3.0f;
+
+	StartMapSaver(&lab_state->saver, WorldLabMapArenaSize);
+	SetMapSaved(&lab_state->saver, &lab_state->map);
 
-	lab_state->map = {};
+	TrackMemArena(&lab_state->map_arena, "World lab map", MapMemoryTagId);
+	TrackMemArena(&lab_state->journal_arena, "World lab journal", EditMemoryTagId);
+	TrackMemArena(&lab_state->saver.file_arenas[0], "World lab save file", SaveMemoryTagId);
+	TrackMemArena(&lab_state->saver.file_arenas[1], "World lab save file", SaveMemoryTagId);
+	TrackMemArena(&lab_state->saver.job_arena, "World lab save job", SaveMemoryTagId);
 
 	lab_state->edit_mode = PlaceTileMode;
 
@@ -95,164 +120,157 @@ func WorldLabInit(WorldLabState *lab_state, Canvas* canvas)
 	lab_state->place_entity_group_id = OrangeGroupId;
 }
 
-static B32
-func ArenaContainsMapData(MemArena *arena, Map *map)
+static IV2
+func GetMouseTile(Canvas *canvas, UserInput *user_input)
 {
-	B32 contains_tile_types = ArenaContainsAddress(arena, map->tile_types);
-	B32 contains_items = ArenaContainsAddress(arena, map->items);
-	B32 contains_entities = ArenaContainsAddress(arena, map->entities);
-	B32 contains_data = (contains_tile_types && contains_items && contains_entities);
-	return contains_data;
+	V2 mouse_position = PixelToUnit(canvas->camera, user_input->mouse_pixel_position);
+
+	IV2 tile = {};
+	tile.row = Floor(mouse_position.y / MapTileSide);
+	tile.col = Floor(mouse_position.x / MapTileSide);
+	return tile;
 }
 
-static void
-func CheckConsistency(WorldLabState *lab_state)
+static Rect
+func GetTileRect(I32 top_row, I32 left_col, I32 bottom_row, I32 right_col)
 {
-	Assert(ArenaContainsMapData(lab_state->arena, &lab_state->map));
+	Rect rect = {};
+	rect.left   = left_col * MapTileSide;
+	rect.right  = (right_col + 1) * MapTileSide;
+	rect.top    = top_row * MapTileSide;
+	rect.bottom = (bottom_row + 1) * MapTileSide;
+	return rect;
+}
+
+// NOTE: Left button places cave tiles, right button erases them.
+static B32
+func GetPaintTileType(UserInput *user_input, B32 use_released, TileId *type)
+{
+	B32 is_painting = false;
+	if(use_released ? WasKeyReleased(user_input, VK_LBUTTON) : IsKeyDown(user_input, VK_LBUTTON))
+	{
+		*type = CaveTileId;
+		is_painting = true;
+	}
+	else if(use_released ? WasKeyReleased(user_input, VK_RBUTTON) : IsKeyDown(user_input, VK_RBUTTON))
+	{
+		*type = NoTileId;
+		is_painting = true;
+	}
+	return is_painting;
 }
 
 static void
 func HandlePlaceTileMode(WorldLabState *lab_state, Canvas *canvas, UserInput *user_input)
 {
-	MemArena *arena = lab_state->arena;
-	MemArena *tmp_arena = lab_state->tmp_arena;
-	Map *map = &lab_state->map;
-
-	Camera *camera = canvas->camera;
-	V2 mouse_position = PixelToUnit(camera, user_input->mouse_pixel_position);
-
-	IV2 tile = {};
-	tile.row = Floor(mouse_position.y / MapTileSide);
-	tile.col = Floor(mouse_position.x / MapTileSide);
+	SparseMap *map = &lab_state->map;
+	IV2 tile = GetMouseTile(canvas, user_input);
 
-	if(WasKeyReleased(user_input, VK_LBUTTON))
+	TileId type = NoTileId;
+	if(GetPaintTileType(user_input, true, &type))
 	{
-		V2 world_offset = {};
-
-		ArenaReset(tmp_arena);
-
-		if(map->tile_row_n == 0)
-		{
-			Assert(map->tile_col_n == 0);
-			Assert(map->tile_types == 0);
-			map->tile_row_n = 1;
-			map->tile_col_n = 1;
-			map->tile_types = ArenaAllocArray(tmp_arena, TileId, 1);
-
-			IV2 new_tile = MakeIntPoint(0, 0);
-			SetTileType(map, new_tile, CaveTileId);
+		BeginMapEdit(&lab_state->journal);
+		FillSparseMapRowSpan(map, tile.row, tile.col, 1, type, &lab_state->journal);
+		EndMapEdit(&lab_state->journal);
+	}
+	
+	Rect tile_rect = GetTileRect(tile.row, tile.col, tile.row, tile.col);
+	V4 tile_color = MakeColor(0.5f, 0.5f, 0.5f);
+	DrawRect(canvas, tile_rect, tile_color);
+}
 
-			camera->center.y -= tile.row * MapTileSide;
-			camera->center.x -= tile.col * MapTileSide;
-		}
-		else
-		{
-			Assert(map->tile_col_n > 0);
-			Assert(map->tile_row_n > 0);
+static void
+func HandleFillRectMode(WorldLabState *lab_state, Canvas *canvas, UserInput *user_input)
+{
+	SparseMap *map = &lab_state->map;
+	IV2 tile = GetMouseTile(canvas, user_input);
 
-			I32 new_row_n = map->tile_row_n;
-			I32 new_col_n = map->tile_col_n;
+	if(WasKeyPressed(user_input, VK_LBUTTON) || WasKeyPressed(user_input, VK_RBUTTON))
+	{
+		lab_state->fill_rect_start = tile;
+		lab_state->is_filling_rect = true;
+	}
 
-			if(tile.row < 0)
-			{
-				new_row_n += (-tile.row);
-			}
-			else if(tile.row >= map->tile_row_n)
-			{
-				new_row_n += (tile.row - map->tile_row_n + 1);
-			}
+	IV2 start = (lab_state->is_filling_rect) ? lab_state->fill_rect_start : tile;
+	I32 top_row = IntMin2(start.row, tile.row);
+	I32 left_col = IntMin2(start.col, tile.col);
+	I32 bottom_row = IntMax2(start.row, tile.row);
+	I32 right_col = IntMax2(start.col, tile.col);
 
-			if(tile.col < 0)
-			{
-				new_col_n += (-tile.col);
-			}
-			else if(tile.col >= map->tile_col_n)
-			{
-				new_col_n += (tile.col - map->tile_col_n + 1);
-			}
+	TileId type = NoTileId;
+	if(lab_state->is_filling_rect && GetPaintTileType(user_input, true, &type))
+	{
+		BeginMapEdit(&lab_state->journal);
+		FillSparseMapRect(map, top_row, left_col, bottom_row, right_col, type, &lab_state->journal);
+		EndMapEdit(&lab_state->journal);
+		lab_state->is_filling_rect = false;
+	}
 
-			TileId *new_tiles = ArenaAllocArray(tmp_arena, TileId, new_row_n * new_col_n);
-			for(I32 index = 0; index < new_row_n * new_col_n; index++)
-			{
-				new_tiles[index] = NoTileId;
-			}
+	Rect rect = GetTileRect(top_row, left_col, bottom_row, right_col);
+	V4 rect_color = MakeColor(0.5f, 0.5f, 0.5f);
+	DrawRectOutline(canvas, rect, rect_color);
+}
 
-			for(I32 row = 0; row < map->tile_row_n; row++)
-			{
-				for(I32 col = 0; col < map->tile_col_n; col++)
-				{
-					I32 old_index = map->tile_col_n * row + col;
-					I32 new_row = row;
-					if(tile.row < 0)
-					{
-						new_row += (-tile.row);
-					}
-
-					I32 new_col = col;
-					if(tile.col < 0)
-					{
-						new_col += (-tile.col);
-					}
-
-					I32 new_index = new_col_n * new_row + new_col;
-					new_tiles[new_index] = map->tile_types[old_index];
-				}
-			}
+static void
+func HandleFloodFillMode(WorldLabState *lab_state, Canvas *canvas, UserInput *user_input)
+{
+	SparseMap *map = &lab_state->map;
+	IV2 tile = GetMouseTile(canvas, user_input);
 
-			map->tile_row_n = new_row_n;
-			map->tile_col_n = new_col_n;
-			map->tile_types = new_tiles;
+	TileId type = NoTileId;
+	if(GetPaintTileType(user_input, true, &type))
+	{
+		BeginMapEdit(&lab_state->journal);
+		FloodFillSparseMap(map, tile.row, tile.col, type, &lab_state->journal, GetScratchArena());
+		EndMapEdit(&lab_state->journal);
+	}
 
-			if(tile.row < 0)
-			{
-				world_offset.y = (-tile.row) * MapTileSide;
-			}
-			if(tile.col < 0)
-			{
-				world_offset.x = (-tile.col) * MapTileSide;
-			}
+	Rect tile_rect = GetTileRect(tile.row, tile.col, tile.row, tile.col);
+	V4 tile_color = MakeColor(0.0f, 0.5f, 1.0f);
+	DrawRectOutline(canvas, tile_rect, tile_color);
+}
 
-			tile.row = IntMax2(tile.row, 0);
-			tile.col = IntMax2(tile.col, 0);
-			SetTileType(map, tile, CaveTileId);
-		}
+// NOTE: A whole stroke, from pressing a button until releasing it, is one edit.
+static void
+func HandleBrushMode(WorldLabState *lab_state, Canvas *canvas, UserInput *user_input)
+{
+	SparseMap *map = &lab_state->map;
+	MapEditJournal *journal = &lab_state->journal;
+	IV2 tile = GetMouseTile(canvas, user_input);
 
-		MapItem *new_items = ArenaAllocArray(tmp_arena, MapItem, map->item_n);
-		for(I32 i = 0; i < map->item_n; i++)
-		{
-			new_items[i] = map->items[i];
-			new_items[i].position += world_offset;
-		}
-		map->items = new_items;
+	if(IsKeyDown(user_input, 'R'))
+	{
+		lab_state->brush_radius = Min2(lab_state->brush_radius + 0.2f, 64.0f);
+	}
+	if(IsKeyDown(user_input, 'F'))
+	{
+		lab_state->brush_radius = Max2(lab_state->brush_radius - 0.2f, 0.0f);
+	}
 
-		MapEntity *new_entities = ArenaAllocArray(tmp_arena, MapEntity, map->entity_n);
-		for(I32 i = 0; i < map->entity_n; i++)
+	TileId type = NoTileId;
+	if(GetPaintTileType(user_input, false, &type))
+	{
+		if(!journal->is_recording)
 		{
-			new_entities[i] = map->entities[i];
-			new_entities[i].spawn_position += world_offset;
+			BeginMapEdit(journal);
 		}
-		map->entities = new_entities;
-
-		camera->center += world_offset;
-
-		WorldLabSwapArenas(lab_state);
-		CheckConsistency(lab_state);
+		PaintSparseMapCircle(map, tile.row, tile.col, lab_state->brush_radius, type, journal);
+	}
+	else if(journal->is_recording)
+	{
+		EndMapEdit(journal);
 	}
-	
-	Rect tile_rect = {};
-	tile_rect.left   = tile.col * MapTileSide;
-	tile_rect.right  = tile_rect.left + MapTileSide;
-	tile_rect.top    = tile.row * MapTileSide;
-	tile_rect.bottom = tile_rect.top + MapTileSide;
 
-	V4 tile_color = MakeColor(0.5f, 0.5f, 0.5f);
-	DrawRect(canvas, tile_rect, tile_color);
+	V2 center = MakePoint((tile.col + 0.5f) * MapTileSide, (tile.row + 0.5f) * MapTileSide);
+	R32 radius = (lab_state->brush_radius + 0.5f) * MapTileSide;
+	V4 brush_color = MakeColor(0.5f, 0.5f, 0.5f);
+	DrawCircle(canvas, center, radius, brush_color);
 }
 
 static void
 func HandlePlaceItemMode(WorldLabState *lab_state, Canvas *canvas, UserInput *user_input)
 {
-	Map *map = &lab_state->map;
+	SparseMap *map = &lab_state->map;
 	Camera *camera = canvas->camera;
 	V2 mouse_position = PixelToUnit(camera, user_input->mouse_pixel_position);
 
@@ -263,42 +281,10 @@ func HandlePlaceItemMode(WorldLabState *lab_state, Canvas *canvas, UserInput *us
 
 	if(WasKeyReleased(user_input, VK_LBUTTON))
 	{
-		Assert(ArenaContainsMapData(lab_state->arena, map));
-
-		MemArena *tmp_arena = lab_state->tmp_arena;
-
-		ArenaReset(tmp_arena);
-
-		I32 tile_n = map->tile_row_n * map->tile_col_n;
-		TileId *new_tile_types = ArenaAllocArray(tmp_arena, TileId, tile_n);
-		for(I32 i = 0; i < tile_n; i++)
-		{
-			new_tile_types[i] = map->tile_types[i];
-		}
-		map->tile_types = new_tile_types;
-
-		MapItem *new_items = ArenaAllocArray(tmp_arena, MapItem, map->item_n + 1);
-		for(I32 i = 0; i < map->item_n; i++)
-		{
-			new_items[i] = map->items[i];
-		}
-		MapItem *new_item = &new_items[map->item_n];
-		new_item->item_id = NoItemId;
-		new_item->position = mouse_position;
-		map->item_n++;
-		map->items = new_items;
-
-		MapEntity *new_entities = ArenaAllocArray(tmp_arena, MapEntity, map->entity_n);
-		for(I32 i = 0; i < map->entity_n; i++)
-		{
-			new_entities[i] = map->entities[i];
-		}
-		map->entities = new_entities;
-
-		Assert(ArenaContainsMapData(tmp_arena, map));
-
-		WorldLabSwapArenas(lab_state);
-		CheckConsistency(lab_state);
+		MapItem item = {};
+		item.item_id = NoItemId;
+		item.position = mouse_position;
+		AddSparseMapItem(map, item);
 	}
 }
 
@@ -307,7 +293,7 @@ func HandleRemoveItemMode(WorldLabState *lab_state, Canvas *canvas, UserInput *u
 {
 	V2 mouse_position = PixelToUnit(canvas->camera, user_input->mouse_pixel_position);
 
-	Map *map = &lab_state->map;
+	SparseMap *map = &lab_state->map;
 	MapItem *hover_item = 0;
 	I32 hover_index = -1;
 	for(I32 i = 0; i < map->item_n; i++)
@@ -330,43 +316,7 @@ func HandleRemoveItemMode(WorldLabState *lab_state, Canvas *canvas, UserInput *u
 		DrawCircle(canvas, hover_item->position, MapItemRadius, item_color);
 		if(WasKeyReleased(user_input, VK_LBUTTON))
 		{
-			MemArena *tmp_arena = lab_state->tmp_arena;
-			
-			ArenaReset(tmp_arena);
-
-			I32 tile_n = map->tile_row_n * map->tile_col_n;
-			TileId *new_tile_types = ArenaAllocArray(tmp_arena, TileId, tile_n);
-			for(I32 i = 0; i < tile_n; i++)
-			{
-				new_tile_types[i] = map->tile_types[i];
-			}
-			map->tile_types = new_tile_types;
-
-			I32 item_index = 0;
-			MapItem *new_items = ArenaAllocArray(tmp_arena, MapItem, map->item_n - 1);
-			for(I32 i = 0; i < map->item_n; i++)
-			{
-				if(i != hover_index)
-				{
-					new_items[item_index] = map->items[i];
-					item_index++;
-				}
-			}
-			map->item_n--;
-			Assert(item_index == map->item_n);
-			map->items = new_items;
-
-			MapEntity *new_entities = ArenaAllocArray(tmp_arena, MapEntity, map->entity_n);
-			for(I32 i = 0; i < map->entity_n; i++)
-			{
-				new_entities[i] = map->entities[i];
-			}
-			map->entities = new_entities;
-
-			Assert(ArenaContainsMapData(tmp_arena, map));
-
-			WorldLabSwapArenas(lab_state);
-			CheckConsistency(lab_state);
+			RemoveSparseMapItem(map, hover_index);
 		}
 	}
 }
@@ -376,7 +326,7 @@ func HandlePlaceEntityMode(WorldLabState *lab_state, Canvas *canvas, UserInput *
 {
 	Assert(lab_state->edit_mode == PlaceEntityMode);
 
-	Map *map = &lab_state->map;
+	SparseMap *map = &lab_state->map;
 	Camera *camera = canvas->camera;
 	V2 mouse_position = PixelToUnit(camera, user_input->mouse_pixel_position);
 
@@ -386,43 +336,15 @@ func HandlePlaceEntityMode(WorldLabState *lab_state, Canvas *canvas, UserInput *
 
 	if(WasKeyReleased(user_input, VK_LBUTTON))
 	{
-		MemArena *tmp_arena = lab_state->tmp_arena;
-		ArenaReset(tmp_arena);
-
-		I32 tile_n = map->tile_row_n * map->tile_col_n;
-		TileId *new_tile_types = ArenaAllocArray(tmp_arena, TileId, tile_n);
-		for(I32 i = 0; i < tile_n; i++)
-		{
-			new_tile_types[i] = map->tile_types[i];
-		}
-		map->tile_types = new_tile_types;
-
-		MapItem *new_items = ArenaAllocArray(tmp_arena, MapItem, map->item_n);
-		for(I32 i = 0; i < map->item_n; i++)
-		{
-			new_items[i] = map->items[i];
-		}
-		map->items = new_items;
-
-		MapEntity *new_entities = ArenaAllocArray(tmp_arena, MapEntity, map->entity_n + 1);
-		for(I32 i = 0; i < map->entity_n; i++)
-		{
-			new_entities[i] = map->entities[i];
-		}
-		MapEntity *new_entity = &new_entities[map->entity_n];
-		new_entity->group_id = lab_state->place_entity_group_id;
-		new_entity->spawn_position = mouse_position;
-		map->entity_n++;
-		map->entities = new_entities;
-
-		Assert(ArenaContainsMapData(tmp_arena, map));
-
-		WorldLabSwapArenas(lab_state);
-		CheckConsistency(lab_state);
+		MapEntity entity = {};
+		entity.group_id = lab_state->place_entity_group_id;
+		entity.spawn_position = mouse_position;
+		AddSparseMapEntity(map, entity);
 	}
 }
 
 static I8 *map_file = "Data/Map.data";
+static I8 *cave_map_file = "Data/Cave.data";
 
 static void
 func WorldLabUpdate(WorldLabState *lab_state, Canvas *canvas, R32 seconds, UserInput *user_input)
@@ -473,6 +395,18 @@ func WorldLabUpdate(WorldLabState *lab_state, Canvas *canvas, R32 seconds, UserI
 	{
 		lab_state->edit_mode = RemoveItemMode;
 	}
+	if(WasKeyPressed(user_input, '5'))
+	{
+		lab_state->edit_mode = FillRectMode;
+	}
+	if(WasKeyPressed(user_input, '6'))
+	{
+		lab_state->edit_mode = FloodFillMode;
+	}
+	if(WasKeyPressed(user_input, '7'))
+	{
+		lab_state->edit_mode = BrushMode;
+	}
 	if(WasKeyPressed(user_input, '4'))
 	{
 		if(lab_state->edit_mode == PlaceEntityMode)
@@ -496,61 +430,78 @@ func WorldLabUpdate(WorldLabState *lab_state, Canvas *canvas, R32 seconds, UserI
 		}
 	}
 
-	MemArena *arena = lab_state->arena;
-	MemArena *tmp_arena = lab_state->tmp_arena;
-	if(WasKeyReleased(user_input, 'M'))
+	MapEditJournal *journal = &lab_state->journal;
+	if(lab_state->edit_mode != BrushMode && journal->is_recording)
 	{
-		CheckConsistency(lab_state);
-
-		HANDLE file = CreateFileA(map_file, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
-		Assert(file != INVALID_HANDLE_VALUE);
-
-		MemArena *file_arena = tmp_arena;
-		ArenaReset(file_arena);
-		I32 version = MapVersion;
-		ArenaPushVar(file_arena, version);
-
-		Map *map = &lab_state->map;
-		Map *pushed_map = (Map *)ArenaPushVar(file_arena, *map);
-		I32 tile_n = (map->tile_row_n * map->tile_col_n);
-
-		TileId *tile_types = (TileId *)ArenaPushData(file_arena, tile_n * sizeof(TileId), map->tile_types);
-		pushed_map->tile_types = (TileId *)GetRelativeAddress(tile_types, file_arena->base_address);
+		EndMapEdit(journal);
+	}
+	if(lab_state->edit_mode != FillRectMode)
+	{
+		lab_state->is_filling_rect = false;
+	}
 
-		MapItem *items = (MapItem *)ArenaPushData(file_arena, map->item_n * sizeof(MapItem), map->items);
-		pushed_map->items = (MapItem *)GetRelativeAddress(items, file_arena->base_address);
+	if(!journal->is_recording && WasKeyPressed(user_input, 'Z'))
+	{
+		UndoMapEdit(&lab_state->map, journal);
+	}
+	if(!journal->is_recording && WasKeyPressed(user_input, 'Y'))
+	{
+		RedoMapEdit(&lab_state->map, journal);
+	}
 
-		MapEntity *entities = (MapEntity *)ArenaPushData(file_arena, map->entity_n * sizeof(MapEntity), map->entities);
-		pushed_map->entities = (MapEntity *)GetRelativeAddress(entities, file_arena->base_address);
+	MapSaver *saver = &lab_state->saver;
+	UpdateMapSaver(saver, &lab_state->map);
 
-		I8 *data = file_arena->base_address;
-		DWORD data_size = file_arena->used_size;
-		DWORD written_data_size = 0;
+	lab_state->autosave_seconds += seconds;
+	if(WasKeyReleased(user_input, 'M'))
+	{
+		lab_state->is_save_requested = true;
+	}
+	if(lab_state->autosave_seconds >= WorldLabAutosaveSeconds && HasUnsavedMapChanges(saver, &lab_state->map))
+	{
+		lab_state->is_save_requested = true;
+	}
+	if(lab_state->is_save_requested && StartMapSave(saver, &lab_state->map, map_file))
+	{
+		lab_state->is_save_requested = false;
+		lab_state->autosave_seconds = 0.0f;
+	}
 
-		BOOL result = WriteFile(file, (LPCVOID)data, (DWORD)data_size, &written_data_size, 0);
-		Assert(result);
-		Assert(written_data_size == data_size);
+	MemArena *scratch_arena = GetScratchArena();
+	if(WasKeyReleased(user_input, 'L'))	
+	{
+		FinishMapSave(saver, &lab_state->map);
+		lab_state->is_save_requested = false;
+
+		// NOTE: A file that can not be loaded leaves the map as it is.
+		//       LoadMapFromFile resets its arena, so the flat map gets an arena of its own until it is copied.
+		MemArena load_arena = CreateReservedMemArena(WorldLabLoadArenaSize);
+		Map file_map = {};
+		if(UpgradeMapFile(map_file, scratch_arena) && LoadMapFromFile(map_file, &load_arena, &file_map))
+		{
+			SetSparseMapFromMap(&lab_state->map, &file_map);
+			SetMapSaved(saver, &lab_state->map);
 
-		result = CloseHandle(file);
-		Assert(result);
+			ArenaReset(&lab_state->journal_arena);
+			lab_state->journal = CreateMapEditJournal(&lab_state->journal_arena, WorldLabMaxMapEditN, WorldLabMaxMapEditRunN);
+		}
+		FreeReservedMemArena(&load_arena);
 	}
 
-	if(WasKeyReleased(user_input, 'L'))	
+	// NOTE: Generated caves go to their own file, they are test inputs and should not replace the edited map.
+	if(WasKeyReleased(user_input, 'G'))
 	{
-		lab_state->map = ReadMapFromFile(map_file, arena);
+		MapGenParams params = GetDefaultMapGenParams(WorldLabCaveMapSide, WorldLabCaveMapSide, lab_state->cave_seed);
+		WriteCaveMapToFile(&params, cave_map_file, scratch_arena);
+		lab_state->cave_seed++;
 	}
 
-	Map *map = &lab_state->map;
+	SparseMap *map = &lab_state->map;
 	DrawMapWithItems(canvas, map);
 
-	if(map->tile_row_n > 0)
+	if(map->has_tiles)
 	{
-		Assert(map->tile_col_n > 0);
-		Rect rect = {};
-		rect.left = 0.0f;
-		rect.right = GetMapWidth(map);
-		rect.top = 0.0f;
-		rect.bottom = GetMapHeight(map);
+		Rect rect = GetTileRect(map->top_row, map->left_col, map->bottom_row, map->right_col);
 
 		V4 border_color = MakeColor(1.0f, 1.0f, 0.0);
 		DrawRectOutline(canvas, rect, border_color);
@@ -578,6 +529,21 @@ func WorldLabUpdate(WorldLabState *lab_state, Canvas *canvas, R32 seconds, UserI
 			HandlePlaceEntityMode(lab_state, canvas, user_input);
 			break;
 		}
+		case FillRectMode:
+		{
+			HandleFillRectMode(lab_state, canvas, user_input);
+			break;
+		}
+		case FloodFillMode:
+		{
+			HandleFloodFillMode(lab_state, canvas, user_input);
+			break;
+		}
+		case BrushMode:
+		{
+			HandleBrushMode(lab_state, canvas, user_input);
+			break;
+		}
 		default:
 		{
 			DebugBreak();
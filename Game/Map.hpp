@@ -4,6 +4,7 @@
 #include "Draw.hpp"
 #include "Item.hpp"
 #include "Memory.hpp"
+#include "Profiler.hpp"
 #include "Type.hpp"
 
 enum TileId
@@ -56,17 +57,55 @@ struct MapEntity
 	V2 spawn_position;
 };
 
+#define MapChunkSide 64
+#define MapChunkTileN (MapChunkSide * MapChunkSide)
+
+// NOTE: Tile ids are stored as U8. Every tile also has a passability bit, packed into 64-bit words
+//       so that neighboring tiles can be tested a word at a time. Bit i of a word is column (64 * word + i).
+struct MapChunk
+{
+	U8 tiles[MapChunkTileN];
+	U64 passable_rows[MapChunkSide];
+};
+
+struct MapNav;
+
+// NOTE: A map either has all of its tiles in tile_types and passable_words, or it is streamed:
+//       then tile_types is 0 and chunks points to the resident chunks, 0 for the rest.
+//       Every row of passable_words starts at a new word.
 struct Map
 {
 	I32 tile_row_n;
 	I32 tile_col_n;
-	TileId *tile_types;
+	U8 *tile_types;
+	U64 *passable_words;
+	I32 passable_word_per_row_n;
 
 	I32 item_n;
 	MapItem *items;
 
 	I32 entity_n;
 	MapEntity *entities;
+
+	I32 chunk_row_n;
+	I32 chunk_col_n;
+	MapChunk **chunks;
+
+	MapNav *nav;
+
+	// NOTE: Regions are 4-connected components of passable tiles, region_labels has one label per tile
+	//       and 0 for solid tiles. Tiles that become passable join labels in region_parents,
+	//       the region of a tile is the root of its label. 0 if the map has no regions.
+	//       Streamed maps keep the labels of their resident chunks in chunk_region_labels instead, 0 for the rest.
+	//       They come from the file until are_chunk_regions_local is set, after that every chunk is labeled
+	//       on its own when it arrives.
+	I32 *region_labels;
+	I32 **chunk_region_labels;
+	I32 *region_parents;
+	I32 region_n;
+	I32 max_region_n;
+	B32 are_regions_stale;
+	B32 are_chunk_regions_local;
 };
 
 #define MapTileSide 10.0f
@@ -115,14 +154,352 @@ func IsValidGridIndex(Map *map, IV2 index)
 	return result;
 }
 
+static I32
+func GetMapChunkIndex(Map *map, IV2 tile)
+{
+	I32 chunk_row = tile.row / MapChunkSide;
+	I32 chunk_col = tile.col / MapChunkSide;
+	I32 chunk_index = chunk_row * map->chunk_col_n + chunk_col;
+	return chunk_index;
+}
+
+static I32
+func GetTileIndexInMapChunk(IV2 tile)
+{
+	I32 index = (tile.row % MapChunkSide) * MapChunkSide + (tile.col % MapChunkSide);
+	return index;
+}
+
+// NOTE: Never blocks. Tiles of chunks that are still loading are not resident.
+static B32
+func IsTileResident(Map *map, IV2 tile)
+{
+	Assert(IsValidTile(map, tile));
+	B32 is_resident = true;
+	if(!map->tile_types)
+	{
+		is_resident = (map->chunks[GetMapChunkIndex(map, tile)] != 0);
+	}
+	return is_resident;
+}
+
+// NOTE: Tiles that are not resident read as NoTileId, so they block movement and sight until they arrive.
 static TileId
 func GetTileType(Map *map, IV2 tile)
 {
 	Assert(IsValidTile(map, tile));
-	TileId tile_type = map->tile_types[tile.row * map->tile_col_n + tile.col];
+	TileId tile_type = NoTileId;
+	if(map->tile_types)
+	{
+		tile_type = (TileId)map->tile_types[tile.row * map->tile_col_n + tile.col];
+	}
+	else
+	{
+		MapChunk *chunk = map->chunks[GetMapChunkIndex(map, tile)];
+		if(chunk)
+		{
+			tile_type = (TileId)chunk->tiles[GetTileIndexInMapChunk(tile)];
+		}
+	}
 	return tile_type;
 }
 
+static B32
+func IsPassableTileType(TileId tile_type)
+{
+	B32 is_passable = (tile_type != NoTileId);
+	return is_passable;
+}
+
+static U64
+func GetLowBitMask(I32 bit_n)
+{
+	Assert(IsIntBetween(bit_n, 0, 64));
+	U64 mask = (bit_n == 64) ? ~(U64)0 : (((U64)1 << bit_n) - 1);
+	return mask;
+}
+
+// NOTE: Passability of columns [64 * word_col, 64 * word_col + 64) of a row.
+//       Outside the map and in chunks that are not resident, nothing is passable.
+static U64
+func GetPassableWord(Map *map, I32 row, I32 word_col)
+{
+	U64 word = 0;
+	if(IsIntBetween(row, 0, map->tile_row_n - 1) && word_col >= 0 && word_col * 64 < map->tile_col_n)
+	{
+		if(map->tile_types)
+		{
+			word = map->passable_words[row * map->passable_word_per_row_n + word_col];
+		}
+		else
+		{
+			MapChunk *chunk = map->chunks[(row / MapChunkSide) * map->chunk_col_n + word_col];
+			if(chunk)
+			{
+				word = chunk->passable_rows[row % MapChunkSide];
+			}
+		}
+	}
+	return word;
+}
+
+// NOTE: Bit i is set if tile (row, first_col + i) is passable, col_n is at most 64.
+static U64
+func GetPassableRowMask(Map *map, I32 row, I32 first_col, I32 col_n)
+{
+	Assert(IsIntBetween(col_n, 0, 64));
+	I32 word_col = (first_col >= 0) ? (first_col / 64) : -((63 - first_col) / 64);
+	I32 shift = first_col - word_col * 64;
+
+	U64 mask = GetPassableWord(map, row, word_col) >> shift;
+	if(shift > 0)
+	{
+		mask |= GetPassableWord(map, row, word_col + 1) << (64 - shift);
+	}
+	mask &= GetLowBitMask(col_n);
+	return mask;
+}
+
+// NOTE: The rectangle is inclusive and clipped to the map, tiles outside the map do not count.
+static B32
+func AnySolidTileInRect(Map *map, I32 top_row, I32 left_col, I32 bottom_row, I32 right_col)
+{
+	top_row = IntMax2(top_row, 0);
+	left_col = IntMax2(left_col, 0);
+	bottom_row = IntMin2(bottom_row, map->tile_row_n - 1);
+	right_col = IntMin2(right_col, map->tile_col_n - 1);
+
+	B32 any_solid = false;
+	for(I32 row = top_row; row <= bottom_row && !any_solid; row++)
+	{
+		for(I32 col = left_col; col <= right_col; col += 64)
+		{
+			I32 col_n = IntMin2(64, right_col - col + 1);
+			U64 passable_mask = GetPassableRowMask(map, row, col, col_n);
+			if(passable_mask != GetLowBitMask(col_n))
+			{
+				any_solid = true;
+				break;
+			}
+		}
+	}
+	return any_solid;
+}
+
+static void
+func UpdateMapChunkPassability(MapChunk *chunk)
+{
+	for(I32 row = 0; row < MapChunkSide; row++)
+	{
+		U64 word = 0;
+		U8 *row_tiles = chunk->tiles + row * MapChunkSide;
+		for(I32 col = 0; col < MapChunkSide; col++)
+		{
+			if(IsPassableTileType((TileId)row_tiles[col]))
+			{
+				word |= ((U64)1 << col);
+			}
+		}
+		chunk->passable_rows[row] = word;
+	}
+}
+
+static void
+func UpdateMapPassability(Map *map)
+{
+	Assert(map->tile_types != 0);
+	for(I32 row = 0; row < map->tile_row_n; row++)
+	{
+		U64 *row_words = map->passable_words + row * map->passable_word_per_row_n;
+		for(I32 word_col = 0; word_col < map->passable_word_per_row_n; word_col++)
+		{
+			row_words[word_col] = 0;
+		}
+
+		U8 *row_tiles = map->tile_types + row * map->tile_col_n;
+		for(I32 col = 0; col < map->tile_col_n; col++)
+		{
+			if(IsPassableTileType((TileId)row_tiles[col]))
+			{
+				row_words[col >> 6] |= ((U64)1 << (col & 63));
+			}
+		}
+	}
+}
+
+struct MapRegionRun
+{
+	I32 row;
+	I32 first_col;
+	I32 last_col;
+	I32 parent;
+};
+
+// NOTE: Index of the first bit at or after col that is set (or not set) in the row, col_n if there is none.
+static I32
+func FindNextPassableBit(U64 *row_words, I32 col_n, I32 col, B32 is_passable)
+{
+	I32 result = col_n;
+	U64 flip = (is_passable) ? 0 : ~(U64)0;
+	I32 word_n = (col_n + 63) / 64;
+	I32 word_col = col >> 6;
+	if(word_col < word_n)
+	{
+		U64 word = (row_words[word_col] ^ flip) & (~(U64)0 << (col & 63));
+		while(word == 0 && word_col + 1 < word_n)
+		{
+			word_col++;
+			word = row_words[word_col] ^ flip;
+		}
+		if(word != 0)
+		{
+			result = IntMin2(col_n, word_col * 64 + GetLowestSetBitIndex(word));
+		}
+	}
+	return result;
+}
+
+static I32
+func FindMapRegionRoot(MapRegionRun *runs, I32 run_index)
+{
+	while(runs[run_index].parent != run_index)
+	{
+		runs[run_index].parent = runs[runs[run_index].parent].parent;
+		run_index = runs[run_index].parent;
+	}
+	return run_index;
+}
+
+// NOTE: Two pass labeling on runs of passable tiles. The first pass joins every run with the runs of the row
+//       above that it touches, the second pass numbers the roots from 1. labels has one I32 per tile.
+//       Every row of passable_words starts at a new word. Returns the number of regions.
+static I32
+func LabelPassableRegions(U64 *passable_words, I32 word_per_row_n, I32 row_n, I32 col_n, I32 *labels,
+						  MemArena *tmp_arena)
+{
+	TempMemory temp_memory = BeginTempMemory(tmp_arena);
+	I32 *row_first_runs = ArenaAllocArray(tmp_arena, I32, row_n + 1);
+	MapRegionRun *runs = (MapRegionRun *)GetArenaTop(tmp_arena);
+	I32 run_n = 0;
+
+	for(I32 row = 0; row < row_n; row++)
+	{
+		row_first_runs[row] = run_n;
+		U64 *row_words = passable_words + row * word_per_row_n;
+		I32 above_run = (row > 0) ? row_first_runs[row - 1] : 0;
+		I32 above_end = run_n;
+
+		I32 col = FindNextPassableBit(row_words, col_n, 0, true);
+		while(col < col_n)
+		{
+			I32 end_col = FindNextPassableBit(row_words, col_n, col, false);
+			MapRegionRun *run = ArenaAllocType(tmp_arena, MapRegionRun);
+			run->row = row;
+			run->first_col = col;
+			run->last_col = end_col - 1;
+			run->parent = run_n;
+
+			while(above_run < above_end && runs[above_run].last_col < col)
+			{
+				above_run++;
+			}
+			for(I32 i = above_run; i < above_end && runs[i].first_col <= end_col - 1; i++)
+			{
+				I32 root = FindMapRegionRoot(runs, i);
+				I32 run_root = FindMapRegionRoot(runs, run_n);
+				if(root < run_root)
+				{
+					runs[run_root].parent = root;
+				}
+				else if(run_root < root)
+				{
+					runs[root].parent = run_root;
+				}
+			}
+			run_n++;
+
+			col = FindNextPassableBit(row_words, col_n, end_col, true);
+		}
+	}
+	row_first_runs[row_n] = run_n;
+
+	// NOTE: A parent always has a smaller index than its child, so it has its label by the time the child is reached.
+	//       Labels are stored as -label in parent.
+	I32 region_n = 0;
+	for(I32 i = 0; i < run_n; i++)
+	{
+		I32 parent = runs[i].parent;
+		if(parent == i)
+		{
+			region_n++;
+			runs[i].parent = -region_n;
+		}
+		else
+		{
+			Assert(parent < i);
+			runs[i].parent = runs[parent].parent;
+		}
+	}
+
+	I32 tile_n = row_n * col_n;
+	for(I32 i = 0; i < tile_n; i++)
+	{
+		labels[i] = 0;
+	}
+	for(I32 i = 0; i < run_n; i++)
+	{
+		MapRegionRun *run = &runs[i];
+		I32 *row_labels = labels + run->row * col_n;
+		for(I32 col = run->first_col; col <= run->last_col; col++)
+		{
+			row_labels[col] = -run->parent;
+		}
+	}
+
+	EndTempMemory(temp_memory);
+	return region_n;
+}
+
+// NOTE: The map needs flat tiles.
+static I32
+func LabelMapRegions(Map *map, I32 *labels, MemArena *tmp_arena)
+{
+	Assert(map->tile_types != 0);
+	I32 region_n = LabelPassableRegions(map->passable_words, map->passable_word_per_row_n,
+										map->tile_row_n, map->tile_col_n, labels, tmp_arena);
+	return region_n;
+}
+
+// NOTE: Allocates tile_types and passable_words for the current size, every tile is NoTileId.
+static void
+func AllocMapTiles(Map *map, MemArena *arena)
+{
+	I32 tile_n = map->tile_row_n * map->tile_col_n;
+	map->passable_word_per_row_n = (map->tile_col_n + 63) / 64;
+	I32 word_n = map->tile_row_n * map->passable_word_per_row_n;
+
+	map->tile_types = ArenaAllocArray(arena, U8, tile_n);
+	for(I32 i = 0; i < tile_n; i++)
+	{
+		map->tile_types[i] = NoTileId;
+	}
+
+	map->passable_words = ArenaAllocArray(arena, U64, word_n);
+	for(I32 i = 0; i < word_n; i++)
+	{
+		map->passable_words[i] = 0;
+	}
+}
+
+static void
+func CopyMapTiles(Map *map, MemArena *arena)
+{
+	I32 tile_n = map->tile_row_n * map->tile_col_n;
+	I32 word_n = map->tile_row_n * map->passable_word_per_row_n;
+	map->tile_types = (U8 *)ArenaPushData(arena, tile_n * sizeof(U8), map->tile_types);
+	map->passable_words = (U64 *)ArenaPushData(arena, word_n * sizeof(U64), map->passable_words);
+}
+
 static B32
 func IsTileType(Map *map, IV2 tile, TileId type)
 {
@@ -131,11 +508,429 @@ func IsTileType(Map *map, IV2 tile, TileId type)
 	return is_type;
 }
 
+#define MapRegionSpareLabelN 1024
+
+// NOTE: max_region_n is the number of labels that can exist before the map is labeled again,
+//       tiles that become passable on their own use up a label each.
+static void
+func SetMapRegionLabels(Map *map, I32 *labels, I32 region_n, I32 max_region_n, MemArena *arena)
+{
+	Assert(region_n <= max_region_n);
+	map->region_labels = labels;
+	map->region_n = region_n;
+	map->max_region_n = max_region_n;
+	map->region_parents = ArenaAllocArray(arena, I32, max_region_n + 1);
+	for(I32 i = 0; i <= max_region_n; i++)
+	{
+		map->region_parents[i] = i;
+	}
+	map->are_regions_stale = false;
+}
+
+// NOTE: A 4-connected grid has at most half of its tiles as separate regions, so labeling again always fits.
+static I32
+func GetMaxMapRegionN(Map *map)
+{
+	I32 tile_n = map->tile_row_n * map->tile_col_n;
+	I32 max_region_n = (tile_n + 1) / 2;
+	return max_region_n;
+}
+
+// NOTE: The map needs flat tiles.
+static void
+func InitMapRegions(Map *map, MemArena *arena)
+{
+	I32 tile_n = map->tile_row_n * map->tile_col_n;
+	I32 *labels = ArenaAllocArray(arena, I32, tile_n);
+	I32 region_n = LabelMapRegions(map, labels, arena);
+	SetMapRegionLabels(map, labels, region_n, GetMaxMapRegionN(map), arena);
+}
+
+static I32
+func FindMapRegion(Map *map, I32 label)
+{
+	I32 *parents = map->region_parents;
+	while(parents[label] != label)
+	{
+		parents[label] = parents[parents[label]];
+		label = parents[label];
+	}
+	return label;
+}
+
+static B32
+func HasMapRegions(Map *map)
+{
+	B32 has_regions = (map->region_labels != 0 || map->chunk_region_labels != 0);
+	return has_regions;
+}
+
+// NOTE: 0 for tiles of streamed chunks that are not resident.
+static I32 *
+func GetTileRegionLabelAddress(Map *map, IV2 tile)
+{
+	I32 *label = 0;
+	if(map->region_labels)
+	{
+		label = &map->region_labels[tile.row * map->tile_col_n + tile.col];
+	}
+	else
+	{
+		I32 *chunk_labels = map->chunk_region_labels[GetMapChunkIndex(map, tile)];
+		if(chunk_labels)
+		{
+			label = &chunk_labels[GetTileIndexInMapChunk(tile)];
+		}
+	}
+	return label;
+}
+
+static I32
+func GetTileRegionLabel(Map *map, IV2 tile)
+{
+	I32 label = 0;
+	if(IsValidTile(map, tile))
+	{
+		I32 *label_address = GetTileRegionLabelAddress(map, tile);
+		if(label_address)
+		{
+			label = *label_address;
+		}
+	}
+	return label;
+}
+
+// NOTE: Tiles of streamed chunks that are not resident have no label.
+static B32
+func HasTileRegionLabel(Map *map, IV2 tile)
+{
+	B32 has_label = (!IsValidTile(map, tile) || GetTileRegionLabelAddress(map, tile) != 0);
+	return has_label;
+}
+
+// NOTE: False only if no path can lead from one tile to the other. A tile that became solid can split
+//       its region, until the map is labeled again the two halves still count as one region.
+//       Tiles that are not resident can be in any region.
+static B32
+func SameRegion(Map *map, IV2 tile1, IV2 tile2)
+{
+	B32 same_region = true;
+	if(HasMapRegions(map) && HasTileRegionLabel(map, tile1) && HasTileRegionLabel(map, tile2))
+	{
+		I32 label1 = GetTileRegionLabel(map, tile1);
+		I32 label2 = GetTileRegionLabel(map, tile2);
+		if(label1 == 0 || label2 == 0)
+		{
+			same_region = map->are_regions_stale;
+		}
+		else
+		{
+			same_region = (FindMapRegion(map, label1) == FindMapRegion(map, label2));
+		}
+	}
+	return same_region;
+}
+
+// NOTE: The smaller root becomes the parent, like in LabelPassableRegions.
+static I32
+func JoinMapRegions(Map *map, I32 label1, I32 label2)
+{
+	I32 root1 = FindMapRegion(map, label1);
+	I32 root2 = FindMapRegion(map, label2);
+	I32 root = IntMin2(root1, root2);
+	map->region_parents[root1] = root;
+	map->region_parents[root2] = root;
+	return root;
+}
+
+// NOTE: Walks the 8 tiles around the tile, each step goes to a side neighbor of the last tile.
+//       The side neighbors stay connected without the tile if all of them are on a single passable arc.
+static B32
+func CanSolidTileSplitRegion(Map *map, IV2 tile)
+{
+	IV2 ring_offsets[8] =
+	{
+		MakeIntPoint(-1, 0), MakeIntPoint(-1, +1), MakeIntPoint(0, +1), MakeIntPoint(+1, +1),
+		MakeIntPoint(+1, 0), MakeIntPoint(+1, -1), MakeIntPoint(0, -1), MakeIntPoint(-1, -1)
+	};
+	B32 is_passable[8] = {};
+	I32 solid_index = -1;
+	for(I32 i = 0; i < 8; i++)
+	{
+		is_passable[i] = (GetTileRegionLabel(map, tile + ring_offsets[i]) != 0);
+		if(!is_passable[i])
+		{
+			solid_index = i;
+		}
+	}
+
+	I32 side_arc_n = 0;
+	if(solid_index >= 0)
+	{
+		B32 arc_has_side = false;
+		for(I32 step = 1; step <= 8; step++)
+		{
+			I32 i = (solid_index + step) % 8;
+			if(is_passable[i])
+			{
+				if((i % 2) == 0 && !arc_has_side)
+				{
+					arc_has_side = true;
+					side_arc_n++;
+				}
+			}
+			else
+			{
+				arc_has_side = false;
+			}
+		}
+	}
+	B32 can_split = (side_arc_n > 1);
+	return can_split;
+}
+
+// NOTE: Keeps the labels up to date when the passability of a tile changes, a new passable tile joins
+//       the regions of its side neighbors. When a split is possible or labels run out, the regions
+//       are stale until UpdateMapRegions labels them again.
+static void
+func UpdateTileRegion(Map *map, IV2 tile, B32 is_passable)
+{
+	I32 *label = GetTileRegionLabelAddress(map, tile);
+	Assert(label != 0);
+	if(is_passable && *label == 0)
+	{
+		IV2 side_offsets[4] = {MakeIntPoint(-1, 0), MakeIntPoint(+1, 0), MakeIntPoint(0, -1), MakeIntPoint(0, +1)};
+		I32 root = 0;
+		for(I32 i = 0; i < 4; i++)
+		{
+			I32 side_label = GetTileRegionLabel(map, tile + side_offsets[i]);
+			if(side_label != 0)
+			{
+				root = (root == 0) ? FindMapRegion(map, side_label) : JoinMapRegions(map, root, side_label);
+			}
+		}
+
+		if(root == 0 && map->region_n < map->max_region_n)
+		{
+			map->region_n++;
+			root = map->region_n;
+		}
+
+		if(root == 0)
+		{
+			map->are_regions_stale = true;
+		}
+		*label = root;
+	}
+	else if(!is_passable && *label != 0)
+	{
+		*label = 0;
+		if(CanSolidTileSplitRegion(map, tile))
+		{
+			map->are_regions_stale = true;
+		}
+	}
+}
+
+// NOTE: Regions of streamed chunks that reach a chunk that is not resident join this label,
+//       as the tiles they cannot see could connect them to anything.
+#define OpenMapRegionLabel 1
+// NOTE: A chunk has at most half of its tiles as separate regions, like a whole map.
+#define MaxMapChunkRegionN (MapChunkTileN / 2)
+// NOTE: What LabelMapChunkRegions takes from the temporary arena.
+#define MapChunkRegionTempSize (MapChunkSide * sizeof(U64) + (MapChunkSide + 1) * sizeof(I32) + \
+								MapChunkSide * (MapChunkSide / 2) * sizeof(MapRegionRun))
+
+// NOTE: Labels a resident chunk on its own, its labels come after the ones in use.
+static void
+func LabelMapChunkRegions(Map *map, I32 chunk_index, MemArena *tmp_arena)
+{
+	Assert(map->region_n + MaxMapChunkRegionN <= map->max_region_n);
+	MapChunk *chunk = map->chunks[chunk_index];
+	I32 *labels = map->chunk_region_labels[chunk_index];
+	Assert(chunk != 0 && labels != 0);
+
+	I32 chunk_row = chunk_index / map->chunk_col_n;
+	I32 chunk_col = chunk_index % map->chunk_col_n;
+	I32 row_n = IntMin2(MapChunkSide, map->tile_row_n - chunk_row * MapChunkSide);
+	U64 col_mask = GetLowBitMask(IntMin2(MapChunkSide, map->tile_col_n - chunk_col * MapChunkSide));
+
+	TempMemory temp_memory = BeginTempMemory(tmp_arena);
+	U64 *passable_rows = ArenaAllocArray(tmp_arena, U64, MapChunkSide);
+	for(I32 row = 0; row < MapChunkSide; row++)
+	{
+		passable_rows[row] = (row < row_n) ? (chunk->passable_rows[row] & col_mask) : 0;
+	}
+	I32 region_n = LabelPassableRegions(passable_rows, 1, MapChunkSide, MapChunkSide, labels, tmp_arena);
+	EndTempMemory(temp_memory);
+
+	for(I32 i = 0; i < MapChunkTileN; i++)
+	{
+		if(labels[i] != 0)
+		{
+			labels[i] += map->region_n;
+		}
+	}
+	map->region_n += region_n;
+}
+
+static void
+func JoinMapRegionAcrossChunkSide(Map *map, IV2 tile, IV2 side_offset)
+{
+	I32 label = GetTileRegionLabel(map, tile);
+	IV2 other_tile = tile + side_offset;
+	if(label != 0 && IsValidTile(map, other_tile))
+	{
+		I32 other_label = OpenMapRegionLabel;
+		if(map->chunk_region_labels[GetMapChunkIndex(map, other_tile)])
+		{
+			other_label = GetTileRegionLabel(map, other_tile);
+		}
+
+		if(other_label != 0)
+		{
+			JoinMapRegions(map, label, other_label);
+		}
+	}
+}
+
+// NOTE: Joins the regions on the sides of a resident chunk with the regions across them.
+static void
+func JoinMapChunkRegionSides(Map *map, I32 chunk_index)
+{
+	I32 first_row = (chunk_index / map->chunk_col_n) * MapChunkSide;
+	I32 first_col = (chunk_index % map->chunk_col_n) * MapChunkSide;
+	I32 last_row = IntMin2(first_row + MapChunkSide, map->tile_row_n) - 1;
+	I32 last_col = IntMin2(first_col + MapChunkSide, map->tile_col_n) - 1;
+	for(I32 row = first_row; row <= last_row; row++)
+	{
+		JoinMapRegionAcrossChunkSide(map, MakeTile(row, first_col), MakeIntPoint(0, -1));
+		JoinMapRegionAcrossChunkSide(map, MakeTile(row, last_col), MakeIntPoint(0, +1));
+	}
+	for(I32 col = first_col; col <= last_col; col++)
+	{
+		JoinMapRegionAcrossChunkSide(map, MakeTile(first_row, col), MakeIntPoint(-1, 0));
+		JoinMapRegionAcrossChunkSide(map, MakeTile(last_row, col), MakeIntPoint(+1, 0));
+	}
+}
+
+// NOTE: Only the resident chunks are labeled, the rest of the map is never decoded for it.
+static void
+func LabelResidentMapChunkRegions(Map *map, MemArena *tmp_arena)
+{
+	map->region_n = OpenMapRegionLabel;
+	for(I32 i = 0; i <= map->max_region_n; i++)
+	{
+		map->region_parents[i] = i;
+	}
+
+	I32 chunk_n = map->chunk_row_n * map->chunk_col_n;
+	for(I32 i = 0; i < chunk_n; i++)
+	{
+		if(map->chunk_region_labels[i])
+		{
+			LabelMapChunkRegions(map, i, tmp_arena);
+		}
+	}
+	for(I32 i = 0; i < chunk_n; i++)
+	{
+		if(map->chunk_region_labels[i])
+		{
+			JoinMapChunkRegionSides(map, i);
+		}
+	}
+	map->are_chunk_regions_local = true;
+	map->are_regions_stale = false;
+}
+
+// NOTE: Call when a chunk of a streamed map with local regions arrives, after its chunk and labels are set.
+//       When the labels run out every resident chunk is labeled again.
+static void
+func AddMapChunkRegions(Map *map, I32 chunk_index, MemArena *tmp_arena)
+{
+	Assert(map->are_chunk_regions_local);
+	if(map->region_n + MaxMapChunkRegionN > map->max_region_n)
+	{
+		LabelResidentMapChunkRegions(map, tmp_arena);
+	}
+	else
+	{
+		LabelMapChunkRegions(map, chunk_index, tmp_arena);
+		JoinMapChunkRegionSides(map, chunk_index);
+	}
+}
+
+// NOTE: Edits of an evicted chunk are lost, so with local regions its resident neighbors open up towards it.
+static void
+func RemoveMapChunkRegions(Map *map, I32 chunk_index)
+{
+	map->chunk_region_labels[chunk_index] = 0;
+	if(map->are_chunk_regions_local)
+	{
+		I32 chunk_row = chunk_index / map->chunk_col_n;
+		I32 chunk_col = chunk_index % map->chunk_col_n;
+		IV2 side_offsets[4] = {MakeIntPoint(-1, 0), MakeIntPoint(+1, 0), MakeIntPoint(0, -1), MakeIntPoint(0, +1)};
+		for(I32 i = 0; i < 4; i++)
+		{
+			I32 row = chunk_row + side_offsets[i].row;
+			I32 col = chunk_col + side_offsets[i].col;
+			if(IsIntBetween(row, 0, map->chunk_row_n - 1) && IsIntBetween(col, 0, map->chunk_col_n - 1) &&
+			   map->chunk_region_labels[row * map->chunk_col_n + col])
+			{
+				JoinMapChunkRegionSides(map, row * map->chunk_col_n + col);
+			}
+		}
+	}
+}
+
+// NOTE: Labels stale regions again. Streamed maps only label their resident chunks and keep labeling
+//       chunks on their own from then on.
+static void
+func UpdateMapRegions(Map *map, MemArena *tmp_arena)
+{
+	ProfileFunction();
+	if(map->region_labels && map->are_regions_stale && map->tile_types)
+	{
+		I32 region_n = LabelMapRegions(map, map->region_labels, tmp_arena);
+		Assert(region_n <= map->max_region_n);
+		map->region_n = region_n;
+		for(I32 i = 0; i <= map->max_region_n; i++)
+		{
+			map->region_parents[i] = i;
+		}
+		map->are_regions_stale = false;
+	}
+	else if(map->chunk_region_labels && map->are_regions_stale)
+	{
+		LabelResidentMapChunkRegions(map, tmp_arena);
+	}
+}
+
 static void
 func SetTileType(Map *map, IV2 tile, TileId type)
 {
 	Assert(IsValidTile(map, tile));
-	map->tile_types[tile.row * map->tile_col_n + tile.col] = type;
+	U64 bit = ((U64)1 << (tile.col & 63));
+	if(map->tile_types)
+	{
+		map->tile_types[tile.row * map->tile_col_n + tile.col] = (U8)type;
+		U64 *word = &map->passable_words[tile.row * map->passable_word_per_row_n + (tile.col >> 6)];
+		*word = (IsPassableTileType(type)) ? (*word | bit) : (*word & ~bit);
+	}
+	else
+	{
+		// NOTE: Changes to streamed chunks only last until the chunk is evicted.
+		MapChunk *chunk = map->chunks[GetMapChunkIndex(map, tile)];
+		Assert(chunk != 0);
+		chunk->tiles[GetTileIndexInMapChunk(tile)] = (U8)type;
+		U64 *word = &chunk->passable_rows[tile.row % MapChunkSide];
+		*word = (IsPassableTileType(type)) ? (*word | bit) : (*word & ~bit);
+	}
+
+	if(HasMapRegions(map))
+	{
+		UpdateTileRegion(map, tile, IsPassableTileType(type));
+	}
 }
 
 static IV2
@@ -171,7 +966,7 @@ static B32
 func IsPassableTile(Map *map, IV2 tile)
 {
 	TileId tile_type = GetTileType(map, tile);
-	bool is_passable = (tile_type != NoTileId);
+	B32 is_passable = IsPassableTileType(tile_type);
 	return is_passable;
 }
 
@@ -194,18 +989,12 @@ func GetContainingTile(Map *map, V2 point)
 }
 
 static V4
-func GetTileColor(Map* map, I32 row, I32 col)
+func GetTileTypeColor(TileId tile_type)
 {
-	Assert(IsIntBetween(row, 0, map->tile_row_n - 1));
-	Assert(IsIntBetween(col, 0, map->tile_col_n - 1));
-
-	I32 tile_index = row * map->tile_col_n + col;
-
 	V4 black_color = MakeColor(0.0f, 0.0f, 0.0f);
 	V4 cave_color  = MakeColor(0.2f, 0.05f, 0.0f);
 
 	V4 color = {};
-	TileId tile_type = map->tile_types[tile_index];
 	switch(tile_type)
 	{
 		case NoTileId:
@@ -227,6 +1016,17 @@ func GetTileColor(Map* map, I32 row, I32 col)
 	return color;
 }
 
+static V4
+func GetTileColor(Map* map, I32 row, I32 col)
+{
+	Assert(IsIntBetween(row, 0, map->tile_row_n - 1));
+	Assert(IsIntBetween(col, 0, map->tile_col_n - 1));
+
+	TileId tile_type = GetTileType(map, MakeTile(row, col));
+	V4 color = GetTileTypeColor(tile_type);
+	return color;
+}
+
 static Rect
 func GetTileRect(Map *map, IV2 tile)
 {
@@ -254,28 +1054,45 @@ static B32 TilesAreAdjacent(IV2 tile1, IV2 tile2)
 
 #define MapItemRadius 0.2f
 
+static V4
+func GetMapItemColor()
+{
+	V4 item_color = MakeColor(0.5f, 0.0f, 0.5f);
+	return item_color;
+}
+
 static void
 func DrawMapItem(Canvas *canvas, MapItem *item)
 {
-	V4 item_color = MakeColor(0.5f, 0.0f, 0.5f);
-	DrawCircle(canvas, item->position, MapItemRadius, item_color);
+	DrawCircle(canvas, item->position, MapItemRadius, GetMapItemColor());
+}
+
+static void
+func DrawMapItemsAt(Canvas *canvas, V2 *positions, I32 position_n)
+{
+	ProfileFunction();
+	DrawCircles(canvas, positions, position_n, MapItemRadius, GetMapItemColor());
 }
 
 static void
 func DrawMapWithoutItems(Canvas *canvas, Map *map)
 {
+	ProfileFunction();
 	Camera *camera = canvas->camera;
 	R32 camera_left   = CameraLeftSide(camera);
 	R32 camera_right  = CameraRightSide(camera);
 	R32 camera_top    = CameraTopSide(camera);
 	R32 camera_bottom = CameraBottomSide(camera);
 
-	R32 map_left   = 0.0f;
-	R32 map_right  = GetMapWidth(map);
-	R32 map_top    = 0.0f;
-	R32 map_bottom = GetMapHeight(map);
+	R32 map_left = 0.0f;
+	R32 map_top  = 0.0f;
 
-	for(I32 row = 0; row < map->tile_row_n; row++)
+	I32 first_row = IntMax2(0, Floor((camera_top - map_top) / MapTileSide));
+	I32 last_row  = IntMin2(map->tile_row_n - 1, Floor((camera_bottom - map_top) / MapTileSide));
+	I32 first_col = IntMax2(0, Floor((camera_left - map_left) / MapTileSide));
+	I32 last_col  = IntMin2(map->tile_col_n - 1, Floor((camera_right - map_left) / MapTileSide));
+
+	for(I32 row = first_row; row <= last_row; row++)
 	{
 		R32 tile_top    = map_top + MapTileSide * row;
 		R32 tile_bottom = tile_top + MapTileSide;
@@ -284,7 +1101,7 @@ func DrawMapWithoutItems(Canvas *canvas, Map *map)
 			continue;
 		}
 
-		for(I32 col = 0; col < map->tile_col_n; col++)
+		for(I32 col = first_col; col <= last_col; col++)
 		{
 			R32 tile_left  = map_left + MapTileSide * col;
 			R32 tile_right = tile_left + MapTileSide;
@@ -297,49 +1114,4 @@ func DrawMapWithoutItems(Canvas *canvas, Map *map)
 			DrawRectLRTB(canvas, tile_left, tile_right, tile_top, tile_bottom, color);
 		}
 	}
-}
-
-#define MapVersion 3
-
-static Map
-func ReadMapFromFile(I8 *file_path, MemArena *arena)
-{
-	HANDLE file = CreateFileA(file_path, GENERIC_READ, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
-	Assert(file != INVALID_HANDLE_VALUE);
-
-	arena->used_size = 0;
-	DWORD file_size = GetFileSize(file, 0);
-	Assert(file_size <= arena->max_size);
-
-	DWORD read_size = 0;
-	bool result = ReadFile(file, arena->base_address, file_size, &read_size, 0);
-	Assert(result);
-	Assert(file_size == read_size);
-	arena->used_size += file_size;
-
-	I8 *base = arena->base_address;
-
-	I8 *position = base;
-	I32 version = *(I32 *)position;
-	Assert(version == MapVersion);
-
-	position += sizeof(I32);
-
-	Map *map = (Map *)position;
-	map->tile_types = (TileId *)GetAbsoluteAddress(map->tile_types, base);
-	map->items = (MapItem *)GetAbsoluteAddress(map->items, base);
-	map->entities = (MapEntity *)GetAbsoluteAddress(map->entities, base);
-
-	position += sizeof(Map);
-	position += map->tile_row_n * map->tile_col_n * sizeof(TileId);
-	position += map->item_n * sizeof(MapItem);
-	position += map->entity_n * sizeof(MapEntity);
-
-	I8 *arena_top = GetArenaTop(arena);
-	Assert(position == arena_top);
-
-	result = CloseHandle(file);
-	Assert(result);
-
-	return *map;
 }
\ No newline at end of file
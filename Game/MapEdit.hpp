@@ -0,0 +1,535 @@
+#pragma once
+
+#include "Debug.hpp"
+#include "Map.hpp"
+#include "Math.hpp"
+#include "Memory.hpp"
+#include "SparseMap.hpp"
+#include "Type.hpp"
+
+// NOTE: Bulk tile edits on a SparseMap. Everything is built on filling a span of one tile row:
+//       tiles are written eight at a time and the passability bits a word at a time.
+//       Every changed run of tiles goes into the journal as (row, col, tile_n, old type, new type),
+//       so undo and redo never copy the map.
+
+struct MapEditRun
+{
+	I32 row;
+	I32 col;
+	I32 tile_n;
+	U8 old_type;
+	U8 new_type;
+};
+
+struct MapEdit
+{
+	I32 first_run;
+	I32 run_n;
+};
+
+struct MapEditJournal
+{
+	MapEditRun *runs;
+	I32 run_n;
+	I32 max_run_n;
+
+	MapEdit *edits;
+	I32 edit_n;
+	I32 max_edit_n;
+	I32 undone_edit_n;
+
+	B32 is_recording;
+	B32 recording_overflowed;
+};
+
+static MapEditJournal
+func CreateMapEditJournal(MemArena *arena, I32 max_edit_n, I32 max_run_n)
+{
+	Assert(max_edit_n > 1 && max_run_n > 0);
+	MapEditJournal journal = {};
+	journal.edits = ArenaAllocArray(arena, MapEdit, max_edit_n);
+	journal.max_edit_n = max_edit_n;
+	journal.runs = ArenaAllocArray(arena, MapEditRun, max_run_n);
+	journal.max_run_n = max_run_n;
+	return journal;
+}
+
+// NOTE: Forgets the oldest edits until at least a quarter of both buffers is free.
+static void
+func DropOldestMapEdits(MapEditJournal *journal)
+{
+	I32 drop_edit_n = 0;
+	I32 drop_run_n = 0;
+	while(drop_edit_n < journal->edit_n - 1 &&
+		  (journal->edit_n - drop_edit_n > (3 * journal->max_edit_n) / 4 ||
+		   journal->run_n - drop_run_n > (3 * journal->max_run_n) / 4))
+	{
+		drop_run_n += journal->edits[drop_edit_n].run_n;
+		drop_edit_n++;
+	}
+
+	for(I32 i = drop_edit_n; i < journal->edit_n; i++)
+	{
+		MapEdit edit = journal->edits[i];
+		edit.first_run -= drop_run_n;
+		journal->edits[i - drop_edit_n] = edit;
+	}
+	journal->edit_n -= drop_edit_n;
+
+	for(I32 i = drop_run_n; i < journal->run_n; i++)
+	{
+		journal->runs[i - drop_run_n] = journal->runs[i];
+	}
+	journal->run_n -= drop_run_n;
+}
+
+static void
+func BeginMapEdit(MapEditJournal *journal)
+{
+	Assert(!journal->is_recording);
+	if(journal->undone_edit_n > 0)
+	{
+		journal->edit_n -= journal->undone_edit_n;
+		journal->undone_edit_n = 0;
+		journal->run_n = (journal->edit_n > 0) ? (journal->edits[journal->edit_n - 1].first_run +
+												   journal->edits[journal->edit_n - 1].run_n) : 0;
+	}
+
+	if(journal->edit_n == journal->max_edit_n)
+	{
+		DropOldestMapEdits(journal);
+	}
+
+	MapEdit *edit = &journal->edits[journal->edit_n];
+	journal->edit_n++;
+	edit->first_run = journal->run_n;
+	edit->run_n = 0;
+	journal->is_recording = true;
+}
+
+static void
+func EndMapEdit(MapEditJournal *journal)
+{
+	Assert(journal->is_recording);
+	journal->is_recording = false;
+	if(journal->recording_overflowed)
+	{
+		journal->recording_overflowed = false;
+	}
+	else if(journal->edits[journal->edit_n - 1].run_n == 0)
+	{
+		journal->edit_n--;
+	}
+}
+
+static void
+func AddMapEditRun(MapEditJournal *journal, I32 row, I32 col, I32 tile_n, U8 old_type, U8 new_type)
+{
+	Assert(journal->is_recording);
+	if(journal->recording_overflowed)
+	{
+		return;
+	}
+
+	MapEdit *edit = &journal->edits[journal->edit_n - 1];
+	if(edit->run_n > 0)
+	{
+		MapEditRun *last_run = &journal->runs[journal->run_n - 1];
+		if(last_run->row == row && last_run->col + last_run->tile_n == col &&
+		   last_run->old_type == old_type && last_run->new_type == new_type)
+		{
+			last_run->tile_n += tile_n;
+			return;
+		}
+	}
+
+	if(journal->run_n == journal->max_run_n)
+	{
+		DropOldestMapEdits(journal);
+		edit = &journal->edits[journal->edit_n - 1];
+	}
+
+	// NOTE: A single edit that fills the whole journal can not be undone completely.
+	//       It is not recorded at all, and the edits before it are forgotten too, since they would be undone on the wrong tiles.
+	if(journal->run_n == journal->max_run_n)
+	{
+		journal->edit_n = 0;
+		journal->run_n = 0;
+		journal->undone_edit_n = 0;
+		journal->recording_overflowed = true;
+		return;
+	}
+
+	MapEditRun *run = &journal->runs[journal->run_n];
+	journal->run_n++;
+	edit->run_n++;
+	run->row = row;
+	run->col = col;
+	run->tile_n = tile_n;
+	run->old_type = old_type;
+	run->new_type = new_type;
+}
+
+static U64
+func GetTileFillWord(TileId type)
+{
+	U64 fill_word = (U64)(U8)type * 0x0101010101010101ULL;
+	return fill_word;
+}
+
+// NOTE: col_n tiles starting at col, the span has to be inside one chunk.
+static void
+func FillMapChunkRowSpan(MapChunk *chunk, I32 row, I32 col, I32 col_n, TileId type)
+{
+	Assert(IsIntBetween(row, 0, MapChunkSide - 1));
+	Assert(col >= 0 && col_n > 0 && col + col_n <= MapChunkSide);
+
+	U8 *tiles = chunk->tiles + row * MapChunkSide;
+	U64 fill_word = GetTileFillWord(type);
+	I32 index = col;
+	I32 end = col + col_n;
+	while(index < end && (index & 7) != 0)
+	{
+		tiles[index] = (U8)type;
+		index++;
+	}
+	while(index + 8 <= end)
+	{
+		*(U64 *)(tiles + index) = fill_word;
+		index += 8;
+	}
+	while(index < end)
+	{
+		tiles[index] = (U8)type;
+		index++;
+	}
+
+	U64 span_mask = GetLowBitMask(col_n) << col;
+	if(IsPassableTileType(type))
+	{
+		chunk->passable_rows[row] |= span_mask;
+	}
+	else
+	{
+		chunk->passable_rows[row] &= ~span_mask;
+	}
+}
+
+static void
+func RecordMapChunkRowSpan(MapEditJournal *journal, MapChunk *chunk, I32 tile_row, I32 chunk_left,
+						   I32 row, I32 col, I32 col_n, TileId type)
+{
+	U8 *tiles = chunk->tiles + row * MapChunkSide;
+	U64 fill_word = GetTileFillWord(type);
+	I32 index = col;
+	I32 end = col + col_n;
+	while(index < end)
+	{
+		// NOTE: Skip eight tiles at a time while they already have the new type.
+		if((index & 7) == 0 && index + 8 <= end && *(U64 *)(tiles + index) == fill_word)
+		{
+			index += 8;
+			continue;
+		}
+
+		U8 old_type = tiles[index];
+		if(old_type == (U8)type)
+		{
+			index++;
+			continue;
+		}
+
+		I32 run_start = index;
+		while(index < end && tiles[index] == old_type)
+		{
+			index++;
+		}
+		AddMapEditRun(journal, tile_row, chunk_left + run_start, index - run_start, old_type, (U8)type);
+	}
+}
+
+// NOTE: Fills tile_n tiles of a row starting at col. The journal can be 0.
+static void
+func FillSparseMapRowSpan(SparseMap *map, I32 row, I32 col, I32 tile_n, TileId type, MapEditJournal *journal)
+{
+	if(tile_n <= 0)
+	{
+		return;
+	}
+
+	if(type != NoTileId)
+	{
+		ExtendSparseMapBounds(map, row, col);
+		ExtendSparseMapBounds(map, row, col + tile_n - 1);
+	}
+
+	I32 chunk_row = GetSparseMapChunkCoordinate(row);
+	I32 chunk_top = chunk_row * MapChunkSide;
+	I32 end_col = col + tile_n;
+	while(col < end_col)
+	{
+		I32 chunk_col = GetSparseMapChunkCoordinate(col);
+		I32 chunk_left = chunk_col * MapChunkSide;
+		I32 span_n = IntMin2(end_col, chunk_left + MapChunkSide) - col;
+
+		SparseMapSlot *slot = (type == NoTileId) ? FindSparseMapSlot(map->slots, map->slot_n, chunk_row, chunk_col) :
+												   GetOrAddSparseMapSlot(map, chunk_row, chunk_col);
+		MapChunk *chunk = slot->chunk;
+		if(chunk)
+		{
+			MarkSparseMapSlotChanged(map, slot);
+			if(journal)
+			{
+				RecordMapChunkRowSpan(journal, chunk, row, chunk_left, row - chunk_top, col - chunk_left, span_n, type);
+			}
+			FillMapChunkRowSpan(chunk, row - chunk_top, col - chunk_left, span_n, type);
+		}
+		col += span_n;
+	}
+}
+
+// NOTE: The rectangle is inclusive.
+static void
+func FillSparseMapRect(SparseMap *map, I32 top_row, I32 left_col, I32 bottom_row, I32 right_col,
+					   TileId type, MapEditJournal *journal)
+{
+	for(I32 row = top_row; row <= bottom_row; row++)
+	{
+		FillSparseMapRowSpan(map, row, left_col, right_col - left_col + 1, type, journal);
+	}
+}
+
+// NOTE: Every tile whose center is within radius tiles of the center of the given tile.
+static void
+func PaintSparseMapCircle(SparseMap *map, I32 center_row, I32 center_col, R32 radius, TileId type,
+						  MapEditJournal *journal)
+{
+	I32 row_radius = (I32)radius;
+	for(I32 row_offset = -row_radius; row_offset <= row_radius; row_offset++)
+	{
+		R32 half_width = Sqrt(radius * radius - (R32)(row_offset * row_offset));
+		I32 col_radius = (I32)half_width;
+		FillSparseMapRowSpan(map, center_row + row_offset, center_col - col_radius, 2 * col_radius + 1, type, journal);
+	}
+}
+
+// NOTE: Kogge-Stone fill: grows the seed bits through the runs of set bits in mask, in six steps per direction.
+static U64
+func SpreadBitsInMask(U64 seeds, U64 mask)
+{
+	U64 up = seeds & mask;
+	U64 up_mask = mask;
+	up |= up_mask & (up << 1);  up_mask &= (up_mask << 1);
+	up |= up_mask & (up << 2);  up_mask &= (up_mask << 2);
+	up |= up_mask & (up << 4);  up_mask &= (up_mask << 4);
+	up |= up_mask & (up << 8);  up_mask &= (up_mask << 8);
+	up |= up_mask & (up << 16); up_mask &= (up_mask << 16);
+	up |= up_mask & (up << 32);
+
+	U64 down = seeds & mask;
+	U64 down_mask = mask;
+	down |= down_mask & (down >> 1);  down_mask &= (down_mask >> 1);
+	down |= down_mask & (down >> 2);  down_mask &= (down_mask >> 2);
+	down |= down_mask & (down >> 4);  down_mask &= (down_mask >> 4);
+	down |= down_mask & (down >> 8);  down_mask &= (down_mask >> 8);
+	down |= down_mask & (down >> 16); down_mask &= (down_mask >> 16);
+	down |= down_mask & (down >> 32);
+
+	U64 spread = (up | down);
+	return spread;
+}
+
+#define FloodFillSeedBlockN 4096
+
+struct FloodFillSeed
+{
+	I32 row;
+	I32 chunk_col;
+	U64 seeds;
+};
+
+// NOTE: Bit i is set if byte i of the word equals the byte of type.
+static U64
+func GetTileMatchBits(U64 tiles, TileId type)
+{
+	U64 high_bits = 0x8080808080808080ULL;
+	U64 low_bits = ~high_bits;
+	U64 diff = tiles ^ GetTileFillWord(type);
+	U64 zero_bytes = ~(((diff & low_bits) + low_bits) | diff | low_bits);
+	U64 match_bits = (((zero_bytes >> 7) * 0x0102040810204080ULL) >> 56);
+	return match_bits;
+}
+
+// NOTE: Bit i is set if tile (row, 64 * chunk_col + i) has the given type and is inside the bounds.
+static U64
+func GetFloodFillMask(SparseMap *map, I32 row, I32 chunk_col, TileId type,
+					  I32 top_row, I32 left_col, I32 bottom_row, I32 right_col)
+{
+	U64 mask = 0;
+	I32 chunk_left = chunk_col * MapChunkSide;
+	I32 first_col = IntMax2(left_col - chunk_left, 0);
+	I32 last_col = IntMin2(right_col - chunk_left, MapChunkSide - 1);
+	if(IsIntBetween(row, top_row, bottom_row) && first_col <= last_col)
+	{
+		I32 chunk_row = GetSparseMapChunkCoordinate(row);
+		MapChunk *chunk = GetSparseMapChunk(map, chunk_row, chunk_col);
+		if(chunk)
+		{
+			U64 *tiles = (U64 *)(chunk->tiles + (row - chunk_row * MapChunkSide) * MapChunkSide);
+			for(I32 i = 0; i < MapChunkSide / 8; i++)
+			{
+				mask |= (GetTileMatchBits(tiles[i], type) << (8 * i));
+			}
+		}
+		else
+		{
+			mask = (type == NoTileId) ? ~(U64)0 : 0;
+		}
+		mask &= (GetLowBitMask(last_col - first_col + 1) << first_col);
+	}
+	return mask;
+}
+
+// NOTE: 4-connected flood over the tiles with the same type as the start tile,
+//       limited to the bounds of the map. Rows are handled a chunk word at a time.
+//       tmp_arena holds the seed stack, which grows in place as seeds are pushed.
+static void
+func FloodFillSparseMap(SparseMap *map, I32 start_row, I32 start_col, TileId type,
+						MapEditJournal *journal, MemArena *tmp_arena)
+{
+	if(!map->has_tiles)
+	{
+		return;
+	}
+
+	I32 top_row = map->top_row;
+	I32 left_col = map->left_col;
+	I32 bottom_row = map->bottom_row;
+	I32 right_col = map->right_col;
+	if(!IsIntBetween(start_row, top_row, bottom_row) || !IsIntBetween(start_col, left_col, right_col))
+	{
+		return;
+	}
+
+	TileId start_type = GetSparseTileType(map, start_row, start_col);
+	if(start_type == type)
+	{
+		return;
+	}
+
+	TempMemory temp_memory = BeginTempMemory(tmp_arena);
+	FloodFillSeed *stack = ArenaAllocArray(tmp_arena, FloodFillSeed, FloodFillSeedBlockN);
+	I32 max_seed_n = FloodFillSeedBlockN;
+	I32 seed_n = 0;
+
+	I32 start_chunk_col = GetSparseMapChunkCoordinate(start_col);
+	FloodFillSeed start = {};
+	start.row = start_row;
+	start.chunk_col = start_chunk_col;
+	start.seeds = ((U64)1 << (start_col - start_chunk_col * MapChunkSide));
+	stack[seed_n] = start;
+	seed_n++;
+
+	while(seed_n > 0)
+	{
+		seed_n--;
+		FloodFillSeed seed = stack[seed_n];
+		U64 mask = GetFloodFillMask(map, seed.row, seed.chunk_col, start_type,
+									top_row, left_col, bottom_row, right_col);
+		U64 fill = SpreadBitsInMask(seed.seeds, mask);
+		if(fill == 0)
+		{
+			continue;
+		}
+
+		I32 chunk_left = seed.chunk_col * MapChunkSide;
+		U64 runs = fill;
+		while(runs)
+		{
+			I32 run_start = GetLowestSetBitIndex(runs);
+			U64 shifted = ~(runs >> run_start);
+			I32 run_n = (shifted == 0) ? (64 - run_start) : GetLowestSetBitIndex(shifted);
+			FillSparseMapRowSpan(map, seed.row, chunk_left + run_start, run_n, type, journal);
+			runs &= ~(GetLowBitMask(run_n) << run_start);
+		}
+
+		if(seed_n + 4 > max_seed_n)
+		{
+			ArenaAllocArray(tmp_arena, FloodFillSeed, FloodFillSeedBlockN);
+			max_seed_n += FloodFillSeedBlockN;
+		}
+		FloodFillSeed next = {};
+		next.chunk_col = seed.chunk_col;
+		next.seeds = fill;
+		next.row = seed.row - 1;
+		stack[seed_n] = next;
+		seed_n++;
+		next.row = seed.row + 1;
+		stack[seed_n] = next;
+		seed_n++;
+
+		if(fill & 1)
+		{
+			next.row = seed.row;
+			next.chunk_col = seed.chunk_col - 1;
+			next.seeds = ((U64)1 << 63);
+			stack[seed_n] = next;
+			seed_n++;
+		}
+		if(fill >> 63)
+		{
+			next.row = seed.row;
+			next.chunk_col = seed.chunk_col + 1;
+			next.seeds = 1;
+			stack[seed_n] = next;
+			seed_n++;
+		}
+	}
+	EndTempMemory(temp_memory);
+}
+
+static B32
+func CanUndoMapEdit(MapEditJournal *journal)
+{
+	B32 can_undo = (journal->undone_edit_n < journal->edit_n);
+	return can_undo;
+}
+
+static B32
+func CanRedoMapEdit(MapEditJournal *journal)
+{
+	B32 can_redo = (journal->undone_edit_n > 0);
+	return can_redo;
+}
+
+static void
+func UndoMapEdit(SparseMap *map, MapEditJournal *journal)
+{
+	Assert(!journal->is_recording);
+	if(CanUndoMapEdit(journal))
+	{
+		MapEdit *edit = &journal->edits[journal->edit_n - 1 - journal->undone_edit_n];
+		for(I32 i = edit->run_n - 1; i >= 0; i--)
+		{
+			MapEditRun *run = &journal->runs[edit->first_run + i];
+			FillSparseMapRowSpan(map, run->row, run->col, run->tile_n, (TileId)run->old_type, 0);
+		}
+		journal->undone_edit_n++;
+	}
+}
+
+static void
+func RedoMapEdit(SparseMap *map, MapEditJournal *journal)
+{
+	Assert(!journal->is_recording);
+	if(CanRedoMapEdit(journal))
+	{
+		journal->undone_edit_n--;
+		MapEdit *edit = &journal->edits[journal->edit_n - 1 - journal->undone_edit_n];
+		for(I32 i = 0; i < edit->run_n; i++)
+		{
+			MapEditRun *run = &journal->runs[edit->first_run + i];
+			FillSparseMapRowSpan(map, run->row, run->col, run->tile_n, (TileId)run->new_type, 0);
+		}
+	}
+}
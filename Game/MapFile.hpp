@@ -0,0 +1,1167 @@
+#pragma once
+
+#include <Windows.h>
+
+#include "Debug.hpp"
+#include "File.hpp"
+#include "Hash.hpp"
+#include "Map.hpp"
+#include "MapNav.hpp"
+#include "Memory.hpp"
+#include "Type.hpp"
+
+// NOTE: Map file version 5.
+//       [MapFileHeader][sections...]
+//       Every section is addressed by its offset from the start of the file, so a mapped
+//       view of the file can be used as it is. Tiles are stored in chunks of
+//       MapChunkSide x MapChunkSide U8 tile ids, each chunk compressed on its own.
+//       Chunks that only contain NoTileId take no space at all.
+//       The optional Nav sections hold a baked MapNav. They are only used if the tile hash
+//       in the nav info still matches the chunks of the file.
+//       The header and every section have a HashBytes checksum, and so does the data of every chunk.
+//       Older versions are upgraded by MapMigrate.hpp.
+
+#define MapFileVersion 5
+#define MapFileMagic 0x50414D47
+#define MaxMapFileSectionN 16
+
+enum MapFileSectionId
+{
+	NoMapFileSectionId,
+	ChunkTableMapFileSectionId,
+	ChunkDataMapFileSectionId,
+	ItemMapFileSectionId,
+	EntityMapFileSectionId,
+	NavInfoMapFileSectionId,
+	NavRegionRunMapFileSectionId,
+	NavClusterMapFileSectionId,
+	NavNodeMapFileSectionId,
+	NavEdgeMapFileSectionId,
+	NavDistanceMapFileSectionId
+};
+
+struct MapFileSection
+{
+	U32 section_id;
+	U32 offset;
+	U32 size;
+	U32 element_n;
+	U64 checksum;
+};
+
+struct MapFileHeader
+{
+	U32 version;
+	U32 magic;
+	U32 header_size;
+	U32 file_size;
+
+	I32 tile_row_n;
+	I32 tile_col_n;
+	I32 chunk_row_n;
+	I32 chunk_col_n;
+
+	U32 section_n;
+	U32 flags;
+	U64 header_checksum;
+	MapFileSection sections[MaxMapFileSectionN];
+};
+
+enum MapChunkEncoding
+{
+	EmptyMapChunkEncoding,
+	RawMapChunkEncoding,
+	RunLengthMapChunkEncoding
+};
+
+// NOTE: offset is relative to the start of the chunk data section.
+struct MapFileChunk
+{
+	U32 offset;
+	U32 size;
+	U32 encoding;
+	U32 checksum;
+};
+
+struct MapFileNavInfo
+{
+	U64 tile_hash;
+	I32 region_n;
+	I32 cluster_side;
+	I32 cluster_row_n;
+	I32 cluster_col_n;
+	U32 distance_field_groups;
+	U32 reserved;
+};
+
+// NOTE: region_labels is stored as runs of equal labels, every row starts a new run.
+struct MapFileRegionRun
+{
+	I32 label;
+	I32 tile_n;
+};
+
+struct MapFileView
+{
+	U8 *base;
+	U32 size;
+	HANDLE file;
+	HANDLE mapping;
+};
+
+static I32
+func GetMapChunkN(I32 tile_n)
+{
+	I32 chunk_n = (tile_n + MapChunkSide - 1) / MapChunkSide;
+	return chunk_n;
+}
+
+// NOTE: Empty chunks have no data and a checksum of 0.
+static U32
+func GetMapChunkChecksum(U8 *data, U32 size)
+{
+	U32 checksum = 0;
+	if(size > 0)
+	{
+		U64 hash = HashBytes(data, size);
+		checksum = (U32)(hash ^ (hash >> 32));
+	}
+	return checksum;
+}
+
+// NOTE: Runs are stored as [run length - 1][tile id] byte pairs.
+static U32
+func RunLengthEncodeMapChunk(U8 *tiles, U8 *output, U32 max_output_size)
+{
+	U32 output_size = 0;
+	I32 index = 0;
+	while(index < MapChunkTileN)
+	{
+		U8 tile = tiles[index];
+		I32 run_length = 1;
+		while(index + run_length < MapChunkTileN && run_length < 256 && tiles[index + run_length] == tile)
+		{
+			run_length++;
+		}
+
+		if(output_size + 2 > max_output_size)
+		{
+			output_size = max_output_size + 1;
+			break;
+		}
+		output[output_size] = (U8)(run_length - 1);
+		output[output_size + 1] = tile;
+		output_size += 2;
+		index += run_length;
+	}
+	return output_size;
+}
+
+// NOTE: Returns false if the runs do not add up to exactly one chunk.
+static B32
+func RunLengthDecodeMapChunk(U8 *input, U32 input_size, U8 *tiles)
+{
+	B32 is_valid = (input_size % 2 == 0);
+	I32 index = 0;
+	for(U32 i = 0; is_valid && i < input_size; i += 2)
+	{
+		I32 run_length = (I32)input[i] + 1;
+		U8 tile = input[i + 1];
+		is_valid = (index + run_length <= MapChunkTileN);
+		for(I32 j = 0; is_valid && j < run_length; j++)
+		{
+			tiles[index + j] = tile;
+		}
+		index += run_length;
+	}
+	is_valid = (is_valid && index == MapChunkTileN);
+	return is_valid;
+}
+
+// NOTE: Picks the smallest encoding, output has to hold at least MapChunkTileN bytes.
+static MapFileChunk
+func EncodeMapChunk(U8 *tiles, U8 *output)
+{
+	MapFileChunk chunk = {};
+
+	B32 is_empty = true;
+	for(I32 i = 0; i < MapChunkTileN; i++)
+	{
+		if(tiles[i] != NoTileId)
+		{
+			is_empty = false;
+			break;
+		}
+	}
+
+	if(is_empty)
+	{
+		chunk.encoding = EmptyMapChunkEncoding;
+		chunk.size = 0;
+	}
+	else
+	{
+		U32 run_length_size = RunLengthEncodeMapChunk(tiles, output, MapChunkTileN - 1);
+		if(run_length_size < MapChunkTileN)
+		{
+			chunk.encoding = RunLengthMapChunkEncoding;
+			chunk.size = run_length_size;
+		}
+		else
+		{
+			chunk.encoding = RawMapChunkEncoding;
+			chunk.size = MapChunkTileN;
+			for(I32 i = 0; i < MapChunkTileN; i++)
+			{
+				output[i] = tiles[i];
+			}
+		}
+	}
+	chunk.checksum = GetMapChunkChecksum(output, chunk.size);
+	return chunk;
+}
+
+// NOTE: The sizes IsValidMapFileView allows for each encoding, run-length data still has to add up when decoded.
+static B32
+func IsValidMapFileChunk(MapFileChunk *chunk)
+{
+	B32 is_valid = false;
+	switch(chunk->encoding)
+	{
+		case EmptyMapChunkEncoding:
+		{
+			is_valid = (chunk->size == 0);
+			break;
+		}
+		case RawMapChunkEncoding:
+		{
+			is_valid = (chunk->size == MapChunkTileN);
+			break;
+		}
+		case RunLengthMapChunkEncoding:
+		{
+			is_valid = (chunk->size > 0 && chunk->size % 2 == 0 && chunk->size <= 2 * MapChunkTileN);
+			break;
+		}
+	}
+	return is_valid;
+}
+
+// NOTE: Returns false for an unknown encoding or data that does not decode to one chunk, the tiles are empty then.
+static B32
+func DecodeMapChunk(MapFileChunk *chunk, U8 *data, U8 *tiles)
+{
+	B32 is_decoded = IsValidMapFileChunk(chunk);
+	if(is_decoded)
+	{
+		switch(chunk->encoding)
+		{
+			case EmptyMapChunkEncoding:
+			{
+				for(I32 i = 0; i < MapChunkTileN; i++)
+				{
+					tiles[i] = NoTileId;
+				}
+				break;
+			}
+			case RawMapChunkEncoding:
+			{
+				for(I32 i = 0; i < MapChunkTileN; i++)
+				{
+					tiles[i] = data[i];
+				}
+				break;
+			}
+			case RunLengthMapChunkEncoding:
+			{
+				is_decoded = RunLengthDecodeMapChunk(data, chunk->size, tiles);
+				break;
+			}
+		}
+	}
+
+	if(!is_decoded)
+	{
+		for(I32 i = 0; i < MapChunkTileN; i++)
+		{
+			tiles[i] = NoTileId;
+		}
+	}
+	return is_decoded;
+}
+
+static MapFileHeader *
+func GetMapFileHeader(MapFileView *view)
+{
+	Assert(view->size >= sizeof(MapFileHeader));
+	MapFileHeader *header = (MapFileHeader *)view->base;
+	return header;
+}
+
+static MapFileSection *
+func GetMapFileSection(MapFileHeader *header, MapFileSectionId section_id)
+{
+	MapFileSection *result = 0;
+	for(U32 i = 0; i < header->section_n; i++)
+	{
+		if(header->sections[i].section_id == (U32)section_id)
+		{
+			result = &header->sections[i];
+			break;
+		}
+	}
+	return result;
+}
+
+// NOTE: Encoding is deterministic and the chunk table has the checksum of every chunk,
+//       so the same tiles always give the same hash.
+static U64
+func GetMapChunkTableHash(I32 tile_row_n, I32 tile_col_n, MapFileChunk *chunks, U32 chunk_n)
+{
+	HashState state = BeginHash();
+	UpdateHash(&state, &tile_row_n, sizeof(tile_row_n));
+	UpdateHash(&state, &tile_col_n, sizeof(tile_col_n));
+	UpdateHash(&state, chunks, chunk_n * sizeof(MapFileChunk));
+	U64 hash = EndHash(&state);
+	return hash;
+}
+
+// NOTE: Hash of the size and the chunks of a file that is in memory.
+static U64
+func GetMapFileTileHash(MapFileHeader *header)
+{
+	MapFileSection *chunk_table = GetMapFileSection(header, ChunkTableMapFileSectionId);
+	MapFileChunk *chunks = (chunk_table) ? (MapFileChunk *)((U8 *)header + chunk_table->offset) : 0;
+	U32 chunk_n = (chunk_table) ? chunk_table->element_n : 0;
+	U64 hash = GetMapChunkTableHash(header->tile_row_n, header->tile_col_n, chunks, chunk_n);
+	return hash;
+}
+
+static U64
+func GetMapFileHeaderChecksum(MapFileHeader *header)
+{
+	MapFileHeader checked_header = *header;
+	checked_header.header_checksum = 0;
+	U64 checksum = HashBytes(&checked_header, sizeof(checked_header));
+	return checksum;
+}
+
+static U64
+func GetMapFileSectionChecksum(MapFileHeader *header, MapFileSection *section)
+{
+	U64 checksum = HashBytes((U8 *)header + section->offset, section->size);
+	return checksum;
+}
+
+// NOTE: Sets the checksums of the sections from first_section_index on, then the checksum of the header.
+static void
+func SealMapFile(MapFileHeader *header, U32 first_section_index)
+{
+	for(U32 i = first_section_index; i < header->section_n; i++)
+	{
+		MapFileSection *section = &header->sections[i];
+		section->checksum = GetMapFileSectionChecksum(header, section);
+	}
+	header->header_checksum = GetMapFileHeaderChecksum(header);
+}
+
+static void *
+func GetMapFileSectionData(MapFileView *view, MapFileSectionId section_id)
+{
+	MapFileHeader *header = GetMapFileHeader(view);
+	MapFileSection *section = GetMapFileSection(header, section_id);
+	void *data = 0;
+	if(section)
+	{
+		Assert(section->offset + section->size <= view->size);
+		data = view->base + section->offset;
+	}
+	return data;
+}
+
+static MapFileChunk *
+func GetMapFileChunk(MapFileView *view, I32 chunk_row, I32 chunk_col)
+{
+	MapFileHeader *header = GetMapFileHeader(view);
+	Assert(IsIntBetween(chunk_row, 0, header->chunk_row_n - 1));
+	Assert(IsIntBetween(chunk_col, 0, header->chunk_col_n - 1));
+	MapFileChunk *chunks = (MapFileChunk *)GetMapFileSectionData(view, ChunkTableMapFileSectionId);
+	MapFileChunk *chunk = &chunks[chunk_row * header->chunk_col_n + chunk_col];
+	return chunk;
+}
+
+// NOTE: Chunk data is not checked when the file is opened, every chunk is checked here before it is decoded.
+//       Returns false if the chunk fails its checksum or does not decode, the tiles are empty then.
+static B32
+func ReadMapFileChunkTiles(MapFileView *view, I32 chunk_row, I32 chunk_col, U8 *tiles)
+{
+	MapFileChunk chunk = *GetMapFileChunk(view, chunk_row, chunk_col);
+	U8 *chunk_data = (U8 *)GetMapFileSectionData(view, ChunkDataMapFileSectionId);
+	B32 is_intact = (GetMapChunkChecksum(chunk_data + chunk.offset, chunk.size) == chunk.checksum);
+	if(!is_intact)
+	{
+		chunk = {};
+	}
+	B32 is_decoded = DecodeMapChunk(&chunk, chunk_data + chunk.offset, tiles);
+	B32 is_read = (is_intact && is_decoded);
+	return is_read;
+}
+
+static MapItem *
+func GetMapFileItems(MapFileView *view, I32 *item_n)
+{
+	MapFileHeader *header = GetMapFileHeader(view);
+	MapFileSection *section = GetMapFileSection(header, ItemMapFileSectionId);
+	*item_n = (section) ? (I32)section->element_n : 0;
+	MapItem *items = (MapItem *)GetMapFileSectionData(view, ItemMapFileSectionId);
+	return items;
+}
+
+static MapEntity *
+func GetMapFileEntities(MapFileView *view, I32 *entity_n)
+{
+	MapFileHeader *header = GetMapFileHeader(view);
+	MapFileSection *section = GetMapFileSection(header, EntityMapFileSectionId);
+	*entity_n = (section) ? (I32)section->element_n : 0;
+	MapEntity *entities = (MapEntity *)GetMapFileSectionData(view, EntityMapFileSectionId);
+	return entities;
+}
+
+static B32
+func IsValidMapFileSection(MapFileHeader *header, MapFileSection *section, U32 element_size)
+{
+	B32 is_valid = (section->offset >= header->header_size &&
+					section->offset <= header->file_size &&
+					section->size <= header->file_size - section->offset &&
+					(U64)section->element_n * element_size == section->size);
+	return is_valid;
+}
+
+// NOTE: Checks the header, the bounds of every section and chunk, and the checksums of every section
+//       but the chunk data. The chunk data is the bulk of the file, ReadMapFileChunkTiles checks it
+//       one chunk at a time so that streamed maps only read the chunks they use.
+static B32
+func IsValidMapFileView(MapFileView *view)
+{
+	B32 is_valid = false;
+	if(view->base != 0 && view->size >= sizeof(MapFileHeader))
+	{
+		MapFileHeader *header = GetMapFileHeader(view);
+		is_valid = (header->version == MapFileVersion &&
+					header->magic == MapFileMagic &&
+					header->header_size == sizeof(MapFileHeader) &&
+					header->file_size == view->size &&
+					header->section_n <= MaxMapFileSectionN &&
+					header->tile_row_n >= 0 && header->tile_col_n >= 0 &&
+					header->chunk_row_n == GetMapChunkN(header->tile_row_n) &&
+					header->chunk_col_n == GetMapChunkN(header->tile_col_n) &&
+					header->header_checksum == GetMapFileHeaderChecksum(header));
+
+		for(U32 i = 0; is_valid && i < header->section_n; i++)
+		{
+			MapFileSection *section = &header->sections[i];
+			is_valid = (section->offset >= header->header_size &&
+						section->offset <= header->file_size &&
+						section->size <= header->file_size - section->offset);
+			if(is_valid && section->section_id != ChunkDataMapFileSectionId)
+			{
+				is_valid = (section->checksum == GetMapFileSectionChecksum(header, section));
+			}
+		}
+
+		MapFileSection *chunk_table = (is_valid) ? GetMapFileSection(header, ChunkTableMapFileSectionId) : 0;
+		MapFileSection *chunk_data = (is_valid) ? GetMapFileSection(header, ChunkDataMapFileSectionId) : 0;
+		is_valid = (chunk_table && chunk_data &&
+					IsValidMapFileSection(header, chunk_table, sizeof(MapFileChunk)) &&
+					chunk_table->element_n == (U32)(header->chunk_row_n * header->chunk_col_n));
+		for(U32 i = 0; is_valid && i < chunk_table->element_n; i++)
+		{
+			MapFileChunk *chunk = (MapFileChunk *)(view->base + chunk_table->offset) + i;
+			is_valid = (chunk->offset <= chunk_data->size && chunk->size <= chunk_data->size - chunk->offset &&
+						IsValidMapFileChunk(chunk));
+		}
+
+		MapFileSection *item_section = (is_valid) ? GetMapFileSection(header, ItemMapFileSectionId) : 0;
+		MapFileSection *entity_section = (is_valid) ? GetMapFileSection(header, EntityMapFileSectionId) : 0;
+		is_valid = (is_valid &&
+					(!item_section || IsValidMapFileSection(header, item_section, sizeof(MapItem))) &&
+					(!entity_section || IsValidMapFileSection(header, entity_section, sizeof(MapEntity))));
+	}
+	return is_valid;
+}
+
+// NOTE: A file that is missing or empty or can not be mapped gives a view with a base of 0 and a size of 0,
+//       IsValidMapFileView fails on it. The view still has to be closed.
+static MapFileView
+func OpenMapFileView(I8 *file_path)
+{
+	MapFileView view = {};
+	view.file = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if(view.file == INVALID_HANDLE_VALUE)
+	{
+		view.file = 0;
+	}
+
+	U32 size = (view.file) ? GetFileSize(view.file, 0) : 0;
+	if(size > 0 && size != INVALID_FILE_SIZE)
+	{
+		view.mapping = CreateFileMappingA(view.file, 0, PAGE_READONLY, 0, 0, 0);
+	}
+	if(view.mapping)
+	{
+		view.base = (U8 *)MapViewOfFile(view.mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if(view.base)
+	{
+		view.size = size;
+	}
+	return view;
+}
+
+static void
+func CloseMapFileView(MapFileView *view)
+{
+	if(view->base)
+	{
+		BOOL result = UnmapViewOfFile(view->base);
+		Assert(result);
+	}
+	if(view->mapping)
+	{
+		BOOL result = CloseHandle(view->mapping);
+		Assert(result);
+	}
+	if(view->file)
+	{
+		BOOL result = CloseHandle(view->file);
+		Assert(result);
+	}
+	*view = {};
+}
+
+static B32
+func IsValidMapFileRegionRunSection(MapFileHeader *header, MapFileSection *section, I32 region_n)
+{
+	B32 is_valid = (header->tile_row_n > 0 && header->tile_col_n > 0 &&
+					IsValidMapFileSection(header, section, sizeof(MapFileRegionRun)));
+	MapFileRegionRun *runs = (MapFileRegionRun *)((U8 *)header + section->offset);
+	I64 tile_n = (I64)header->tile_row_n * (I64)header->tile_col_n;
+	I64 tile_index = 0;
+	for(U32 i = 0; is_valid && i < section->element_n; i++)
+	{
+		MapFileRegionRun run = runs[i];
+		I64 col = tile_index % header->tile_col_n;
+		is_valid = (IsIntBetween(run.label, 0, region_n) && run.tile_n > 0 &&
+					col + run.tile_n <= header->tile_col_n);
+		tile_index += run.tile_n;
+	}
+	is_valid = (is_valid && tile_index == tile_n);
+	return is_valid;
+}
+
+// NOTE: Checks every count in the nav info and the nav sections against the sizes of the sections,
+//       and every index stored in them against the counts, so the nav can be read without checking again.
+static B32
+func IsValidMapFileNav(MapFileView *view)
+{
+	MapFileHeader *header = GetMapFileHeader(view);
+	MapFileSection *info_section = GetMapFileSection(header, NavInfoMapFileSectionId);
+	MapFileSection *run_section = GetMapFileSection(header, NavRegionRunMapFileSectionId);
+	MapFileSection *cluster_section = GetMapFileSection(header, NavClusterMapFileSectionId);
+	MapFileSection *node_section = GetMapFileSection(header, NavNodeMapFileSectionId);
+	MapFileSection *edge_section = GetMapFileSection(header, NavEdgeMapFileSectionId);
+	MapFileSection *distance_section = GetMapFileSection(header, NavDistanceMapFileSectionId);
+	B32 is_valid = (info_section && run_section && cluster_section && node_section && edge_section && distance_section &&
+					IsValidMapFileSection(header, info_section, sizeof(MapFileNavInfo)) &&
+					info_section->element_n == 1 &&
+					IsValidMapFileSection(header, cluster_section, sizeof(I32)) &&
+					IsValidMapFileSection(header, node_section, sizeof(MapNavNode)) &&
+					IsValidMapFileSection(header, edge_section, sizeof(MapNavEdge)));
+
+	MapFileNavInfo *info = (is_valid) ? (MapFileNavInfo *)((U8 *)header + info_section->offset) : 0;
+	I64 tile_n = (I64)header->tile_row_n * (I64)header->tile_col_n;
+	is_valid = (is_valid && info->region_n >= 0 && info->region_n <= (tile_n + 1) / 2 &&
+				info->cluster_side == MapNavClusterSide &&
+				info->cluster_row_n == (header->tile_row_n + MapNavClusterSide - 1) / MapNavClusterSide &&
+				info->cluster_col_n == (header->tile_col_n + MapNavClusterSide - 1) / MapNavClusterSide &&
+				(info->distance_field_groups >> MapNavGroupN) == 0);
+	is_valid = (is_valid && IsValidMapFileRegionRunSection(header, run_section, info->region_n));
+
+	I64 cluster_n = (is_valid) ? (I64)info->cluster_row_n * (I64)info->cluster_col_n : 0;
+	is_valid = (is_valid && cluster_section->element_n == cluster_n + 1);
+	I32 *cluster_first_nodes = (is_valid) ? (I32 *)((U8 *)header + cluster_section->offset) : 0;
+	I32 node_n = (I32)node_section->element_n;
+	is_valid = (is_valid && cluster_first_nodes[0] == 0 && cluster_first_nodes[cluster_n] == node_n);
+	for(I64 i = 0; is_valid && i < cluster_n; i++)
+	{
+		is_valid = (cluster_first_nodes[i] <= cluster_first_nodes[i + 1]);
+	}
+
+	MapNavNode *nodes = (MapNavNode *)((U8 *)header + node_section->offset);
+	I32 edge_n = (I32)edge_section->element_n;
+	for(I32 i = 0; is_valid && i < node_n; i++)
+	{
+		MapNavNode *node = &nodes[i];
+		is_valid = (IsIntBetween(node->row, 0, header->tile_row_n - 1) &&
+					IsIntBetween(node->col, 0, header->tile_col_n - 1) &&
+					node->first_edge >= 0 && node->edge_n >= 0 && node->first_edge <= edge_n - node->edge_n);
+	}
+
+	MapNavEdge *edges = (MapNavEdge *)((U8 *)header + edge_section->offset);
+	for(I32 i = 0; is_valid && i < edge_n; i++)
+	{
+		is_valid = IsIntBetween(edges[i].node_index, 0, node_n - 1);
+	}
+
+	I64 field_n = 0;
+	for(I32 group_id = 0; is_valid && group_id < MapNavGroupN; group_id++)
+	{
+		field_n += (info->distance_field_groups >> group_id) & 1;
+	}
+	// NOTE: Every element of the distance section is a whole field of tile_n distances.
+	is_valid = (is_valid && distance_section->element_n == field_n &&
+				(U64)distance_section->size == (U64)(field_n * tile_n) * sizeof(U16) &&
+				distance_section->offset >= header->header_size &&
+				distance_section->offset <= header->file_size &&
+				distance_section->size <= header->file_size - distance_section->offset);
+	return is_valid;
+}
+
+// NOTE: False if the file has no nav sections, if they were baked for other tiles, or if they do not add up.
+static B32
+func HasUpToDateMapNav(MapFileView *view)
+{
+	MapFileHeader *header = GetMapFileHeader(view);
+	MapFileNavInfo *info = (MapFileNavInfo *)GetMapFileSectionData(view, NavInfoMapFileSectionId);
+	B32 is_up_to_date = (info && IsValidMapFileNav(view) && info->tile_hash == GetMapFileTileHash(header));
+	return is_up_to_date;
+}
+
+// NOTE: labels has one I32 per tile. Only call this if HasUpToDateMapNav.
+static void
+func ReadMapFileRegionLabels(MapFileView *view, I32 *labels)
+{
+	MapFileHeader *header = GetMapFileHeader(view);
+	I32 tile_n = header->tile_row_n * header->tile_col_n;
+	MapFileRegionRun *runs = (MapFileRegionRun *)GetMapFileSectionData(view, NavRegionRunMapFileSectionId);
+	I32 run_n = (I32)GetMapFileSection(header, NavRegionRunMapFileSectionId)->element_n;
+	I32 tile_index = 0;
+	for(I32 i = 0; i < run_n; i++)
+	{
+		MapFileRegionRun run = runs[i];
+		Assert(tile_index + run.tile_n <= tile_n);
+		for(I32 j = 0; j < run.tile_n; j++)
+		{
+			labels[tile_index + j] = run.label;
+		}
+		tile_index += run.tile_n;
+	}
+	Assert(tile_index == tile_n);
+}
+
+// NOTE: Returns 0 if the file has no nav sections, if they were baked for other tiles or if they do not add up.
+static MapNav *
+func ReadMapNavFromFileView(MapFileView *view, MemArena *arena)
+{
+	MapFileHeader *header = GetMapFileHeader(view);
+	if(!HasUpToDateMapNav(view))
+	{
+		return 0;
+	}
+	MapFileNavInfo *info = (MapFileNavInfo *)GetMapFileSectionData(view, NavInfoMapFileSectionId);
+
+	MapNav *nav = ArenaAllocType(arena, MapNav);
+	*nav = {};
+	nav->tile_row_n = header->tile_row_n;
+	nav->tile_col_n = header->tile_col_n;
+	nav->tile_hash = info->tile_hash;
+	nav->region_n = info->region_n;
+
+	I32 tile_n = nav->tile_row_n * nav->tile_col_n;
+	nav->region_labels = ArenaAllocArray(arena, I32, tile_n);
+	ReadMapFileRegionLabels(view, nav->region_labels);
+
+	nav->cluster_row_n = info->cluster_row_n;
+	nav->cluster_col_n = info->cluster_col_n;
+	I32 cluster_n = nav->cluster_row_n * nav->cluster_col_n;
+	nav->cluster_first_nodes = (I32 *)ArenaPushData(arena, (cluster_n + 1) * sizeof(I32),
+													 GetMapFileSectionData(view, NavClusterMapFileSectionId));
+
+	MapFileSection *node_section = GetMapFileSection(header, NavNodeMapFileSectionId);
+	nav->node_n = (I32)node_section->element_n;
+	nav->nodes = (MapNavNode *)ArenaPushData(arena, node_section->size, view->base + node_section->offset);
+
+	MapFileSection *edge_section = GetMapFileSection(header, NavEdgeMapFileSectionId);
+	nav->edge_n = (I32)edge_section->element_n;
+	nav->edges = (MapNavEdge *)ArenaPushData(arena, edge_section->size, view->base + edge_section->offset);
+
+	U16 *distances = (U16 *)GetMapFileSectionData(view, NavDistanceMapFileSectionId);
+	for(I32 group_id = 0; group_id < MapNavGroupN; group_id++)
+	{
+		if((info->distance_field_groups >> group_id) & 1)
+		{
+			nav->distance_fields[group_id] = (U16 *)ArenaPushData(arena, tile_n * sizeof(U16), distances);
+			distances += tile_n;
+		}
+	}
+	return nav;
+}
+
+// NOTE: The view has to be valid. Returns false if a chunk could not be read, it is left empty in the map.
+static B32
+func ReadMapFromFileView(MapFileView *view, MemArena *arena, Map *result)
+{
+	MapFileHeader *header = GetMapFileHeader(view);
+
+	B32 are_chunks_read = true;
+	Map map = {};
+	map.tile_row_n = header->tile_row_n;
+	map.tile_col_n = header->tile_col_n;
+	AllocMapTiles(&map, arena);
+
+	U8 chunk_tiles[MapChunkTileN] = {};
+	for(I32 chunk_row = 0; chunk_row < header->chunk_row_n; chunk_row++)
+	{
+		for(I32 chunk_col = 0; chunk_col < header->chunk_col_n; chunk_col++)
+		{
+			if(!ReadMapFileChunkTiles(view, chunk_row, chunk_col, chunk_tiles))
+			{
+				are_chunks_read = false;
+			}
+			for(I32 row = 0; row < MapChunkSide; row++)
+			{
+				I32 tile_row = chunk_row * MapChunkSide + row;
+				if(tile_row >= map.tile_row_n)
+				{
+					break;
+				}
+				for(I32 col = 0; col < MapChunkSide; col++)
+				{
+					I32 tile_col = chunk_col * MapChunkSide + col;
+					if(tile_col >= map.tile_col_n)
+					{
+						break;
+					}
+					map.tile_types[tile_row * map.tile_col_n + tile_col] = chunk_tiles[row * MapChunkSide + col];
+				}
+			}
+		}
+	}
+	UpdateMapPassability(&map);
+
+	MapItem *items = GetMapFileItems(view, &map.item_n);
+	map.items = ArenaAllocArray(arena, MapItem, map.item_n);
+	for(I32 i = 0; i < map.item_n; i++)
+	{
+		map.items[i] = items[i];
+	}
+
+	MapEntity *entities = GetMapFileEntities(view, &map.entity_n);
+	map.entities = ArenaAllocArray(arena, MapEntity, map.entity_n);
+	for(I32 i = 0; i < map.entity_n; i++)
+	{
+		map.entities[i] = entities[i];
+	}
+
+	map.nav = ReadMapNavFromFileView(view, arena);
+	*result = map;
+	return are_chunks_read;
+}
+
+// NOTE: Decodes every chunk into a flat Map. Use the view directly to only touch the used chunks.
+//       Returns false without touching map or the arena if the view is not a valid map file,
+//       and false after filling them if a chunk could not be read.
+static B32
+func LoadMapFromFileView(MapFileView *view, MemArena *arena, Map *map)
+{
+	B32 is_loaded = IsValidMapFileView(view);
+	if(is_loaded)
+	{
+		is_loaded = ReadMapFromFileView(view, arena, map);
+	}
+	return is_loaded;
+}
+
+// NOTE: For maps streamed from the file, the labels of a chunk are only set when it arrives.
+//       If the regions baked into the file are up to date, returns the index of the first region run of every row
+//       for ReadMapFileChunkRegionLabels. Otherwise returns 0 and chunks are labeled on their own.
+//       max_resident_chunk_n is the most chunks that can be resident at the same time.
+static I32 *
+func InitMapRegionsFromFileView(Map *map, MapFileView *view, I32 max_resident_chunk_n, MemArena *arena)
+{
+	MapFileHeader *header = GetMapFileHeader(view);
+	I32 chunk_n = map->chunk_row_n * map->chunk_col_n;
+	map->chunk_region_labels = ArenaAllocArray(arena, I32 *, chunk_n);
+	for(I32 i = 0; i < chunk_n; i++)
+	{
+		map->chunk_region_labels[i] = 0;
+	}
+
+	I32 *row_first_runs = 0;
+	I32 region_n = OpenMapRegionLabel;
+	if(HasUpToDateMapNav(view))
+	{
+		MapFileNavInfo *info = (MapFileNavInfo *)GetMapFileSectionData(view, NavInfoMapFileSectionId);
+		region_n = info->region_n;
+
+		MapFileRegionRun *runs = (MapFileRegionRun *)GetMapFileSectionData(view, NavRegionRunMapFileSectionId);
+		I32 run_n = (I32)GetMapFileSection(header, NavRegionRunMapFileSectionId)->element_n;
+		row_first_runs = ArenaAllocArray(arena, I32, header->tile_row_n + 1);
+		I32 row = 0;
+		I32 col = 0;
+		for(I32 i = 0; i < run_n; i++)
+		{
+			if(col == 0)
+			{
+				row_first_runs[row] = i;
+			}
+			col += runs[i].tile_n;
+			if(col == header->tile_col_n)
+			{
+				row++;
+				col = 0;
+			}
+		}
+		Assert(row == header->tile_row_n);
+		row_first_runs[row] = run_n;
+	}
+
+	I32 max_region_n = IntMax2(region_n + MapRegionSpareLabelN,
+							   OpenMapRegionLabel + (max_resident_chunk_n + 1) * MaxMapChunkRegionN);
+	SetMapRegionLabels(map, 0, region_n, max_region_n, arena);
+	map->are_chunk_regions_local = (row_first_runs == 0);
+	return row_first_runs;
+}
+
+// NOTE: labels has one I32 per tile of the chunk, tiles outside of the map get 0.
+static void
+func ReadMapFileChunkRegionLabels(MapFileView *view, I32 *row_first_runs, I32 chunk_row, I32 chunk_col, I32 *labels)
+{
+	MapFileHeader *header = GetMapFileHeader(view);
+	MapFileRegionRun *runs = (MapFileRegionRun *)GetMapFileSectionData(view, NavRegionRunMapFileSectionId);
+	I32 first_col = chunk_col * MapChunkSide;
+	I32 col_n = IntMin2(MapChunkSide, header->tile_col_n - first_col);
+	for(I32 row = 0; row < MapChunkSide; row++)
+	{
+		I32 tile_row = chunk_row * MapChunkSide + row;
+		I32 *row_labels = labels + row * MapChunkSide;
+		I32 run_index = (tile_row < header->tile_row_n) ? row_first_runs[tile_row] : 0;
+		I32 run_end_col = (tile_row < header->tile_row_n) ? runs[run_index].tile_n : 0;
+		for(I32 col = 0; col < MapChunkSide; col++)
+		{
+			I32 label = 0;
+			if(tile_row < header->tile_row_n && col < col_n)
+			{
+				while(run_end_col <= first_col + col)
+				{
+					run_index++;
+					run_end_col += runs[run_index].tile_n;
+				}
+				label = runs[run_index].label;
+			}
+			row_labels[col] = label;
+		}
+	}
+}
+
+static MapFileSection *
+func AddMapFileSection(MapFileHeader *header, MapFileSectionId section_id, U32 offset, U32 size, U32 element_n)
+{
+	Assert(header->section_n < MaxMapFileSectionN);
+	MapFileSection *section = &header->sections[header->section_n];
+	header->section_n++;
+	section->section_id = section_id;
+	section->offset = offset;
+	section->size = size;
+	section->element_n = element_n;
+	return section;
+}
+
+// NOTE: Files are built in an arena: BeginMapFile, then PushMapFileChunk for every chunk in
+//       row order, then EndMapFile. Nothing else may be pushed to the arena in between.
+static MapFileHeader *
+func BeginMapFile(MemArena *arena, I32 tile_row_n, I32 tile_col_n)
+{
+	I8 *file_base = GetArenaTop(arena);
+	MapFileHeader *header = ArenaAllocType(arena, MapFileHeader);
+	*header = {};
+	header->version = MapFileVersion;
+	header->magic = MapFileMagic;
+	header->header_size = sizeof(MapFileHeader);
+	header->tile_row_n = tile_row_n;
+	header->tile_col_n = tile_col_n;
+	header->chunk_row_n = GetMapChunkN(tile_row_n);
+	header->chunk_col_n = GetMapChunkN(tile_col_n);
+
+	I32 chunk_n = header->chunk_row_n * header->chunk_col_n;
+	MapFileChunk *chunks = ArenaAllocArray(arena, MapFileChunk, chunk_n);
+	U32 chunk_table_offset = (U32)((I8 *)chunks - file_base);
+	AddMapFileSection(header, ChunkTableMapFileSectionId, chunk_table_offset, chunk_n * sizeof(MapFileChunk), chunk_n);
+
+	U32 chunk_data_offset = (U32)(GetArenaTop(arena) - file_base);
+	AddMapFileSection(header, ChunkDataMapFileSectionId, chunk_data_offset, 0, 0);
+	return header;
+}
+
+static void
+func PushMapFileChunk(MemArena *arena, MapFileHeader *header, U8 *tiles)
+{
+	I8 *file_base = (I8 *)header;
+	MapFileSection *chunk_table = GetMapFileSection(header, ChunkTableMapFileSectionId);
+	MapFileSection *chunk_data = GetMapFileSection(header, ChunkDataMapFileSectionId);
+	Assert(chunk_data->element_n < chunk_table->element_n);
+	Assert(GetArenaTop(arena) == file_base + chunk_data->offset + chunk_data->size);
+
+	U8 *output = (U8 *)ArenaAlloc(arena, MapChunkTileN);
+	MapFileChunk chunk = EncodeMapChunk(tiles, output);
+	chunk.offset = chunk_data->size;
+
+	MapFileChunk *chunks = (MapFileChunk *)(file_base + chunk_table->offset);
+	chunks[chunk_data->element_n] = chunk;
+	chunk_data->element_n++;
+	chunk_data->size += chunk.size;
+	SetArenaSize(arena, (U64)((I8 *)output + chunk.size - arena->base_address));
+}
+
+// NOTE: Appends a chunk that is already encoded, data is chunk.size bytes. Returns the chunk as stored.
+static MapFileChunk
+func PushEncodedMapFileChunk(MemArena *arena, MapFileHeader *header, MapFileChunk chunk, U8 *data)
+{
+	I8 *file_base = (I8 *)header;
+	MapFileSection *chunk_table = GetMapFileSection(header, ChunkTableMapFileSectionId);
+	MapFileSection *chunk_data = GetMapFileSection(header, ChunkDataMapFileSectionId);
+	Assert(chunk_data->element_n < chunk_table->element_n);
+	Assert(GetArenaTop(arena) == file_base + chunk_data->offset + chunk_data->size);
+
+	ArenaPushData(arena, chunk.size, data);
+	chunk.offset = chunk_data->size;
+
+	MapFileChunk *chunks = (MapFileChunk *)(file_base + chunk_table->offset);
+	chunks[chunk_data->element_n] = chunk;
+	chunk_data->element_n++;
+	chunk_data->size += chunk.size;
+	return chunk;
+}
+
+static void
+func EndMapFile(MemArena *arena, MapFileHeader *header, MapItem *items, I32 item_n, MapEntity *entities, I32 entity_n)
+{
+	I8 *file_base = (I8 *)header;
+	MapFileSection *chunk_table = GetMapFileSection(header, ChunkTableMapFileSectionId);
+	MapFileSection *chunk_data = GetMapFileSection(header, ChunkDataMapFileSectionId);
+	Assert(chunk_data->element_n == chunk_table->element_n);
+
+	U32 padding_size = (8 - (chunk_data->size % 8)) % 8;
+	U8 *padding = (U8 *)ArenaAlloc(arena, padding_size);
+	for(U32 i = 0; i < padding_size; i++)
+	{
+		padding[i] = 0;
+	}
+
+	MapItem *file_items = (MapItem *)ArenaPushData(arena, item_n * sizeof(MapItem), items);
+	AddMapFileSection(header, ItemMapFileSectionId, (U32)((I8 *)file_items - file_base),
+					  item_n * sizeof(MapItem), item_n);
+
+	MapEntity *file_entities = (MapEntity *)ArenaPushData(arena, entity_n * sizeof(MapEntity), entities);
+	AddMapFileSection(header, EntityMapFileSectionId, (U32)((I8 *)file_entities - file_base),
+					  entity_n * sizeof(MapEntity), entity_n);
+
+	header->file_size = (U32)(GetArenaTop(arena) - file_base);
+	SealMapFile(header, 0);
+}
+
+static void
+func PushMapFilePadding(MemArena *arena, MapFileHeader *header)
+{
+	U32 size = (U32)(GetArenaTop(arena) - (I8 *)header);
+	U32 padding_size = (8 - (size % 8)) % 8;
+	U8 *padding = (U8 *)ArenaAlloc(arena, padding_size);
+	for(U32 i = 0; i < padding_size; i++)
+	{
+		padding[i] = 0;
+	}
+}
+
+static void
+func PushMapFileSection(MemArena *arena, MapFileHeader *header, MapFileSectionId section_id,
+						void *data, U32 size, U32 element_n)
+{
+	PushMapFilePadding(arena, header);
+	I8 *section_data = ArenaPushData(arena, size, data);
+	AddMapFileSection(header, section_id, (U32)(section_data - (I8 *)header), size, element_n);
+}
+
+// NOTE: The most PushMapNavSections can add to the file, padding included.
+static U64
+func GetMapNavSectionsSize(MapNav *nav)
+{
+	U64 run_n = 0;
+	for(I32 row = 0; row < nav->tile_row_n; row++)
+	{
+		I32 *row_labels = nav->region_labels + row * nav->tile_col_n;
+		for(I32 col = 0; col < nav->tile_col_n; col++)
+		{
+			if(col == 0 || row_labels[col] != row_labels[col - 1])
+			{
+				run_n++;
+			}
+		}
+	}
+
+	U64 tile_n = (U64)nav->tile_row_n * (U64)nav->tile_col_n;
+	U64 cluster_n = (U64)nav->cluster_row_n * (U64)nav->cluster_col_n;
+	U64 field_n = 0;
+	for(I32 group_id = 0; group_id < MapNavGroupN; group_id++)
+	{
+		field_n += (nav->distance_fields[group_id] != 0);
+	}
+
+	U64 padding_n = 6;
+	U64 size = padding_n * 7 + sizeof(MapFileNavInfo) + run_n * sizeof(MapFileRegionRun) +
+			   (cluster_n + 1) * sizeof(I32) + (U64)nav->node_n * sizeof(MapNavNode) +
+			   (U64)nav->edge_n * sizeof(MapNavEdge) + field_n * tile_n * sizeof(U16);
+	return size;
+}
+
+// NOTE: Appends the nav sections to a finished file, the file has to be at the top of the arena.
+static void
+func PushMapNavSections(MemArena *arena, MapFileHeader *header, MapNav *nav)
+{
+	I8 *file_base = (I8 *)header;
+	Assert(GetArenaTop(arena) == file_base + header->file_size);
+	Assert(nav->tile_row_n == header->tile_row_n && nav->tile_col_n == header->tile_col_n);
+	U32 first_section_index = header->section_n;
+
+	MapFileNavInfo info = {};
+	info.tile_hash = nav->tile_hash;
+	info.region_n = nav->region_n;
+	info.cluster_side = MapNavClusterSide;
+	info.cluster_row_n = nav->cluster_row_n;
+	info.cluster_col_n = nav->cluster_col_n;
+	for(I32 group_id = 0; group_id < MapNavGroupN; group_id++)
+	{
+		if(nav->distance_fields[group_id])
+		{
+			info.distance_field_groups |= (1 << group_id);
+		}
+	}
+	PushMapFileSection(arena, header, NavInfoMapFileSectionId, &info, sizeof(info), 1);
+
+	PushMapFilePadding(arena, header);
+	MapFileRegionRun *runs = (MapFileRegionRun *)GetArenaTop(arena);
+	I32 run_n = 0;
+	for(I32 row = 0; row < nav->tile_row_n; row++)
+	{
+		I32 *row_labels = nav->region_labels + row * nav->tile_col_n;
+		I32 col = 0;
+		while(col < nav->tile_col_n)
+		{
+			I32 end_col = col + 1;
+			while(end_col < nav->tile_col_n && row_labels[end_col] == row_labels[col])
+			{
+				end_col++;
+			}
+			MapFileRegionRun *run = ArenaAllocType(arena, MapFileRegionRun);
+			run->label = row_labels[col];
+			run->tile_n = end_col - col;
+			run_n++;
+			col = end_col;
+		}
+	}
+	AddMapFileSection(header, NavRegionRunMapFileSectionId, (U32)((I8 *)runs - file_base),
+					  run_n * sizeof(MapFileRegionRun), run_n);
+
+	I32 cluster_n = nav->cluster_row_n * nav->cluster_col_n;
+	PushMapFileSection(arena, header, NavClusterMapFileSectionId, nav->cluster_first_nodes,
+					   (cluster_n + 1) * sizeof(I32), cluster_n + 1);
+	PushMapFileSection(arena, header, NavNodeMapFileSectionId, nav->nodes,
+					   nav->node_n * sizeof(MapNavNode), nav->node_n);
+	PushMapFileSection(arena, header, NavEdgeMapFileSectionId, nav->edges,
+					   nav->edge_n * sizeof(MapNavEdge), nav->edge_n);
+
+	PushMapFilePadding(arena, header);
+	I8 *distances = GetArenaTop(arena);
+	I32 tile_n = nav->tile_row_n * nav->tile_col_n;
+	I32 field_n = 0;
+	for(I32 group_id = 0; group_id < MapNavGroupN; group_id++)
+	{
+		if(nav->distance_fields[group_id])
+		{
+			ArenaPushData(arena, tile_n * sizeof(U16), nav->distance_fields[group_id]);
+			field_n++;
+		}
+	}
+	AddMapFileSection(header, NavDistanceMapFileSectionId, (U32)(distances - file_base),
+					  field_n * tile_n * sizeof(U16), field_n);
+
+	header->file_size = (U32)(GetArenaTop(arena) - file_base);
+	SealMapFile(header, first_section_index);
+}
+
+// NOTE: Builds the whole file in the arena, returns its first byte. Size is in header->file_size.
+static MapFileHeader *
+func PushMapFile(Map *map, MemArena *arena)
+{
+	MapFileHeader *header = BeginMapFile(arena, map->tile_row_n, map->tile_col_n);
+
+	U8 chunk_tiles[MapChunkTileN] = {};
+	for(I32 chunk_row = 0; chunk_row < header->chunk_row_n; chunk_row++)
+	{
+		for(I32 chunk_col = 0; chunk_col < header->chunk_col_n; chunk_col++)
+		{
+			for(I32 row = 0; row < MapChunkSide; row++)
+			{
+				for(I32 col = 0; col < MapChunkSide; col++)
+				{
+					I32 tile_row = chunk_row * MapChunkSide + row;
+					I32 tile_col = chunk_col * MapChunkSide + col;
+					U8 tile = NoTileId;
+					if(tile_row < map->tile_row_n && tile_col < map->tile_col_n)
+					{
+						tile = map->tile_types[tile_row * map->tile_col_n + tile_col];
+					}
+					chunk_tiles[row * MapChunkSide + col] = tile;
+				}
+			}
+			PushMapFileChunk(arena, header, chunk_tiles);
+		}
+	}
+
+	EndMapFile(arena, header, map->items, map->item_n, map->entities, map->entity_n);
+	return header;
+}
+
+// NOTE: Goes through WriteFileAtomically, a failed write leaves the old file as it was. Returns false if it failed.
+static B32
+func WriteMapFileData(MapFileHeader *header, I8 *file_path)
+{
+	B32 succeeded = WriteFileAtomically(file_path, header, header->file_size);
+	return succeeded;
+}
+
+static B32
+func WriteMapToFile(Map *map, I8 *file_path, MemArena *tmp_arena)
+{
+	TempMemory temp_memory = BeginTempMemory(tmp_arena);
+	MapFileHeader *header = PushMapFile(map, tmp_arena);
+	B32 succeeded = WriteMapFileData(header, file_path);
+	EndTempMemory(temp_memory);
+	return succeeded;
+}
+
+// NOTE: Older versions have to go through UpgradeMapFile first.
+//       Returns false if the file is missing, not a valid map file or has a chunk that can not be read.
+//       The arena is only reset if the file is valid.
+static B32
+func LoadMapFromFile(I8 *file_path, MemArena *arena, Map *map)
+{
+	MapFileView view = OpenMapFileView(file_path);
+	B32 is_loaded = IsValidMapFileView(&view);
+	if(is_loaded)
+	{
+		ArenaReset(arena);
+		is_loaded = ReadMapFromFileView(&view, arena, map);
+	}
+	CloseMapFileView(&view);
+	return is_loaded;
+}
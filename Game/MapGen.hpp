@@ -0,0 +1,337 @@
+#pragma once
+
+#include "Debug.hpp"
+#include "Item.hpp"
+#include "Map.hpp"
+#include "MapFile.hpp"
+#include "Math.hpp"
+#include "Memory.hpp"
+#include "Thread.hpp"
+#include "Type.hpp"
+
+// NOTE: Cellular automaton caves. Every tile starts out passable with probability passable_ratio,
+//       then in every step a tile becomes passable if at least 5 of the 3x3 tiles around it are passable.
+//       Tiles outside the map count as solid. Tiles are kept as passability bits, one 64-bit word
+//       holds 64 tiles of a row and a step updates a whole word at a time.
+//       Threads work on bands of chunk rows. Every row has its own random stream,
+//       so the map only depends on the parameters and not on the number of threads.
+
+#define MaxMapGenThreadN 32
+#define MapGenPlaceTryN 1024
+
+struct MapGenParams
+{
+	I32 tile_row_n;
+	I32 tile_col_n;
+	U64 seed;
+	R32 passable_ratio;
+	I32 step_n;
+	I32 item_n;
+	I32 orange_entity_n;
+	I32 purple_entity_n;
+};
+
+struct MapGenJob
+{
+	MapGenParams *params;
+	I32 first_row;
+	I32 last_row;
+	I32 word_per_row_n;
+	U64 *source_words;
+	U64 *target_words;
+	U64 *zero_words;
+
+	MapFileChunk *chunks;
+	U8 *chunk_data;
+};
+
+static MapGenParams
+func GetDefaultMapGenParams(I32 tile_row_n, I32 tile_col_n, U64 seed)
+{
+	MapGenParams params = {};
+	params.tile_row_n = tile_row_n;
+	params.tile_col_n = tile_col_n;
+	params.seed = seed;
+	params.passable_ratio = 0.55f;
+	params.step_n = 5;
+	params.item_n = (tile_row_n * tile_col_n) / 4096;
+	params.orange_entity_n = (tile_row_n * tile_col_n) / 16384;
+	params.purple_entity_n = (tile_row_n * tile_col_n) / 16384;
+	return params;
+}
+
+static U64
+func GetRandomBits(RandomSeries *series)
+{
+	U64 low = RandomU32(series);
+	U64 high = RandomU32(series);
+	U64 bits = (high << 32) | low;
+	return bits;
+}
+
+// NOTE: Every bit is set with probability threshold / 256. Going from the lowest binary digit of threshold,
+//       a set digit ORs in random bits and a clear digit ANDs them, halving the probability each time.
+static U64
+func GetRandomBitsWithRatio(RandomSeries *series, U32 threshold)
+{
+	U64 bits = ~(U64)0;
+	if(threshold < 256)
+	{
+		bits = 0;
+		for(I32 i = 0; i < 8; i++)
+		{
+			U64 random_bits = GetRandomBits(series);
+			bits = ((threshold >> i) & 1) ? (bits | random_bits) : (bits & random_bits);
+		}
+	}
+	return bits;
+}
+
+// NOTE: Mask of the bits of a word in a row that are inside the map.
+static U64
+func GetMapGenWordMask(I32 tile_col_n, I32 word_col)
+{
+	U64 mask = GetLowBitMask(IntMin2(64, tile_col_n - word_col * 64));
+	return mask;
+}
+
+static void
+func InitCaveRows(void *parameter)
+{
+	MapGenJob *job = (MapGenJob *)parameter;
+	MapGenParams *params = job->params;
+	U32 threshold = (U32)Clip(params->passable_ratio * 256.0f, 0.0f, 256.0f);
+	for(I32 row = job->first_row; row <= job->last_row; row++)
+	{
+		RandomSeries series = CreateRandomSeries(params->seed, (U64)row);
+		U64 *row_words = job->target_words + row * job->word_per_row_n;
+		for(I32 word_col = 0; word_col < job->word_per_row_n; word_col++)
+		{
+			row_words[word_col] = GetRandomBitsWithRatio(&series, threshold) & GetMapGenWordMask(params->tile_col_n, word_col);
+		}
+	}
+}
+
+// NOTE: ones and twos are the bit-sliced count of passable tiles in the row at (and left and right of) every bit.
+static void
+func CountCaveRowWord(U64 *row_words, I32 word_col, I32 word_per_row_n, U64 *ones, U64 *twos)
+{
+	U64 center = row_words[word_col];
+	U64 previous = (word_col > 0) ? row_words[word_col - 1] : 0;
+	U64 next = (word_col + 1 < word_per_row_n) ? row_words[word_col + 1] : 0;
+	U64 left = (center << 1) | (previous >> 63);
+	U64 right = (center >> 1) | (next << 63);
+	*ones = left ^ center ^ right;
+	*twos = (left & center) | (left & right) | (center & right);
+}
+
+static void
+func StepCaveRows(void *parameter)
+{
+	MapGenJob *job = (MapGenJob *)parameter;
+	MapGenParams *params = job->params;
+	I32 word_per_row_n = job->word_per_row_n;
+	for(I32 row = job->first_row; row <= job->last_row; row++)
+	{
+		U64 *above = (row > 0) ? (job->source_words + (row - 1) * word_per_row_n) : job->zero_words;
+		U64 *middle = job->source_words + row * word_per_row_n;
+		U64 *below = (row + 1 < params->tile_row_n) ? (job->source_words + (row + 1) * word_per_row_n) : job->zero_words;
+		U64 *target = job->target_words + row * word_per_row_n;
+		for(I32 word_col = 0; word_col < word_per_row_n; word_col++)
+		{
+			U64 ones1 = 0, twos1 = 0, ones2 = 0, twos2 = 0, ones3 = 0, twos3 = 0;
+			CountCaveRowWord(above, word_col, word_per_row_n, &ones1, &twos1);
+			CountCaveRowWord(middle, word_col, word_per_row_n, &ones2, &twos2);
+			CountCaveRowWord(below, word_col, word_per_row_n, &ones3, &twos3);
+
+			// NOTE: Adds up the three row counts into the bits of a 4 bit count, sum1 + 2 * sum2 + 4 * sum4 + 8 * sum8.
+			U64 sum1 = ones1 ^ ones2 ^ ones3;
+			U64 ones_carry = (ones1 & ones2) | (ones1 & ones3) | (ones2 & ones3);
+			U64 twos_sum = twos1 ^ twos2 ^ twos3;
+			U64 twos_carry = (twos1 & twos2) | (twos1 & twos3) | (twos2 & twos3);
+			U64 sum2 = twos_sum ^ ones_carry;
+			U64 sum2_carry = twos_sum & ones_carry;
+			U64 sum4 = twos_carry ^ sum2_carry;
+			U64 sum8 = twos_carry & sum2_carry;
+
+			U64 is_passable = sum8 | (sum4 & (sum2 | sum1));
+			target[word_col] = is_passable & GetMapGenWordMask(params->tile_col_n, word_col);
+		}
+	}
+}
+
+static void
+func EncodeCaveChunks(void *parameter)
+{
+	MapGenJob *job = (MapGenJob *)parameter;
+	MapGenParams *params = job->params;
+	I32 chunk_col_n = GetMapChunkN(params->tile_col_n);
+	U8 tiles[MapChunkTileN] = {};
+	for(I32 chunk_row = job->first_row / MapChunkSide; chunk_row <= job->last_row / MapChunkSide; chunk_row++)
+	{
+		for(I32 chunk_col = 0; chunk_col < chunk_col_n; chunk_col++)
+		{
+			for(I32 row = 0; row < MapChunkSide; row++)
+			{
+				I32 tile_row = chunk_row * MapChunkSide + row;
+				U64 word = (tile_row < params->tile_row_n) ? job->source_words[tile_row * job->word_per_row_n + chunk_col] : 0;
+				U8 *row_tiles = tiles + row * MapChunkSide;
+				for(I32 col = 0; col < MapChunkSide; col++)
+				{
+					row_tiles[col] = ((word >> col) & 1) ? CaveTileId : NoTileId;
+				}
+			}
+
+			I32 chunk_index = chunk_row * chunk_col_n + chunk_col;
+			job->chunks[chunk_index] = EncodeMapChunk(tiles, job->chunk_data + chunk_index * MapChunkTileN);
+		}
+	}
+}
+
+static void
+func RunMapGenJobs(MapGenJob *jobs, I32 job_n, ThreadProc *proc)
+{
+	Thread threads[MaxMapGenThreadN] = {};
+	for(I32 i = 0; i < job_n; i++)
+	{
+		StartThread(&threads[i], proc, &jobs[i]);
+	}
+	for(I32 i = 0; i < job_n; i++)
+	{
+		WaitForThread(&threads[i]);
+	}
+}
+
+static IV2
+func GetRandomPassableTile(U64 *words, I32 word_per_row_n, MapGenParams *params, RandomSeries *series)
+{
+	IV2 tile = MakeTile(-1, -1);
+	for(I32 i = 0; i < MapGenPlaceTryN; i++)
+	{
+		I32 row = RandomIntBetween(series, 0, params->tile_row_n - 1);
+		I32 col = RandomIntBetween(series, 0, params->tile_col_n - 1);
+		if((words[row * word_per_row_n + (col >> 6)] >> (col & 63)) & 1)
+		{
+			tile = MakeTile(row, col);
+			break;
+		}
+	}
+	return tile;
+}
+
+static V2
+func GetMapGenTileCenter(IV2 tile)
+{
+	V2 center = MakePoint((tile.col + 0.5f) * MapTileSide, (tile.row + 0.5f) * MapTileSide);
+	return center;
+}
+
+// NOTE: Builds the whole file in the arena, after the buffers it works in. Returns its first byte,
+//       the size is in header->file_size. Items and entities that find no passable tile are left out.
+static MapFileHeader *
+func PushCaveMapFile(MapGenParams *params, MemArena *arena)
+{
+	Assert(params->tile_row_n > 0 && params->tile_col_n > 0);
+	I32 word_per_row_n = (params->tile_col_n + 63) / 64;
+	I32 word_n = params->tile_row_n * word_per_row_n;
+	U64 *words1 = ArenaAllocArray(arena, U64, word_n);
+	U64 *words2 = ArenaAllocArray(arena, U64, word_n);
+	U64 *zero_words = ArenaAllocArray(arena, U64, word_per_row_n);
+	for(I32 i = 0; i < word_per_row_n; i++)
+	{
+		zero_words[i] = 0;
+	}
+
+	I32 chunk_row_n = GetMapChunkN(params->tile_row_n);
+	I32 chunk_n = chunk_row_n * GetMapChunkN(params->tile_col_n);
+	MapFileChunk *chunks = ArenaAllocArray(arena, MapFileChunk, chunk_n);
+	U8 *chunk_data = ArenaAllocArray(arena, U8, chunk_n * MapChunkTileN);
+
+	I32 job_n = IntMin2(IntMin2(GetProcessorCount(), MaxMapGenThreadN), chunk_row_n);
+	MapGenJob jobs[MaxMapGenThreadN] = {};
+	for(I32 i = 0; i < job_n; i++)
+	{
+		MapGenJob *job = &jobs[i];
+		job->params = params;
+		job->first_row = ((chunk_row_n * i) / job_n) * MapChunkSide;
+		job->last_row = IntMin2(((chunk_row_n * (i + 1)) / job_n) * MapChunkSide, params->tile_row_n) - 1;
+		job->word_per_row_n = word_per_row_n;
+		job->zero_words = zero_words;
+		job->target_words = words1;
+		job->chunks = chunks;
+		job->chunk_data = chunk_data;
+	}
+	RunMapGenJobs(jobs, job_n, InitCaveRows);
+
+	U64 *source_words = words1;
+	U64 *target_words = words2;
+	for(I32 step = 0; step < params->step_n; step++)
+	{
+		for(I32 i = 0; i < job_n; i++)
+		{
+			jobs[i].source_words = source_words;
+			jobs[i].target_words = target_words;
+		}
+		RunMapGenJobs(jobs, job_n, StepCaveRows);
+
+		U64 *swap_words = source_words;
+		source_words = target_words;
+		target_words = swap_words;
+	}
+
+	for(I32 i = 0; i < job_n; i++)
+	{
+		jobs[i].source_words = source_words;
+	}
+	RunMapGenJobs(jobs, job_n, EncodeCaveChunks);
+
+	// NOTE: The rows use the streams below tile_row_n.
+	RandomSeries series = CreateRandomSeries(params->seed, (U64)params->tile_row_n);
+	MapItem *items = ArenaAllocArray(arena, MapItem, params->item_n);
+	I32 item_n = 0;
+	for(I32 i = 0; i < params->item_n; i++)
+	{
+		IV2 tile = GetRandomPassableTile(source_words, word_per_row_n, params, &series);
+		if(tile.row >= 0)
+		{
+			MapItem *item = &items[item_n];
+			item->item_id = (ItemId)RandomIntBetween(&series, HealthPotionItemId, CrystalItemId);
+			item->position = GetMapGenTileCenter(tile);
+			item_n++;
+		}
+	}
+
+	I32 max_entity_n = params->orange_entity_n + params->purple_entity_n;
+	MapEntity *entities = ArenaAllocArray(arena, MapEntity, max_entity_n);
+	I32 entity_n = 0;
+	for(I32 i = 0; i < max_entity_n; i++)
+	{
+		IV2 tile = GetRandomPassableTile(source_words, word_per_row_n, params, &series);
+		if(tile.row >= 0)
+		{
+			MapEntity *entity = &entities[entity_n];
+			entity->group_id = (i < params->orange_entity_n) ? OrangeGroupId : PurpleGroupId;
+			entity->spawn_position = GetMapGenTileCenter(tile);
+			entity_n++;
+		}
+	}
+
+	MapFileHeader *header = BeginMapFile(arena, params->tile_row_n, params->tile_col_n);
+	for(I32 i = 0; i < chunk_n; i++)
+	{
+		PushEncodedMapFileChunk(arena, header, chunks[i], chunk_data + i * MapChunkTileN);
+	}
+	EndMapFile(arena, header, items, item_n, entities, entity_n);
+	return header;
+}
+
+// NOTE: Returns false if the file could not be written, the old file is left as it was then.
+static B32
+func WriteCaveMapToFile(MapGenParams *params, I8 *file_path, MemArena *tmp_arena)
+{
+	TempMemory temp_memory = BeginTempMemory(tmp_arena);
+	MapFileHeader *header = PushCaveMapFile(params, tmp_arena);
+	B32 succeeded = WriteMapFileData(header, file_path);
+	EndTempMemory(temp_memory);
+	return succeeded;
+}
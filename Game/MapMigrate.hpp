@@ -0,0 +1,439 @@
+#pragma once
+
+#include "Debug.hpp"
+#include "File.hpp"
+#include "Hash.hpp"
+#include "Map.hpp"
+#include "MapFile.hpp"
+#include "Memory.hpp"
+#include "Type.hpp"
+
+// NOTE: Upgrades map files of older versions to the current version. The old file is read through a
+//       mapped view and the new one is written section by section and chunk by chunk, so memory use is
+//       a chunk and the chunk table, however big the map is. Every old file is checked before
+//       anything in it is trusted.
+//       - Version 3: a dump of MapV3 with addresses relative to the start of the file, a TileId per tile.
+//       - Version 4: the current layout without checksums.
+
+#define MapVersion3 3
+#define MapFileVersion4 4
+
+// NOTE: The Map struct as it was dumped into version 3 files.
+struct MapV3
+{
+	I32 tile_row_n;
+	I32 tile_col_n;
+	TileId *tile_types;
+
+	I32 item_n;
+	MapItem *items;
+
+	I32 entity_n;
+	MapEntity *entities;
+};
+
+struct MapFileSectionV4
+{
+	U32 section_id;
+	U32 offset;
+	U32 size;
+	U32 element_n;
+};
+
+struct MapFileHeaderV4
+{
+	U32 version;
+	U32 magic;
+	U32 header_size;
+	U32 file_size;
+
+	I32 tile_row_n;
+	I32 tile_col_n;
+	I32 chunk_row_n;
+	I32 chunk_col_n;
+
+	U32 section_n;
+	U32 flags;
+	MapFileSectionV4 sections[MaxMapFileSectionN];
+};
+
+struct MapFileChunkV4
+{
+	U32 offset;
+	U32 size;
+	U32 encoding;
+};
+
+// NOTE: Writes a map file straight to disk: BeginMapFileWriter, then sections one after the other,
+//       then EndMapFileWriter, which writes the header and replaces the file.
+struct MapFileWriter
+{
+	FileWriter file;
+	MapFileHeader header;
+	MapFileSection *section;
+	HashState section_hash;
+};
+
+static void
+func BeginMapFileWriter(MapFileWriter *writer, I8 *file_path, I32 tile_row_n, I32 tile_col_n)
+{
+	*writer = {};
+	BeginFileWriter(&writer->file, file_path);
+
+	MapFileHeader *header = &writer->header;
+	header->version = MapFileVersion;
+	header->magic = MapFileMagic;
+	header->header_size = sizeof(MapFileHeader);
+	header->tile_row_n = tile_row_n;
+	header->tile_col_n = tile_col_n;
+	header->chunk_row_n = GetMapChunkN(tile_row_n);
+	header->chunk_col_n = GetMapChunkN(tile_col_n);
+
+	// NOTE: Only holds the place of the header until EndMapFileWriter.
+	WriteToFile(&writer->file, header, sizeof(MapFileHeader));
+}
+
+static void
+func BeginMapFileWriterSection(MapFileWriter *writer, MapFileSectionId section_id, U32 element_n)
+{
+	Assert(writer->section == 0);
+	U8 padding[8] = {};
+	WriteToFile(&writer->file, padding, (8 - (writer->file.size % 8)) % 8);
+	writer->section = AddMapFileSection(&writer->header, section_id, writer->file.size, 0, element_n);
+	writer->section_hash = BeginHash();
+}
+
+static void
+func WriteMapFileWriterSection(MapFileWriter *writer, void *data, U32 size)
+{
+	Assert(writer->section != 0);
+	WriteToFile(&writer->file, data, size);
+	UpdateHash(&writer->section_hash, data, size);
+	writer->section->size += size;
+}
+
+static void
+func EndMapFileWriterSection(MapFileWriter *writer)
+{
+	Assert(writer->section != 0);
+	writer->section->checksum = EndHash(&writer->section_hash);
+	writer->section = 0;
+}
+
+static void
+func WriteMapFileWriterSectionOnce(MapFileWriter *writer, MapFileSectionId section_id, void *data, U32 size, U32 element_n)
+{
+	BeginMapFileWriterSection(writer, section_id, element_n);
+	WriteMapFileWriterSection(writer, data, size);
+	EndMapFileWriterSection(writer);
+}
+
+// NOTE: Writes the final data of a section that was written with placeholder data, for tables that are only known at the end.
+static void
+func RewriteMapFileWriterSection(MapFileWriter *writer, MapFileSectionId section_id, void *data)
+{
+	MapFileSection *section = GetMapFileSection(&writer->header, section_id);
+	Assert(section != 0);
+	WriteToFileAt(&writer->file, section->offset, data, section->size);
+	section->checksum = HashBytes(data, section->size);
+}
+
+static B32
+func EndMapFileWriter(MapFileWriter *writer)
+{
+	Assert(writer->section == 0);
+	MapFileHeader *header = &writer->header;
+	header->file_size = writer->file.size;
+	header->header_checksum = GetMapFileHeaderChecksum(header);
+	WriteToFileAt(&writer->file, 0, header, sizeof(MapFileHeader));
+	B32 succeeded = EndFileWriter(&writer->file);
+	return succeeded;
+}
+
+// NOTE: Checks the layout of a version 3 dump before any of its addresses is used. Returns 0 if it is not valid.
+static MapV3 *
+func GetValidMapV3(MapFileView *view)
+{
+	MapV3 *file_map = 0;
+	U64 tiles_offset = sizeof(I32) + sizeof(MapV3);
+	if(view->size >= tiles_offset && *(I32 *)view->base == MapVersion3)
+	{
+		MapV3 *header_map = (MapV3 *)(view->base + sizeof(I32));
+		B32 is_valid = (header_map->tile_row_n >= 0 && header_map->tile_col_n >= 0 &&
+						header_map->item_n >= 0 && header_map->entity_n >= 0);
+		if(is_valid)
+		{
+			U64 items_offset = tiles_offset + (U64)header_map->tile_row_n * (U64)header_map->tile_col_n * sizeof(TileId);
+			U64 entities_offset = items_offset + (U64)header_map->item_n * sizeof(MapItem);
+			U64 end_offset = entities_offset + (U64)header_map->entity_n * sizeof(MapEntity);
+			is_valid = ((U64)header_map->tile_types == tiles_offset &&
+						(U64)header_map->items == items_offset &&
+						(U64)header_map->entities == entities_offset &&
+						end_offset == view->size);
+		}
+		if(is_valid)
+		{
+			file_map = header_map;
+		}
+	}
+	return file_map;
+}
+
+static B32
+func MigrateMapFileV3(MapFileView *view, MapFileWriter *writer, I8 *file_path, MemArena *tmp_arena)
+{
+	MapV3 *file_map = GetValidMapV3(view);
+	if(file_map)
+	{
+		I32 row_n = file_map->tile_row_n;
+		I32 col_n = file_map->tile_col_n;
+		TileId *file_tiles = (TileId *)GetAbsoluteAddress(file_map->tile_types, view->base);
+		BeginMapFileWriter(writer, file_path, row_n, col_n);
+
+		I32 chunk_n = writer->header.chunk_row_n * writer->header.chunk_col_n;
+		MapFileChunk *chunks = ArenaAllocArray(tmp_arena, MapFileChunk, chunk_n);
+		for(I32 i = 0; i < chunk_n; i++)
+		{
+			chunks[i] = {};
+		}
+		WriteMapFileWriterSectionOnce(writer, ChunkTableMapFileSectionId, chunks, chunk_n * sizeof(MapFileChunk), chunk_n);
+
+		BeginMapFileWriterSection(writer, ChunkDataMapFileSectionId, chunk_n);
+		U8 tiles[MapChunkTileN] = {};
+		U8 output[MapChunkTileN] = {};
+		for(I32 chunk_index = 0; chunk_index < chunk_n; chunk_index++)
+		{
+			I32 chunk_row = chunk_index / writer->header.chunk_col_n;
+			I32 chunk_col = chunk_index % writer->header.chunk_col_n;
+			for(I32 row = 0; row < MapChunkSide; row++)
+			{
+				for(I32 col = 0; col < MapChunkSide; col++)
+				{
+					I32 tile_row = chunk_row * MapChunkSide + row;
+					I32 tile_col = chunk_col * MapChunkSide + col;
+					U8 tile = NoTileId;
+					if(tile_row < row_n && tile_col < col_n)
+					{
+						tile = (U8)file_tiles[tile_row * col_n + tile_col];
+					}
+					tiles[row * MapChunkSide + col] = tile;
+				}
+			}
+
+			MapFileChunk chunk = EncodeMapChunk(tiles, output);
+			chunk.offset = writer->section->size;
+			WriteMapFileWriterSection(writer, output, chunk.size);
+			chunks[chunk_index] = chunk;
+		}
+		EndMapFileWriterSection(writer);
+		RewriteMapFileWriterSection(writer, ChunkTableMapFileSectionId, chunks);
+
+		MapItem *items = (MapItem *)GetAbsoluteAddress(file_map->items, view->base);
+		WriteMapFileWriterSectionOnce(writer, ItemMapFileSectionId, items,
+									  file_map->item_n * sizeof(MapItem), file_map->item_n);
+		MapEntity *entities = (MapEntity *)GetAbsoluteAddress(file_map->entities, view->base);
+		WriteMapFileWriterSectionOnce(writer, EntityMapFileSectionId, entities,
+									  file_map->entity_n * sizeof(MapEntity), file_map->entity_n);
+	}
+	return (file_map != 0);
+}
+
+static MapFileSectionV4 *
+func GetMapFileSectionV4(MapFileHeaderV4 *header, MapFileSectionId section_id)
+{
+	MapFileSectionV4 *result = 0;
+	for(U32 i = 0; i < header->section_n; i++)
+	{
+		if(header->sections[i].section_id == (U32)section_id)
+		{
+			result = &header->sections[i];
+			break;
+		}
+	}
+	return result;
+}
+
+// NOTE: Returns 0 if the header or the chunk table do not fit the file.
+static MapFileHeaderV4 *
+func GetValidMapFileHeaderV4(MapFileView *view)
+{
+	MapFileHeaderV4 *header = 0;
+	if(view->size >= sizeof(MapFileHeaderV4))
+	{
+		MapFileHeaderV4 *file_header = (MapFileHeaderV4 *)view->base;
+		B32 is_valid = (file_header->version == MapFileVersion4 &&
+						file_header->magic == MapFileMagic &&
+						file_header->header_size == sizeof(MapFileHeaderV4) &&
+						file_header->file_size == view->size &&
+						file_header->section_n <= MaxMapFileSectionN &&
+						file_header->tile_row_n >= 0 && file_header->tile_col_n >= 0 &&
+						file_header->chunk_row_n == GetMapChunkN(file_header->tile_row_n) &&
+						file_header->chunk_col_n == GetMapChunkN(file_header->tile_col_n));
+		for(U32 i = 0; is_valid && i < file_header->section_n; i++)
+		{
+			MapFileSectionV4 *section = &file_header->sections[i];
+			is_valid = (section->offset >= file_header->header_size &&
+						section->offset <= file_header->file_size &&
+						section->size <= file_header->file_size - section->offset);
+		}
+
+		MapFileSectionV4 *chunk_table = (is_valid) ? GetMapFileSectionV4(file_header, ChunkTableMapFileSectionId) : 0;
+		MapFileSectionV4 *chunk_data = (is_valid) ? GetMapFileSectionV4(file_header, ChunkDataMapFileSectionId) : 0;
+		is_valid = (chunk_table && chunk_data &&
+					chunk_table->element_n == (U32)(file_header->chunk_row_n * file_header->chunk_col_n) &&
+					chunk_table->size == chunk_table->element_n * sizeof(MapFileChunkV4));
+		for(U32 i = 0; is_valid && i < chunk_table->element_n; i++)
+		{
+			MapFileChunkV4 *chunk = (MapFileChunkV4 *)(view->base + chunk_table->offset) + i;
+			is_valid = (chunk->offset <= chunk_data->size && chunk->size <= chunk_data->size - chunk->offset);
+		}
+
+		if(is_valid)
+		{
+			header = file_header;
+		}
+	}
+	return header;
+}
+
+static U64
+func HashMapFileBytesV4(U8 *data, U32 size, U64 hash)
+{
+	U64 multiplier = 0x9E3779B97F4A7C15ULL;
+	U32 word_n = size / 8;
+	for(U32 i = 0; i < word_n; i++)
+	{
+		U64 word = 0;
+		U8 *word_bytes = data + 8 * i;
+		for(I32 j = 0; j < 8; j++)
+		{
+			word |= ((U64)word_bytes[j] << (8 * j));
+		}
+		hash = (hash ^ word) * multiplier;
+		hash ^= (hash >> 29);
+	}
+	for(U32 i = 8 * word_n; i < size; i++)
+	{
+		hash = (hash ^ data[i]) * multiplier;
+		hash ^= (hash >> 29);
+	}
+	return hash;
+}
+
+// NOTE: The tile hash that version 4 nav sections were baked with.
+static U64
+func GetMapFileTileHashV4(MapFileHeaderV4 *header)
+{
+	U8 *file_base = (U8 *)header;
+	U64 hash = 0xCBF29CE484222325ULL;
+	hash = HashMapFileBytesV4((U8 *)&header->tile_row_n, sizeof(header->tile_row_n), hash);
+	hash = HashMapFileBytesV4((U8 *)&header->tile_col_n, sizeof(header->tile_col_n), hash);
+
+	MapFileSectionV4 *chunk_table = GetMapFileSectionV4(header, ChunkTableMapFileSectionId);
+	MapFileSectionV4 *chunk_data = GetMapFileSectionV4(header, ChunkDataMapFileSectionId);
+	hash = HashMapFileBytesV4(file_base + chunk_table->offset, chunk_table->size, hash);
+	hash = HashMapFileBytesV4(file_base + chunk_data->offset, chunk_data->size, hash);
+	return hash;
+}
+
+// NOTE: Chunk data, items and entities are copied as they are. Nav sections are kept, with the new tile hash,
+//       if they were up to date, otherwise they are left out and the next save bakes them again.
+static B32
+func MigrateMapFileV4(MapFileView *view, MapFileWriter *writer, I8 *file_path, MemArena *tmp_arena)
+{
+	MapFileHeaderV4 *header = GetValidMapFileHeaderV4(view);
+	if(header)
+	{
+		BeginMapFileWriter(writer, file_path, header->tile_row_n, header->tile_col_n);
+
+		MapFileSectionV4 *chunk_table = GetMapFileSectionV4(header, ChunkTableMapFileSectionId);
+		MapFileSectionV4 *chunk_data = GetMapFileSectionV4(header, ChunkDataMapFileSectionId);
+		U8 *chunk_data_base = view->base + chunk_data->offset;
+		MapFileChunkV4 *old_chunks = (MapFileChunkV4 *)(view->base + chunk_table->offset);
+		U32 chunk_n = chunk_table->element_n;
+		MapFileChunk *chunks = ArenaAllocArray(tmp_arena, MapFileChunk, chunk_n);
+		for(U32 i = 0; i < chunk_n; i++)
+		{
+			MapFileChunkV4 old_chunk = old_chunks[i];
+			MapFileChunk *chunk = &chunks[i];
+			chunk->offset = old_chunk.offset;
+			chunk->size = old_chunk.size;
+			chunk->encoding = old_chunk.encoding;
+			chunk->checksum = GetMapChunkChecksum(chunk_data_base + old_chunk.offset, old_chunk.size);
+		}
+		WriteMapFileWriterSectionOnce(writer, ChunkTableMapFileSectionId, chunks, chunk_n * sizeof(MapFileChunk), chunk_n);
+		WriteMapFileWriterSectionOnce(writer, ChunkDataMapFileSectionId, chunk_data_base, chunk_data->size, chunk_data->element_n);
+
+		MapFileSectionV4 *nav_info_section = GetMapFileSectionV4(header, NavInfoMapFileSectionId);
+		MapFileNavInfo *nav_info = (nav_info_section && nav_info_section->size == sizeof(MapFileNavInfo))
+								   ? (MapFileNavInfo *)(view->base + nav_info_section->offset) : 0;
+		B32 keep_nav = (nav_info && nav_info->tile_hash == GetMapFileTileHashV4(header));
+
+		for(U32 i = 0; i < header->section_n; i++)
+		{
+			MapFileSectionV4 *section = &header->sections[i];
+			MapFileSectionId section_id = (MapFileSectionId)section->section_id;
+			B32 is_nav = (section_id >= NavInfoMapFileSectionId && section_id <= NavDistanceMapFileSectionId);
+			if(section_id == ChunkTableMapFileSectionId || section_id == ChunkDataMapFileSectionId)
+			{
+				continue;
+			}
+			if(is_nav && !keep_nav)
+			{
+				continue;
+			}
+
+			if(section_id == NavInfoMapFileSectionId)
+			{
+				MapFileNavInfo new_nav_info = *nav_info;
+				new_nav_info.tile_hash = GetMapChunkTableHash(header->tile_row_n, header->tile_col_n, chunks, chunk_n);
+				WriteMapFileWriterSectionOnce(writer, section_id, &new_nav_info, sizeof(new_nav_info), section->element_n);
+			}
+			else
+			{
+				WriteMapFileWriterSectionOnce(writer, section_id, view->base + section->offset, section->size, section->element_n);
+			}
+		}
+	}
+	return (header != 0);
+}
+
+// NOTE: Brings a map file to the current version in place. Returns false if the file is not a valid map
+//       file of any version, or if writing the upgraded file failed, the old file is left as it was then.
+static B32
+func UpgradeMapFile(I8 *file_path, MemArena *tmp_arena)
+{
+	TempMemory temp_memory = BeginTempMemory(tmp_arena);
+	MapFileView view = OpenMapFileView(file_path);
+	U32 version = (view.size >= sizeof(U32)) ? *(U32 *)view.base : 0;
+
+	B32 succeeded = false;
+	if(version == MapFileVersion)
+	{
+		succeeded = IsValidMapFileView(&view);
+		CloseMapFileView(&view);
+	}
+	else
+	{
+		MapFileWriter writer = {};
+		B32 is_valid = false;
+		if(version == MapVersion3)
+		{
+			is_valid = MigrateMapFileV3(&view, &writer, file_path, tmp_arena);
+		}
+		else if(version == MapFileVersion4)
+		{
+			is_valid = MigrateMapFileV4(&view, &writer, file_path, tmp_arena);
+		}
+
+		// NOTE: The old file has to be closed before the new one can replace it.
+		CloseMapFileView(&view);
+		if(is_valid)
+		{
+			succeeded = EndMapFileWriter(&writer);
+		}
+	}
+
+	EndTempMemory(temp_memory);
+	return succeeded;
+}
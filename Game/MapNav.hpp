@@ -0,0 +1,445 @@
+#pragma once
+
+#include "Debug.hpp"
+#include "Map.hpp"
+#include "Math.hpp"
+#include "Memory.hpp"
+#include "Type.hpp"
+
+// NOTE: Navigation data that only depends on the tiles, so it can be computed when the map is saved.
+//       - Regions: 4-connected components of passable tiles. region_labels has one label per tile,
+//         0 for tiles that are not passable, and two tiles are reachable from each other if their labels match.
+//       - Cluster graph: the map is cut into MapNavClusterSide x MapNavClusterSide clusters. Every passable
+//         stretch of a cluster border gets an entrance: one node on each side, linked with cost 1.
+//         Nodes of a cluster are linked with their walking distance inside the cluster.
+//       - Distance fields: walking distance in tiles from the nearest spawn point of an entity group.
+
+#define MapNavClusterSide 16
+#define MapNavGroupN (PurpleGroupId + 1)
+#define MapNavNoDistance 0xFFFF
+
+struct MapNavNode
+{
+	I32 row;
+	I32 col;
+	I32 first_edge;
+	I32 edge_n;
+};
+
+struct MapNavEdge
+{
+	I32 node_index;
+	I32 cost;
+};
+
+struct MapNav
+{
+	I32 tile_row_n;
+	I32 tile_col_n;
+	U64 tile_hash;
+
+	I32 region_n;
+	I32 *region_labels;
+
+	I32 cluster_row_n;
+	I32 cluster_col_n;
+	I32 *cluster_first_nodes;
+	I32 node_n;
+	MapNavNode *nodes;
+	I32 edge_n;
+	MapNavEdge *edges;
+
+	U16 *distance_fields[MapNavGroupN];
+};
+
+static B32
+func IsMapTilePassable(Map *map, I32 row, I32 col)
+{
+	U64 word = map->passable_words[row * map->passable_word_per_row_n + (col >> 6)];
+	B32 is_passable = (word >> (col & 63)) & 1;
+	return is_passable;
+}
+
+struct MapNavEntrance
+{
+	I32 row1;
+	I32 col1;
+	I32 row2;
+	I32 col2;
+};
+
+static I32
+func GetMapNavClusterIndex(MapNav *nav, I32 row, I32 col)
+{
+	I32 cluster_index = (row / MapNavClusterSide) * nav->cluster_col_n + (col / MapNavClusterSide);
+	return cluster_index;
+}
+
+// NOTE: Walking distance from one tile to every tile of its cluster, -1 where it can not walk.
+static void
+func GetMapNavClusterDistances(Map *map, I32 cluster_row, I32 cluster_col, I32 start_row, I32 start_col,
+							   I32 *distances)
+{
+	I32 top = cluster_row * MapNavClusterSide;
+	I32 left = cluster_col * MapNavClusterSide;
+	I32 row_n = IntMin2(MapNavClusterSide, map->tile_row_n - top);
+	I32 col_n = IntMin2(MapNavClusterSide, map->tile_col_n - left);
+	for(I32 i = 0; i < MapNavClusterSide * MapNavClusterSide; i++)
+	{
+		distances[i] = -1;
+	}
+
+	I32 queue[MapNavClusterSide * MapNavClusterSide] = {};
+	I32 queue_n = 0;
+	I32 start = (start_row - top) * MapNavClusterSide + (start_col - left);
+	distances[start] = 0;
+	queue[queue_n] = start;
+	queue_n++;
+	for(I32 i = 0; i < queue_n; i++)
+	{
+		I32 index = queue[i];
+		I32 row = index / MapNavClusterSide;
+		I32 col = index % MapNavClusterSide;
+		IV2 neighbors[4] = {
+			MakeTile(row - 1, col),
+			MakeTile(row + 1, col),
+			MakeTile(row, col - 1),
+			MakeTile(row, col + 1)
+		};
+		for(I32 j = 0; j < 4; j++)
+		{
+			IV2 neighbor = neighbors[j];
+			if(!IsIntBetween(neighbor.row, 0, row_n - 1) || !IsIntBetween(neighbor.col, 0, col_n - 1))
+			{
+				continue;
+			}
+			I32 neighbor_index = neighbor.row * MapNavClusterSide + neighbor.col;
+			if(distances[neighbor_index] >= 0 || !IsMapTilePassable(map, top + neighbor.row, left + neighbor.col))
+			{
+				continue;
+			}
+			distances[neighbor_index] = distances[index] + 1;
+			queue[queue_n] = neighbor_index;
+			queue_n++;
+		}
+	}
+}
+
+static void
+func AddMapNavEntrance(MapNavEntrance *entrances, I32 *entrance_n, I32 row1, I32 col1, I32 row2, I32 col2)
+{
+	MapNavEntrance *entrance = &entrances[*entrance_n];
+	(*entrance_n)++;
+	entrance->row1 = row1;
+	entrance->col1 = col1;
+	entrance->row2 = row2;
+	entrance->col2 = col2;
+}
+
+// NOTE: Entrances in the middle of every passable stretch of the borders between clusters.
+static I32
+func FindMapNavEntrances(Map *map, MapNav *nav, MapNavEntrance *entrances)
+{
+	I32 entrance_n = 0;
+	for(I32 cluster_row = 0; cluster_row < nav->cluster_row_n; cluster_row++)
+	{
+		for(I32 cluster_col = 0; cluster_col < nav->cluster_col_n; cluster_col++)
+		{
+			I32 top = cluster_row * MapNavClusterSide;
+			I32 left = cluster_col * MapNavClusterSide;
+			I32 bottom = IntMin2(top + MapNavClusterSide, map->tile_row_n) - 1;
+			I32 right = IntMin2(left + MapNavClusterSide, map->tile_col_n) - 1;
+
+			if(right + 1 < map->tile_col_n)
+			{
+				I32 stretch_start = -1;
+				for(I32 row = top; row <= bottom + 1; row++)
+				{
+					B32 is_open = (row <= bottom && IsMapTilePassable(map, row, right) &&
+								   IsMapTilePassable(map, row, right + 1));
+					if(is_open && stretch_start < 0)
+					{
+						stretch_start = row;
+					}
+					else if(!is_open && stretch_start >= 0)
+					{
+						I32 middle = (stretch_start + row - 1) / 2;
+						AddMapNavEntrance(entrances, &entrance_n, middle, right, middle, right + 1);
+						stretch_start = -1;
+					}
+				}
+			}
+
+			if(bottom + 1 < map->tile_row_n)
+			{
+				I32 stretch_start = -1;
+				for(I32 col = left; col <= right + 1; col++)
+				{
+					B32 is_open = (col <= right && IsMapTilePassable(map, bottom, col) &&
+								   IsMapTilePassable(map, bottom + 1, col));
+					if(is_open && stretch_start < 0)
+					{
+						stretch_start = col;
+					}
+					else if(!is_open && stretch_start >= 0)
+					{
+						I32 middle = (stretch_start + col - 1) / 2;
+						AddMapNavEntrance(entrances, &entrance_n, bottom, middle, bottom + 1, middle);
+						stretch_start = -1;
+					}
+				}
+			}
+		}
+	}
+	return entrance_n;
+}
+
+static void
+func BuildMapNavClusterGraph(Map *map, MapNav *nav, MemArena *arena)
+{
+	nav->cluster_row_n = (map->tile_row_n + MapNavClusterSide - 1) / MapNavClusterSide;
+	nav->cluster_col_n = (map->tile_col_n + MapNavClusterSide - 1) / MapNavClusterSide;
+	I32 cluster_n = nav->cluster_row_n * nav->cluster_col_n;
+	nav->cluster_first_nodes = ArenaAllocArray(arena, I32, cluster_n + 1);
+
+	// NOTE: A cluster has at most MapNavClusterSide / 2 + 1 entrances on a side.
+	//       The entrances are found twice: once to count the nodes and edges, so that nodes and edges
+	//       can be allocated below the temporary memory, and once more to fill them in.
+	I32 max_entrance_n = 2 * cluster_n * (MapNavClusterSide / 2 + 1);
+	TempMemory temp_memory = BeginTempMemory(arena);
+	MapNavEntrance *entrances = ArenaAllocArray(arena, MapNavEntrance, max_entrance_n);
+	I32 entrance_n = FindMapNavEntrances(map, nav, entrances);
+
+	for(I32 i = 0; i <= cluster_n; i++)
+	{
+		nav->cluster_first_nodes[i] = 0;
+	}
+	for(I32 i = 0; i < entrance_n; i++)
+	{
+		MapNavEntrance *entrance = &entrances[i];
+		nav->cluster_first_nodes[GetMapNavClusterIndex(nav, entrance->row1, entrance->col1) + 1]++;
+		nav->cluster_first_nodes[GetMapNavClusterIndex(nav, entrance->row2, entrance->col2) + 1]++;
+	}
+	for(I32 i = 0; i < cluster_n; i++)
+	{
+		nav->cluster_first_nodes[i + 1] += nav->cluster_first_nodes[i];
+	}
+	EndTempMemory(temp_memory);
+
+	// NOTE: Every node gets the edge through its entrance and one edge to each node of its cluster that it can reach.
+	I32 max_edge_n = 0;
+	for(I32 i = 0; i < cluster_n; i++)
+	{
+		I32 node_n = nav->cluster_first_nodes[i + 1] - nav->cluster_first_nodes[i];
+		max_edge_n += node_n * node_n;
+	}
+	nav->node_n = 2 * entrance_n;
+	MapNavNode *nodes = ArenaAllocArray(arena, MapNavNode, nav->node_n);
+	MapNavEdge *edges = ArenaAllocArray(arena, MapNavEdge, max_edge_n);
+
+	temp_memory = BeginTempMemory(arena);
+	entrances = ArenaAllocArray(arena, MapNavEntrance, max_entrance_n);
+	Verify(FindMapNavEntrances(map, nav, entrances) == entrance_n);
+	I32 *entrance_nodes = ArenaAllocArray(arena, I32, nav->node_n);
+	I32 *cluster_node_n = ArenaAllocArray(arena, I32, cluster_n);
+	for(I32 i = 0; i < cluster_n; i++)
+	{
+		cluster_node_n[i] = 0;
+	}
+	for(I32 i = 0; i < entrance_n; i++)
+	{
+		MapNavEntrance *entrance = &entrances[i];
+		for(I32 side = 0; side < 2; side++)
+		{
+			I32 row = (side == 0) ? entrance->row1 : entrance->row2;
+			I32 col = (side == 0) ? entrance->col1 : entrance->col2;
+			I32 cluster_index = GetMapNavClusterIndex(nav, row, col);
+			I32 node_index = nav->cluster_first_nodes[cluster_index] + cluster_node_n[cluster_index];
+			cluster_node_n[cluster_index]++;
+
+			MapNavNode *node = &nodes[node_index];
+			*node = {};
+			node->row = row;
+			node->col = col;
+			entrance_nodes[2 * i + side] = node_index;
+		}
+	}
+
+	I32 edge_n = 0;
+	I32 distances[MapNavClusterSide * MapNavClusterSide] = {};
+	for(I32 cluster_index = 0; cluster_index < cluster_n; cluster_index++)
+	{
+		I32 cluster_row = cluster_index / nav->cluster_col_n;
+		I32 cluster_col = cluster_index % nav->cluster_col_n;
+		I32 top = cluster_row * MapNavClusterSide;
+		I32 left = cluster_col * MapNavClusterSide;
+		I32 first_node = nav->cluster_first_nodes[cluster_index];
+		I32 end_node = nav->cluster_first_nodes[cluster_index + 1];
+		for(I32 node_index = first_node; node_index < end_node; node_index++)
+		{
+			MapNavNode *node = &nodes[node_index];
+			node->first_edge = edge_n;
+			GetMapNavClusterDistances(map, cluster_row, cluster_col, node->row, node->col, distances);
+			for(I32 other_index = first_node; other_index < end_node; other_index++)
+			{
+				MapNavNode *other = &nodes[other_index];
+				I32 distance = distances[(other->row - top) * MapNavClusterSide + (other->col - left)];
+				if(other_index != node_index && distance >= 0)
+				{
+					edges[edge_n].node_index = other_index;
+					edges[edge_n].cost = distance;
+					edge_n++;
+				}
+			}
+			// NOTE: The entrance edge is filled in below, once every node has its place.
+			edges[edge_n].node_index = -1;
+			edges[edge_n].cost = 1;
+			edge_n++;
+			node->edge_n = edge_n - node->first_edge;
+		}
+	}
+	for(I32 i = 0; i < entrance_n; i++)
+	{
+		I32 node1 = entrance_nodes[2 * i];
+		I32 node2 = entrance_nodes[2 * i + 1];
+		edges[nodes[node1].first_edge + nodes[node1].edge_n - 1].node_index = node2;
+		edges[nodes[node2].first_edge + nodes[node2].edge_n - 1].node_index = node1;
+	}
+	EndTempMemory(temp_memory);
+
+	// NOTE: The edges are the last thing in the arena, so the part that was not used can be given back.
+	SetArenaSize(arena, (U64)((I8 *)(edges + edge_n) - arena->base_address));
+	nav->nodes = nodes;
+	nav->edge_n = edge_n;
+	nav->edges = edges;
+}
+
+// NOTE: Breadth first search from every spawn point of the group at once.
+static U16 *
+func BuildMapNavDistanceField(Map *map, EntityGroupId group_id, MemArena *arena)
+{
+	I32 tile_n = map->tile_row_n * map->tile_col_n;
+	U16 *distances = ArenaAllocArray(arena, U16, tile_n);
+	for(I32 i = 0; i < tile_n; i++)
+	{
+		distances[i] = MapNavNoDistance;
+	}
+
+	TempMemory temp_memory = BeginTempMemory(arena);
+	I32 *queue = ArenaAllocArray(arena, I32, tile_n);
+	I32 queue_n = 0;
+	for(I32 i = 0; i < map->entity_n; i++)
+	{
+		MapEntity *entity = &map->entities[i];
+		I32 row = Floor(entity->spawn_position.y / MapTileSide);
+		I32 col = Floor(entity->spawn_position.x / MapTileSide);
+		if(entity->group_id == group_id &&
+		   IsIntBetween(row, 0, map->tile_row_n - 1) && IsIntBetween(col, 0, map->tile_col_n - 1) &&
+		   IsMapTilePassable(map, row, col) && distances[row * map->tile_col_n + col] != 0)
+		{
+			distances[row * map->tile_col_n + col] = 0;
+			queue[queue_n] = row * map->tile_col_n + col;
+			queue_n++;
+		}
+	}
+
+	for(I32 i = 0; i < queue_n; i++)
+	{
+		I32 index = queue[i];
+		I32 row = index / map->tile_col_n;
+		I32 col = index % map->tile_col_n;
+		U16 distance = (U16)IntMin2(distances[index] + 1, MapNavNoDistance - 1);
+		IV2 neighbors[4] = {
+			MakeTile(row - 1, col),
+			MakeTile(row + 1, col),
+			MakeTile(row, col - 1),
+			MakeTile(row, col + 1)
+		};
+		for(I32 j = 0; j < 4; j++)
+		{
+			IV2 neighbor = neighbors[j];
+			if(!IsIntBetween(neighbor.row, 0, map->tile_row_n - 1) || !IsIntBetween(neighbor.col, 0, map->tile_col_n - 1))
+			{
+				continue;
+			}
+			I32 neighbor_index = neighbor.row * map->tile_col_n + neighbor.col;
+			if(distances[neighbor_index] != MapNavNoDistance || !IsMapTilePassable(map, neighbor.row, neighbor.col))
+			{
+				continue;
+			}
+			distances[neighbor_index] = distance;
+			queue[queue_n] = neighbor_index;
+			queue_n++;
+		}
+	}
+
+	EndTempMemory(temp_memory);
+	return distances;
+}
+
+// NOTE: An upper bound of what BakeMapNav takes from the arena, temporary memory included.
+//       Every cluster counts with the most entrances it can have, so real maps use a lot less.
+static U64
+func GetMaxMapNavBakeSize(I32 tile_row_n, I32 tile_col_n, B32 bake_distance_fields)
+{
+	U64 tile_n = (U64)tile_row_n * (U64)tile_col_n;
+	U64 cluster_row_n = (U64)((tile_row_n + MapNavClusterSide - 1) / MapNavClusterSide);
+	U64 cluster_col_n = (U64)((tile_col_n + MapNavClusterSide - 1) / MapNavClusterSide);
+	U64 cluster_n = cluster_row_n * cluster_col_n;
+	U64 max_entrance_n = 2 * cluster_n * (MapNavClusterSide / 2 + 1);
+	U64 max_cluster_node_n = 4 * (MapNavClusterSide / 2 + 1);
+
+	U64 max_run_n = (U64)tile_row_n * (U64)((tile_col_n + 1) / 2);
+	U64 region_size = tile_n * sizeof(I32) + ((U64)tile_row_n + 1) * sizeof(I32) + max_run_n * sizeof(MapRegionRun);
+
+	U64 graph_size = (cluster_n + 1) * sizeof(I32) + max_entrance_n * sizeof(MapNavEntrance) +
+					 2 * max_entrance_n * (sizeof(MapNavNode) + sizeof(I32)) + cluster_n * sizeof(I32) +
+					 cluster_n * max_cluster_node_n * max_cluster_node_n * sizeof(MapNavEdge);
+
+	U64 distance_size = 0;
+	if(bake_distance_fields)
+	{
+		distance_size = MapNavGroupN * tile_n * sizeof(U16) + tile_n * sizeof(I32);
+	}
+
+	U64 size = sizeof(MapNav) + region_size + graph_size + distance_size;
+	return size;
+}
+
+// NOTE: Everything ends up in the arena, the map needs flat tiles.
+//       Distance fields are only built for the groups that have spawn points.
+static MapNav *
+func BakeMapNav(Map *map, U64 tile_hash, B32 bake_distance_fields, MemArena *arena)
+{
+	MapNav *nav = ArenaAllocType(arena, MapNav);
+	*nav = {};
+	nav->tile_row_n = map->tile_row_n;
+	nav->tile_col_n = map->tile_col_n;
+	nav->tile_hash = tile_hash;
+
+	nav->region_labels = ArenaAllocArray(arena, I32, map->tile_row_n * map->tile_col_n);
+	nav->region_n = LabelMapRegions(map, nav->region_labels, arena);
+
+	BuildMapNavClusterGraph(map, nav, arena);
+
+	if(bake_distance_fields)
+	{
+		for(I32 group_id = 0; group_id < MapNavGroupN; group_id++)
+		{
+			B32 has_spawn = false;
+			for(I32 i = 0; i < map->entity_n; i++)
+			{
+				if(map->entities[i].group_id == group_id)
+				{
+					has_spawn = true;
+					break;
+				}
+			}
+			if(has_spawn)
+			{
+				nav->distance_fields[group_id] = BuildMapNavDistanceField(map, (EntityGroupId)group_id, arena);
+			}
+		}
+	}
+	return nav;
+}
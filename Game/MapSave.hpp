@@ -0,0 +1,474 @@
+#pragma once
+
+#include "Debug.hpp"
+#include "File.hpp"
+#include "Map.hpp"
+#include "MapFile.hpp"
+#include "Memory.hpp"
+#include "SparseMap.hpp"
+#include "Thread.hpp"
+#include "Type.hpp"
+
+// NOTE: Saves a SparseMap on a background thread.
+//       Starting a save takes a snapshot on the main thread. The snapshot copies the tiles of the
+//       chunks that changed since they were last saved, and keeps a reference to the encoded bytes
+//       of every other chunk in the previous file. The save thread only encodes the copied chunks.
+//       It builds the new file in the other of two file buffers, bakes the MapNav of the new tiles into it
+//       and writes it with WriteFileAtomically. The job arena only holds the snapshot, the bake reserves its own.
+//       The main thread never waits, it picks the results up in UpdateMapSaver.
+//       The buffers are reserved for the most memory the map can take. A map spread so wide that its file
+//       would not fit into them fails to save, the save is counted as failed and nothing is written.
+
+enum MapSaveStateId
+{
+	IdleMapSaveStateId,
+	SavingMapSaveStateId,
+	DoneMapSaveStateId
+};
+
+struct MapSaveChunk
+{
+	I32 chunk_row;
+	I32 chunk_col;
+	U8 *tiles;
+	MapFileChunk cached_chunk;
+	MapFileChunk saved_chunk;
+};
+
+struct MapSaver
+{
+	MemArena file_arenas[2];
+	I32 file_index;
+	MapFileHeader *file;
+
+	MemArena job_arena;
+	U64 max_bake_tile_n;
+	I8 *file_path;
+	MapSaveChunk *chunks;
+	I32 chunk_n;
+	I32 *chunk_grid;
+	I32 top_chunk_row;
+	I32 left_chunk_col;
+	I32 chunk_row_n;
+	I32 chunk_col_n;
+	MapItem *items;
+	I32 item_n;
+	MapEntity *entities;
+	I32 entity_n;
+	U32 job_change_n;
+	volatile B32 succeeded;
+
+	volatile I32 state;
+	Thread thread;
+	Semaphore semaphore;
+	Semaphore done_semaphore;
+	volatile B32 stop;
+
+	B32 has_saved;
+	U32 saved_change_n;
+	I32 save_n;
+	I32 failed_save_n;
+
+	I32 encoded_chunk_n;
+	I32 reused_chunk_n;
+};
+
+static B32
+func IsMapChunkEmpty(MapChunk *chunk)
+{
+	B32 is_empty = true;
+	U64 *words = (U64 *)chunk->tiles;
+	U64 empty_word = (U64)NoTileId * 0x0101010101010101ULL;
+	for(I32 i = 0; i < MapChunkTileN / 8; i++)
+	{
+		if(words[i] != empty_word)
+		{
+			is_empty = false;
+			break;
+		}
+	}
+	return is_empty;
+}
+
+// NOTE: The most the file of a save can take. Raw chunks are the largest encoding, the nav is not counted.
+static U64
+func GetMapSaveFileSize(U64 grid_n, U64 chunk_n, I32 item_n, I32 entity_n)
+{
+	U64 size = sizeof(MapFileHeader) + grid_n * sizeof(MapFileChunk) + chunk_n * MapChunkTileN + 8 +
+			   (U64)item_n * sizeof(MapItem) + (U64)entity_n * sizeof(MapEntity);
+	return size;
+}
+
+// NOTE: The most the snapshot of a save can take from the job arena.
+static U64
+func GetMapSaveJobSize(U64 grid_n, U64 chunk_n, I32 item_n, I32 entity_n, I32 path_length)
+{
+	U64 size = chunk_n * (sizeof(MapSaveChunk) + MapChunkTileN) + grid_n * sizeof(I32) +
+			   (U64)item_n * sizeof(MapItem) + (U64)entity_n * sizeof(MapEntity) + (U64)path_length + 1;
+	return size;
+}
+
+static U64
+func GetMapSaveBakeSize(MapFileHeader *header, I32 item_n, I32 entity_n)
+{
+	U64 word_per_row_n = (U64)((header->tile_col_n + 63) / 64);
+	U64 map_size = (U64)header->tile_row_n * (U64)header->tile_col_n * sizeof(U8) +
+				   (U64)header->tile_row_n * word_per_row_n * sizeof(U64) +
+				   (U64)item_n * sizeof(MapItem) + (U64)entity_n * sizeof(MapEntity);
+	U64 size = map_size + GetMaxMapNavBakeSize(header->tile_row_n, header->tile_col_n, true);
+	return size;
+}
+
+static void
+func RunMapSaveJob(MapSaver *saver)
+{
+	MapFileHeader *old_file = saver->file;
+	U8 *old_chunk_data = 0;
+	if(old_file)
+	{
+		old_chunk_data = (U8 *)old_file + GetMapFileSection(old_file, ChunkDataMapFileSectionId)->offset;
+	}
+
+	MemArena *arena = &saver->file_arenas[1 - saver->file_index];
+	ArenaReset(arena);
+	MapFileHeader *header = BeginMapFile(arena, saver->chunk_row_n * MapChunkSide, saver->chunk_col_n * MapChunkSide);
+
+	MapFileChunk empty_chunk = {};
+	empty_chunk.encoding = EmptyMapChunkEncoding;
+	for(I32 i = 0; i < saver->chunk_row_n * saver->chunk_col_n; i++)
+	{
+		I32 chunk_index = saver->chunk_grid[i];
+		if(chunk_index < 0)
+		{
+			PushEncodedMapFileChunk(arena, header, empty_chunk, 0);
+			continue;
+		}
+
+		MapSaveChunk *chunk = &saver->chunks[chunk_index];
+		if(chunk->tiles)
+		{
+			PushMapFileChunk(arena, header, chunk->tiles);
+			MapFileChunk *chunk_table = (MapFileChunk *)((I8 *)header + GetMapFileSection(header, ChunkTableMapFileSectionId)->offset);
+			chunk->saved_chunk = chunk_table[i];
+		}
+		else
+		{
+			Assert(old_chunk_data != 0 || chunk->cached_chunk.size == 0);
+			chunk->saved_chunk = PushEncodedMapFileChunk(arena, header, chunk->cached_chunk,
+														 old_chunk_data + chunk->cached_chunk.offset);
+		}
+	}
+	EndMapFile(arena, header, saver->items, saver->item_n, saver->entities, saver->entity_n);
+
+	// NOTE: The bake gets an arena of its own, reserved for the most that decoding and baking a map of this size
+	//       can take. Only the pages that are used get committed.
+	//       A map spread wider than max_bake_tile_n flat tiles is not baked, its file goes without nav.
+	U64 tile_n = (U64)header->tile_row_n * (U64)header->tile_col_n;
+	if(tile_n <= saver->max_bake_tile_n)
+	{
+		MemArena bake_arena = CreateReservedMemArena(GetMapSaveBakeSize(header, saver->item_n, saver->entity_n));
+		MapFileView view = {};
+		view.base = (U8 *)header;
+		view.size = header->file_size;
+		Map map = {};
+		Verify(LoadMapFromFileView(&view, &bake_arena, &map));
+		MapNav *nav = BakeMapNav(&map, GetMapFileTileHash(header), true, &bake_arena);
+
+		// NOTE: When the nav does not fit into the file buffer, the file goes without it and its nav reads as stale.
+		U64 nav_size = GetMapNavSectionsSize(nav);
+		if(nav_size <= arena->max_size - arena->used_size && (U64)header->file_size + nav_size <= 0xFFFFFFFF)
+		{
+			PushMapNavSections(arena, header, nav);
+		}
+		FreeReservedMemArena(&bake_arena);
+	}
+
+	saver->succeeded = WriteFileAtomically(saver->file_path, header, header->file_size);
+}
+
+static void
+func MapSaveThreadProc(void *parameter)
+{
+	MapSaver *saver = (MapSaver *)parameter;
+	while(1)
+	{
+		WaitOnSemaphore(&saver->semaphore);
+		if(saver->stop)
+		{
+			break;
+		}
+
+		Assert(saver->state == SavingMapSaveStateId);
+		RunMapSaveJob(saver);
+		FullMemoryBarrier();
+		saver->state = DoneMapSaveStateId;
+		SignalSemaphore(&saver->done_semaphore);
+	}
+}
+
+// NOTE: max_map_size is the most memory the SparseMap can take. The buffers are reserved for a map that fills it
+//       with chunks in one block, with as much again in each file buffer for the nav. Only used pages get committed.
+//       The nav is baked for maps of up to as many flat tiles as max_map_size has bytes.
+static void
+func StartMapSaver(MapSaver *saver, U64 max_map_size)
+{
+	*saver = {};
+	U64 max_chunk_n = max_map_size / sizeof(MapChunk);
+	U64 file_size = 2 * GetMapSaveFileSize(max_chunk_n, max_chunk_n, 0, 0) + max_map_size;
+	U64 job_size = GetMapSaveJobSize(max_chunk_n, max_chunk_n, 0, 0, 0) + max_map_size;
+	if(file_size > 0xFFFFFFFF)
+	{
+		file_size = 0xFFFFFFFF;
+	}
+	saver->file_arenas[0] = CreateReservedMemArena(file_size);
+	saver->file_arenas[1] = CreateReservedMemArena(file_size);
+	saver->job_arena = CreateReservedMemArena(job_size);
+	saver->max_bake_tile_n = max_map_size;
+	saver->state = IdleMapSaveStateId;
+	InitSemaphore(&saver->semaphore, 0);
+	InitSemaphore(&saver->done_semaphore, 0);
+	StartThread(&saver->thread, MapSaveThreadProc, saver);
+}
+
+static B32
+func IsMapSaverIdle(MapSaver *saver)
+{
+	B32 is_idle = (saver->state == IdleMapSaveStateId);
+	return is_idle;
+}
+
+static B32
+func HasUnsavedMapChanges(MapSaver *saver, SparseMap *map)
+{
+	B32 has_changes = (!saver->has_saved || saver->saved_change_n != map->change_n);
+	return has_changes;
+}
+
+// NOTE: The map as it is now counts as saved, call after loading it from the file.
+static void
+func SetMapSaved(MapSaver *saver, SparseMap *map)
+{
+	Assert(IsMapSaverIdle(saver));
+	saver->has_saved = true;
+	saver->saved_change_n = map->change_n;
+}
+
+// NOTE: Returns false if a save is still running.
+//       A map that does not fit into the buffers counts as a failed save right away.
+static B32
+func StartMapSave(MapSaver *saver, SparseMap *map, I8 *file_path)
+{
+	if(!IsMapSaverIdle(saver))
+	{
+		return false;
+	}
+
+	I32 path_length = 0;
+	while(file_path[path_length] != 0)
+	{
+		path_length++;
+	}
+
+	// NOTE: The bounds of the map are never smaller than the chunks that get saved, so the grid fits in them.
+	U64 max_grid_n = 0;
+	if(map->has_tiles)
+	{
+		U64 chunk_row_n = (U64)(GetSparseMapChunkCoordinate(map->bottom_row) - GetSparseMapChunkCoordinate(map->top_row) + 1);
+		U64 chunk_col_n = (U64)(GetSparseMapChunkCoordinate(map->right_col) - GetSparseMapChunkCoordinate(map->left_col) + 1);
+		max_grid_n = chunk_row_n * chunk_col_n;
+	}
+	U64 file_size = GetMapSaveFileSize(max_grid_n, (U64)map->chunk_n, map->item_n, map->entity_n);
+	U64 job_size = GetMapSaveJobSize(max_grid_n, (U64)map->chunk_n, map->item_n, map->entity_n, path_length);
+	if(file_size > saver->file_arenas[0].max_size || job_size > saver->job_arena.max_size)
+	{
+		saver->failed_save_n++;
+		return true;
+	}
+
+	MemArena *arena = &saver->job_arena;
+	ArenaReset(arena);
+	saver->encoded_chunk_n = 0;
+	saver->reused_chunk_n = 0;
+
+	saver->chunks = ArenaAllocArray(arena, MapSaveChunk, map->chunk_n);
+	saver->chunk_n = 0;
+
+	B32 has_tiles = false;
+	I32 top_chunk_row = 0;
+	I32 left_chunk_col = 0;
+	I32 bottom_chunk_row = 0;
+	I32 right_chunk_col = 0;
+	for(I32 i = 0; i < map->slot_n; i++)
+	{
+		SparseMapSlot *slot = &map->slots[i];
+		if(!slot->chunk)
+		{
+			continue;
+		}
+
+		MapSaveChunk *chunk = &saver->chunks[saver->chunk_n];
+		saver->chunk_n++;
+		*chunk = {};
+		chunk->chunk_row = slot->chunk_row;
+		chunk->chunk_col = slot->chunk_col;
+
+		B32 is_empty = false;
+		if(slot->has_saved_chunk)
+		{
+			chunk->cached_chunk = slot->saved_chunk;
+			is_empty = (slot->saved_chunk.encoding == EmptyMapChunkEncoding);
+			saver->reused_chunk_n++;
+		}
+		else
+		{
+			is_empty = IsMapChunkEmpty(slot->chunk);
+			if(is_empty)
+			{
+				chunk->cached_chunk.encoding = EmptyMapChunkEncoding;
+			}
+			else
+			{
+				chunk->tiles = (U8 *)ArenaAlloc(arena, MapChunkTileN);
+				U64 *from = (U64 *)slot->chunk->tiles;
+				U64 *to = (U64 *)chunk->tiles;
+				for(I32 j = 0; j < MapChunkTileN / 8; j++)
+				{
+					to[j] = from[j];
+				}
+				saver->encoded_chunk_n++;
+			}
+		}
+
+		if(is_empty)
+		{
+			continue;
+		}
+
+		if(has_tiles)
+		{
+			top_chunk_row = IntMin2(top_chunk_row, slot->chunk_row);
+			left_chunk_col = IntMin2(left_chunk_col, slot->chunk_col);
+			bottom_chunk_row = IntMax2(bottom_chunk_row, slot->chunk_row);
+			right_chunk_col = IntMax2(right_chunk_col, slot->chunk_col);
+		}
+		else
+		{
+			has_tiles = true;
+			top_chunk_row = bottom_chunk_row = slot->chunk_row;
+			left_chunk_col = right_chunk_col = slot->chunk_col;
+		}
+	}
+
+	saver->top_chunk_row = top_chunk_row;
+	saver->left_chunk_col = left_chunk_col;
+	saver->chunk_row_n = (has_tiles) ? (bottom_chunk_row - top_chunk_row + 1) : 0;
+	saver->chunk_col_n = (has_tiles) ? (right_chunk_col - left_chunk_col + 1) : 0;
+
+	I32 grid_n = saver->chunk_row_n * saver->chunk_col_n;
+	saver->chunk_grid = ArenaAllocArray(arena, I32, grid_n);
+	for(I32 i = 0; i < grid_n; i++)
+	{
+		saver->chunk_grid[i] = -1;
+	}
+	for(I32 i = 0; i < saver->chunk_n; i++)
+	{
+		MapSaveChunk *chunk = &saver->chunks[i];
+		I32 row = chunk->chunk_row - top_chunk_row;
+		I32 col = chunk->chunk_col - left_chunk_col;
+		if(IsIntBetween(row, 0, saver->chunk_row_n - 1) && IsIntBetween(col, 0, saver->chunk_col_n - 1))
+		{
+			saver->chunk_grid[row * saver->chunk_col_n + col] = i;
+		}
+		else
+		{
+			chunk->saved_chunk = chunk->cached_chunk;
+		}
+	}
+
+	V2 origin = MakePoint((R32)(left_chunk_col * MapChunkSide) * MapTileSide, (R32)(top_chunk_row * MapChunkSide) * MapTileSide);
+	saver->items = ArenaAllocArray(arena, MapItem, map->item_n);
+	saver->item_n = map->item_n;
+	for(I32 i = 0; i < map->item_n; i++)
+	{
+		saver->items[i] = map->items[i];
+		saver->items[i].position = saver->items[i].position - origin;
+	}
+	saver->entities = ArenaAllocArray(arena, MapEntity, map->entity_n);
+	saver->entity_n = map->entity_n;
+	for(I32 i = 0; i < map->entity_n; i++)
+	{
+		saver->entities[i] = map->entities[i];
+		saver->entities[i].spawn_position = saver->entities[i].spawn_position - origin;
+	}
+
+	saver->file_path = ArenaPushData(arena, path_length + 1, file_path);
+
+	saver->job_change_n = map->change_n;
+	saver->state = SavingMapSaveStateId;
+	FullMemoryBarrier();
+	SignalSemaphore(&saver->semaphore);
+	return true;
+}
+
+// NOTE: Call every frame, picks up a finished save. Chunks that changed while saving stay unsaved.
+static void
+func UpdateMapSaver(MapSaver *saver, SparseMap *map)
+{
+	if(saver->state != DoneMapSaveStateId)
+	{
+		return;
+	}
+	FullMemoryBarrier();
+
+	for(I32 i = 0; i < saver->chunk_n; i++)
+	{
+		MapSaveChunk *chunk = &saver->chunks[i];
+		SparseMapSlot *slot = FindSparseMapSlot(map->slots, map->slot_n, chunk->chunk_row, chunk->chunk_col);
+		if(slot->chunk)
+		{
+			slot->has_saved_chunk = (slot->change_n <= saver->job_change_n);
+			slot->saved_chunk = chunk->saved_chunk;
+		}
+	}
+
+	saver->file_index = 1 - saver->file_index;
+	saver->file = (MapFileHeader *)saver->file_arenas[saver->file_index].base_address;
+	if(saver->succeeded)
+	{
+		saver->has_saved = true;
+		saver->saved_change_n = saver->job_change_n;
+		saver->save_n++;
+	}
+	else
+	{
+		saver->failed_save_n++;
+	}
+	saver->state = IdleMapSaveStateId;
+}
+
+// NOTE: Blocks until the running save, if any, is done.
+//       Every save signals done_semaphore once, a signal left from a save that was not waited for only loops again.
+static void
+func FinishMapSave(MapSaver *saver, SparseMap *map)
+{
+	while(saver->state == SavingMapSaveStateId)
+	{
+		WaitOnSemaphore(&saver->done_semaphore);
+	}
+	UpdateMapSaver(saver, map);
+}
+
+static void
+func StopMapSaver(MapSaver *saver, SparseMap *map)
+{
+	FinishMapSave(saver, map);
+	saver->stop = true;
+	FullMemoryBarrier();
+	SignalSemaphore(&saver->semaphore);
+	WaitForThread(&saver->thread);
+	DestroySemaphore(&saver->semaphore);
+	DestroySemaphore(&saver->done_semaphore);
+	FreeReservedMemArena(&saver->file_arenas[0]);
+	FreeReservedMemArena(&saver->file_arenas[1]);
+	FreeReservedMemArena(&saver->job_arena);
+}
@@ -0,0 +1,387 @@
+#pragma once
+
+#include "Debug.hpp"
+#include "Map.hpp"
+#include "MapFile.hpp"
+#include "Memory.hpp"
+#include "Thread.hpp"
+#include "Type.hpp"
+
+// NOTE: Streams the tile chunks of a version 4 map file around a set of focus points.
+//       The main thread decides what to load and evict, the I/O thread only decodes chunks
+//       from the mapped file into the slots it is given. The two talk through single producer,
+//       single consumer rings, so nothing here ever blocks the main thread.
+//       Items and entities are small and are always resident.
+
+#define MapStreamRingSize 256
+#define MapStreamRingMask (MapStreamRingSize - 1)
+
+enum MapChunkStateId
+{
+	NotLoadedMapChunkStateId,
+	LoadingMapChunkStateId,
+	ResidentMapChunkStateId
+};
+
+struct MapStreamSlot
+{
+	MapChunk chunk;
+	I32 region_labels[MapChunkTileN];
+	I32 chunk_index;
+	U32 last_used_frame;
+};
+
+struct MapStreamRequest
+{
+	I32 chunk_index;
+	I32 slot_index;
+};
+
+struct MapStreamRing
+{
+	MapStreamRequest requests[MapStreamRingSize];
+	volatile I32 write_index;
+	volatile I32 read_index;
+};
+
+struct MapStream
+{
+	MapFileView view;
+	Map *map;
+
+	MapStreamSlot *slots;
+	I32 slot_n;
+	I32 *free_slots;
+	I32 free_slot_n;
+
+	I32 *chunk_slots;
+	U8 *chunk_states;
+
+	I32 *row_first_region_runs;
+	MemArena region_arena;
+
+	MapStreamRing load_ring;
+	MapStreamRing done_ring;
+	I32 loading_chunk_n;
+	I32 frame_request_n;
+
+	Thread thread;
+	Semaphore semaphore;
+	volatile B32 stop;
+
+	U32 frame;
+	I32 loaded_chunk_n;
+	I32 evicted_chunk_n;
+	volatile I32 failed_chunk_n;
+};
+
+static B32
+func PushMapStreamRequest(MapStreamRing *ring, MapStreamRequest request)
+{
+	B32 pushed = false;
+	I32 write_index = ring->write_index;
+	if(write_index - ring->read_index < MapStreamRingSize)
+	{
+		ring->requests[write_index & MapStreamRingMask] = request;
+		FullMemoryBarrier();
+		ring->write_index = write_index + 1;
+		pushed = true;
+	}
+	return pushed;
+}
+
+static B32
+func PopMapStreamRequest(MapStreamRing *ring, MapStreamRequest *request)
+{
+	B32 popped = false;
+	I32 read_index = ring->read_index;
+	if(read_index != ring->write_index)
+	{
+		FullMemoryBarrier();
+		*request = ring->requests[read_index & MapStreamRingMask];
+		FullMemoryBarrier();
+		ring->read_index = read_index + 1;
+		popped = true;
+	}
+	return popped;
+}
+
+static void
+func MapStreamThreadProc(void *parameter)
+{
+	MapStream *stream = (MapStream *)parameter;
+	while(1)
+	{
+		WaitOnSemaphore(&stream->semaphore);
+		if(stream->stop)
+		{
+			break;
+		}
+
+		MapStreamRequest request = {};
+		while(PopMapStreamRequest(&stream->load_ring, &request))
+		{
+			MapFileHeader *header = GetMapFileHeader(&stream->view);
+			I32 chunk_row = request.chunk_index / header->chunk_col_n;
+			I32 chunk_col = request.chunk_index % header->chunk_col_n;
+			MapStreamSlot *slot = &stream->slots[request.slot_index];
+			// NOTE: A chunk that can not be read arrives empty, so it blocks movement like a chunk that never loads.
+			if(!ReadMapFileChunkTiles(&stream->view, chunk_row, chunk_col, slot->chunk.tiles))
+			{
+				stream->failed_chunk_n++;
+			}
+			UpdateMapChunkPassability(&slot->chunk);
+
+			B32 pushed = PushMapStreamRequest(&stream->done_ring, request);
+			Assert(pushed);
+		}
+	}
+}
+
+static B32
+func IsStreamableMapFile(I8 *file_path)
+{
+	MapFileView view = OpenMapFileView(file_path);
+	B32 is_streamable = IsValidMapFileView(&view);
+	CloseMapFileView(&view);
+	return is_streamable;
+}
+
+// NOTE: Memory use is slot_n chunks with their region labels plus a few bytes per chunk of the whole map,
+//       and an I32 per row when the file has up to date regions.
+static Map
+func OpenMapStream(MapStream *stream, Map *map, I8 *file_path, MemArena *arena, I32 slot_n)
+{
+	Assert(slot_n > 0);
+	*stream = {};
+	stream->view = OpenMapFileView(file_path);
+	Assert(IsValidMapFileView(&stream->view));
+	MapFileHeader *header = GetMapFileHeader(&stream->view);
+
+	Map result = {};
+	result.tile_row_n = header->tile_row_n;
+	result.tile_col_n = header->tile_col_n;
+	result.tile_types = 0;
+	result.chunk_row_n = header->chunk_row_n;
+	result.chunk_col_n = header->chunk_col_n;
+
+	I32 chunk_n = result.chunk_row_n * result.chunk_col_n;
+	result.chunks = ArenaAllocArray(arena, MapChunk *, chunk_n);
+	stream->chunk_slots = ArenaAllocArray(arena, I32, chunk_n);
+	stream->chunk_states = ArenaAllocArray(arena, U8, chunk_n);
+	for(I32 i = 0; i < chunk_n; i++)
+	{
+		result.chunks[i] = 0;
+		stream->chunk_slots[i] = -1;
+		stream->chunk_states[i] = NotLoadedMapChunkStateId;
+	}
+
+	stream->slot_n = IntMin2(slot_n, chunk_n);
+	stream->slots = ArenaAllocArray(arena, MapStreamSlot, stream->slot_n);
+	stream->free_slots = ArenaAllocArray(arena, I32, stream->slot_n);
+	for(I32 i = 0; i < stream->slot_n; i++)
+	{
+		stream->slots[i].chunk_index = -1;
+		stream->slots[i].last_used_frame = 0;
+		stream->free_slots[i] = stream->slot_n - 1 - i;
+	}
+	stream->free_slot_n = stream->slot_n;
+
+	MapItem *items = GetMapFileItems(&stream->view, &result.item_n);
+	result.items = ArenaAllocArray(arena, MapItem, result.item_n);
+	for(I32 i = 0; i < result.item_n; i++)
+	{
+		result.items[i] = items[i];
+	}
+
+	MapEntity *entities = GetMapFileEntities(&stream->view, &result.entity_n);
+	result.entities = ArenaAllocArray(arena, MapEntity, result.entity_n);
+	for(I32 i = 0; i < result.entity_n; i++)
+	{
+		result.entities[i] = entities[i];
+	}
+
+	stream->row_first_region_runs = InitMapRegionsFromFileView(&result, &stream->view, stream->slot_n, arena);
+	stream->region_arena = CreateSubArena(arena, MapChunkRegionTempSize);
+
+	stream->map = map;
+	InitSemaphore(&stream->semaphore, 0);
+	StartThread(&stream->thread, MapStreamThreadProc, stream);
+	return result;
+}
+
+static void
+func CloseMapStream(MapStream *stream)
+{
+	stream->stop = true;
+	FullMemoryBarrier();
+	SignalSemaphore(&stream->semaphore);
+	WaitForThread(&stream->thread);
+	DestroySemaphore(&stream->semaphore);
+	CloseMapFileView(&stream->view);
+}
+
+static void
+func EvictMapChunk(MapStream *stream, I32 slot_index)
+{
+	MapStreamSlot *slot = &stream->slots[slot_index];
+	I32 chunk_index = slot->chunk_index;
+	Assert(stream->chunk_states[chunk_index] == ResidentMapChunkStateId);
+	stream->map->chunks[chunk_index] = 0;
+	RemoveMapChunkRegions(stream->map, chunk_index);
+	stream->chunk_slots[chunk_index] = -1;
+	stream->chunk_states[chunk_index] = NotLoadedMapChunkStateId;
+	slot->chunk_index = -1;
+
+	stream->free_slots[stream->free_slot_n] = slot_index;
+	stream->free_slot_n++;
+	stream->evicted_chunk_n++;
+}
+
+// NOTE: Evicts the least recently wanted resident chunk that was not wanted this frame.
+static I32
+func GetFreeMapStreamSlot(MapStream *stream)
+{
+	if(stream->free_slot_n == 0)
+	{
+		I32 oldest_slot = -1;
+		U32 oldest_frame = stream->frame;
+		for(I32 i = 0; i < stream->slot_n; i++)
+		{
+			MapStreamSlot *slot = &stream->slots[i];
+			if(slot->chunk_index >= 0 &&
+			   stream->chunk_states[slot->chunk_index] == ResidentMapChunkStateId &&
+			   slot->last_used_frame < oldest_frame)
+			{
+				oldest_frame = slot->last_used_frame;
+				oldest_slot = i;
+			}
+		}
+
+		if(oldest_slot >= 0)
+		{
+			EvictMapChunk(stream, oldest_slot);
+		}
+	}
+
+	I32 slot_index = -1;
+	if(stream->free_slot_n > 0)
+	{
+		stream->free_slot_n--;
+		slot_index = stream->free_slots[stream->free_slot_n];
+	}
+	return slot_index;
+}
+
+static void
+func WantMapChunk(MapStream *stream, I32 chunk_index)
+{
+	U8 state = stream->chunk_states[chunk_index];
+	if(state == NotLoadedMapChunkStateId)
+	{
+		I32 slot_index = GetFreeMapStreamSlot(stream);
+		if(slot_index >= 0)
+		{
+			MapStreamRequest request = {};
+			request.chunk_index = chunk_index;
+			request.slot_index = slot_index;
+			if(PushMapStreamRequest(&stream->load_ring, request))
+			{
+				MapStreamSlot *slot = &stream->slots[slot_index];
+				slot->chunk_index = chunk_index;
+				slot->last_used_frame = stream->frame;
+				stream->chunk_slots[chunk_index] = slot_index;
+				stream->chunk_states[chunk_index] = LoadingMapChunkStateId;
+				stream->loading_chunk_n++;
+				stream->frame_request_n++;
+			}
+			else
+			{
+				stream->free_slots[stream->free_slot_n] = slot_index;
+				stream->free_slot_n++;
+			}
+		}
+	}
+	else
+	{
+		I32 slot_index = stream->chunk_slots[chunk_index];
+		stream->slots[slot_index].last_used_frame = stream->frame;
+	}
+}
+
+// NOTE: Call once per frame before requesting chunks, publishes the chunks that finished loading.
+static void
+func BeginMapStreamFrame(MapStream *stream)
+{
+	Map *map = stream->map;
+	stream->frame++;
+	stream->frame_request_n = 0;
+
+	MapStreamRequest done = {};
+	while(PopMapStreamRequest(&stream->done_ring, &done))
+	{
+		Assert(stream->chunk_states[done.chunk_index] == LoadingMapChunkStateId);
+		Assert(stream->chunk_slots[done.chunk_index] == done.slot_index);
+		MapStreamSlot *slot = &stream->slots[done.slot_index];
+		map->chunks[done.chunk_index] = &slot->chunk;
+		map->chunk_region_labels[done.chunk_index] = slot->region_labels;
+		if(map->are_chunk_regions_local)
+		{
+			AddMapChunkRegions(map, done.chunk_index, &stream->region_arena);
+		}
+		else
+		{
+			ReadMapFileChunkRegionLabels(&stream->view, stream->row_first_region_runs,
+										 done.chunk_index / map->chunk_col_n, done.chunk_index % map->chunk_col_n,
+										 slot->region_labels);
+		}
+		stream->chunk_states[done.chunk_index] = ResidentMapChunkStateId;
+		stream->loading_chunk_n--;
+		stream->loaded_chunk_n++;
+	}
+}
+
+// NOTE: Chunks requested earlier in the frame win when the slots run out.
+static void
+func RequestMapChunksAround(MapStream *stream, V2 point, R32 radius)
+{
+	Map *map = stream->map;
+	R32 chunk_side = MapChunkSide * MapTileSide;
+	I32 min_row = IntMax2(0, Floor((point.y - radius) / chunk_side));
+	I32 max_row = IntMin2(map->chunk_row_n - 1, Floor((point.y + radius) / chunk_side));
+	I32 min_col = IntMax2(0, Floor((point.x - radius) / chunk_side));
+	I32 max_col = IntMin2(map->chunk_col_n - 1, Floor((point.x + radius) / chunk_side));
+	for(I32 row = min_row; row <= max_row; row++)
+	{
+		for(I32 col = min_col; col <= max_col; col++)
+		{
+			WantMapChunk(stream, row * map->chunk_col_n + col);
+		}
+	}
+}
+
+static void
+func EndMapStreamFrame(MapStream *stream)
+{
+	if(stream->frame_request_n > 0)
+	{
+		SignalSemaphore(&stream->semaphore);
+	}
+}
+
+static B32
+func IsMapStreamIdle(MapStream *stream)
+{
+	B32 is_idle = (stream->loading_chunk_n == 0);
+	return is_idle;
+}
+
+// NOTE: Blocks until everything requested so far is resident. Only for startup.
+static void
+func FinishMapStreamLoading(MapStream *stream)
+{
+	while(!IsMapStreamIdle(stream))
+	{
+		BeginMapStreamFrame(stream);
+	}
+}
@@ -3,6 +3,9 @@
 #include <math.h>
 #include <stdlib.h>
 #include <time.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #include "Debug.hpp"
 #include "Type.hpp"
@@ -373,6 +376,31 @@ func IntSquare(I32 x)
 	return result;
 }
 
+static I32
+func GetLowestSetBitIndex(U64 value)
+{
+	Assert(value != 0);
+#ifdef _MSC_VER
+	unsigned long index = 0;
+	_BitScanForward64(&index, value);
+	I32 result = (I32)index;
+#else
+	I32 result = __builtin_ctzll(value);
+#endif
+	return result;
+}
+
+static I32
+func CountSetBits(U64 value)
+{
+#ifdef _MSC_VER
+	I32 result = (I32)__popcnt64(value);
+#else
+	I32 result = __builtin_popcountll(value);
+#endif
+	return result;
+}
+
 static void
 func InitRandom()
 {
@@ -386,6 +414,52 @@ func RandomBetween(R32 min, R32 max)
 	return result;
 }
 
+// NOTE: PCG32, every stream is independent of the others and of rand().
+struct RandomSeries
+{
+	U64 state;
+	U64 increment;
+};
+
+static U32
+func RandomU32(RandomSeries *series)
+{
+	U64 old_state = series->state;
+	series->state = old_state * 6364136223846793005ULL + series->increment;
+	U32 xor_shifted = (U32)(((old_state >> 18) ^ old_state) >> 27);
+	U32 rotation = (U32)(old_state >> 59);
+	U32 result = (xor_shifted >> rotation) | (xor_shifted << ((32 - rotation) & 31));
+	return result;
+}
+
+static RandomSeries
+func CreateRandomSeries(U64 seed, U64 stream)
+{
+	RandomSeries series = {};
+	series.increment = (stream << 1) | 1;
+	RandomU32(&series);
+	series.state += seed;
+	RandomU32(&series);
+	return series;
+}
+
+static R32
+func RandomUnit(RandomSeries *series)
+{
+	R32 result = (R32)(RandomU32(series) >> 8) * (1.0f / 16777216.0f);
+	return result;
+}
+
+static I32
+func RandomIntBetween(RandomSeries *series, I32 min, I32 max)
+{
+	Assert(min <= max);
+	U32 range = (U32)(max - min) + 1;
+	I32 result = min + (I32)(RandomU32(series) % range);
+	Assert(IsIntBetween(result, min, max));
+	return result;
+}
+
 static B32
 func IsBetween(R32 test, R32 value1, R32 value2)
 {
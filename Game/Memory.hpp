@@ -1,5 +1,11 @@
 #pragma once
 
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
 #include <stdlib.h>
 
 #include "Debug.hpp"
@@ -8,51 +14,166 @@
 #define Byte (8)
 #define KiloByte (1024 * Byte)
 #define MegaByte (1024 * KiloByte)
-#define GigaByte (1024 * MegaByte)
+#define GigaByte ((U64)1024 * MegaByte)
+
+#define ArenaCommitSize (64 * KiloByte)
+#define SimdAlignment 16
 
+// NOTE: Arenas either live in a buffer given by the caller or in a reserved range of address space.
+//       Reserved arenas only commit pages when allocations reach them, so reserving much more than
+//       will ever be used is cheap. committed_size is max_size for arenas in a caller buffer.
+//       high_water_size and the allocation counts are only statistics, see MemoryStats.hpp.
 struct MemArena 
 {
 	I8 *base_address;
-	U32 used_size;
-	U32 max_size;
+	U64 used_size;
+	U64 max_size;
+	U64 committed_size;
+	B32 is_reserved;
+
+	U64 high_water_size;
+	U32 alloc_n;
+	U32 frame_alloc_n;
+};
+
+struct TempMemory
+{
+	MemArena *arena;
+	U64 used_size;
 };
 
 static MemArena
-func CreateMemArena(void *memory, U32 size)
+func CreateMemArena(void *memory, U64 size)
 {
 	MemArena arena = {};
 	arena.base_address = (I8 *)memory;
 	arena.max_size = size;
+	arena.committed_size = size;
 	arena.used_size = 0;
 	return arena;
 }
 
+static U64
+func AlignArenaSize(U64 size, U64 alignment)
+{
+	Assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+	U64 aligned_size = (size + alignment - 1) & ~(alignment - 1);
+	return aligned_size;
+}
+
+static MemArena
+func CreateReservedMemArena(U64 max_size)
+{
+	max_size = AlignArenaSize(max_size, ArenaCommitSize);
+#ifdef _WIN32
+	void *memory = VirtualAlloc(0, (SIZE_T)max_size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+	void *memory = mmap(0, max_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(memory == MAP_FAILED)
+	{
+		memory = 0;
+	}
+#endif
+	Verify(memory != 0);
+
+	MemArena arena = {};
+	arena.base_address = (I8 *)memory;
+	arena.max_size = max_size;
+	arena.committed_size = 0;
+	arena.used_size = 0;
+	arena.is_reserved = true;
+	return arena;
+}
+
+static void
+func FreeReservedMemArena(MemArena *arena)
+{
+	Assert(arena->is_reserved);
+#ifdef _WIN32
+	VirtualFree(arena->base_address, 0, MEM_RELEASE);
+#else
+	munmap(arena->base_address, arena->max_size);
+#endif
+	*arena = {};
+}
+
+static void
+func CommitArenaMemory(MemArena *arena, U64 size)
+{
+	if(size > arena->committed_size)
+	{
+		Assert(arena->is_reserved);
+		U64 commit_size = AlignArenaSize(size, ArenaCommitSize);
+		if(commit_size > arena->max_size)
+		{
+			commit_size = arena->max_size;
+		}
+		I8 *commit_address = arena->base_address + arena->committed_size;
+		U64 commit_add_size = commit_size - arena->committed_size;
+#ifdef _WIN32
+		B32 committed = (VirtualAlloc(commit_address, (SIZE_T)commit_add_size, MEM_COMMIT, PAGE_READWRITE) != 0);
+#else
+		B32 committed = (mprotect(commit_address, commit_add_size, PROT_READ | PROT_WRITE) == 0);
+#endif
+		Verify(committed);
+		arena->committed_size = commit_size;
+	}
+}
+
 static void
 func ArenaReset(MemArena *arena)
 {
 	arena->used_size = 0;
 }
 
+// NOTE: Running out of an arena breaks even without DEBUG_MODE, carrying on would overwrite whatever comes after it.
 static void *
-func ArenaAlloc(MemArena *arena, U32 size)
+func ArenaAlloc(MemArena *arena, U64 size)
 {
-	Assert(arena->used_size + size <= arena->max_size);
+	if(size > arena->max_size - arena->used_size)
+	{
+		DebugBreak();
+	}
 	I8 *result = arena->base_address + arena->used_size;
 	arena->used_size += size;
+	CommitArenaMemory(arena, arena->used_size);
+
+	if(arena->used_size > arena->high_water_size)
+	{
+		arena->high_water_size = arena->used_size;
+	}
+	arena->alloc_n++;
+	arena->frame_alloc_n++;
+	return result;
+}
+
+// NOTE: alignment is a power of two. The padding before the allocation is lost until the arena is popped below it.
+static void *
+func ArenaAllocAligned(MemArena *arena, U64 size, U64 alignment)
+{
+	U64 address = (U64)(arena->base_address + arena->used_size);
+	U64 padding = AlignArenaSize(address, alignment) - address;
+	I8 *result = (I8 *)ArenaAlloc(arena, padding + size) + padding;
 	return result;
 }
 
-static U32
+static U64
 func GetArenaSize(MemArena *arena)
 {
-	U32 result = arena->used_size;
+	U64 result = arena->used_size;
 	return result;
 }
 
 static void
-func SetArenaSize(MemArena *arena, U32 size)
+func SetArenaSize(MemArena *arena, U64 size)
 {
+	Assert(size <= arena->max_size);
 	arena->used_size = size;
+	CommitArenaMemory(arena, arena->used_size);
+	if(arena->used_size > arena->high_water_size)
+	{
+		arena->high_water_size = arena->used_size;
+	}
 }
 
 static void
@@ -60,7 +181,25 @@ func ArenaPopTo(MemArena *arena, void *address)
 {
 	Assert(arena->base_address <= address);
 	Assert(address < arena->base_address + arena->used_size);
-	arena->used_size = (U32)((I8 *)address - arena->base_address);
+	arena->used_size = (U64)((I8 *)address - arena->base_address);
+}
+
+// NOTE: Everything allocated between BeginTempMemory and EndTempMemory is freed by EndTempMemory.
+static TempMemory
+func BeginTempMemory(MemArena *arena)
+{
+	TempMemory temp_memory = {};
+	temp_memory.arena = arena;
+	temp_memory.used_size = arena->used_size;
+	return temp_memory;
+}
+
+static void
+func EndTempMemory(TempMemory temp_memory)
+{
+	MemArena *arena = temp_memory.arena;
+	Assert(temp_memory.used_size <= arena->used_size);
+	arena->used_size = temp_memory.used_size;
 }
 
 static I8 *
@@ -71,11 +210,11 @@ func GetArenaTop(MemArena *arena)
 }
 
 static I8 *
-func ArenaPushData(MemArena *arena, U32 size, void* data)
+func ArenaPushData(MemArena *arena, U64 size, void* data)
 {
 	I8 *copy_to = (I8*)ArenaAlloc(arena, size);
 	I8 *copy_from = (I8*)data;
-	for(U32 index = 0; index < size; index++)
+	for(U64 index = 0; index < size; index++)
 	{
 		copy_to[index] = copy_from[index];
 	}
@@ -94,7 +233,8 @@ func ArenaContainsAddress(MemArena *arena, void *address)
 }
 
 #define ArenaAllocType(arena, type) ((type *)ArenaAlloc((arena), sizeof(type)))
-#define ArenaAllocArray(arena, type, size) ((type *)ArenaAlloc((arena), (size) * sizeof(type)))
+#define ArenaAllocArray(arena, type, size) ((type *)ArenaAlloc((arena), (U64)(size) * sizeof(type)))
+#define ArenaAllocAlignedArray(arena, type, size, alignment) ((type *)ArenaAllocAligned((arena), (U64)(size) * sizeof(type), (alignment)))
 
 /*
 #define ArenaPush(arena, type, variable) {\
@@ -104,12 +244,13 @@ func ArenaContainsAddress(MemArena *arena, void *address)
 #define ArenaPushVar(arena, variable) ArenaPushData(arena, sizeof(variable), &(variable))
 
 static MemArena
-func CreateSubArena(MemArena *arena, U32 size)
+func CreateSubArena(MemArena *arena, U64 size)
 {
 	MemArena result = {};
 	result.base_address = (I8 *)ArenaAlloc(arena, size);
 	result.used_size = 0;
 	result.max_size = size;
+	result.committed_size = size;
 	return result;
 }
 
@@ -0,0 +1,306 @@
+#pragma once
+
+#include "Debug.hpp"
+#include "File.hpp"
+#include "Math.hpp"
+#include "Memory.hpp"
+#include "String.hpp"
+#include "Thread.hpp"
+#include "Type.hpp"
+
+// NOTE: Arenas that show up in the memory statistics are tracked here with a name and the subsystem they belong to.
+//       Only arenas that own their memory are tracked, a sub-arena would be counted twice.
+//       Arenas used by other threads are read without locking, so their numbers can be off by a frame.
+
+#define MaxTrackedMemArenaN 256
+#define ScratchArenaSize (64 * MegaByte)
+#define MemoryStatsLineSize 128
+
+enum MemoryTagId
+{
+	GeneralMemoryTagId,
+	MapMemoryTagId,
+	EditMemoryTagId,
+	SaveMemoryTagId,
+	TextureMemoryTagId,
+	ScratchMemoryTagId,
+	MemoryTagN
+};
+
+struct TrackedMemArena
+{
+	volatile I32 is_taken;
+	MemArena *arena;
+	I8 *name;
+	MemoryTagId tag_id;
+	U32 last_frame_alloc_n;
+};
+
+struct MemoryStats
+{
+	TrackedMemArena arenas[MaxTrackedMemArenaN];
+	volatile I32 arena_n;
+	U32 frame_index;
+};
+
+struct MemoryTagStats
+{
+	U64 used_size;
+	U64 high_water_size;
+	U64 committed_size;
+	U32 last_frame_alloc_n;
+	I32 arena_n;
+};
+
+static MemoryStats global_memory_stats;
+
+// NOTE: Every thread gets its own scratch arena the first time it asks for one.
+//       The scratch arena of the main thread is reset by BeginMemoryFrame, so nothing in it lives longer than a frame.
+//       Other threads reset theirs when they see fit and call FreeScratchArena before they return.
+static thread_local MemArena global_scratch_arena;
+
+static I8 *
+func GetMemoryTagName(MemoryTagId tag_id)
+{
+	I8 *name = 0;
+	switch(tag_id)
+	{
+		case GeneralMemoryTagId:
+		{
+			name = "General";
+			break;
+		}
+		case MapMemoryTagId:
+		{
+			name = "Map";
+			break;
+		}
+		case EditMemoryTagId:
+		{
+			name = "Edit";
+			break;
+		}
+		case SaveMemoryTagId:
+		{
+			name = "Save";
+			break;
+		}
+		case TextureMemoryTagId:
+		{
+			name = "Texture";
+			break;
+		}
+		case ScratchMemoryTagId:
+		{
+			name = "Scratch";
+			break;
+		}
+		default:
+		{
+			DebugBreak();
+		}
+	}
+	return name;
+}
+
+static I32
+func GetTrackedMemArenaN()
+{
+	I32 arena_n = IntMin2(global_memory_stats.arena_n, MaxTrackedMemArenaN);
+	return arena_n;
+}
+
+// NOTE: Slots freed by UntrackMemArena are taken again before new ones are added.
+//       When all slots are used the arena is simply not tracked, statistics should never stop the game.
+static void
+func TrackMemArena(MemArena *arena, I8 *name, MemoryTagId tag_id)
+{
+	// NOTE: A slot that was just added can be taken by another thread before this one gets to it, then try again.
+	TrackedMemArena *tracked = 0;
+	B32 is_full = false;
+	while(!tracked && !is_full)
+	{
+		I32 arena_n = GetTrackedMemArenaN();
+		for(I32 i = 0; i < arena_n; i++)
+		{
+			if(AtomicCompareExchange(&global_memory_stats.arenas[i].is_taken, 1, 0))
+			{
+				tracked = &global_memory_stats.arenas[i];
+				break;
+			}
+		}
+		if(!tracked)
+		{
+			I32 index = AtomicIncrement(&global_memory_stats.arena_n) - 1;
+			if(index >= MaxTrackedMemArenaN)
+			{
+				is_full = true;
+			}
+			else if(AtomicCompareExchange(&global_memory_stats.arenas[index].is_taken, 1, 0))
+			{
+				tracked = &global_memory_stats.arenas[index];
+			}
+		}
+	}
+
+	if(tracked)
+	{
+		tracked->name = name;
+		tracked->tag_id = tag_id;
+		tracked->last_frame_alloc_n = 0;
+		FullMemoryBarrier();
+		tracked->arena = arena;
+	}
+}
+
+static void
+func UntrackMemArena(MemArena *arena)
+{
+	I32 arena_n = GetTrackedMemArenaN();
+	for(I32 i = 0; i < arena_n; i++)
+	{
+		TrackedMemArena *tracked = &global_memory_stats.arenas[i];
+		if(tracked->arena == arena)
+		{
+			tracked->arena = 0;
+			FullMemoryBarrier();
+			tracked->is_taken = 0;
+		}
+	}
+}
+
+static MemArena *
+func GetScratchArena()
+{
+	MemArena *arena = &global_scratch_arena;
+	if(arena->base_address == 0)
+	{
+		*arena = CreateReservedMemArena(ScratchArenaSize);
+		TrackMemArena(arena, "Scratch", ScratchMemoryTagId);
+	}
+	return arena;
+}
+
+static void
+func FreeScratchArena()
+{
+	MemArena *arena = &global_scratch_arena;
+	if(arena->base_address != 0)
+	{
+		UntrackMemArena(arena);
+		FreeReservedMemArena(arena);
+	}
+}
+
+// NOTE: Called by the main thread before anything else happens in a frame.
+static void
+func BeginMemoryFrame()
+{
+	MemoryStats *stats = &global_memory_stats;
+	stats->frame_index++;
+
+	I32 arena_n = GetTrackedMemArenaN();
+	for(I32 i = 0; i < arena_n; i++)
+	{
+		TrackedMemArena *tracked = &stats->arenas[i];
+		MemArena *arena = tracked->arena;
+		if(arena != 0)
+		{
+			tracked->last_frame_alloc_n = arena->frame_alloc_n;
+			arena->frame_alloc_n = 0;
+		}
+	}
+
+	ArenaReset(GetScratchArena());
+}
+
+static void
+func GetMemoryTagStats(MemoryTagStats *tag_stats)
+{
+	for(I32 tag_id = 0; tag_id < MemoryTagN; tag_id++)
+	{
+		tag_stats[tag_id] = {};
+	}
+
+	I32 arena_n = GetTrackedMemArenaN();
+	for(I32 i = 0; i < arena_n; i++)
+	{
+		TrackedMemArena *tracked = &global_memory_stats.arenas[i];
+		MemArena *arena = tracked->arena;
+		if(arena != 0)
+		{
+			MemoryTagStats *stats = &tag_stats[tracked->tag_id];
+			stats->used_size += arena->used_size;
+			stats->high_water_size += arena->high_water_size;
+			stats->committed_size += arena->committed_size;
+			stats->last_frame_alloc_n += tracked->last_frame_alloc_n;
+			stats->arena_n++;
+		}
+	}
+}
+
+static I32
+func GetKiloByteN(U64 size)
+{
+	I32 kilobyte_n = (I32)((size + 1023) / 1024);
+	return kilobyte_n;
+}
+
+static void
+func AddMemoryStatsLine(String *string, I8 *name, U64 used_size, U64 high_water_size, U64 committed_size,
+						U32 last_frame_alloc_n)
+{
+	*string = *string + name + ": " + GetKiloByteN(used_size) + " KB used, ";
+	*string = *string + GetKiloByteN(high_water_size) + " KB peak, ";
+	*string = *string + GetKiloByteN(committed_size) + " KB committed, ";
+	*string = *string + (I32)last_frame_alloc_n + " allocs";
+}
+
+static void
+func AddMemoryTagStatsLine(String *string, MemoryTagId tag_id, MemoryTagStats *stats)
+{
+	AddMemoryStatsLine(string, GetMemoryTagName(tag_id), stats->used_size, stats->high_water_size,
+					   stats->committed_size, stats->last_frame_alloc_n);
+}
+
+// NOTE: Writes the statistics of every subsystem and then every tracked arena, one line each.
+//       The text is built in the scratch arena of the calling thread.
+static B32
+func DumpMemoryStats(I8 *file_path)
+{
+	MemArena *arena = GetScratchArena();
+	TempMemory temp_memory = BeginTempMemory(arena);
+
+	I32 arena_n = GetTrackedMemArenaN();
+	I32 line_n = 2 + MemoryTagN + arena_n;
+	I32 buffer_size = line_n * MemoryStatsLineSize;
+	I8 *buffer = ArenaAllocArray(arena, I8, buffer_size);
+	String string = StartString(buffer, buffer_size);
+
+	string = string + "Frame " + (I32)global_memory_stats.frame_index + "\n";
+
+	MemoryTagStats tag_stats[MemoryTagN] = {};
+	GetMemoryTagStats(tag_stats);
+	for(I32 tag_id = 0; tag_id < MemoryTagN; tag_id++)
+	{
+		AddMemoryTagStatsLine(&string, (MemoryTagId)tag_id, &tag_stats[tag_id]);
+		string = string + ", " + tag_stats[tag_id].arena_n + " arenas\n";
+	}
+
+	string = string + "\n";
+	for(I32 i = 0; i < arena_n; i++)
+	{
+		TrackedMemArena *tracked = &global_memory_stats.arenas[i];
+		MemArena *tracked_arena = tracked->arena;
+		if(tracked_arena != 0)
+		{
+			AddMemoryStatsLine(&string, tracked->name, tracked_arena->used_size, tracked_arena->high_water_size,
+							   tracked_arena->committed_size, tracked->last_frame_alloc_n);
+			string = string + " (" + GetMemoryTagName(tracked->tag_id) + ")\n";
+		}
+	}
+
+	B32 written = WriteFileAtomically(file_path, string.buffer, (U32)string.used_size);
+	EndTempMemory(temp_memory);
+	return written;
+}
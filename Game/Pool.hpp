@@ -0,0 +1,182 @@
+#pragma once
+
+#include "Debug.hpp"
+#include "Memory.hpp"
+#include "Type.hpp"
+
+// NOTE: Fixed capacity pool of records allocated from an arena.
+//       Items stay in their slot while they are alive, so pointers to them stay valid until they are removed.
+//       The live items are listed densely in dense_slots, GetPoolItemAt(pool, 0..item_n - 1) visits each of them once.
+//       Removing swaps the last item of the list into the removed place, so a loop that removes at i
+//       visits i again instead of moving on.
+//       A slot's generation is odd while its item is alive and changes on every add and remove,
+//       so a handle to a removed item never finds the item that reuses its slot.
+
+#define PoolNoSlot 0xFFFFFFFF
+#define PoolFreedByte 0xDD
+
+struct PoolHandle
+{
+	U32 slot;
+	U32 generation;
+};
+
+template<typename Item>
+struct Pool
+{
+	Item *items;
+	U32 *generations;
+	U32 *dense_slots;
+	// NOTE: For a live item the index of its slot in dense_slots, for a free slot the next free slot.
+	U32 *slot_links;
+	U32 first_free_slot;
+	I32 item_n;
+	I32 max_item_n;
+};
+
+template<typename Item>
+static Pool<Item>
+func CreatePool(MemArena *arena, I32 max_item_n)
+{
+	Assert(max_item_n > 0);
+	Pool<Item> pool = {};
+	pool.items = ArenaAllocAlignedArray(arena, Item, max_item_n, SimdAlignment);
+	pool.generations = ArenaAllocArray(arena, U32, max_item_n);
+	pool.dense_slots = ArenaAllocArray(arena, U32, max_item_n);
+	pool.slot_links = ArenaAllocArray(arena, U32, max_item_n);
+	for(I32 i = 0; i < max_item_n; i++)
+	{
+		pool.generations[i] = 0;
+		pool.slot_links[i] = (i + 1 < max_item_n) ? (U32)(i + 1) : PoolNoSlot;
+	}
+	pool.first_free_slot = 0;
+	pool.item_n = 0;
+	pool.max_item_n = max_item_n;
+	return pool;
+}
+
+template<typename Item>
+static B32
+func IsPoolFull(Pool<Item> *pool)
+{
+	B32 is_full = (pool->item_n == pool->max_item_n);
+	return is_full;
+}
+
+template<typename Item>
+static U32
+func GetPoolItemSlot(Pool<Item> *pool, Item *item)
+{
+	Assert(pool->items <= item && item < pool->items + pool->max_item_n);
+	U32 slot = (U32)(item - pool->items);
+	Assert(pool->generations[slot] & 1);
+	return slot;
+}
+
+// NOTE: The new item is zeroed.
+template<typename Item>
+static Item *
+func AddPoolItem(Pool<Item> *pool)
+{
+	Assert(!IsPoolFull(pool));
+	U32 slot = pool->first_free_slot;
+	pool->first_free_slot = pool->slot_links[slot];
+
+	pool->generations[slot]++;
+	pool->dense_slots[pool->item_n] = slot;
+	pool->slot_links[slot] = (U32)pool->item_n;
+	pool->item_n++;
+
+	Item *item = &pool->items[slot];
+	*item = {};
+	return item;
+}
+
+template<typename Item>
+static void
+func RemovePoolItem(Pool<Item> *pool, Item *item)
+{
+	U32 slot = GetPoolItemSlot(pool, item);
+	U32 dense_index = pool->slot_links[slot];
+	U32 last_slot = pool->dense_slots[pool->item_n - 1];
+	pool->dense_slots[dense_index] = last_slot;
+	pool->slot_links[last_slot] = dense_index;
+	pool->item_n--;
+
+	pool->generations[slot]++;
+	pool->slot_links[slot] = pool->first_free_slot;
+	pool->first_free_slot = slot;
+
+#ifdef DEBUG_MODE
+	U8 *bytes = (U8 *)item;
+	for(U32 i = 0; i < sizeof(Item); i++)
+	{
+		bytes[i] = PoolFreedByte;
+	}
+#endif
+}
+
+template<typename Item>
+static Item *
+func GetPoolItemAt(Pool<Item> *pool, I32 index)
+{
+	Assert(index >= 0 && index < pool->item_n);
+	Item *item = &pool->items[pool->dense_slots[index]];
+	return item;
+}
+
+template<typename Item>
+static void
+func RemovePoolItemAt(Pool<Item> *pool, I32 index)
+{
+	RemovePoolItem(pool, GetPoolItemAt(pool, index));
+}
+
+// NOTE: Only changes the order in which GetPoolItemAt lists the items, they stay in their slots.
+template<typename Item>
+static void
+func SwapPoolItemsAt(Pool<Item> *pool, I32 index1, I32 index2)
+{
+	Assert(index1 >= 0 && index1 < pool->item_n);
+	Assert(index2 >= 0 && index2 < pool->item_n);
+	U32 slot1 = pool->dense_slots[index1];
+	U32 slot2 = pool->dense_slots[index2];
+	pool->dense_slots[index1] = slot2;
+	pool->dense_slots[index2] = slot1;
+	pool->slot_links[slot1] = (U32)index2;
+	pool->slot_links[slot2] = (U32)index1;
+}
+
+template<typename Item>
+static void
+func ClearPool(Pool<Item> *pool)
+{
+	while(pool->item_n > 0)
+	{
+		RemovePoolItemAt(pool, pool->item_n - 1);
+	}
+}
+
+template<typename Item>
+static PoolHandle
+func GetPoolHandle(Pool<Item> *pool, Item *item)
+{
+	PoolHandle handle = {};
+	handle.slot = GetPoolItemSlot(pool, item);
+	handle.generation = pool->generations[handle.slot];
+	return handle;
+}
+
+// NOTE: Returns 0 for the zero handle and for handles of removed items.
+template<typename Item>
+static Item *
+func GetPoolItem(Pool<Item> *pool, PoolHandle handle)
+{
+	Item *item = 0;
+	if(handle.generation != 0 && handle.slot < (U32)pool->max_item_n &&
+	   pool->generations[handle.slot] == handle.generation)
+	{
+		item = &pool->items[handle.slot];
+	}
+	return item;
+}
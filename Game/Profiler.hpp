@@ -0,0 +1,401 @@
+#pragma once
+
+#define PROFILER_MODE
+
+#ifdef PROFILER_MODE
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+#include "Debug.hpp"
+#include "Math.hpp"
+#include "String.hpp"
+#include "Thread.hpp"
+#include "Type.hpp"
+
+// NOTE: A zone writes a begin and an end record with the time stamp counter to a ring buffer of its own thread.
+//       Only that thread writes the records and only the main thread reads them in BeginProfileFrame,
+//       which adds the time of every zone to a call tree node: the same zone under different parents gets different nodes.
+//       Zones are told apart by the address of their name, so the name has to be a string literal.
+//       When a ring buffer is full new zones are dropped, the end of every zone already written always has room.
+//       Every thread that records a zone keeps its slot for good, so only long-lived threads should be profiled.
+
+#define MaxProfileThreadN 16
+#define ProfileRecordN (1 << 16)
+#define MaxProfileNodeN 512
+#define MaxProfileZoneDepth 32
+#define ProfileLineSize 128
+
+struct ProfileRecord
+{
+	const char *name;
+	U64 time_stamp;
+};
+
+struct ProfileThread
+{
+	ProfileRecord *volatile records;
+	volatile U32 write_index;
+	volatile U32 read_index;
+
+	I32 open_record_n;
+	I32 dropped_open_zone_n;
+	volatile U32 dropped_zone_n;
+
+	I32 root_node_index;
+	I32 open_node_indices[MaxProfileZoneDepth];
+	U64 open_time_stamps[MaxProfileZoneDepth];
+	I32 open_node_n;
+	U32 last_dropped_zone_n;
+};
+
+struct ProfileNode
+{
+	const char *name;
+	I32 depth;
+	I32 parent_index;
+	I32 first_child_index;
+	I32 next_sibling_index;
+
+	U64 cycles;
+	U64 child_cycles;
+	U32 call_n;
+
+	U64 last_cycles;
+	U64 last_child_cycles;
+	U32 last_call_n;
+};
+
+struct Profiler
+{
+	ProfileThread threads[MaxProfileThreadN];
+	volatile I32 thread_n;
+
+	ProfileNode nodes[MaxProfileNodeN];
+	I32 node_n;
+
+	U64 frame_time_stamp;
+	U64 last_frame_cycles;
+	U32 last_dropped_zone_n;
+};
+
+static Profiler global_profiler;
+static thread_local ProfileThread *global_profile_thread;
+static thread_local B32 global_profile_thread_is_full;
+
+static ProfileThread *
+func GetProfileThread()
+{
+	ProfileThread *thread = global_profile_thread;
+	if(thread == 0 && !global_profile_thread_is_full)
+	{
+		I32 index = AtomicIncrement(&global_profiler.thread_n) - 1;
+		if(index < MaxProfileThreadN)
+		{
+			thread = &global_profiler.threads[index];
+			ProfileRecord *records = new ProfileRecord[ProfileRecordN];
+			FullMemoryBarrier();
+			thread->records = records;
+			global_profile_thread = thread;
+		}
+		else
+		{
+			global_profile_thread_is_full = true;
+		}
+	}
+	return thread;
+}
+
+static void
+func WriteProfileRecord(ProfileThread *thread, const char *name, U64 time_stamp)
+{
+	U32 write_index = thread->write_index;
+	ProfileRecord *record = &thread->records[write_index & (ProfileRecordN - 1)];
+	record->name = name;
+	record->time_stamp = time_stamp;
+	CompilerMemoryBarrier();
+	thread->write_index = write_index + 1;
+}
+
+// NOTE: A zone is only written when the buffer also has room for its end and the ends of all zones open around it.
+//       Zones inside a dropped zone are dropped too, so the records written always pair up.
+static void
+func BeginProfileZone(const char *name)
+{
+	ProfileThread *thread = GetProfileThread();
+	if(thread != 0)
+	{
+		U32 free_record_n = ProfileRecordN - (thread->write_index - thread->read_index);
+		if(thread->dropped_open_zone_n == 0 && free_record_n >= (U32)thread->open_record_n + 2)
+		{
+			thread->open_record_n++;
+			WriteProfileRecord(thread, name, __rdtsc());
+		}
+		else
+		{
+			thread->dropped_open_zone_n++;
+			thread->dropped_zone_n++;
+		}
+	}
+}
+
+static void
+func EndProfileZone()
+{
+	U64 time_stamp = __rdtsc();
+	ProfileThread *thread = global_profile_thread;
+	if(thread != 0)
+	{
+		if(thread->dropped_open_zone_n > 0)
+		{
+			thread->dropped_open_zone_n--;
+		}
+		else
+		{
+			Assert(thread->open_record_n > 0);
+			thread->open_record_n--;
+			WriteProfileRecord(thread, 0, time_stamp);
+		}
+	}
+}
+
+struct ProfileScope
+{
+	ProfileScope(const char *name)
+	{
+		BeginProfileZone(name);
+	}
+
+	~ProfileScope()
+	{
+		EndProfileZone();
+	}
+};
+
+#define ProfileScopeName2(line) profile_scope_##line
+#define ProfileScopeName(line) ProfileScopeName2(line)
+#define ProfileZone(name) ProfileScope ProfileScopeName(__LINE__)(name)
+#define ProfileFunction() ProfileZone(__FUNCTION__)
+
+// NOTE: Returns -1 when every node is used, the time of that zone and the zones in it is then not counted.
+static I32
+func AddProfileNode(const char *name, I32 parent_index)
+{
+	Profiler *profiler = &global_profiler;
+	I32 index = -1;
+	if(profiler->node_n < MaxProfileNodeN)
+	{
+		index = profiler->node_n;
+		profiler->node_n++;
+
+		ProfileNode *node = &profiler->nodes[index];
+		*node = {};
+		node->name = name;
+		node->parent_index = parent_index;
+		node->first_child_index = -1;
+		node->next_sibling_index = -1;
+		if(parent_index >= 0)
+		{
+			ProfileNode *parent = &profiler->nodes[parent_index];
+			node->depth = parent->depth + 1;
+			if(parent->first_child_index < 0)
+			{
+				parent->first_child_index = index;
+			}
+			else
+			{
+				ProfileNode *sibling = &profiler->nodes[parent->first_child_index];
+				while(sibling->next_sibling_index >= 0)
+				{
+					sibling = &profiler->nodes[sibling->next_sibling_index];
+				}
+				sibling->next_sibling_index = index;
+			}
+		}
+	}
+	return index;
+}
+
+static I32
+func GetProfileChildNode(I32 parent_index, const char *name)
+{
+	Profiler *profiler = &global_profiler;
+	I32 index = -1;
+	if(parent_index >= 0)
+	{
+		index = profiler->nodes[parent_index].first_child_index;
+		while(index >= 0 && profiler->nodes[index].name != name)
+		{
+			index = profiler->nodes[index].next_sibling_index;
+		}
+		if(index < 0)
+		{
+			index = AddProfileNode(name, parent_index);
+		}
+	}
+	return index;
+}
+
+static void
+func ReadProfileRecord(ProfileThread *thread, ProfileRecord *record)
+{
+	Profiler *profiler = &global_profiler;
+	if(record->name != 0)
+	{
+		Assert(thread->open_node_n < MaxProfileZoneDepth);
+		I32 parent_index = thread->root_node_index;
+		if(thread->open_node_n > 0)
+		{
+			parent_index = thread->open_node_indices[thread->open_node_n - 1];
+		}
+		thread->open_node_indices[thread->open_node_n] = GetProfileChildNode(parent_index, record->name);
+		thread->open_time_stamps[thread->open_node_n] = record->time_stamp;
+		thread->open_node_n++;
+	}
+	else
+	{
+		Assert(thread->open_node_n > 0);
+		thread->open_node_n--;
+		I32 node_index = thread->open_node_indices[thread->open_node_n];
+		if(node_index >= 0)
+		{
+			U64 cycles = record->time_stamp - thread->open_time_stamps[thread->open_node_n];
+			ProfileNode *node = &profiler->nodes[node_index];
+			node->cycles += cycles;
+			node->call_n++;
+			profiler->nodes[node->parent_index].child_cycles += cycles;
+		}
+	}
+}
+
+static void
+func ReadProfileThread(ProfileThread *thread, I32 thread_index)
+{
+	if(thread->root_node_index == 0)
+	{
+		const char *name = (thread_index == 0) ? "Main thread" : "Other thread";
+		thread->root_node_index = AddProfileNode(name, 0);
+	}
+
+	U32 write_index = thread->write_index;
+	CompilerMemoryBarrier();
+	for(U32 read_index = thread->read_index; read_index != write_index; read_index++)
+	{
+		ReadProfileRecord(thread, &thread->records[read_index & (ProfileRecordN - 1)]);
+	}
+	CompilerMemoryBarrier();
+	thread->read_index = write_index;
+
+	U32 dropped_zone_n = thread->dropped_zone_n;
+	global_profiler.last_dropped_zone_n += (dropped_zone_n - thread->last_dropped_zone_n);
+	thread->last_dropped_zone_n = dropped_zone_n;
+}
+
+// NOTE: Called by the main thread at the start of every frame, outside of any zone.
+//       Everything recorded since the last call becomes the statistics of the last frame.
+//       Node 0 is the whole frame and the nodes under it are the threads.
+static void
+func BeginProfileFrame()
+{
+	Profiler *profiler = &global_profiler;
+	U64 time_stamp = __rdtsc();
+	if(profiler->node_n == 0)
+	{
+		AddProfileNode("Frame", -1);
+	}
+
+	profiler->last_dropped_zone_n = 0;
+	I32 thread_n = IntMin2(profiler->thread_n, MaxProfileThreadN);
+	for(I32 i = 0; i < thread_n; i++)
+	{
+		ProfileThread *thread = &profiler->threads[i];
+		if(thread->records != 0)
+		{
+			ReadProfileThread(thread, i);
+		}
+	}
+
+	profiler->last_frame_cycles = 0;
+	if(profiler->frame_time_stamp != 0)
+	{
+		profiler->last_frame_cycles = time_stamp - profiler->frame_time_stamp;
+	}
+	profiler->frame_time_stamp = time_stamp;
+
+	ProfileNode *frame_node = &profiler->nodes[0];
+	frame_node->cycles = profiler->last_frame_cycles;
+	frame_node->call_n = 1;
+	for(I32 i = frame_node->first_child_index; i >= 0; i = profiler->nodes[i].next_sibling_index)
+	{
+		ProfileNode *thread_node = &profiler->nodes[i];
+		if(thread_node->child_cycles > 0)
+		{
+			thread_node->cycles = thread_node->child_cycles;
+			thread_node->call_n = 1;
+			frame_node->child_cycles += thread_node->cycles;
+		}
+	}
+
+	for(I32 i = 0; i < profiler->node_n; i++)
+	{
+		ProfileNode *node = &profiler->nodes[i];
+		node->last_cycles = node->cycles;
+		node->last_child_cycles = node->child_cycles;
+		node->last_call_n = node->call_n;
+		node->cycles = 0;
+		node->child_cycles = 0;
+		node->call_n = 0;
+	}
+}
+
+// NOTE: Walks the call tree depth first, returns -1 after the last node.
+static I32
+func GetNextProfileNode(I32 index)
+{
+	ProfileNode *nodes = global_profiler.nodes;
+	I32 next_index = nodes[index].first_child_index;
+	while(next_index < 0 && index >= 0)
+	{
+		next_index = nodes[index].next_sibling_index;
+		index = nodes[index].parent_index;
+	}
+	return next_index;
+}
+
+static R32
+func GetPercentOfFrame(U64 cycles)
+{
+	R32 percent = 0.0f;
+	if(global_profiler.last_frame_cycles > 0)
+	{
+		percent = 100.0f * (R32)cycles / (R32)global_profiler.last_frame_cycles;
+	}
+	return percent;
+}
+
+static void
+func AddProfileNodeLine(String *string, ProfileNode *node)
+{
+	for(I32 i = 0; i < node->depth; i++)
+	{
+		*string = *string + "  ";
+	}
+	U64 self_cycles = 0;
+	if(node->last_cycles > node->last_child_cycles)
+	{
+		self_cycles = node->last_cycles - node->last_child_cycles;
+	}
+	*string = *string + (I8 *)node->name + ": " + (I32)node->last_call_n + " calls, ";
+	*string = *string + (I32)(node->last_cycles / 1000) + " kcycles, ";
+	*string = *string + GetPercentOfFrame(node->last_cycles) + "% (self " + GetPercentOfFrame(self_cycles) + "%)";
+}
+
+#else
+
+#define ProfileZone(name)
+#define ProfileFunction()
+
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Bitmap.hpp"
+#include "Draw.hpp"
+#include "Profiler.hpp"
+#include "String.hpp"
+#include "Text.hpp"
+#include "Type.hpp"
+
+#ifdef PROFILER_MODE
+#define ProfilerOverlayWidth 560
+#define MaxProfilerOverlayLineN 40
+#define ProfilerOverlayPadding 5
+
+// NOTE: Shows the call tree of the last frame, zones that did not run in it are left out.
+static void
+func DrawProfilerOverlay(Canvas *canvas)
+{
+	Bitmap *bitmap = &canvas->bitmap;
+	Profiler *profiler = &global_profiler;
+	I32 node_indices[MaxProfilerOverlayLineN] = {};
+	I32 node_n = 0;
+	for(I32 i = 0; i >= 0 && i < profiler->node_n && node_n < MaxProfilerOverlayLineN; i = GetNextProfileNode(i))
+	{
+		if(profiler->nodes[i].last_call_n > 0)
+		{
+			node_indices[node_n] = i;
+			node_n++;
+		}
+	}
+
+	IntRect rect = {};
+	rect.right = (bitmap->width - 1) - ProfilerOverlayPadding;
+	rect.left = rect.right - ProfilerOverlayWidth;
+	rect.top = ProfilerOverlayPadding;
+	rect.bottom = rect.top + 2 * TooltipTopPadding + (node_n + 1) * TextHeightInPixels;
+	DrawBitmapRect(bitmap, rect, MakeColor(0.0f, 0.0f, 0.0f));
+	DrawBitmapRectOutline(bitmap, rect, MakeColor(1.0f, 1.0f, 1.0f));
+
+	V4 text_color = MakeColor(1.0f, 1.0f, 1.0f);
+	I32 text_left = rect.left + TooltipPadding;
+	I32 text_top = rect.top + TooltipTopPadding;
+	I8 line[ProfileLineSize];
+	for(I32 i = 0; i < node_n; i++)
+	{
+		String string = StartString(line, ProfileLineSize);
+		AddProfileNodeLine(&string, &profiler->nodes[node_indices[i]]);
+		DrawBitmapTextLineTopLeft(bitmap, line, canvas->glyph_data, text_left, text_top, text_color);
+		text_top += TextHeightInPixels;
+	}
+
+	String string = StartString(line, ProfileLineSize);
+	string = string + (I32)profiler->last_dropped_zone_n + " zones dropped";
+	DrawBitmapTextLineTopLeft(bitmap, line, canvas->glyph_data, text_left, text_top, text_color);
+}
+#endif
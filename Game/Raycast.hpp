@@ -0,0 +1,310 @@
+#pragma once
+
+#include "Debug.hpp"
+#include "Map.hpp"
+#include "Math.hpp"
+#include "Memory.hpp"
+#include "Type.hpp"
+
+// NOTE: Rays walk the tile grid with DDA, visiting every tile the segment touches exactly once.
+//       Tiles outside the map and impassable tiles block sight.
+
+static B32
+func TileBlocksSight(Map *map, I32 row, I32 col)
+{
+	U64 passable_word = GetPassableWord(map, row, col >> 6);
+	B32 blocks = !((passable_word >> (col & 63)) & 1);
+	return blocks;
+}
+
+// NOTE: Returns true if nothing blocks the segment. Otherwise blocking_tile is the first blocking tile.
+//       When the segment passes exactly through a tile corner, both side tiles have to be open.
+static B32
+func CastTileRay(Map *map, V2 from, V2 to, IV2 *blocking_tile)
+{
+	R32 inverse_tile_side = 1.0f / MapTileSide;
+	R32 from_x = from.x * inverse_tile_side;
+	R32 from_y = from.y * inverse_tile_side;
+	R32 to_x = to.x * inverse_tile_side;
+	R32 to_y = to.y * inverse_tile_side;
+
+	I32 col = Floor(from_x);
+	I32 row = Floor(from_y);
+	I32 end_col = Floor(to_x);
+	I32 end_row = Floor(to_y);
+
+	R32 dx = to_x - from_x;
+	R32 dy = to_y - from_y;
+	I32 step_col = (dx > 0.0f) ? 1 : -1;
+	I32 step_row = (dy > 0.0f) ? 1 : -1;
+
+	R32 infinity = 1e30f;
+	R32 t_delta_x = (dx != 0.0f) ? Abs(1.0f / dx) : infinity;
+	R32 t_delta_y = (dy != 0.0f) ? Abs(1.0f / dy) : infinity;
+	R32 next_x = (dx > 0.0f) ? (R32)(col + 1) : (R32)col;
+	R32 next_y = (dy > 0.0f) ? (R32)(row + 1) : (R32)row;
+	R32 t_max_x = (dx != 0.0f) ? (next_x - from_x) / dx : infinity;
+	R32 t_max_y = (dy != 0.0f) ? (next_y - from_y) / dy : infinity;
+
+	I32 step_n = IntAbs(end_col - col) + IntAbs(end_row - row);
+	B32 is_clear = true;
+	IV2 blocked_at = {};
+	for(I32 i = 0; ; i++)
+	{
+		if(TileBlocksSight(map, row, col))
+		{
+			is_clear = false;
+			blocked_at = MakeTile(row, col);
+			break;
+		}
+
+		if(i >= step_n || (row == end_row && col == end_col))
+		{
+			break;
+		}
+
+		if(t_max_x < t_max_y)
+		{
+			col += step_col;
+			t_max_x += t_delta_x;
+		}
+		else if(t_max_y < t_max_x)
+		{
+			row += step_row;
+			t_max_y += t_delta_y;
+		}
+		else
+		{
+			if(TileBlocksSight(map, row, col + step_col) || TileBlocksSight(map, row + step_row, col))
+			{
+				is_clear = false;
+				blocked_at = MakeTile(row, col + step_col);
+				break;
+			}
+			col += step_col;
+			row += step_row;
+			t_max_x += t_delta_x;
+			t_max_y += t_delta_y;
+			i++;
+		}
+	}
+
+	if(!is_clear && blocking_tile)
+	{
+		*blocking_tile = blocked_at;
+	}
+	return is_clear;
+}
+
+static B32
+func HasLineOfSight(Map *map, V2 from, V2 to)
+{
+	B32 has_line_of_sight = CastTileRay(map, from, to, 0);
+	return has_line_of_sight;
+}
+
+struct LineOfSightQuery
+{
+	V2 from;
+	V2 to;
+	B32 is_visible;
+};
+
+static void
+func CastLineOfSightQueries(Map *map, LineOfSightQuery *queries, I32 query_n)
+{
+	for(I32 i = 0; i < query_n; i++)
+	{
+		LineOfSightQuery *query = &queries[i];
+		query->is_visible = CastTileRay(map, query->from, query->to, 0);
+	}
+}
+
+// NOTE: Tile level sight: a ray between the two tile centers. This is what the cache and
+//       the precomputed table answer. The cache treats it as symmetric and always casts from the lower tile index.
+static B32
+func HasTileLineOfSight(Map *map, IV2 from_tile, IV2 to_tile)
+{
+	V2 from = GetTileCenter(map, from_tile);
+	V2 to = GetTileCenter(map, to_tile);
+	B32 has_line_of_sight = CastTileRay(map, from, to, 0);
+	return has_line_of_sight;
+}
+
+struct LineOfSightCacheEntry
+{
+	U64 key;
+	U32 frame;
+	B32 is_visible;
+};
+
+// NOTE: Open addressing, invalidated as a whole by bumping the frame counter.
+struct LineOfSightCache
+{
+	LineOfSightCacheEntry *entries;
+	I32 entry_n;
+	U32 frame;
+
+	I32 hit_n;
+	I32 miss_n;
+};
+
+static LineOfSightCache
+func CreateLineOfSightCache(MemArena *arena, I32 log_entry_n)
+{
+	Assert(IsIntBetween(log_entry_n, 1, 24));
+	LineOfSightCache cache = {};
+	cache.entry_n = (1 << log_entry_n);
+	cache.entries = ArenaAllocArray(arena, LineOfSightCacheEntry, cache.entry_n);
+	for(I32 i = 0; i < cache.entry_n; i++)
+	{
+		cache.entries[i] = {};
+	}
+	cache.frame = 1;
+	return cache;
+}
+
+static void
+func StartLineOfSightCacheFrame(LineOfSightCache *cache)
+{
+	cache->frame++;
+	if(cache->frame == 0)
+	{
+		for(I32 i = 0; i < cache->entry_n; i++)
+		{
+			cache->entries[i].frame = 0;
+		}
+		cache->frame = 1;
+	}
+	cache->hit_n = 0;
+	cache->miss_n = 0;
+}
+
+static B32
+func HasCachedTileLineOfSight(LineOfSightCache *cache, Map *map, IV2 from_tile, IV2 to_tile)
+{
+	U32 from_index = (U32)(from_tile.row * map->tile_col_n + from_tile.col);
+	U32 to_index = (U32)(to_tile.row * map->tile_col_n + to_tile.col);
+	if(from_index > to_index)
+	{
+		U32 swap = from_index;
+		from_index = to_index;
+		to_index = swap;
+
+		IV2 swap_tile = from_tile;
+		from_tile = to_tile;
+		to_tile = swap_tile;
+	}
+
+	U64 key = ((U64)from_index << 32) | (U64)to_index;
+	U64 hash = key * 0x9E3779B97F4A7C15ULL;
+	I32 mask = cache->entry_n - 1;
+	I32 index = (I32)(hash >> 40) & mask;
+
+	B32 is_visible = false;
+	B32 found = false;
+	for(I32 probe = 0; probe < 8; probe++)
+	{
+		LineOfSightCacheEntry *entry = &cache->entries[(index + probe) & mask];
+		if(entry->frame != cache->frame)
+		{
+			is_visible = HasTileLineOfSight(map, from_tile, to_tile);
+			entry->key = key;
+			entry->frame = cache->frame;
+			entry->is_visible = is_visible;
+			found = true;
+			cache->miss_n++;
+			break;
+		}
+		else if(entry->key == key)
+		{
+			is_visible = entry->is_visible;
+			found = true;
+			cache->hit_n++;
+			break;
+		}
+	}
+
+	if(!found)
+	{
+		is_visible = HasTileLineOfSight(map, from_tile, to_tile);
+		cache->miss_n++;
+	}
+	return is_visible;
+}
+
+// NOTE: For maps that do not change: every tile stores one bit for every tile in the square
+//       of the given radius around it. Queries farther than that fall back to casting a ray.
+#define MaxVisibilityRadius 7
+
+struct VisibilityTable
+{
+	I32 radius;
+	I32 side;
+	I32 word_per_tile_n;
+	U64 *words;
+};
+
+static VisibilityTable
+func CreateVisibilityTable(MemArena *arena, Map *map, I32 radius)
+{
+	Assert(IsIntBetween(radius, 1, MaxVisibilityRadius));
+	VisibilityTable table = {};
+	table.radius = radius;
+	table.side = 2 * radius + 1;
+	table.word_per_tile_n = (table.side * table.side + 63) / 64;
+
+	I32 tile_n = map->tile_row_n * map->tile_col_n;
+	table.words = ArenaAllocArray(arena, U64, tile_n * table.word_per_tile_n);
+	for(I32 i = 0; i < tile_n * table.word_per_tile_n; i++)
+	{
+		table.words[i] = 0;
+	}
+
+	for(I32 row = 0; row < map->tile_row_n; row++)
+	{
+		for(I32 col = 0; col < map->tile_col_n; col++)
+		{
+			U64 *tile_words = table.words + (row * map->tile_col_n + col) * table.word_per_tile_n;
+			IV2 from_tile = MakeTile(row, col);
+			for(I32 row_offset = -radius; row_offset <= radius; row_offset++)
+			{
+				for(I32 col_offset = -radius; col_offset <= radius; col_offset++)
+				{
+					IV2 to_tile = MakeTile(row + row_offset, col + col_offset);
+					if(!IsValidTile(map, to_tile))
+					{
+						continue;
+					}
+
+					I32 bit = (row_offset + radius) * table.side + (col_offset + radius);
+					if(HasTileLineOfSight(map, from_tile, to_tile))
+					{
+						tile_words[bit >> 6] |= ((U64)1 << (bit & 63));
+					}
+				}
+			}
+		}
+	}
+	return table;
+}
+
+static B32
+func HasPrecomputedTileLineOfSight(VisibilityTable *table, Map *map, IV2 from_tile, IV2 to_tile)
+{
+	B32 is_visible = false;
+	I32 row_offset = to_tile.row - from_tile.row;
+	I32 col_offset = to_tile.col - from_tile.col;
+	if(IntAbs(row_offset) <= table->radius && IntAbs(col_offset) <= table->radius)
+	{
+		Assert(IsValidTile(map, from_tile));
+		U64 *tile_words = table->words + (from_tile.row * map->tile_col_n + from_tile.col) * table->word_per_tile_n;
+		I32 bit = (row_offset + table->radius) * table->side + (col_offset + table->radius);
+		is_visible = ((tile_words[bit >> 6] >> (bit & 63)) & 1);
+	}
+	else
+	{
+		is_visible = HasTileLineOfSight(map, from_tile, to_tile);
+	}
+	return is_visible;
+}
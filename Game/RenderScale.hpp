@@ -0,0 +1,264 @@
+#pragma once
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RENDER_SCALE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "Bitmap.hpp"
+#include "Debug.hpp"
+#include "Draw.hpp"
+#include "Math.hpp"
+#include "Memory.hpp"
+#include "MemoryStats.hpp"
+#include "Profiler.hpp"
+#include "Type.hpp"
+
+// NOTE: The world can be drawn to a smaller bitmap of its own and stretched to the output bitmap afterwards,
+//       everything drawn to the output canvas after EndWorldRender (the UI) stays at full resolution.
+//       With a dynamic render scale the scale follows the measured frame time to keep close to the target frame rate.
+
+#define MinRenderScale 0.5f
+#define MaxRenderScale 1.0f
+#define RenderScaleStep 0.125f
+#define DefaultTargetFramesPerSecond 60.0f
+#define RenderScaleFrameTimeSmoothing 0.1f
+#define RenderScaleSlowFrameRatio 1.1f
+#define RenderScaleFastFrameRatio 0.75f
+#define RenderScaleChangeWaitFrameN 30
+
+struct RenderScale
+{
+	R32 scale;
+	B32 is_dynamic;
+	R32 target_frame_seconds;
+	R32 average_frame_seconds;
+	I32 frames_since_change;
+
+	Camera world_camera;
+	Canvas world_canvas;
+};
+
+static void
+func InitRenderScale(RenderScale *render_scale, R32 target_frames_per_second)
+{
+	Assert(target_frames_per_second > 0.0f);
+	render_scale->scale = MaxRenderScale;
+	render_scale->is_dynamic = true;
+	render_scale->target_frame_seconds = 1.0f / target_frames_per_second;
+	render_scale->average_frame_seconds = render_scale->target_frame_seconds;
+	render_scale->frames_since_change = 0;
+}
+
+static void
+func SetRenderScale(RenderScale *render_scale, R32 scale)
+{
+	render_scale->scale = Clip(scale, MinRenderScale, MaxRenderScale);
+	render_scale->frames_since_change = 0;
+}
+
+// NOTE: Moves the scale one step at a time, and only after the new scale had a few frames to show in the frame time.
+//       Going down needs a frame time a bit over the target and going up one well under it,
+//       so a frame time close to the target does not make the scale jump back and forth.
+static void
+func UpdateRenderScale(RenderScale *render_scale, R32 frame_seconds)
+{
+	R32 smoothing = RenderScaleFrameTimeSmoothing;
+	render_scale->average_frame_seconds = Lerp(render_scale->average_frame_seconds, smoothing, frame_seconds);
+	render_scale->frames_since_change++;
+
+	if(render_scale->is_dynamic && render_scale->frames_since_change >= RenderScaleChangeWaitFrameN)
+	{
+		R32 target_seconds = render_scale->target_frame_seconds;
+		R32 average_seconds = render_scale->average_frame_seconds;
+		if(average_seconds > target_seconds * RenderScaleSlowFrameRatio && render_scale->scale > MinRenderScale)
+		{
+			SetRenderScale(render_scale, render_scale->scale - RenderScaleStep);
+		}
+		else if(average_seconds < target_seconds * RenderScaleFastFrameRatio && render_scale->scale < MaxRenderScale)
+		{
+			SetRenderScale(render_scale, render_scale->scale + RenderScaleStep);
+		}
+	}
+}
+
+static void
+func ToggleDynamicRenderScale(RenderScale *render_scale)
+{
+	render_scale->is_dynamic = !render_scale->is_dynamic;
+	if(!render_scale->is_dynamic)
+	{
+		SetRenderScale(render_scale, MaxRenderScale);
+	}
+}
+
+#ifdef RENDER_SCALE_SSE2
+// NOTE: Same as BlendColorCodes on every 16-bit channel, weights are between 0 and 256.
+static __m128i
+func BlendColorChannels(__m128i channels1, __m128i weights, __m128i channels2)
+{
+	__m128i weights1 = _mm_sub_epi16(_mm_set1_epi16(256), weights);
+	__m128i sum = _mm_add_epi16(_mm_mullo_epi16(channels1, weights1), _mm_mullo_epi16(channels2, weights));
+	__m128i result = _mm_srli_epi16(sum, 8);
+	return result;
+}
+
+static __m128i
+func GetStretchPairWeights(U32 x1, U32 x2)
+{
+	U16 weight1 = (U16)((x1 >> 8) & 0xFF);
+	U16 weight2 = (U16)((x2 >> 8) & 0xFF);
+	__m128i weights = _mm_setr_epi16(weight1, weight1, weight1, weight1, weight2, weight2, weight2, weight2);
+	return weights;
+}
+#endif
+
+static void
+func LerpBitmapRows(U32 *top_row, U32 *bottom_row, U32 *pixels, I32 pixel_n, U8 ratio)
+{
+	I32 i = 0;
+#ifdef RENDER_SCALE_SSE2
+	__m128i zero = _mm_setzero_si128();
+	__m128i weights = _mm_set1_epi16((U16)ratio);
+	for(; i + 4 <= pixel_n; i += 4)
+	{
+		__m128i top = _mm_loadu_si128((__m128i *)(top_row + i));
+		__m128i bottom = _mm_loadu_si128((__m128i *)(bottom_row + i));
+		__m128i low = BlendColorChannels(_mm_unpacklo_epi8(top, zero), weights, _mm_unpacklo_epi8(bottom, zero));
+		__m128i high = BlendColorChannels(_mm_unpackhi_epi8(top, zero), weights, _mm_unpackhi_epi8(bottom, zero));
+		__m128i result = _mm_packus_epi16(low, high);
+		_mm_storeu_si128((__m128i *)(pixels + i), result);
+	}
+#endif
+	for(; i < pixel_n; i++)
+	{
+		pixels[i] = BlendColorCodes(top_row[i], bottom_row[i], ratio);
+	}
+}
+
+// NOTE: xs holds a 16.16 fixed point column of the row for every pixel, row has one more pixel after the last column.
+static void
+func StretchBitmapRow(U32 *row, U32 *xs, U32 *pixels, I32 pixel_n)
+{
+	I32 i = 0;
+#ifdef RENDER_SCALE_SSE2
+	__m128i zero = _mm_setzero_si128();
+	for(; i + 4 <= pixel_n; i += 4)
+	{
+		U32 *x = xs + i;
+		I32 col0 = (I32)(x[0] >> 16);
+		I32 col1 = (I32)(x[1] >> 16);
+		I32 col2 = (I32)(x[2] >> 16);
+		I32 col3 = (I32)(x[3] >> 16);
+		__m128i left = _mm_setr_epi32((I32)row[col0], (I32)row[col1], (I32)row[col2], (I32)row[col3]);
+		__m128i right = _mm_setr_epi32((I32)row[col0 + 1], (I32)row[col1 + 1], (I32)row[col2 + 1], (I32)row[col3 + 1]);
+		__m128i low = BlendColorChannels(_mm_unpacklo_epi8(left, zero), GetStretchPairWeights(x[0], x[1]), _mm_unpacklo_epi8(right, zero));
+		__m128i high = BlendColorChannels(_mm_unpackhi_epi8(left, zero), GetStretchPairWeights(x[2], x[3]), _mm_unpackhi_epi8(right, zero));
+		__m128i result = _mm_packus_epi16(low, high);
+		_mm_storeu_si128((__m128i *)(pixels + i), result);
+	}
+#endif
+	for(; i < pixel_n; i++)
+	{
+		I32 col = (I32)(xs[i] >> 16);
+		U8 ratio = (U8)((xs[i] >> 8) & 0xFF);
+		pixels[i] = BlendColorCodes(row[col], row[col + 1], ratio);
+	}
+}
+
+// NOTE: Returns the 16.16 fixed point source coordinate of every destination pixel center, clamped to the source.
+static void
+func GetStretchCoords(U32 *coords, I32 destination_n, I32 source_n)
+{
+	Assert(destination_n > 0 && source_n > 0);
+	I64 step = ((I64)source_n << 16) / destination_n;
+	I64 coord = step / 2 - (1 << 15);
+	I64 max_coord = (I64)(source_n - 1) << 16;
+	for(I32 i = 0; i < destination_n; i++)
+	{
+		I64 clamped_coord = (coord < 0) ? 0 : (coord > max_coord) ? max_coord : coord;
+		coords[i] = (U32)clamped_coord;
+		coord += step;
+	}
+}
+
+// NOTE: Bilinear stretch of the whole source bitmap to the whole destination bitmap.
+//       Every destination row is a blend of two source rows, that blend is done once per row into a scratch row
+//       and then sampled across, rows that use the same two source rows with the same ratio reuse it.
+static void
+func UpscaleBitmap(Bitmap *source, Bitmap *destination)
+{
+	ProfileFunction();
+	Assert(source->width > 0 && source->height > 0);
+	MemArena *arena = GetScratchArena();
+	TempMemory temp_memory = BeginTempMemory(arena);
+
+	U32 *xs = ArenaAllocArray(arena, U32, destination->width);
+	U32 *ys = ArenaAllocArray(arena, U32, destination->height);
+	GetStretchCoords(xs, destination->width, source->width);
+	GetStretchCoords(ys, destination->height, source->height);
+
+	U32 *blended_row = ArenaAllocArray(arena, U32, source->width + 1);
+	U32 blended_y = 0xFFFFFFFF;
+	for(I32 row = 0; row < destination->height; row++)
+	{
+		U32 y = (ys[row] & 0xFFFFFF00);
+		if(y != blended_y)
+		{
+			I32 source_row = (I32)(y >> 16);
+			I32 next_source_row = IntMin2(source_row + 1, source->height - 1);
+			U8 ratio = (U8)((y >> 8) & 0xFF);
+			U32 *top_row = source->memory + source_row * source->width;
+			U32 *bottom_row = source->memory + next_source_row * source->width;
+			LerpBitmapRows(top_row, bottom_row, blended_row, source->width, ratio);
+			blended_row[source->width] = blended_row[source->width - 1];
+			blended_y = y;
+		}
+
+		U32 *pixels = destination->memory + row * destination->width;
+		StretchBitmapRow(blended_row, xs, pixels, destination->width);
+	}
+
+	EndTempMemory(temp_memory);
+}
+
+// NOTE: Returns the canvas the world has to be drawn to this frame, at full scale that is the output canvas itself.
+//       The world camera is the output camera with every pixel size scaled, so world positions land on the same spots.
+static Canvas *
+func BeginWorldRender(RenderScale *render_scale, Canvas *canvas)
+{
+	Canvas *world_canvas = canvas;
+	Bitmap *bitmap = &canvas->bitmap;
+	I32 width = IntMax2(1, (I32)(render_scale->scale * (R32)bitmap->width + 0.5f));
+	I32 height = IntMax2(1, (I32)(render_scale->scale * (R32)bitmap->height + 0.5f));
+	if(width < bitmap->width || height < bitmap->height)
+	{
+		world_canvas = &render_scale->world_canvas;
+		Bitmap *world_bitmap = &world_canvas->bitmap;
+		if(world_bitmap->width != width || world_bitmap->height != height)
+		{
+			ResizeBitmap(world_bitmap, width, height);
+		}
+
+		Camera *world_camera = &render_scale->world_camera;
+		*world_camera = *canvas->camera;
+		R32 pixel_ratio = (R32)width / (R32)bitmap->width;
+		world_camera->screen_pixel_size = MakeVector((R32)width, (R32)height);
+		world_camera->unit_in_pixels = pixel_ratio * canvas->camera->unit_in_pixels;
+		world_camera->target_unit_in_pixels = pixel_ratio * canvas->camera->target_unit_in_pixels;
+
+		world_canvas->camera = world_camera;
+		world_canvas->glyph_data = canvas->glyph_data;
+	}
+	return world_canvas;
+}
+
+static void
+func EndWorldRender(RenderScale *render_scale, Canvas *canvas, Canvas *world_canvas)
+{
+	if(world_canvas != canvas)
+	{
+		Assert(world_canvas == &render_scale->world_canvas);
+		UpscaleBitmap(&world_canvas->bitmap, &canvas->bitmap);
+	}
+}
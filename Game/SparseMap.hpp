@@ -0,0 +1,404 @@
+#pragma once
+
+#include "Debug.hpp"
+#include "Map.hpp"
+#include "MapFile.hpp"
+#include "Math.hpp"
+#include "Memory.hpp"
+#include "Type.hpp"
+
+// NOTE: Backing store for editing. Tiles live in MapChunkSide x MapChunkSide chunks that are
+//       looked up by signed chunk coordinates in an open addressing table, so the map grows in
+//       any direction without moving anything that is already there. Items and entities keep
+//       their world positions, only the flattened copy that goes to disk is shifted.
+//       Every change bumps change_n. Changed chunks lose their saved encoding, see MapSave.hpp.
+
+struct SparseMapSlot
+{
+	I32 chunk_row;
+	I32 chunk_col;
+	MapChunk *chunk;
+
+	U32 change_n;
+	B32 has_saved_chunk;
+	MapFileChunk saved_chunk;
+};
+
+struct SparseMap
+{
+	MemArena *arena;
+	U32 change_n;
+
+	SparseMapSlot *slots;
+	I32 slot_n;
+	I32 chunk_n;
+
+	B32 has_tiles;
+	I32 top_row;
+	I32 left_col;
+	I32 bottom_row;
+	I32 right_col;
+
+	I32 item_n;
+	I32 max_item_n;
+	MapItem *items;
+
+	I32 entity_n;
+	I32 max_entity_n;
+	MapEntity *entities;
+};
+
+static I32
+func GetSparseMapChunkCoordinate(I32 tile_coordinate)
+{
+	I32 chunk_coordinate = (tile_coordinate >= 0) ? (tile_coordinate / MapChunkSide) :
+							-((MapChunkSide - 1 - tile_coordinate) / MapChunkSide);
+	return chunk_coordinate;
+}
+
+static SparseMapSlot *
+func AllocSparseMapSlots(MemArena *arena, I32 slot_n)
+{
+	SparseMapSlot *slots = ArenaAllocArray(arena, SparseMapSlot, slot_n);
+	for(I32 i = 0; i < slot_n; i++)
+	{
+		slots[i] = {};
+	}
+	return slots;
+}
+
+static SparseMap
+func CreateSparseMap(MemArena *arena)
+{
+	SparseMap map = {};
+	map.arena = arena;
+	map.slot_n = 64;
+	map.slots = AllocSparseMapSlots(arena, map.slot_n);
+	return map;
+}
+
+static U32
+func HashSparseMapChunk(I32 chunk_row, I32 chunk_col)
+{
+	U64 key = ((U64)(U32)chunk_row << 32) | (U64)(U32)chunk_col;
+	U32 hash = (U32)((key * 0x9E3779B97F4A7C15ULL) >> 32);
+	return hash;
+}
+
+static SparseMapSlot *
+func FindSparseMapSlot(SparseMapSlot *slots, I32 slot_n, I32 chunk_row, I32 chunk_col)
+{
+	I32 mask = slot_n - 1;
+	I32 index = (I32)(HashSparseMapChunk(chunk_row, chunk_col) & (U32)mask);
+	SparseMapSlot *slot = &slots[index];
+	while(slot->chunk != 0 && (slot->chunk_row != chunk_row || slot->chunk_col != chunk_col))
+	{
+		index = (index + 1) & mask;
+		slot = &slots[index];
+	}
+	return slot;
+}
+
+static MapChunk *
+func GetSparseMapChunk(SparseMap *map, I32 chunk_row, I32 chunk_col)
+{
+	SparseMapSlot *slot = FindSparseMapSlot(map->slots, map->slot_n, chunk_row, chunk_col);
+	MapChunk *chunk = slot->chunk;
+	return chunk;
+}
+
+// NOTE: The table is kept at most half full. Growing leaves the old table in the arena,
+//       that is at most as much memory as the new one.
+static void
+func GrowSparseMapSlots(SparseMap *map)
+{
+	I32 slot_n = 2 * map->slot_n;
+	SparseMapSlot *slots = AllocSparseMapSlots(map->arena, slot_n);
+	for(I32 i = 0; i < map->slot_n; i++)
+	{
+		SparseMapSlot *old_slot = &map->slots[i];
+		if(old_slot->chunk)
+		{
+			SparseMapSlot *slot = FindSparseMapSlot(slots, slot_n, old_slot->chunk_row, old_slot->chunk_col);
+			*slot = *old_slot;
+		}
+	}
+	map->slots = slots;
+	map->slot_n = slot_n;
+}
+
+static SparseMapSlot *
+func GetOrAddSparseMapSlot(SparseMap *map, I32 chunk_row, I32 chunk_col)
+{
+	SparseMapSlot *slot = FindSparseMapSlot(map->slots, map->slot_n, chunk_row, chunk_col);
+	if(!slot->chunk)
+	{
+		if(2 * (map->chunk_n + 1) > map->slot_n)
+		{
+			GrowSparseMapSlots(map);
+			slot = FindSparseMapSlot(map->slots, map->slot_n, chunk_row, chunk_col);
+		}
+
+		MapChunk *chunk = ArenaAllocType(map->arena, MapChunk);
+		for(I32 i = 0; i < MapChunkTileN; i++)
+		{
+			chunk->tiles[i] = NoTileId;
+		}
+		for(I32 i = 0; i < MapChunkSide; i++)
+		{
+			chunk->passable_rows[i] = 0;
+		}
+
+		*slot = {};
+		slot->chunk_row = chunk_row;
+		slot->chunk_col = chunk_col;
+		slot->chunk = chunk;
+		map->chunk_n++;
+	}
+	return slot;
+}
+
+static MapChunk *
+func GetOrAddSparseMapChunk(SparseMap *map, I32 chunk_row, I32 chunk_col)
+{
+	SparseMapSlot *slot = GetOrAddSparseMapSlot(map, chunk_row, chunk_col);
+	return slot->chunk;
+}
+
+static void
+func MarkSparseMapSlotChanged(SparseMap *map, SparseMapSlot *slot)
+{
+	map->change_n++;
+	slot->change_n = map->change_n;
+	slot->has_saved_chunk = false;
+}
+
+static TileId
+func GetSparseTileType(SparseMap *map, I32 row, I32 col)
+{
+	I32 chunk_row = GetSparseMapChunkCoordinate(row);
+	I32 chunk_col = GetSparseMapChunkCoordinate(col);
+	MapChunk *chunk = GetSparseMapChunk(map, chunk_row, chunk_col);
+	TileId tile_type = NoTileId;
+	if(chunk)
+	{
+		I32 chunk_tile_row = row - chunk_row * MapChunkSide;
+		I32 chunk_tile_col = col - chunk_col * MapChunkSide;
+		tile_type = (TileId)chunk->tiles[chunk_tile_row * MapChunkSide + chunk_tile_col];
+	}
+	return tile_type;
+}
+
+static void
+func ExtendSparseMapBounds(SparseMap *map, I32 row, I32 col)
+{
+	if(map->has_tiles)
+	{
+		map->top_row = IntMin2(map->top_row, row);
+		map->left_col = IntMin2(map->left_col, col);
+		map->bottom_row = IntMax2(map->bottom_row, row);
+		map->right_col = IntMax2(map->right_col, col);
+	}
+	else
+	{
+		map->has_tiles = true;
+		map->top_row = map->bottom_row = row;
+		map->left_col = map->right_col = col;
+	}
+}
+
+static void
+func SetSparseTileType(SparseMap *map, I32 row, I32 col, TileId type)
+{
+	I32 chunk_row = GetSparseMapChunkCoordinate(row);
+	I32 chunk_col = GetSparseMapChunkCoordinate(col);
+	SparseMapSlot *slot = 0;
+	if(type == NoTileId)
+	{
+		slot = FindSparseMapSlot(map->slots, map->slot_n, chunk_row, chunk_col);
+	}
+	else
+	{
+		slot = GetOrAddSparseMapSlot(map, chunk_row, chunk_col);
+		ExtendSparseMapBounds(map, row, col);
+	}
+
+	MapChunk *chunk = slot->chunk;
+	if(chunk)
+	{
+		MarkSparseMapSlotChanged(map, slot);
+		I32 chunk_tile_row = row - chunk_row * MapChunkSide;
+		I32 chunk_tile_col = col - chunk_col * MapChunkSide;
+		chunk->tiles[chunk_tile_row * MapChunkSide + chunk_tile_col] = (U8)type;
+
+		U64 bit = ((U64)1 << chunk_tile_col);
+		U64 *word = &chunk->passable_rows[chunk_tile_row];
+		*word = (IsPassableTileType(type)) ? (*word | bit) : (*word & ~bit);
+	}
+}
+
+static void
+func AddSparseMapItem(SparseMap *map, MapItem item)
+{
+	if(map->item_n == map->max_item_n)
+	{
+		I32 max_item_n = IntMax2(16, 2 * map->max_item_n);
+		MapItem *items = ArenaAllocArray(map->arena, MapItem, max_item_n);
+		for(I32 i = 0; i < map->item_n; i++)
+		{
+			items[i] = map->items[i];
+		}
+		map->items = items;
+		map->max_item_n = max_item_n;
+	}
+	map->items[map->item_n] = item;
+	map->item_n++;
+	map->change_n++;
+}
+
+static void
+func RemoveSparseMapItem(SparseMap *map, I32 item_index)
+{
+	Assert(IsIntBetween(item_index, 0, map->item_n - 1));
+	for(I32 i = item_index; i + 1 < map->item_n; i++)
+	{
+		map->items[i] = map->items[i + 1];
+	}
+	map->item_n--;
+	map->change_n++;
+}
+
+static void
+func AddSparseMapEntity(SparseMap *map, MapEntity entity)
+{
+	if(map->entity_n == map->max_entity_n)
+	{
+		I32 max_entity_n = IntMax2(16, 2 * map->max_entity_n);
+		MapEntity *entities = ArenaAllocArray(map->arena, MapEntity, max_entity_n);
+		for(I32 i = 0; i < map->entity_n; i++)
+		{
+			entities[i] = map->entities[i];
+		}
+		map->entities = entities;
+		map->max_entity_n = max_entity_n;
+	}
+	map->entities[map->entity_n] = entity;
+	map->entity_n++;
+	map->change_n++;
+}
+
+// NOTE: Resets the arena of the sparse map and fills it from a flat map.
+static void
+func SetSparseMapFromMap(SparseMap *sparse_map, Map *map)
+{
+	MemArena *arena = sparse_map->arena;
+	ArenaReset(arena);
+	*sparse_map = CreateSparseMap(arena);
+
+	U8 block_tiles[MapChunkTileN] = {};
+	I32 chunk_row_n = GetMapChunkN(map->tile_row_n);
+	I32 chunk_col_n = GetMapChunkN(map->tile_col_n);
+	for(I32 chunk_row = 0; chunk_row < chunk_row_n; chunk_row++)
+	{
+		for(I32 chunk_col = 0; chunk_col < chunk_col_n; chunk_col++)
+		{
+			for(I32 row = 0; row < MapChunkSide; row++)
+			{
+				for(I32 col = 0; col < MapChunkSide; col++)
+				{
+					IV2 tile = MakeTile(chunk_row * MapChunkSide + row, chunk_col * MapChunkSide + col);
+					U8 tile_type = NoTileId;
+					if(IsValidTile(map, tile))
+					{
+						tile_type = (U8)GetTileType(map, tile);
+					}
+					block_tiles[row * MapChunkSide + col] = tile_type;
+				}
+			}
+
+			B32 has_tiles = false;
+			for(I32 i = 0; i < MapChunkTileN; i++)
+			{
+				if(block_tiles[i] != NoTileId)
+				{
+					has_tiles = true;
+					break;
+				}
+			}
+
+			if(has_tiles)
+			{
+				MapChunk *chunk = GetOrAddSparseMapChunk(sparse_map, chunk_row, chunk_col);
+				for(I32 i = 0; i < MapChunkTileN; i++)
+				{
+					chunk->tiles[i] = block_tiles[i];
+				}
+				UpdateMapChunkPassability(chunk);
+			}
+		}
+	}
+
+	if(map->tile_row_n > 0 && map->tile_col_n > 0)
+	{
+		ExtendSparseMapBounds(sparse_map, 0, 0);
+		ExtendSparseMapBounds(sparse_map, map->tile_row_n - 1, map->tile_col_n - 1);
+	}
+
+	for(I32 i = 0; i < map->item_n; i++)
+	{
+		AddSparseMapItem(sparse_map, map->items[i]);
+	}
+	for(I32 i = 0; i < map->entity_n; i++)
+	{
+		AddSparseMapEntity(sparse_map, map->entities[i]);
+	}
+}
+
+static void
+func DrawSparseMap(Canvas *canvas, SparseMap *map)
+{
+	Camera *camera = canvas->camera;
+	I32 first_row = Floor(CameraTopSide(camera) / MapTileSide);
+	I32 last_row = Floor(CameraBottomSide(camera) / MapTileSide);
+	I32 first_col = Floor(CameraLeftSide(camera) / MapTileSide);
+	I32 last_col = Floor(CameraRightSide(camera) / MapTileSide);
+
+	I32 first_chunk_row = GetSparseMapChunkCoordinate(first_row);
+	I32 last_chunk_row = GetSparseMapChunkCoordinate(last_row);
+	I32 first_chunk_col = GetSparseMapChunkCoordinate(first_col);
+	I32 last_chunk_col = GetSparseMapChunkCoordinate(last_col);
+	for(I32 chunk_row = first_chunk_row; chunk_row <= last_chunk_row; chunk_row++)
+	{
+		for(I32 chunk_col = first_chunk_col; chunk_col <= last_chunk_col; chunk_col++)
+		{
+			MapChunk *chunk = GetSparseMapChunk(map, chunk_row, chunk_col);
+			if(!chunk)
+			{
+				continue;
+			}
+
+			I32 chunk_top = chunk_row * MapChunkSide;
+			I32 chunk_left = chunk_col * MapChunkSide;
+			I32 min_row = IntMax2(first_row, chunk_top);
+			I32 max_row = IntMin2(last_row, chunk_top + MapChunkSide - 1);
+			I32 min_col = IntMax2(first_col, chunk_left);
+			I32 max_col = IntMin2(last_col, chunk_left + MapChunkSide - 1);
+			for(I32 row = min_row; row <= max_row; row++)
+			{
+				for(I32 col = min_col; col <= max_col; col++)
+				{
+					TileId tile_type = (TileId)chunk->tiles[(row - chunk_top) * MapChunkSide + (col - chunk_left)];
+					if(tile_type == NoTileId)
+					{
+						continue;
+					}
+
+					R32 tile_left = col * MapTileSide;
+					R32 tile_top = row * MapTileSide;
+					V4 color = GetTileTypeColor(tile_type);
+					DrawRectLRTB(canvas, tile_left, tile_left + MapTileSide, tile_top, tile_top + MapTileSide, color);
+				}
+			}
+		}
+	}
+}
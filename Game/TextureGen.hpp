@@ -0,0 +1,455 @@
+#pragma once
+
+#include "Bitmap.hpp"
+#include "Debug.hpp"
+#include "File.hpp"
+#include "Hash.hpp"
+#include "Math.hpp"
+#include "Memory.hpp"
+#include "MemoryStats.hpp"
+#include "Texture.hpp"
+#include "Thread.hpp"
+#include "Type.hpp"
+
+// NOTE: Generated textures only depend on their parameters. Threads work on bands of rows and every row
+//       (and every grid row of the grass noise) has its own random stream, so the number of threads does not matter.
+//       A generated texture is saved to TextureCacheDirectory in a file named after the hash of its parameters,
+//       next time the file is loaded instead of generating it again.
+//       Change TextureCacheVersion whenever a generator changes its output, old files are then simply not found.
+//       Only the texture itself is cached, row by row, its mips and its layout are made again after loading.
+
+#define MaxTextureGenThreadN 32
+#define TextureGenMinRowN 16
+#define GrassMaxGridN 256
+#define GrassOctaveN 8
+#define TextureCacheMagic 0x48435854
+#define TextureCacheVersion 1
+#define TextureCacheDirectory "Data/TextureCache"
+
+enum TextureGenId
+{
+	RoofTextureGenId,
+	GrassTextureGenId,
+	RandomGreyTextureGenId,
+	TextureGenN
+};
+
+struct TextureGenParams
+{
+	TextureGenId generator_id;
+	I32 log_side;
+	TextureLayout layout;
+	U64 seed;
+	I32 min_ratio;
+	I32 max_ratio;
+};
+
+struct TextureGenJob
+{
+	TextureGenParams *params;
+	Texture texture;
+	I32 first_row;
+	I32 last_row;
+
+	R32 *grid_values[GrassOctaveN];
+	I32 octave_n;
+};
+
+// NOTE: Only has 32 and 64-bit fields in an order that leaves no padding, so it can be hashed and compared as bytes.
+struct TextureCacheKey
+{
+	U32 version;
+	U32 generator_id;
+	I32 log_side;
+	I32 min_ratio;
+	I32 max_ratio;
+	U32 reserved;
+	U64 seed;
+};
+
+struct TextureCacheHeader
+{
+	U32 magic;
+	U32 reserved;
+	TextureCacheKey key;
+	U64 pixel_hash;
+};
+
+static TextureGenParams
+func GetTextureGenParams(TextureGenId generator_id, I32 log_side, U64 seed)
+{
+	TextureGenParams params = {};
+	params.generator_id = generator_id;
+	params.log_side = log_side;
+	params.seed = seed;
+	return params;
+}
+
+static void
+func GenerateRoofTextureRows(TextureGenJob *job)
+{
+	Texture texture = job->texture;
+	I32 tile_width = 16;
+	I32 tile_height = 32;
+
+	for(I32 row = job->first_row; row <= job->last_row; row++)
+	{
+		RandomSeries series = CreateRandomSeries(job->params->seed, (U64)row);
+		U32 *pixel = texture.memory + row * texture.side;
+		for(I32 col = 0; col < texture.side; col++)
+		{
+			I32 red = 0;
+			I32 green = 0;
+			I32 blue = 0;
+
+			I32 tile_left = tile_width * (col / tile_width);
+			I32 tile_right = tile_left + tile_width;
+
+			I32 tile_top = tile_height * (row / tile_height);
+
+			I32 height = IntMin2(col - tile_left, tile_right - col);
+			I32 tile_bottom = tile_top + height;
+
+			B32 on_side = (col % tile_width == 0);
+			B32 on_bottom = (row == tile_bottom);
+
+			B32 on_tile_side = (on_side || on_bottom);
+
+			if(!on_tile_side)
+			{
+				red = RandomIntBetween(&series, 100, 150);
+			}
+
+			*pixel = (red << 16) | (green << 8) | (blue << 0);
+			pixel++;
+		}
+	}
+}
+
+// NOTE: Every octave has a grid twice as dense as the one before and adds less to the green.
+//       The last row and column of a grid repeat the first ones so the texture tiles.
+static I32
+func GetGrassOctaveN(I32 side)
+{
+	I32 octave_n = 0;
+	for(I32 grid_n = 2; grid_n <= GrassMaxGridN && grid_n <= side; grid_n *= 2)
+	{
+		octave_n++;
+	}
+	return octave_n;
+}
+
+static void
+func GenerateGrassGrid(R32 *grid_values, I32 grid_n, R32 opacity, U64 seed, I32 octave)
+{
+	for(I32 row = 0; row < grid_n; row++)
+	{
+		RandomSeries series = CreateRandomSeries(seed, ((U64)(octave + 1) << 32) | (U64)row);
+		R32 *grid_row = grid_values + row * (grid_n + 1);
+		for(I32 col = 0; col < grid_n; col++)
+		{
+			grid_row[col] = opacity * RandomUnit(&series);
+		}
+		grid_row[grid_n] = grid_row[0];
+	}
+
+	for(I32 col = 0; col <= grid_n; col++)
+	{
+		grid_values[grid_n * (grid_n + 1) + col] = grid_values[col];
+	}
+}
+
+static void
+func GenerateGrassTextureRows(TextureGenJob *job)
+{
+	Texture texture = job->texture;
+	for(I32 row = job->first_row; row <= job->last_row; row++)
+	{
+		RandomSeries series = CreateRandomSeries(job->params->seed, (U64)row);
+		U32 *pixel = texture.memory + row * texture.side;
+		for(I32 col = 0; col < texture.side; col++)
+		{
+			R32 green = 0.0f;
+			I32 grid_n = 2;
+			for(I32 octave = 0; octave < job->octave_n; octave++)
+			{
+				R32 *grid_values = job->grid_values[octave];
+				I32 grid_log_width = texture.log_side - (octave + 1);
+				I32 grid_width = (1 << grid_log_width);
+				R32 grid_ratio = 1.0f / (R32)grid_width;
+
+				I32 y0 = (row >> grid_log_width);
+				I32 x0 = (col >> grid_log_width);
+				R32 yr = (R32)(row & (grid_width - 1)) * grid_ratio;
+				R32 xr = (R32)(col & (grid_width - 1)) * grid_ratio;
+
+				R32 *top_row = grid_values + y0 * (grid_n + 1) + x0;
+				R32 *bottom_row = top_row + (grid_n + 1);
+
+				R32 top    = Lerp(top_row[0], xr, top_row[1]);
+				R32 bottom = Lerp(bottom_row[0], xr, bottom_row[1]);
+				green += Lerp(top, yr, bottom);
+
+				grid_n *= 2;
+			}
+
+			green = Min2(green, 1.0f) * (0.9f + 0.1f * RandomUnit(&series));
+			*pixel = GetColorCode(MakeColor(0.0f, green, 0.0f));
+			pixel++;
+		}
+	}
+}
+
+static void
+func GenerateRandomGreyTextureRows(TextureGenJob *job)
+{
+	Texture texture = job->texture;
+	for(I32 row = job->first_row; row <= job->last_row; row++)
+	{
+		RandomSeries series = CreateRandomSeries(job->params->seed, (U64)row);
+		U32 *pixel = texture.memory + row * texture.side;
+		for(I32 col = 0; col < texture.side; col++)
+		{
+			I32 grey_ratio = RandomIntBetween(&series, job->params->min_ratio, job->params->max_ratio);
+
+			*pixel = (grey_ratio << 16) | (grey_ratio << 8) | (grey_ratio << 0);
+			pixel++;
+		}
+	}
+}
+
+static void
+func GenerateTextureRows(void *parameter)
+{
+	TextureGenJob *job = (TextureGenJob *)parameter;
+	switch(job->params->generator_id)
+	{
+		case RoofTextureGenId:
+		{
+			GenerateRoofTextureRows(job);
+			break;
+		}
+		case GrassTextureGenId:
+		{
+			GenerateGrassTextureRows(job);
+			break;
+		}
+		case RandomGreyTextureGenId:
+		{
+			GenerateRandomGreyTextureRows(job);
+			break;
+		}
+		default:
+		{
+			DebugBreak();
+		}
+	}
+}
+
+static void
+func GenerateTextureInParallel(TextureGenParams *params, Texture texture)
+{
+	MemArena *scratch_arena = GetScratchArena();
+	TempMemory temp_memory = BeginTempMemory(scratch_arena);
+
+	TextureGenJob job_template = {};
+	job_template.params = params;
+	job_template.texture = texture;
+	if(params->generator_id == GrassTextureGenId)
+	{
+		R32 multiplier = 0.8f;
+		R32 opacity = 1.0f - multiplier;
+		I32 grid_n = 2;
+		job_template.octave_n = GetGrassOctaveN(texture.side);
+		for(I32 octave = 0; octave < job_template.octave_n; octave++)
+		{
+			R32 *grid_values = ArenaAllocArray(scratch_arena, R32, (grid_n + 1) * (grid_n + 1));
+			GenerateGrassGrid(grid_values, grid_n, opacity, params->seed, octave);
+			job_template.grid_values[octave] = grid_values;
+
+			grid_n *= 2;
+			opacity *= multiplier;
+		}
+	}
+
+	I32 job_n = IntMax2(1, IntMin2(IntMin2(GetProcessorCount(), MaxTextureGenThreadN), texture.side / TextureGenMinRowN));
+	TextureGenJob jobs[MaxTextureGenThreadN] = {};
+	Thread threads[MaxTextureGenThreadN] = {};
+	for(I32 i = 0; i < job_n; i++)
+	{
+		TextureGenJob *job = &jobs[i];
+		*job = job_template;
+		job->first_row = (texture.side * i) / job_n;
+		job->last_row = (texture.side * (i + 1)) / job_n - 1;
+		StartThread(&threads[i], GenerateTextureRows, job);
+	}
+	for(I32 i = 0; i < job_n; i++)
+	{
+		WaitForThread(&threads[i]);
+	}
+
+	EndTempMemory(temp_memory);
+}
+
+static TextureCacheKey
+func GetTextureCacheKey(TextureGenParams *params)
+{
+	TextureCacheKey key = {};
+	key.version = TextureCacheVersion;
+	key.generator_id = (U32)params->generator_id;
+	key.log_side = params->log_side;
+	key.seed = params->seed;
+	if(params->generator_id == RandomGreyTextureGenId)
+	{
+		key.min_ratio = params->min_ratio;
+		key.max_ratio = params->max_ratio;
+	}
+	return key;
+}
+
+static B32
+func AreTextureCacheKeysEqual(TextureCacheKey *key1, TextureCacheKey *key2)
+{
+	B32 are_equal = (key1->version == key2->version &&
+					 key1->generator_id == key2->generator_id &&
+					 key1->log_side == key2->log_side &&
+					 key1->min_ratio == key2->min_ratio &&
+					 key1->max_ratio == key2->max_ratio &&
+					 key1->seed == key2->seed);
+	return are_equal;
+}
+
+// NOTE: TextureCacheDirectory/<16 hex digits of the key hash>.tex
+static void
+func GetTextureCachePath(TextureCacheKey *key, I8 *path)
+{
+	I8 *directory = TextureCacheDirectory;
+	I32 length = 0;
+	while(directory[length] != 0)
+	{
+		path[length] = directory[length];
+		length++;
+	}
+	path[length++] = '/';
+
+	U64 key_hash = HashBytes(key, sizeof(*key));
+	I8 *hex_digits = "0123456789abcdef";
+	for(I32 i = 15; i >= 0; i--)
+	{
+		path[length++] = hex_digits[(key_hash >> (4 * i)) & 0xF];
+	}
+
+	I8 *extension = ".tex";
+	for(I32 i = 0; extension[i] != 0; i++)
+	{
+		path[length++] = extension[i];
+	}
+	path[length] = 0;
+	Assert(length < MaxFilePathSize);
+}
+
+// NOTE: A file that is missing, cut short or does not match the key is a miss, the texture is then left as it was.
+static B32
+func ReadTextureFromCache(TextureCacheKey *key, Texture texture)
+{
+	I8 path[MaxFilePathSize] = {};
+	GetTextureCachePath(key, path);
+
+	MemArena *scratch_arena = GetScratchArena();
+	TempMemory temp_memory = BeginTempMemory(scratch_arena);
+
+	B32 found = false;
+	U32 pixel_size = (U32)(texture.side * texture.side) * sizeof(U32);
+	U32 file_size = 0;
+	U8 *file = ReadWholeFile(path, scratch_arena, &file_size);
+	if(file != 0 && file_size == sizeof(TextureCacheHeader) + pixel_size)
+	{
+		TextureCacheHeader *header = (TextureCacheHeader *)file;
+		U8 *pixels = file + sizeof(TextureCacheHeader);
+		if(header->magic == TextureCacheMagic &&
+		   AreTextureCacheKeysEqual(&header->key, key) &&
+		   header->pixel_hash == HashBytes(pixels, pixel_size))
+		{
+			U32 *source = (U32 *)pixels;
+			I32 pixel_n = texture.side * texture.side;
+			for(I32 i = 0; i < pixel_n; i++)
+			{
+				texture.memory[i] = source[i];
+			}
+			found = true;
+		}
+	}
+
+	EndTempMemory(temp_memory);
+	return found;
+}
+
+// NOTE: A failed write only means the texture is generated again next time.
+static B32
+func WriteTextureToCache(TextureCacheKey *key, Texture texture)
+{
+	I8 path[MaxFilePathSize] = {};
+	GetTextureCachePath(key, path);
+
+	U32 pixel_size = (U32)(texture.side * texture.side) * sizeof(U32);
+	TextureCacheHeader header = {};
+	header.magic = TextureCacheMagic;
+	header.key = *key;
+	header.pixel_hash = HashBytes(texture.memory, pixel_size);
+
+	B32 written = false;
+	if(CreateDirectoryIfMissing(TextureCacheDirectory))
+	{
+		FileWriter writer = {};
+		BeginFileWriter(&writer, path);
+		WriteToFile(&writer, &header, sizeof(header));
+		WriteToFile(&writer, texture.memory, pixel_size);
+		written = EndFileWriter(&writer);
+	}
+	return written;
+}
+
+static TextureHandle
+func GenerateTexture(TexturePool *pool, TextureGenParams *params)
+{
+	Assert(params->generator_id >= 0 && params->generator_id < TextureGenN);
+	TextureHandle handle = AddTexture(pool, params->log_side);
+	Texture *texture = GetTexture(pool, handle);
+
+	TextureCacheKey key = GetTextureCacheKey(params);
+	if(!ReadTextureFromCache(&key, *texture))
+	{
+		GenerateTextureInParallel(params, *texture);
+		WriteTextureToCache(&key, *texture);
+	}
+	BuildTextureMips(texture);
+	SetTextureLayout(texture, params->layout, GetScratchArena());
+	return handle;
+}
+
+static TextureHandle
+func RoofTexture(TexturePool *pool, I32 log_side, U64 seed)
+{
+	TextureGenParams params = GetTextureGenParams(RoofTextureGenId, log_side, seed);
+	TextureHandle handle = GenerateTexture(pool, &params);
+	return handle;
+}
+
+static TextureHandle
+func GrassTexture(TexturePool *pool, I32 log_side, U64 seed)
+{
+	TextureGenParams params = GetTextureGenParams(GrassTextureGenId, log_side, seed);
+	TextureHandle handle = GenerateTexture(pool, &params);
+	return handle;
+}
+
+static TextureHandle
+func RandomGreyTexture(TexturePool *pool, I32 log_side, U64 seed, I32 min_ratio, I32 max_ratio)
+{
+	Assert(min_ratio <= max_ratio);
+	TextureGenParams params = GetTextureGenParams(RandomGreyTextureGenId, log_side, seed);
+	params.min_ratio = min_ratio;
+	params.max_ratio = max_ratio;
+	TextureHandle handle = GenerateTexture(pool, &params);
+	return handle;
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "Debug.hpp"
+#include "Type.hpp"
+
+typedef void ThreadProc(void *parameter);
+
+struct Thread
+{
+	ThreadProc *proc;
+	void *parameter;
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+};
+
+#ifdef _WIN32
+static DWORD WINAPI
+func ThreadEntry(LPVOID parameter)
+{
+	Thread *thread = (Thread *)parameter;
+	thread->proc(thread->parameter);
+	return 0;
+}
+#else
+static void *
+func ThreadEntry(void *parameter)
+{
+	Thread *thread = (Thread *)parameter;
+	thread->proc(thread->parameter);
+	return 0;
+}
+#endif
+
+// NOTE: the Thread struct has to stay in place until WaitForThread returns.
+static void
+func StartThread(Thread *thread, ThreadProc *proc, void *parameter)
+{
+	thread->proc = proc;
+	thread->parameter = parameter;
+#ifdef _WIN32
+	thread->handle = CreateThread(0, 0, ThreadEntry, thread, 0, 0);
+	Assert(thread->handle != 0);
+#else
+	I32 result = pthread_create(&thread->handle, 0, ThreadEntry, thread);
+	Assert(result == 0);
+#endif
+}
+
+static void
+func WaitForThread(Thread *thread)
+{
+#ifdef _WIN32
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+#else
+	pthread_join(thread->handle, 0);
+#endif
+}
+
+static I32
+func GetProcessorCount()
+{
+#ifdef _WIN32
+	SYSTEM_INFO system_info = {};
+	GetSystemInfo(&system_info);
+	I32 processor_n = (I32)system_info.dwNumberOfProcessors;
+#else
+	I32 processor_n = (I32)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if(processor_n < 1)
+	{
+		processor_n = 1;
+	}
+	return processor_n;
+}
+
+static I32
+func AtomicIncrement(volatile I32 *value)
+{
+#ifdef _WIN32
+	I32 result = (I32)InterlockedIncrement((volatile LONG *)value);
+#else
+	I32 result = __sync_add_and_fetch(value, 1);
+#endif
+	return result;
+}
+
+// NOTE: Sets value to new_value if it is expected, returns true if it did.
+static B32
+func AtomicCompareExchange(volatile I32 *value, I32 new_value, I32 expected)
+{
+#ifdef _WIN32
+	B32 exchanged = ((I32)InterlockedCompareExchange((volatile LONG *)value, new_value, expected) == expected);
+#else
+	B32 exchanged = __sync_bool_compare_and_swap(value, expected, new_value);
+#endif
+	return exchanged;
+}
+
+// NOTE: Everything written before the barrier is visible to other threads before anything written after it.
+static void
+func FullMemoryBarrier()
+{
+#ifdef _WIN32
+	MemoryBarrier();
+#else
+	__sync_synchronize();
+#endif
+}
+
+// NOTE: Only keeps the compiler from moving reads and writes across the barrier.
+//       On x86 writes are not reordered with other writes and reads with other reads,
+//       which is all one writer and one reader passing data through a ring buffer need.
+static void
+func CompilerMemoryBarrier()
+{
+#ifdef _MSC_VER
+	_ReadWriteBarrier();
+#else
+	__asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+struct Semaphore
+{
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	sem_t handle;
+#endif
+};
+
+static void
+func InitSemaphore(Semaphore *semaphore, I32 initial_count)
+{
+#ifdef _WIN32
+	semaphore->handle = CreateSemaphoreA(0, initial_count, 0x7FFFFFFF, 0);
+	Assert(semaphore->handle != 0);
+#else
+	I32 result = sem_init(&semaphore->handle, 0, (U32)initial_count);
+	Assert(result == 0);
+#endif
+}
+
+static void
+func SignalSemaphore(Semaphore *semaphore)
+{
+#ifdef _WIN32
+	BOOL result = ReleaseSemaphore(semaphore->handle, 1, 0);
+	Assert(result);
+#else
+	I32 result = sem_post(&semaphore->handle);
+	Assert(result == 0);
+#endif
+}
+
+static void
+func WaitOnSemaphore(Semaphore *semaphore)
+{
+#ifdef _WIN32
+	WaitForSingleObject(semaphore->handle, INFINITE);
+#else
+	while(sem_wait(&semaphore->handle) != 0)
+	{
+	}
+#endif
+}
+
+static void
+func DestroySemaphore(Semaphore *semaphore)
+{
+#ifdef _WIN32
+	CloseHandle(semaphore->handle);
+#else
+	sem_destroy(&semaphore->handle);
+#endif
+}
@@ -4,23 +4,34 @@
 
 #include "Bitmap.hpp"
 #include "Draw.hpp"
-#include "Game.hpp"
+#include "MemoryStats.hpp"
+#include "Profiler.hpp"
 #include "Type.hpp"
 #include "UserInput.hpp"
 
-// #include "Lab/CombatLab.hpp"
+#include "Lab/RaycastLab.hpp"
 #include "Lab/TextLab.hpp"
 #include "Lab/ThreadLab.hpp"
 #include "Lab/WorldLab.hpp"
 
 #define RUN_GAME 1
+#define RUN_COMBAT_LAB 0
+
+// NOTE: The combat lab has an Entity of its own, so it is built instead of the game and not next to it.
+#if RUN_COMBAT_LAB
+#include "Lab/CombatLab.hpp"
+#else
+#include "Game.hpp"
+#endif
 
 Camera global_camera;
 Canvas global_canvas;
 UserInput global_user_input;
 B32 global_running;
 
-#if RUN_GAME
+#if RUN_COMBAT_LAB
+CombatLabState global_lab_state;
+#elif RUN_GAME
 Game global_game;
 #else
 WorldLabState global_lab_state;
@@ -31,7 +42,9 @@ func WinInit()
 {
 	global_canvas.camera = &global_camera;
 
-#if RUN_GAME
+#if RUN_COMBAT_LAB
+	CombatLabInit(&global_lab_state, &global_canvas);
+#elif RUN_GAME
 	GameInit(&global_game, &global_canvas);
 #else
 	WorldLabInit(&global_lab_state, &global_canvas);
@@ -41,7 +54,14 @@ func WinInit()
 static void
 func WinUpdate(R32 seconds, UserInput *user_input)
 {
-#if RUN_GAME
+	BeginMemoryFrame();
+#ifdef PROFILER_MODE
+	BeginProfileFrame();
+#endif
+
+#if RUN_COMBAT_LAB
+	CombatLabUpdate(&global_lab_state, &global_canvas, seconds, user_input);
+#elif RUN_GAME
 	GameUpdate(&global_game, &global_canvas, seconds, user_input);
 #else
 	WorldLabUpdate(&global_lab_state, &global_canvas, seconds, user_input);